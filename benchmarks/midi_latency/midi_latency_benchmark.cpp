@@ -0,0 +1,397 @@
+#include <juce_audio_devices/juce_audio_devices.h>
+#include <juce_events/juce_events.h>
+#include "core/audio/AudioEngine.h"
+#include "core/midi/MidiManager.h"
+#include "core/midi/MidiTransformProcessor.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// Measures how long a note takes to get from a MIDI input, through MidiManager, the
+// engine's input queue and the graph, to a MIDI output, and how much that varies.
+// The probe makes a pair of virtual ALSA sequencer ports and the host opens one as
+// its input and the other as its output, so no MIDI hardware or loopback cable is
+// needed; the engine runs on the virtual audio device, so no sound card either.
+//
+// Each note carries its sequence number in its note number and velocity, so every
+// arrival is matched to the moment it was sent. Expect at least two buffers: one in
+// the input queue and one of device output latency, which MIDI out is delayed by to
+// stay in line with the audio.
+//
+// Usage: midi_latency_benchmark [--buffer-size N] [--sample-rate R] [--notes N]
+//                               [--through-transform] [--max-latency-ms X] [--max-jitter-ms X]
+//
+// Exits with 1 if notes go missing or a limit given is exceeded, so a headless CI
+// job can catch regressions in the MIDI path, and with 2 if it can't run at all.
+
+namespace
+{
+    // Distinct tags a note can carry: note number times non-zero velocity
+    constexpr int maxNotesPerPattern = 128 * 127;
+
+    struct Pattern
+    {
+        const char* name;
+
+        // Time between sends, picked at random between the two when they differ
+        double minIntervalMs;
+        double maxIntervalMs;
+
+        // Notes sent together at each step
+        int notesPerStep;
+    };
+
+    struct Summary
+    {
+        int numSent = 0;
+        int numReceived = 0;
+        double minMs = 0.0, p50Ms = 0.0, p90Ms = 0.0, p99Ms = 0.0, maxMs = 0.0;
+        double meanMs = 0.0;
+
+        // Standard deviation of the latency, and the spread between the 1st and 99th percentiles
+        double jitterMs = 0.0;
+        double spreadMs = 0.0;
+        std::vector<double> latenciesMs;
+    };
+
+    double percentile(const std::vector<double>& sorted, double fraction)
+    {
+        if (sorted.empty())
+            return 0.0;
+
+        return sorted[(size_t) juce::jlimit(0, (int) sorted.size() - 1, (int) std::lround(fraction * (double) (sorted.size() - 1)))];
+    }
+
+    //==============================================================================
+    // Sends tagged notes out of one virtual port and times them back in on the other
+    class LatencyProbe : private juce::MidiInputCallback
+    {
+    public:
+        LatencyProbe()
+            : sendTimes(maxNotesPerPattern),
+              receiveTimes(new std::atomic<double>[(size_t) maxNotesPerPattern])
+        {
+            output = juce::MidiOutput::createNewDevice("VSTLinkHost latency probe out");
+            input = juce::MidiInput::createNewDevice("VSTLinkHost latency probe in", this);
+
+            if (input != nullptr)
+                input->start();
+        }
+
+        ~LatencyProbe() override
+        {
+            if (input != nullptr)
+                input->stop();
+        }
+
+        bool isReady() const { return input != nullptr && output != nullptr; }
+
+        // What the host opens: our output is its input, and the other way round
+        juce::String getHostInputIdentifier() const { return output->getIdentifier(); }
+        juce::String getHostOutputIdentifier() const { return input->getIdentifier(); }
+
+        Summary run(const Pattern& pattern, int numNotes, juce::Thread& thread)
+        {
+            numNotes = juce::jlimit(1, maxNotesPerPattern, numNotes);
+
+            for (int i = 0; i < maxNotesPerPattern; ++i)
+                receiveTimes[(size_t) i].store(0.0, std::memory_order_relaxed);
+
+            juce::Random random(1);
+            auto nextSend = juce::Time::getMillisecondCounterHiRes();
+            int sent = 0;
+
+            while (sent < numNotes && ! thread.threadShouldExit())
+            {
+                waitUntil(nextSend);
+
+                for (int i = 0; i < pattern.notesPerStep && sent < numNotes; ++i, ++sent)
+                {
+                    sendTimes[(size_t) sent] = juce::Time::getMillisecondCounterHiRes();
+                    output->sendMessageNow(juce::MidiMessage::noteOn(1, getNote(sent), getVelocity(sent)));
+                    output->sendMessageNow(juce::MidiMessage::noteOff(1, getNote(sent)));
+                }
+
+                nextSend += pattern.minIntervalMs + (pattern.maxIntervalMs - pattern.minIntervalMs) * random.nextDouble();
+            }
+
+            // Give the last notes time to come back
+            thread.wait(500);
+
+            Summary summary;
+            summary.numSent = sent;
+
+            for (int i = 0; i < sent; ++i)
+            {
+                const auto received = receiveTimes[(size_t) i].load(std::memory_order_acquire);
+
+                if (received > 0.0)
+                    summary.latenciesMs.push_back(received - sendTimes[(size_t) i]);
+            }
+
+            summarise(summary);
+            return summary;
+        }
+
+    private:
+        static int getNote(int tag) { return tag % 128; }
+        static juce::uint8 getVelocity(int tag) { return (juce::uint8) (1 + tag / 128); }
+
+        static void waitUntil(double timeMs)
+        {
+            // Sleep most of the way, then spin, so the pattern keeps its timing
+            for (;;)
+            {
+                const auto remaining = timeMs - juce::Time::getMillisecondCounterHiRes();
+
+                if (remaining <= 0.0)
+                    return;
+
+                if (remaining > 2.0)
+                    juce::Thread::sleep((int) remaining - 1);
+                else
+                    juce::Thread::yield();
+            }
+        }
+
+        void handleIncomingMidiMessage(juce::MidiInput*, const juce::MidiMessage& message) override
+        {
+            // ALSA input timestamps are only to the millisecond, so take our own
+            const auto now = juce::Time::getMillisecondCounterHiRes();
+
+            if (! message.isNoteOn())
+                return;
+
+            const auto tag = (message.getVelocity() - 1) * 128 + message.getNoteNumber();
+
+            if (juce::isPositiveAndBelow(tag, maxNotesPerPattern))
+                receiveTimes[(size_t) tag].store(now, std::memory_order_release);
+        }
+
+        static void summarise(Summary& summary)
+        {
+            auto& latencies = summary.latenciesMs;
+            summary.numReceived = (int) latencies.size();
+
+            if (latencies.empty())
+                return;
+
+            std::sort(latencies.begin(), latencies.end());
+
+            double total = 0.0;
+
+            for (auto latency : latencies)
+                total += latency;
+
+            summary.meanMs = total / (double) latencies.size();
+
+            double squares = 0.0;
+
+            for (auto latency : latencies)
+                squares += (latency - summary.meanMs) * (latency - summary.meanMs);
+
+            summary.jitterMs = std::sqrt(squares / (double) latencies.size());
+            summary.minMs = latencies.front();
+            summary.maxMs = latencies.back();
+            summary.p50Ms = percentile(latencies, 0.5);
+            summary.p90Ms = percentile(latencies, 0.9);
+            summary.p99Ms = percentile(latencies, 0.99);
+            summary.spreadMs = summary.p99Ms - percentile(latencies, 0.01);
+        }
+
+        std::unique_ptr<juce::MidiOutput> output;
+        std::unique_ptr<juce::MidiInput> input;
+
+        // In milliseconds on the Time::getMillisecondCounterHiRes() clock, by tag
+        std::vector<double> sendTimes;
+        std::unique_ptr<std::atomic<double>[]> receiveTimes;
+
+        JUCE_DECLARE_NON_COPYABLE(LatencyProbe)
+    };
+
+    //==============================================================================
+    // Plays the patterns on its own thread while the message thread keeps the host running
+    class ProbeThread : public juce::Thread
+    {
+    public:
+        ProbeThread(LatencyProbe& probeToRun, int notesPerPattern)
+            : juce::Thread("MIDI latency probe"), probe(probeToRun), numNotes(notesPerPattern)
+        {
+        }
+
+        std::vector<std::pair<Pattern, Summary>> results;
+
+    private:
+        void run() override
+        {
+            // Let the host connect to the ports and the first plan reach the audio thread
+            wait(500);
+
+            const Pattern patterns[] = {
+                { "steady 100 Hz", 10.0, 10.0, 1 },
+                { "chords of 8", 50.0, 50.0, 8 },
+                { "random 1-20 ms", 1.0, 20.0, 1 },
+                { "bursts of 32", 100.0, 100.0, 32 }
+            };
+
+            for (const auto& pattern : patterns)
+            {
+                if (threadShouldExit())
+                    break;
+
+                results.emplace_back(pattern, probe.run(pattern, numNotes, *this));
+            }
+
+            juce::MessageManager::callAsync([] { juce::MessageManager::getInstance()->stopDispatchLoop(); });
+        }
+
+        LatencyProbe& probe;
+        const int numNotes;
+    };
+
+    void printHistogram(const Summary& summary)
+    {
+        constexpr int numBins = 10;
+        const auto& latencies = summary.latenciesMs;
+
+        if (latencies.size() < 2 || summary.maxMs <= summary.minMs)
+            return;
+
+        int counts[numBins] = {};
+        const auto binWidth = (summary.maxMs - summary.minMs) / numBins;
+
+        for (auto latency : latencies)
+            ++counts[juce::jmin(numBins - 1, (int) ((latency - summary.minMs) / binWidth))];
+
+        const auto largest = *std::max_element(std::begin(counts), std::end(counts));
+
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            std::cout << "    " << juce::String(summary.minMs + bin * binWidth, 2).paddedLeft(' ', 8) << " ms "
+                      << juce::String::repeatedString("#", juce::roundToInt(40.0 * counts[bin] / largest))
+                      << " " << counts[bin] << std::endl;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    const juce::ArgumentList arguments(argc, argv);
+
+    const auto getValue = [&](const char* option, double fallback)
+    {
+        return arguments.containsOption(option) ? arguments.getValueForOption(option).getDoubleValue() : fallback;
+    };
+
+    VirtualAudioIODevice::Settings settings;
+    settings.sampleRate = getValue("--sample-rate", 48000.0);
+    settings.bufferSize = (int) getValue("--buffer-size", 128.0);
+
+    const auto numNotes = (int) getValue("--notes", 500.0);
+    const auto maxLatencyMs = getValue("--max-latency-ms", 0.0);
+    const auto maxJitterMs = getValue("--max-jitter-ms", 0.0);
+    const auto throughTransform = arguments.containsOption("--through-transform");
+
+    AudioEngine engine;
+
+    if (! engine.useVirtualAudioDevice(settings))
+    {
+        std::cerr << "Couldn't open the virtual audio device" << std::endl;
+        return 2;
+    }
+
+    // MIDI input node straight to the MIDI output node, or through a built-in MIDI node
+    using IOProcessor = juce::AudioProcessorGraph::AudioGraphIOProcessor;
+    auto& graph = engine.getProcessorGraph();
+    const auto midiInputNode = graph.addNode(std::make_unique<IOProcessor>(IOProcessor::midiInputNode))->nodeID;
+    const auto midiOutputNode = graph.addNode(std::make_unique<IOProcessor>(IOProcessor::midiOutputNode))->nodeID;
+    constexpr auto midiChannel = juce::AudioProcessorGraph::midiChannelIndex;
+
+    if (throughTransform)
+    {
+        const auto transform = engine.addPluginProcessor(std::make_unique<MidiTransformProcessor>());
+        engine.connectNodes(midiInputNode, midiChannel, transform, midiChannel);
+        engine.connectNodes(transform, midiChannel, midiOutputNode, midiChannel);
+    }
+    else
+    {
+        engine.connectNodes(midiInputNode, midiChannel, midiOutputNode, midiChannel);
+    }
+
+    MidiManager midiManager;
+    midiManager.setInputPorts(&engine.getMidiInputPorts());
+    midiManager.setOutputQueue(&engine.getMidiOutputQueue());
+    midiManager.initialize();
+
+    LatencyProbe probe;
+
+    if (! probe.isReady())
+    {
+        std::cerr << "Couldn't create virtual ALSA sequencer ports; is the snd-seq module loaded?" << std::endl;
+        return 2;
+    }
+
+    if (! midiManager.openInput(probe.getHostInputIdentifier()) || ! midiManager.openOutput(probe.getHostOutputIdentifier()))
+    {
+        std::cerr << "The host couldn't open the probe's ports" << std::endl;
+        return 2;
+    }
+
+    if (! engine.start())
+    {
+        std::cerr << "Couldn't start the engine" << std::endl;
+        return 2;
+    }
+
+    const auto bufferMs = 1000.0 * engine.getBufferSize() / engine.getSampleRate();
+
+    std::cout << "MIDI in to MIDI out" << (throughTransform ? " through a MIDI transform node" : "")
+              << ", " << engine.getBufferSize() << " samples at " << engine.getSampleRate() << " Hz"
+              << " (expect at least " << juce::String(2.0 * bufferMs, 2) << " ms)" << std::endl;
+
+    ProbeThread probeThread(probe, numNotes);
+    probeThread.startThread(juce::Thread::Priority::high);
+    juce::MessageManager::getInstance()->runDispatchLoop();
+    probeThread.stopThread(5000);
+
+    engine.stop();
+
+    bool failed = false;
+
+    for (const auto& [pattern, summary] : probeThread.results)
+    {
+        std::cout << std::endl << pattern.name << ": " << summary.numReceived << " of " << summary.numSent << " notes" << std::endl
+                  << "  latency ms  min " << juce::String(summary.minMs, 3)
+                  << "  p50 " << juce::String(summary.p50Ms, 3)
+                  << "  p90 " << juce::String(summary.p90Ms, 3)
+                  << "  p99 " << juce::String(summary.p99Ms, 3)
+                  << "  max " << juce::String(summary.maxMs, 3)
+                  << "  mean " << juce::String(summary.meanMs, 3) << std::endl
+                  << "  jitter ms   stddev " << juce::String(summary.jitterMs, 3)
+                  << "  p1-p99 " << juce::String(summary.spreadMs, 3) << std::endl;
+
+        printHistogram(summary);
+
+        failed = failed || summary.numReceived < summary.numSent
+                        || (maxLatencyMs > 0.0 && summary.p99Ms > maxLatencyMs)
+                        || (maxJitterMs > 0.0 && summary.jitterMs > maxJitterMs);
+    }
+
+    const auto inputStats = engine.getMidiInputTimingStats();
+    const auto outputStats = engine.getMidiOutputStats();
+
+    std::cout << std::endl << "Input queue: " << inputStats.numEvents << " events, " << inputStats.numDropped << " dropped, "
+              << inputStats.numDisplaced << " displaced, placement error mean " << juce::String(inputStats.meanErrorSamples, 2)
+              << " max " << juce::String(inputStats.maxErrorSamples, 2) << " samples" << std::endl
+              << "Output queue: " << outputStats.numEvents << " events, " << outputStats.numDropped << " dropped, "
+              << outputStats.numLate << " late" << std::endl;
+
+    if (failed)
+        std::cout << "FAILED: notes went missing or a limit was exceeded" << std::endl;
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/midi/MidiTransform.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+// Measures how many events per second go through a MidiTransform for a few typical
+// rule sets, next to the obvious version that decodes every event into a MidiMessage
+// and applies the rules one by one.
+//
+// Usage: midi_transform_benchmark [eventsPerBlock]
+
+namespace
+{
+    constexpr int numBlocks = 20000;
+
+    // Time `renderBlock` over numBlocks blocks, in events per second
+    template <typename RenderBlock>
+    double measure(int eventsPerBlock, RenderBlock&& renderBlock)
+    {
+        // Warm up caches and the branch predictor first
+        for (int i = 0; i < numBlocks / 10; ++i)
+            renderBlock();
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < numBlocks; ++i)
+            renderBlock();
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return (double) numBlocks * eventsPerBlock / elapsed.count();
+    }
+
+    // Mostly notes, with some controllers and pitch bend, as a keyboard player makes
+    juce::MidiBuffer makeBlock(int eventsPerBlock)
+    {
+        juce::Random random(1);
+        juce::MidiBuffer block;
+
+        for (int i = 0; i < eventsPerBlock; ++i)
+        {
+            const auto channel = 1 + random.nextInt(2);
+            const auto kind = random.nextInt(10);
+
+            if (kind < 4)
+                block.addEvent(juce::MidiMessage::noteOn(channel, 24 + random.nextInt(80), (juce::uint8) (1 + random.nextInt(127))), i);
+            else if (kind < 8)
+                block.addEvent(juce::MidiMessage::noteOff(channel, 24 + random.nextInt(80)), i);
+            else if (kind < 9)
+                block.addEvent(juce::MidiMessage::controllerEvent(channel, 1, random.nextInt(128)), i);
+            else
+                block.addEvent(juce::MidiMessage::pitchWheel(channel, random.nextInt(16384)), i);
+        }
+
+        return block;
+    }
+
+    // The same rules, applied per event on decoded messages
+    void processNaively(const MidiTransform::Rules& rules, const juce::MidiBuffer& input, juce::MidiBuffer& output)
+    {
+        for (const auto metadata : input)
+        {
+            auto message = metadata.getMessage();
+
+            if ((rules.channelMask & (1 << (message.getChannel() - 1))) == 0)
+                continue;
+
+            if (message.isNoteOnOrOff())
+            {
+                auto note = message.getNoteNumber();
+
+                if (note < rules.lowestNote || note > rules.highestNote)
+                    continue;
+
+                auto channel = message.getChannel();
+                note += rules.transpose;
+
+                for (const auto& zone : rules.zones)
+                {
+                    if (message.getNoteNumber() >= zone.lowestNote && message.getNoteNumber() <= zone.highestNote)
+                    {
+                        channel = zone.channel > 0 ? zone.channel : channel;
+                        note += zone.transpose;
+                        break;
+                    }
+                }
+
+                if (note < 0 || note > 127)
+                    continue;
+
+                if (message.isNoteOn())
+                {
+                    const auto shaped = std::pow((message.getVelocity() - 1) / 126.0, rules.velocityCurve);
+                    const auto velocity = juce::jlimit(1, 127, (int) std::lround(rules.lowestOutputVelocity
+                                                                                + (rules.highestOutputVelocity - rules.lowestOutputVelocity) * shaped));
+                    message = juce::MidiMessage::noteOn(channel, note, (juce::uint8) velocity);
+                }
+                else
+                {
+                    message = juce::MidiMessage::noteOff(channel, note);
+                }
+            }
+
+            output.addEvent(message, metadata.samplePosition);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const auto eventsPerBlock = argc > 1 ? juce::jmax(1, juce::String(argv[1]).getIntValue()) : 256;
+
+    std::cout << "MIDI transforms on blocks of " << eventsPerBlock << " events" << std::endl;
+
+    const auto input = makeBlock(eventsPerBlock);
+    juce::MidiBuffer output;
+    output.ensureSize((size_t) input.data.size());
+
+    MidiTransform::Rules transpose;
+    transpose.transpose = 12;
+
+    MidiTransform::Rules velocityCurve;
+    velocityCurve.velocityCurve = 2.0;
+    velocityCurve.lowestOutputVelocity = 20;
+
+    MidiTransform::Rules split;
+    split.zones = { { 0, 59, 2, -12 }, { 60, 127, 1, 0 } };
+
+    MidiTransform::Rules everything = split;
+    everything.channelMask = 0x0001;
+    everything.passPitchBend = false;
+    everything.transpose = 2;
+    everything.velocityCurve = 0.5;
+
+    const std::pair<const char*, MidiTransform::Rules> ruleSets[] = {
+        { "identity", {} },
+        { "transpose", transpose },
+        { "velocity", velocityCurve },
+        { "split", split },
+        { "everything", everything }
+    };
+
+    for (const auto& [name, rules] : ruleSets)
+    {
+        const MidiTransform transform(rules);
+        MidiTransform::ActiveNotes activeNotes;
+
+        const auto compiled = measure(eventsPerBlock, [&]
+        {
+            output.clear();
+            transform.processBlock(input, output, activeNotes);
+        });
+
+        const auto naive = measure(eventsPerBlock, [&]
+        {
+            output.clear();
+            processNaively(rules, input, output);
+        });
+
+        std::cout << juce::String(name).paddedRight(' ', 12)
+                  << juce::String(compiled / 1.0e6, 1).paddedLeft(' ', 10) << " M events/s compiled"
+                  << juce::String(naive / 1.0e6, 1).paddedLeft(' ', 10) << " M events/s per message"
+                  << juce::String(compiled / naive, 1).paddedLeft(' ', 8) << "x" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/audio/Oversampler.h"
+#include <chrono>
+#include <iostream>
+
+// Measures what the oversampling filters cost for one channel, going up and back
+// down, at every factor and phase. The wrapped plugin's own cost at the higher rate
+// comes on top of this.
+//
+// Usage: oversampling_benchmark [blockSize]
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr double secondsToRender = 20.0;
+
+    struct Result
+    {
+        double microsPerBlock;
+        double percentOfDeadline;
+    };
+
+    // Time `renderBlock` over secondsToRender worth of blocks
+    template <typename RenderBlock>
+    Result measure(int blockSize, RenderBlock&& renderBlock)
+    {
+        const auto numBlocks = (int) (secondsToRender * sampleRate / blockSize);
+
+        // Warm up caches and the branch predictor first
+        for (int i = 0; i < numBlocks / 10; ++i)
+            renderBlock();
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < numBlocks; ++i)
+            renderBlock();
+
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        const auto microsPerBlock = elapsed.count() / numBlocks;
+        const auto deadlineMicros = 1.0e6 * blockSize / sampleRate;
+
+        return { microsPerBlock, 100.0 * microsPerBlock / deadlineMicros };
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const auto blockSize = argc > 1 ? juce::jmax(16, juce::String(argv[1]).getIntValue()) : 512;
+
+    std::cout << "Oversampling one channel in blocks of " << blockSize << " at " << sampleRate << " Hz" << std::endl;
+
+    const juce::ScopedNoDenormals noDenormals;
+
+    juce::Random random(1);
+    juce::AudioBuffer<float> input(1, blockSize), output(1, blockSize);
+
+    for (int i = 0; i < blockSize; ++i)
+        input.setSample(0, i, random.nextFloat() * 2.0f - 1.0f);
+
+    for (const auto phase : { Oversampler::Phase::linear, Oversampler::Phase::minimum })
+    {
+        for (const auto factor : { 2, 4, 8 })
+        {
+            Oversampler oversampler(1, factor, phase);
+            oversampler.prepare(blockSize);
+
+            const auto result = measure(blockSize, [&]
+            {
+                oversampler.processUp(input, blockSize);
+                oversampler.processDown(output, blockSize);
+            });
+
+            const auto name = juce::String(factor) + "x " + (phase == Oversampler::Phase::linear ? "linear" : "minimum");
+
+            std::cout << name.paddedRight(' ', 12)
+                      << juce::String(result.microsPerBlock, 2).paddedLeft(' ', 10) << " us/block"
+                      << juce::String(result.percentOfDeadline, 2).paddedLeft(' ', 10) << " % of deadline"
+                      << juce::String(oversampler.getNumMultipliesPerSample()).paddedLeft(' ', 8) << " taps/sample"
+                      << juce::String(oversampler.getLatencyInOversampledSamples() / factor, 2).paddedLeft(' ', 10)
+                      << " samples latency" << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/audio/SampleConversion.h"
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// Compares the cost of rendering a chain of nodes in single and double precision,
+// and of a double-precision chain with one float-only node in the middle, which
+// has to be converted into and out of.
+//
+// Usage: precision_benchmark [blockSize] [numNodes]
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int numChannels = 2;
+    constexpr int numSections = 4;
+    constexpr double secondsToRender = 20.0;
+
+    // Stands in for a plugin: a cascade of biquad low-pass sections per channel
+    template <typename SampleType>
+    class TestNode
+    {
+    public:
+        explicit TestNode(double cutoff)
+        {
+            const auto w = 2.0 * juce::MathConstants<double>::pi * cutoff / sampleRate;
+            const auto alpha = std::sin(w) / (2.0 * 0.7071);
+            const auto a0 = 1.0 + alpha;
+
+            b0 = (SampleType) ((1.0 - std::cos(w)) / 2.0 / a0);
+            b1 = (SampleType) ((1.0 - std::cos(w)) / a0);
+            b2 = b0;
+            a1 = (SampleType) (-2.0 * std::cos(w) / a0);
+            a2 = (SampleType) ((1.0 - alpha) / a0);
+
+            state.assign((size_t) (numChannels * numSections * 2), SampleType());
+        }
+
+        void process(juce::AudioBuffer<SampleType>& buffer) noexcept
+        {
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            {
+                auto* samples = buffer.getWritePointer(channel);
+
+                for (int section = 0; section < numSections; ++section)
+                {
+                    auto* z = state.data() + (size_t) ((channel * numSections + section) * 2);
+                    auto z1 = z[0], z2 = z[1];
+
+                    for (int i = 0; i < buffer.getNumSamples(); ++i)
+                    {
+                        const auto in = samples[i];
+                        const auto out = b0 * in + z1;
+                        z1 = b1 * in - a1 * out + z2;
+                        z2 = b2 * in - a2 * out;
+                        samples[i] = out;
+                    }
+
+                    z[0] = z1;
+                    z[1] = z2;
+                }
+            }
+        }
+
+    private:
+        SampleType b0, b1, b2, a1, a2;
+        std::vector<SampleType> state;
+    };
+
+    template <typename SampleType>
+    std::vector<TestNode<SampleType>> makeChain(int numNodes)
+    {
+        std::vector<TestNode<SampleType>> chain;
+
+        for (int i = 0; i < numNodes; ++i)
+            chain.emplace_back(2000.0 + 500.0 * i);
+
+        return chain;
+    }
+
+    template <typename SampleType>
+    void fillWithNoise(juce::AudioBuffer<SampleType>& buffer, juce::Random& random)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample(channel, i, (SampleType) (random.nextFloat() * 2.0f - 1.0f));
+    }
+
+    struct Result
+    {
+        double microsPerBlock;
+        double percentOfDeadline;
+    };
+
+    // Time `renderBlock` over secondsToRender worth of blocks
+    template <typename RenderBlock>
+    Result measure(int blockSize, RenderBlock&& renderBlock)
+    {
+        const auto numBlocks = (int) (secondsToRender * sampleRate / blockSize);
+
+        // Warm up caches and the branch predictor first
+        for (int i = 0; i < numBlocks / 10; ++i)
+            renderBlock();
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < numBlocks; ++i)
+            renderBlock();
+
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        const auto microsPerBlock = elapsed.count() / numBlocks;
+        const auto deadlineMicros = 1.0e6 * blockSize / sampleRate;
+
+        return { microsPerBlock, 100.0 * microsPerBlock / deadlineMicros };
+    }
+
+    void print(const juce::String& name, const Result& result)
+    {
+        std::cout << name.paddedRight(' ', 36)
+                  << juce::String(result.microsPerBlock, 2).paddedLeft(' ', 10) << " us/block"
+                  << juce::String(result.percentOfDeadline, 2).paddedLeft(' ', 10) << " % of deadline"
+                  << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const auto blockSize = argc > 1 ? juce::jmax(16, juce::String(argv[1]).getIntValue()) : 512;
+    const auto numNodes = argc > 2 ? juce::jmax(2, juce::String(argv[2]).getIntValue()) : 8;
+
+    std::cout << "Rendering " << numNodes << " nodes of " << numChannels << " channels in blocks of "
+              << blockSize << " at " << sampleRate << " Hz" << std::endl;
+
+    // As on the audio thread, so that decaying filter states don't turn denormal
+    const juce::ScopedNoDenormals noDenormals;
+
+    juce::Random random(1);
+    juce::AudioBuffer<float> floatInput(numChannels, blockSize), floatBuffer(numChannels, blockSize);
+    juce::AudioBuffer<double> doubleBuffer(numChannels, blockSize);
+    fillWithNoise(floatInput, random);
+
+    // Single precision throughout
+    auto floatChain = makeChain<float>(numNodes);
+    print("single precision", measure(blockSize, [&]
+    {
+        floatBuffer.makeCopyOf(floatInput, true);
+
+        for (auto& node : floatChain)
+            node.process(floatBuffer);
+    }));
+
+    // Double precision throughout, widened from and narrowed back to the device's floats
+    auto doubleChain = makeChain<double>(numNodes);
+    print("double precision", measure(blockSize, [&]
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+            SampleConversion::convert(floatInput.getReadPointer(channel), doubleBuffer.getWritePointer(channel), blockSize);
+
+        for (auto& node : doubleChain)
+            node.process(doubleBuffer);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            SampleConversion::convert(doubleBuffer.getReadPointer(channel), floatBuffer.getWritePointer(channel), blockSize);
+    }));
+
+    // Double precision with one float-only node halfway along
+    auto mixedChain = makeChain<double>(numNodes - 1);
+    TestNode<float> floatOnlyNode(3000.0);
+    const auto floatOnlyPosition = (numNodes - 1) / 2;
+
+    print("double precision, one float node", measure(blockSize, [&]
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+            SampleConversion::convert(floatInput.getReadPointer(channel), doubleBuffer.getWritePointer(channel), blockSize);
+
+        for (int i = 0; i < (int) mixedChain.size(); ++i)
+        {
+            if (i == floatOnlyPosition)
+            {
+                for (int channel = 0; channel < numChannels; ++channel)
+                    SampleConversion::convert(doubleBuffer.getReadPointer(channel), floatBuffer.getWritePointer(channel), blockSize);
+
+                floatOnlyNode.process(floatBuffer);
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                    SampleConversion::convert(floatBuffer.getReadPointer(channel), doubleBuffer.getWritePointer(channel), blockSize);
+            }
+
+            mixedChain[(size_t) i].process(doubleBuffer);
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            SampleConversion::convert(doubleBuffer.getReadPointer(channel), floatBuffer.getWritePointer(channel), blockSize);
+    }));
+
+    // The boundary conversions on their own: widen and narrow every channel once
+    print("conversion round trip", measure(blockSize, [&]
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            SampleConversion::convert(floatInput.getReadPointer(channel), doubleBuffer.getWritePointer(channel), blockSize);
+            SampleConversion::convert(doubleBuffer.getReadPointer(channel), floatBuffer.getWritePointer(channel), blockSize);
+        }
+    }));
+
+    return 0;
+}
@@ -0,0 +1,316 @@
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "core/plugin/PluginSandbox.h"
+#include "core/plugin/PluginSandboxWorker.h"
+#include "core/plugin/SandboxChannel.h"
+#include "core/plugin/SandboxProtocol.h"
+#include "core/plugin/SandboxedPluginInstance.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// Measures what running a plugin in a sandbox process costs on top of the plugin
+// itself: the time for a block to go over shared memory to the worker and back.
+//
+// The channel part always runs. It starts this benchmark again as a worker that
+// hands every block straight back, so what it measures is the copying and the
+// futex wake-ups in both directions, with no plugin at all.
+//
+// Given a plugin, it's loaded into a real PluginSandbox as the app would, and timed
+// through SandboxedPluginInstance, along with the control messages the editor uses
+// for parameter texts.
+//
+// Usage: sandbox_round_trip_benchmark [--blocks=N] [--channels=N] [--plugin=FILE]
+//
+// Exits with 2 if the worker can't be started or the plugin can't be loaded.
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr const char* channelWorkerOption = "--channel-worker";
+
+    // Sent as a block's length to tell the channel worker to stop
+    constexpr int32_t stopWorker = -1;
+
+    struct Summary
+    {
+        double minMicros = 0.0, p50Micros = 0.0, p99Micros = 0.0, maxMicros = 0.0;
+        int numTimedOut = 0;
+    };
+
+    Summary summarise(std::vector<double> micros, int numTimedOut)
+    {
+        Summary summary;
+        summary.numTimedOut = numTimedOut;
+
+        if (micros.empty())
+            return summary;
+
+        std::sort(micros.begin(), micros.end());
+
+        const auto at = [&](double fraction) { return micros[(size_t) (fraction * (double) (micros.size() - 1))]; };
+
+        summary.minMicros = micros.front();
+        summary.p50Micros = at(0.5);
+        summary.p99Micros = at(0.99);
+        summary.maxMicros = micros.back();
+        return summary;
+    }
+
+    void print(int blockSize, const Summary& summary)
+    {
+        const auto deadlineMicros = 1.0e6 * blockSize / sampleRate;
+
+        std::cout << "  " << blockSize << " samples: min " << juce::String(summary.minMicros, 1)
+                  << " us, p50 " << juce::String(summary.p50Micros, 1)
+                  << " us, p99 " << juce::String(summary.p99Micros, 1)
+                  << " us, max " << juce::String(summary.maxMicros, 1)
+                  << " us (p99 is " << juce::String(100.0 * summary.p99Micros / deadlineMicros, 2)
+                  << "% of the block)";
+
+        if (summary.numTimedOut > 0)
+            std::cout << ", " << summary.numTimedOut << " timed out";
+
+        std::cout << std::endl;
+    }
+
+    //==============================================================================
+    // The worker side of the channel part: every block goes back untouched
+    int runChannelWorker(const juce::File& channelFile)
+    {
+        auto channel = SandboxChannel::open(channelFile);
+
+        if (channel == nullptr)
+            return 2;
+
+        auto& header = channel->getHeader();
+
+        // Counting from the start, in case the first block was sent before this was up
+        uint32_t lastRequest = 0;
+
+        for (;;)
+        {
+            if (! channel->waitForRequest(lastRequest, std::chrono::seconds(5)))
+                return 1;
+
+            lastRequest = header.request.load(std::memory_order_acquire);
+
+            if (header.numSamples == stopWorker)
+                return 0;
+
+            channel->sendResponse(lastRequest);
+        }
+    }
+
+    bool measureChannel(int numChannels, int blockSize, int numBlocks)
+    {
+        auto channel = SandboxChannel::create(SandboxChannel::createChannelFile(), numChannels, blockSize);
+
+        if (channel == nullptr)
+        {
+            std::cerr << "Couldn't create a sandbox channel" << std::endl;
+            return false;
+        }
+
+        juce::ChildProcess worker;
+        const auto executable = juce::File::getSpecialLocation(juce::File::currentExecutableFile);
+
+        if (! worker.start(juce::StringArray { executable.getFullPathName(), juce::String(channelWorkerOption) + "=" + channel->getFile().getFullPathName() }, 0))
+        {
+            std::cerr << "Couldn't start the channel worker" << std::endl;
+            return false;
+        }
+
+        auto& header = channel->getHeader();
+        juce::AudioBuffer<float> buffer(numChannels, blockSize);
+        juce::Random random(1);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < blockSize; ++i)
+                buffer.setSample(ch, i, random.nextFloat() * 2.0f - 1.0f);
+
+        std::vector<double> micros;
+        micros.reserve((size_t) numBlocks);
+        int numTimedOut = 0;
+
+        // The first blocks include the worker starting up
+        const auto numWarmUpBlocks = numBlocks / 10 + 1;
+
+        for (int i = 0; i < numWarmUpBlocks + numBlocks; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            // Copied in and out, as SandboxedPluginInstance does
+            for (int ch = 0; ch < numChannels; ++ch)
+                juce::FloatVectorOperations::copy(channel->getChannel(ch), buffer.getReadPointer(ch), blockSize);
+
+            header.numSamples = blockSize;
+            const auto request = channel->sendRequest();
+            const auto answered = channel->waitForResponse(request, std::chrono::seconds(1));
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                juce::FloatVectorOperations::copy(buffer.getWritePointer(ch), channel->getChannel(ch), blockSize);
+
+            const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+            if (i < numWarmUpBlocks)
+                continue;
+
+            if (answered)
+                micros.push_back(elapsed.count());
+            else
+                ++numTimedOut;
+        }
+
+        header.numSamples = stopWorker;
+        channel->sendRequest();
+        worker.waitForProcessToFinish(5000);
+
+        print(blockSize, summarise(std::move(micros), numTimedOut));
+        return true;
+    }
+
+    //==============================================================================
+    bool measurePlugin(const juce::File& pluginFile, int blockSize, int numBlocks)
+    {
+        juce::AudioPluginFormatManager formatManager;
+        formatManager.addDefaultFormats();
+
+        juce::OwnedArray<juce::PluginDescription> descriptions;
+
+        for (auto* format : formatManager.getFormats())
+            if (format->fileMightContainThisPluginType(pluginFile.getFullPathName()))
+                format->findAllTypesForFile(descriptions, pluginFile.getFullPathName());
+
+        if (descriptions.isEmpty())
+        {
+            std::cerr << "No plugin found in " << pluginFile.getFullPathName() << std::endl;
+            return false;
+        }
+
+        auto sandbox = std::make_shared<PluginSandbox>();
+        juce::String errorMessage;
+
+        if (! sandbox->launch(errorMessage))
+        {
+            std::cerr << errorMessage << std::endl;
+            return false;
+        }
+
+        auto plugin = sandbox->createPluginInstance(*descriptions[0], sampleRate, blockSize, errorMessage);
+        auto* sandboxed = dynamic_cast<SandboxedPluginInstance*>(plugin.get());
+
+        if (sandboxed == nullptr)
+        {
+            std::cerr << "Couldn't load " << descriptions[0]->name << ": " << errorMessage << std::endl;
+            return false;
+        }
+
+        // Give it the whole block, so that only a stuck worker misses one
+        sandboxed->setResponseBudget(1.0);
+        plugin->prepareToPlay(sampleRate, blockSize);
+
+        juce::AudioBuffer<float> buffer(juce::jmax(1, plugin->getTotalNumInputChannels(), plugin->getTotalNumOutputChannels()), blockSize);
+        juce::MidiBuffer midi;
+        std::vector<double> micros;
+        micros.reserve((size_t) numBlocks);
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            buffer.clear();
+            midi.clear();
+
+            const auto start = std::chrono::steady_clock::now();
+            plugin->processBlock(buffer, midi);
+            const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+            micros.push_back(elapsed.count());
+        }
+
+        const auto stats = sandboxed->getRoundTripStats();
+
+        std::cout << descriptions[0]->name << " in a sandbox, including its own processing:" << std::endl;
+        print(blockSize, summarise(std::move(micros), (int) stats.numMissedBlocks));
+
+        // Control messages: a text that has to be asked for, the same text once it's
+        // kept, and a typed-in value, which waits for the worker
+        if (auto* parameter = plugin->getParameters()[0])
+        {
+            const auto timeMicros = [](auto&& function)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                function();
+                return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            };
+
+            const auto valueToShow = 0.37f;
+            const auto firstText = timeMicros([&] { parameter->getText(valueToShow, 64); });
+
+            // Leave time for the text to come back
+            juce::Thread::sleep(100);
+
+            const auto keptText = timeMicros([&] { parameter->getText(valueToShow, 64); });
+            const auto text = parameter->getText(valueToShow, 64);
+            const auto valueForText = timeMicros([&] { parameter->getValueForText(text); });
+
+            std::cout << "  parameter text: first " << juce::String(firstText, 1)
+                      << " us, kept " << juce::String(keptText, 1)
+                      << " us; value for text " << juce::String(valueForText, 1) << " us" << std::endl;
+        }
+
+        plugin->releaseResources();
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const juce::ArgumentList arguments(argc, argv);
+
+    if (arguments.containsOption(channelWorkerOption))
+        return runChannelWorker(juce::File(arguments.getValueForOption(channelWorkerOption)));
+
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    // Started by a PluginSandbox for the plugin part
+    juce::StringArray commandLine;
+
+    for (int i = 1; i < argc; ++i)
+        commandLine.add(argv[i]);
+
+    if (commandLine.joinIntoString(" ").contains(SandboxProtocol::commandLineUID))
+    {
+        PluginSandboxWorker worker;
+
+        if (! worker.initialiseFromCommandLine(commandLine.joinIntoString(" "), SandboxProtocol::commandLineUID))
+            return 2;
+
+        juce::MessageManager::getInstance()->runDispatchLoop();
+        return 0;
+    }
+
+    const auto getValue = [&](const char* option, int fallback)
+    {
+        return arguments.containsOption(option) ? arguments.getValueForOption(option).getIntValue() : fallback;
+    };
+
+    const auto numBlocks = juce::jmax(10, getValue("--blocks", 20000));
+    const auto numChannels = juce::jmax(1, getValue("--channels", 2));
+
+    std::cout << "Shared memory round trip, " << numChannels << " channels, " << numBlocks << " blocks at " << sampleRate << " Hz:" << std::endl;
+
+    for (const auto blockSize : { 32, 64, 128, 256, 512, 1024 })
+        if (! measureChannel(numChannels, blockSize, numBlocks))
+            return 2;
+
+    if (arguments.containsOption("--plugin"))
+    {
+        // The sandbox answers on its own thread, so the message loop isn't needed here
+        const juce::File pluginFile(arguments.getValueForOption("--plugin"));
+
+        if (! measurePlugin(pluginFile, 128, numBlocks))
+            return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/midi/UmpBuffer.h"
+#include "core/midi/UmpTranslator.h"
+#include <chrono>
+#include <iostream>
+
+// Measures what reading a block of incoming MIDI costs the engine when it is kept as
+// MIDI 1.0 bytes in a MidiBuffer and when it is kept as Universal MIDI Packets in a
+// UmpBuffer: finding each chunk's events, reading every event's kind, channel and
+// value, and, for the packets, turning them back into bytes for a plugin.
+//
+// Usage: ump_benchmark [eventsPerBlock]
+
+namespace
+{
+    constexpr int blockSize = 512;
+    constexpr int chunkSize = 32;
+    constexpr int numBlocks = 20000;
+
+    // Time `renderBlock` over numBlocks blocks, in nanoseconds a block
+    template <typename RenderBlock>
+    double measure(RenderBlock&& renderBlock)
+    {
+        // Warm up caches and the branch predictor first
+        for (int i = 0; i < numBlocks / 10; ++i)
+            renderBlock();
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < numBlocks; ++i)
+            renderBlock();
+
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / numBlocks;
+    }
+
+    // A controller-heavy performance: notes, pressure, pitch bend and controllers,
+    // spread across the block
+    juce::MidiBuffer makeBlock(int eventsPerBlock)
+    {
+        juce::Random random(1);
+        juce::MidiBuffer block;
+
+        for (int i = 0; i < eventsPerBlock; ++i)
+        {
+            const auto channel = 1 + random.nextInt(16);
+            const auto position = i * blockSize / eventsPerBlock;
+
+            switch (random.nextInt(5))
+            {
+                case 0:  block.addEvent(juce::MidiMessage::noteOn(channel, random.nextInt(128), (juce::uint8) (1 + random.nextInt(127))), position); break;
+                case 1:  block.addEvent(juce::MidiMessage::noteOff(channel, random.nextInt(128)), position); break;
+                case 2:  block.addEvent(juce::MidiMessage::aftertouchChange(channel, random.nextInt(128), random.nextInt(128)), position); break;
+                case 3:  block.addEvent(juce::MidiMessage::pitchWheel(channel, random.nextInt(16384)), position); break;
+                default: block.addEvent(juce::MidiMessage::controllerEvent(channel, random.nextInt(120), random.nextInt(128)), position); break;
+            }
+        }
+
+        return block;
+    }
+
+    // What a reader has to do with bytes to get the same facts out of an event
+    uint32_t readBytes(const juce::uint8* data, int numBytes)
+    {
+        const auto status = data[0];
+
+        if (status < 0x80 || status >= 0xf0 || numBytes < 2)
+            return status;
+
+        const auto channel = (uint32_t) (status & 0x0f);
+
+        switch (status >> 4)
+        {
+            case 0x8:
+            case 0x9:
+            case 0xa:
+            case 0xb:   return channel ^ data[1] ^ ((uint32_t) data[2] << 25);
+            case 0xd:   return channel ^ ((uint32_t) data[1] << 25);
+            case 0xe:   return channel ^ ((((uint32_t) data[2] << 7) | data[1]) << 18);
+            default:    return channel ^ data[1];
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const auto eventsPerBlock = argc > 1 ? juce::jlimit(1, 1024, juce::String(argv[1]).getIntValue()) : 256;
+
+    std::cout << "Reading " << eventsPerBlock << " events a block of " << blockSize
+              << " samples, in chunks of " << chunkSize << std::endl;
+
+    const auto bytes = makeBlock(eventsPerBlock);
+    UmpBuffer packets(eventsPerBlock);
+
+    for (const auto metadata : bytes)
+        UmpTranslator::fromMidi1(metadata.data, metadata.numBytes, [&](const uint32_t* words) { packets.add(metadata.samplePosition, words); });
+
+    juce::MidiBuffer forPlugin;
+    forPlugin.ensureSize((size_t) bytes.data.size() * 2);
+    UmpTranslator translator;
+    // Written to so that the reads aren't optimised away
+    volatile uint32_t sink = 0;
+
+    // Every chunk finds its events and reads each one
+    const auto bytesRead = measure([&]
+    {
+        for (int start = 0; start < blockSize; start += chunkSize)
+        {
+            for (auto it = bytes.findNextSamplePosition(start); it != bytes.cend(); ++it)
+            {
+                const auto metadata = *it;
+
+                if (metadata.samplePosition >= start + chunkSize)
+                    break;
+
+                sink = sink + readBytes(metadata.data, metadata.numBytes);
+            }
+        }
+    });
+
+    const auto messagesRead = measure([&]
+    {
+        for (int start = 0; start < blockSize; start += chunkSize)
+        {
+            for (auto it = bytes.findNextSamplePosition(start); it != bytes.cend(); ++it)
+            {
+                const auto metadata = *it;
+
+                if (metadata.samplePosition >= start + chunkSize)
+                    break;
+
+                const auto message = metadata.getMessage();
+                sink = sink + ((uint32_t) message.getChannel() ^ (uint32_t) message.getControllerValue() ^ (uint32_t) message.getNoteNumber());
+            }
+        }
+    });
+
+    const auto packetsRead = measure([&]
+    {
+        for (int start = 0; start < blockSize; start += chunkSize)
+        {
+            for (auto* event = packets.findNextSamplePosition(start); event != packets.end() && event->samplePosition < start + chunkSize; ++event)
+                sink = sink + (event->getChannel() ^ event->getIndex() ^ event->getValue());
+        }
+    });
+
+    // What the MIDI input node costs: a copy of the chunk, or a conversion back to bytes
+    const auto bytesCopied = measure([&]
+    {
+        for (int start = 0; start < blockSize; start += chunkSize)
+        {
+            forPlugin.clear();
+            forPlugin.addEvents(bytes, start, chunkSize, -start);
+        }
+    });
+
+    const auto packetsConverted = measure([&]
+    {
+        for (int start = 0; start < blockSize; start += chunkSize)
+        {
+            forPlugin.clear();
+
+            for (auto* event = packets.findNextSamplePosition(start); event != packets.end() && event->samplePosition < start + chunkSize; ++event)
+                translator.toMidi1(event->words, [&](const juce::uint8* data, int numBytes) { forPlugin.addEvent(data, numBytes, event->samplePosition - start); });
+        }
+    });
+
+    const auto report = [&](const char* name, double nanosPerBlock)
+    {
+        std::cout << juce::String(name).paddedRight(' ', 28)
+                  << juce::String(juce::roundToInt(nanosPerBlock)).paddedLeft(' ', 10) << " ns/block"
+                  << juce::String(nanosPerBlock / eventsPerBlock, 2).paddedLeft(' ', 10) << " ns/event" << std::endl;
+    };
+
+    report("read bytes by hand", bytesRead);
+    report("read through MidiMessage", messagesRead);
+    report("read packets", packetsRead);
+    report("copy bytes to a plugin", bytesCopied);
+    report("convert packets to a plugin", packetsConverted);
+
+    std::cout << "Saved reading packets: " << juce::roundToInt(bytesRead - packetsRead) << " ns/block against bytes, "
+              << juce::roundToInt(messagesRead - packetsRead) << " ns/block against MidiMessage" << std::endl;
+
+    return 0;
+}
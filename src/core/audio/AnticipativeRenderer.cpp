@@ -0,0 +1,102 @@
+#include "AnticipativeRenderer.h"
+#include <cmath>
+
+namespace
+{
+    // The live position moved on to where a block rendered ahead will be heard, tempo and
+    // time signature kept, so that tempo-synced plugins see the beat their audio lands on
+    juce::AudioPlayHead::PositionInfo positionAhead(juce::AudioPlayHead::PositionInfo info,
+                                                    juce::int64 position,
+                                                    double sampleRate)
+    {
+        const auto aheadSeconds = (double) (position - info.getTimeInSamples().orFallback(position)) / sampleRate;
+
+        info.setTimeInSamples(position);
+        info.setTimeInSeconds((double) position / sampleRate);
+
+        const auto bpm = info.getBpm();
+        const auto ppq = info.getPpqPosition();
+
+        if (bpm.hasValue() && ppq.hasValue())
+        {
+            const auto ppqAhead = *ppq + aheadSeconds * *bpm / 60.0;
+            info.setPpqPosition(ppqAhead);
+
+            if (const auto timeSignature = info.getTimeSignature(); timeSignature.hasValue() && timeSignature->denominator > 0)
+            {
+                const auto barLength = timeSignature->numerator * 4.0 / timeSignature->denominator;
+                info.setPpqPositionOfLastBarStart(std::floor(ppqAhead / barLength) * barLength);
+            }
+        }
+
+        return info;
+    }
+}
+
+AnticipativeRenderer::AnticipativeRenderer(RenderPlanExchange& planExchange, const EnginePlayHead& playHead)
+    : juce::Thread("Anticipative renderer"),
+      plans(planExchange),
+      livePlayHead(playHead)
+{
+}
+
+AnticipativeRenderer::~AnticipativeRenderer()
+{
+    stop();
+}
+
+void AnticipativeRenderer::start(double newSampleRate, size_t arenaBytes)
+{
+    stop();
+
+    sampleRate = newSampleRate;
+    arena.prepare(arenaBytes);
+
+    plans.beginAnticipation();
+    startThread(juce::Thread::Priority::high);
+}
+
+void AnticipativeRenderer::stop()
+{
+    if (!isThreadRunning())
+        return;
+
+    stopThread(2000);
+    plans.endAnticipation();
+}
+
+void AnticipativeRenderer::run()
+{
+    // Position on the live play head's timeline of the next block to render. The rings
+    // are written and read by position, so the first block is heard about where the live
+    // play head is now.
+    juce::int64 position = livePlayHead.getLatestTimeInSamples();
+
+    while (!threadShouldExit())
+    {
+        bool rendered = false;
+
+        if (auto* plan = plans.acquireForAnticipation())
+        {
+            const auto live = livePlayHead.getLatestPosition();
+            const juce::int64 livePosition = live.getTimeInSamples().orFallback(0);
+
+            // Fallen behind: whatever should have been heard by now has been heard as silence
+            position = juce::jmax(position, livePosition);
+
+            // Nodes rendered here see where their audio will be played, not where the device is now
+            const auto info = positionAhead(live, position, sampleRate);
+            const EnginePlayHead::ScopedPositionOverride positionOverride(info);
+
+            arena.reset();
+            rendered = plan->renderAhead(arena, position, livePosition);
+
+            if (rendered)
+                position += plan->getSettings().anticipativeBlockSize;
+        }
+
+        // The rings are full, or there is nothing to anticipate: wait for the audio thread to catch up
+        if (!rendered)
+            wait(1);
+    }
+}
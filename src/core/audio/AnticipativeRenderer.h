@@ -0,0 +1,33 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "BlockArena.h"
+#include "EnginePlayHead.h"
+#include "RenderPlan.h"
+
+// Background thread that renders the parts of the graph with no live input ahead
+// of the audio thread, in large blocks, and hands the audio over through the
+// render plan's rings. The audio callback then only has to render the live nodes.
+class AnticipativeRenderer : private juce::Thread
+{
+public:
+    // Blocks rendered ahead continue from wherever the live play head is when rendering starts
+    AnticipativeRenderer(RenderPlanExchange& plans, const EnginePlayHead& livePlayHead);
+    ~AnticipativeRenderer() override;
+
+    // Start rendering ahead, with scratch memory for the largest anticipated block (message thread only)
+    void start(double sampleRate, size_t arenaBytes);
+    void stop();
+
+    bool isRendering() const { return isThreadRunning(); }
+
+private:
+    void run() override;
+
+    RenderPlanExchange& plans;
+    const EnginePlayHead& livePlayHead;
+    BlockArena arena;
+    double sampleRate = 44100.0;
+
+    JUCE_DECLARE_NON_COPYABLE(AnticipativeRenderer)
+};
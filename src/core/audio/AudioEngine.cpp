@@ -1,29 +1,58 @@
 #include "AudioEngine.h"
 
+namespace
+{
+    // Length of the fades either side of a reconfiguration
+    constexpr double reconfigureFadeSeconds = 0.01;
+    
+    // Per-block scratch for merging MIDI event lists, about ten thousand events' worth.
+    // Temporary audio lives in the render plan, which allocates it when it is compiled.
+    constexpr size_t blockArenaBytes = 256 * 1024;
+}
+
 AudioEngine::AudioEngine()
-    : sampleRate(44100.0), bufferSize(512), isRunning(false)
+    : parallelRenderingThreshold(RenderPlan::Settings::defaultMinNodesForParallelRendering), sampleRate(44100.0), bufferSize(512), isRunning(false), audioCallbackActive(false)
 {
     deviceManager = std::make_unique<juce::AudioDeviceManager>();
-    deviceManager->initialiseWithDefaultDevices(2, 2);
-    processorGraph.setPlayConfigDetails(2, 2, sampleRate, bufferSize);
     
-    // Add input/output nodes to the graph
-    auto audioInputNode = processorGraph.addNode(std::make_unique<juce::AudioProcessorGraph::AudioGraphIOProcessor>(
-        juce::AudioProcessorGraph::AudioGraphIOProcessor::audioInputNode));
+    // Create the platform device types first: the manager only creates them while it has none
+    deviceManager->getAvailableDeviceTypes();
     
-    auto audioOutputNode = processorGraph.addNode(std::make_unique<juce::AudioProcessorGraph::AudioGraphIOProcessor>(
-        juce::AudioProcessorGraph::AudioGraphIOProcessor::audioOutputNode));
+    auto virtualType = std::make_unique<VirtualAudioIODeviceType>();
+    virtualDeviceType = virtualType.get();
+    deviceManager->addAudioDeviceType(std::move(virtualType));
     
-    if (audioInputNode && audioOutputNode)
+    auto error = deviceManager->initialiseWithDefaultDevices(2, 2);
+    if (error.isNotEmpty() || deviceManager->getCurrentAudioDevice() == nullptr)
     {
-        audioInputNodeID = audioInputNode->nodeID;
-        audioOutputNodeID = audioOutputNode->nodeID;
+        juce::Logger::writeToLog("No audio hardware available, using the virtual audio device. " + error);
+        useVirtualAudioDevice({});
     }
+    
+    processorGraph.setPlayConfigDetails(numInputChannels, numOutputChannels, sampleRate, bufferSize);
+    
+    renderThreadPool = std::make_shared<RenderThreadPool>(RenderThreadPool::getDefaultNumWorkers());
+    deadlineWatchdog.setQuarantineCallback([this](int slot) { handleQuarantine(slot); });
+    outgoingMidi.ensureSize(4096);
+    
+    // Add input/output nodes to the graph
+    createIONodes();
+    rebuildRenderPlan();
+    
+    startTimer(1000);
 }
 
 AudioEngine::~AudioEngine()
 {
+    stopTimer();
     stop();
+    
+    // Wait for any plugins still being prepared, and forget about finishing the job
+    prepareThreadPool.reset();
+    cancelPendingUpdate();
+    
+    for (auto* node : processorGraph.getNodes())
+        node->getProcessor()->removeListener(this);
 }
 
 bool AudioEngine::start()
@@ -31,6 +60,10 @@ bool AudioEngine::start()
     if (isRunning)
         return true;
     
+    // The device can't drive the graph while an offline render owns it
+    if (offlineRendering)
+        return false;
+    
     auto setup = deviceManager->getAudioDeviceSetup();
     setup.sampleRate = sampleRate;
     setup.bufferSize = bufferSize;
@@ -80,48 +113,99 @@ juce::StringArray AudioEngine::getAvailableAudioDevices() const
     return devices;
 }
 
+bool AudioEngine::useVirtualAudioDevice(const VirtualAudioIODevice::Settings& settings)
+{
+    bool wasRunning = isRunning;
+    if (wasRunning)
+        stop();
+    
+    // Close the current device so a new one is created with the new settings
+    virtualDeviceType->setSettings(settings);
+    deviceManager->closeAudioDevice();
+    deviceManager->setCurrentAudioDeviceType(VirtualAudioIODeviceType::typeName, false);
+    
+    juce::AudioDeviceManager::AudioDeviceSetup setup;
+    setup.outputDeviceName = VirtualAudioIODeviceType::deviceName;
+    setup.inputDeviceName = VirtualAudioIODeviceType::deviceName;
+    setup.sampleRate = settings.sampleRate;
+    setup.bufferSize = settings.bufferSize;
+    setup.useDefaultInputChannels = false;
+    setup.useDefaultOutputChannels = false;
+    setup.inputChannels.setRange(0, settings.numInputChannels, true);
+    setup.outputChannels.setRange(0, settings.numOutputChannels, true);
+    
+    auto error = deviceManager->setAudioDeviceSetup(setup, true);
+    if (error.isNotEmpty())
+    {
+        juce::Logger::writeToLog("Could not open the virtual audio device: " + error);
+        return false;
+    }
+    
+    sampleRate = settings.sampleRate;
+    bufferSize = settings.bufferSize;
+    
+    if (wasRunning)
+        start();
+    
+    return true;
+}
+
+bool AudioEngine::isUsingVirtualAudioDevice() const
+{
+    return dynamic_cast<VirtualAudioIODevice*>(deviceManager->getCurrentAudioDevice()) != nullptr;
+}
+
+int AudioEngine::getXRunCount() const
+{
+    if (auto* device = deviceManager->getCurrentAudioDevice())
+        return device->getXRunCount();
+    
+    return -1;
+}
+
 bool AudioEngine::setAudioDevice(int deviceIndex, int inputChannels, int outputChannels)
 {
     auto devices = getAvailableAudioDevices();
     if (deviceIndex < 0 || deviceIndex >= devices.size())
         return false;
     
-    // Stop audio processing
-    bool wasRunning = isRunning;
-    if (wasRunning)
-        stop();
-    
     // Find the device type that contains this device
-    bool deviceFound = false;
     juce::String deviceName = devices[deviceIndex];
+    juce::String typeName;
     
     auto& audioDeviceTypes = deviceManager->getAvailableDeviceTypes();
     for (auto& deviceType : audioDeviceTypes)
     {
-        auto deviceNames = deviceType->getDeviceNames();
-        if (deviceNames.contains(deviceName))
+        if (deviceType->getDeviceNames().contains(deviceName))
         {
-            deviceManager->setCurrentAudioDeviceType(deviceType->getTypeName(), true);
-            
-            juce::AudioDeviceManager::AudioDeviceSetup setup;
-            setup.inputDeviceName = deviceName;
-            setup.outputDeviceName = deviceName;
-            setup.sampleRate = sampleRate;
-            setup.bufferSize = bufferSize;
-            setup.inputChannels.setRange(0, inputChannels, true);
-            setup.outputChannels.setRange(0, outputChannels, true);
-            
-            auto error = deviceManager->setAudioDeviceSetup(setup, true);
-            deviceFound = error.isEmpty();
+            typeName = deviceType->getTypeName();
             break;
         }
     }
     
-    // Restart if it was running
-    if (wasRunning && deviceFound)
-        start();
+    if (typeName.isEmpty())
+        return false;
+    
+    auto changeDevice = [&]
+    {
+        deviceManager->setCurrentAudioDeviceType(typeName, true);
+        
+        juce::AudioDeviceManager::AudioDeviceSetup setup;
+        setup.inputDeviceName = deviceName;
+        setup.outputDeviceName = deviceName;
+        setup.sampleRate = sampleRate;
+        setup.bufferSize = bufferSize;
+        setup.inputChannels.setRange(0, inputChannels, true);
+        setup.outputChannels.setRange(0, outputChannels, true);
+        
+        return deviceManager->setAudioDeviceSetup(setup, true);
+    };
+    
+    // While running, swap devices behind a fade rather than stopping the engine
+    if (isRunning)
+        return reconfigure(changeDevice);
     
-    return deviceFound;
+    return changeDevice().isEmpty();
 }
 
 AudioEngine::NodeID AudioEngine::addPluginProcessor(std::unique_ptr<juce::AudioPluginInstance> processor)
@@ -130,29 +214,52 @@ AudioEngine::NodeID AudioEngine::addPluginProcessor(std::unique_ptr<juce::AudioP
         return {};
     
     // Configure the processor with current settings
-    processor->setPlayConfigDetails(2, 2, sampleRate, bufferSize);
-    processor->prepareToPlay(sampleRate, bufferSize);
+    negotiateBusLayout(*processor);
+    processor->setNonRealtime(offlineRendering);
+    processor->setPlayHead(&playHead);
+    processor->addListener(this);
+    prepareProcessor(*processor, doublePrecisionEnabled);
     
-    // Add it to the graph
-    auto node = processorGraph.addNode(std::move(processor));
-    return node ? node->nodeID : juce::AudioProcessorGraph::NodeID();
+    // Add it to the graph; the audio thread only sees it once the new plan is published
+    auto node = processorGraph.addNode(std::move(processor), std::nullopt,
+                                       juce::AudioProcessorGraph::UpdateKind::none);
+    if (node == nullptr)
+        return {};
+    
+    rebuildRenderPlan();
+    return node->nodeID;
 }
 
 bool AudioEngine::connectNodes(NodeID sourceNodeID, int sourceChannelIndex, 
                               NodeID destinationNodeID, int destinationChannelIndex)
 {
+    // Refuse feedback loops, the render plan needs a strict processing order
+    if (sourceNodeID == destinationNodeID || processorGraph.isAnInputTo(destinationNodeID, sourceNodeID))
+        return false;
+    
     // Make a connection
     auto result = processorGraph.addConnection({ 
         { sourceNodeID, sourceChannelIndex }, 
         { destinationNodeID, destinationChannelIndex } 
-    });
+    }, juce::AudioProcessorGraph::UpdateKind::none);
+    
+    if (result)
+        rebuildRenderPlan();
     
     return result;
 }
 
 bool AudioEngine::removePlugin(NodeID nodeID)
 {
-    return processorGraph.removeNode(nodeID);
+    // The plan the audio thread is rendering keeps the node alive until it is collected
+    auto removedNode = processorGraph.removeNode(nodeID, juce::AudioProcessorGraph::UpdateKind::none);
+    if (removedNode == nullptr)
+        return false;
+    
+    removedNode->getProcessor()->removeListener(this);
+    retiringNodeSlots.emplace_back(renderPlans.getNextGeneration(), nodeID.uid);
+    rebuildRenderPlan();
+    return true;
 }
 
 juce::AudioProcessorGraph& AudioEngine::getProcessorGraph()
@@ -162,14 +269,275 @@ juce::AudioProcessorGraph& AudioEngine::getProcessorGraph()
 
 void AudioEngine::clearPlugins()
 {
-    processorGraph.clear();
+    for (auto* node : processorGraph.getNodes())
+    {
+        node->getProcessor()->removeListener(this);
+        retiringNodeSlots.emplace_back(renderPlans.getNextGeneration(), node->nodeID.uid);
+    }
+    
+    processorGraph.clear(juce::AudioProcessorGraph::UpdateKind::none);
     
     // Re-create input/output nodes
+    createIONodes();
+    rebuildRenderPlan();
+}
+
+void AudioEngine::rebuildRenderPlan()
+{
+    // Compiling asks plugins for their latency; finishReconfigure() rebuilds once they're prepared
+    if (preparingInBackground)
+        return;
+    
+    RenderPlan::Settings settings;
+    settings.sampleRate = sampleRate;
+    settings.blockSize = bufferSize;
+    settings.minNodesForParallelRendering = parallelRenderingThreshold;
+    settings.performanceMonitor = &performanceMonitor;
+    settings.anticipativeRendering = anticipativeRenderingEnabled && !offlineRendering;
+    settings.anticipativeBlockSize = anticipativeBlockSize;
+    settings.anticipationLookahead = juce::jmax(4 * anticipativeBlockSize, 8 * bufferSize);
+    settings.sleepSilentNodes = silentNodeSleepEnabled;
+    settings.midiRouting = midiRouting;
+    
+    // Nothing overruns a deadline when rendering offline
+    settings.watchdog = offlineRendering ? nullptr : &deadlineWatchdog;
+    
+    // Delay lines that are still valid carry over from the previous plan
+    auto plan = RenderPlan::compile(processorGraph, settings, renderThreadPool, renderPlans.getLatestPlan());
+    
+    if (plan->getLatencySamples() != graphLatencySamples)
+    {
+        graphLatencySamples = plan->getLatencySamples();
+        processorGraph.setLatencySamples(graphLatencySamples);
+        juce::Logger::writeToLog("Graph latency is now " + juce::String(graphLatencySamples) + " samples");
+    }
+    
+    renderPlans.publish(std::move(plan));
+    collectRetiredPlans(!audioCallbackActive);
+}
+
+int AudioEngine::getGraphLatencySamples() const
+{
+    return graphLatencySamples;
+}
+
+int AudioEngine::getNodeLatencySamples(NodeID nodeID) const
+{
+    if (auto* plan = renderPlans.getLatestPlan())
+        return plan->getNodeLatencySamples(nodeID);
+    
+    return -1;
+}
+
+int AudioEngine::getTotalLatencySamples() const
+{
+    int total = graphLatencySamples;
+    
+    if (auto* device = deviceManager->getCurrentAudioDevice())
+        total += device->getInputLatencyInSamples() + device->getOutputLatencyInSamples();
+    
+    return total;
+}
+
+void AudioEngine::audioProcessorChanged(juce::AudioProcessor*, const ChangeDetails& details)
+{
+    // May be called from any thread, including the audio thread
+    if (details.latencyChanged)
+        triggerAsyncUpdate();
+}
+
+void AudioEngine::handleAsyncUpdate()
+{
+    // A processor changed, or the plugins a reconfiguration was preparing are ready
+    if (backgroundPreparationDone.exchange(false))
+        finishReconfigure();
+    else
+        rebuildRenderPlan();
+}
+
+void AudioEngine::setNumRenderThreads(int numThreads)
+{
+    numThreads = juce::jmax(0, numThreads);
+    if (numThreads == getNumRenderThreads())
+        return;
+    
+    // Plans still being rendered hold on to the old pool until they are collected
+    renderThreadPool = numThreads > 0 ? std::make_shared<RenderThreadPool>(numThreads) : nullptr;
+    rebuildRenderPlan();
+}
+
+int AudioEngine::getNumRenderThreads() const
+{
+    return renderThreadPool != nullptr ? renderThreadPool->getNumWorkers() : 0;
+}
+
+void AudioEngine::setParallelRenderingThreshold(int minNumNodes)
+{
+    parallelRenderingThreshold = juce::jmax(1, minNumNodes);
+    rebuildRenderPlan();
+}
+
+uint64_t AudioEngine::getNumRenderDeadlineMisses() const
+{
+    return renderThreadPool != nullptr ? renderThreadPool->getNumDeadlineMisses() : 0;
+}
+
+void AudioEngine::setRealtimeSafetyChecksEnabled(bool shouldBeEnabled)
+{
+    RealtimeSafetyMonitor::getInstance().setEnabled(shouldBeEnabled);
+}
+
+bool AudioEngine::areRealtimeSafetyChecksEnabled() const
+{
+    return RealtimeSafetyMonitor::getInstance().isEnabled();
+}
+
+std::vector<AudioEngine::RealtimeSafetyReport> AudioEngine::getRealtimeSafetyReport() const
+{
+    auto& monitor = RealtimeSafetyMonitor::getInstance();
+    std::vector<RealtimeSafetyReport> report;
+    
+    auto engineCounts = monitor.getCounts(RealtimeSafetyMonitor::engineSlot);
+    if (!engineCounts.isClean())
+        report.push_back({ NodeID(), "Audio engine", engineCounts });
+    
+    for (auto* node : processorGraph.getNodes())
+    {
+        if (dynamic_cast<juce::AudioProcessorGraph::AudioGraphIOProcessor*>(node->getProcessor()) != nullptr)
+            continue;
+        
+        // Nodes past the last slot are counted with the engine
+        const auto slot = monitor.getSlotForNode(node->nodeID.uid);
+        if (slot == RealtimeSafetyMonitor::engineSlot)
+            continue;
+        
+        auto counts = monitor.getCounts(slot);
+        if (!counts.isClean())
+            report.push_back({ node->nodeID, node->getProcessor()->getName(), counts });
+    }
+    
+    return report;
+}
+
+void AudioEngine::setPerformanceMonitoringEnabled(bool shouldBeEnabled)
+{
+    performanceMonitor.setEnabled(shouldBeEnabled);
+}
+
+bool AudioEngine::isPerformanceMonitoringEnabled() const
+{
+    return performanceMonitor.isEnabled();
+}
+
+AudioEngine::PerformanceReport AudioEngine::getPerformanceReport()
+{
+    performanceMonitor.collect();
+    
+    PerformanceReport report;
+    report.callback = performanceMonitor.getStats(PerformanceMonitor::callbackSlot);
+    report.deadlineMicros = performanceMonitor.getDeadlineMicros();
+    report.deviceXRuns = getXRunCount();
+    report.overruns = performanceMonitor.getNumOverruns();
+    report.lateCallbacks = performanceMonitor.getNumLateCallbacks();
+    report.droppedRecords = performanceMonitor.getNumDroppedRecords();
+    
+    for (auto* node : processorGraph.getNodes())
+    {
+        if (dynamic_cast<juce::AudioProcessorGraph::AudioGraphIOProcessor*>(node->getProcessor()) != nullptr)
+            continue;
+        
+        // Nodes without a slot of their own aren't timed, rather than showing the callback's figures
+        auto slot = RealtimeSafetyMonitor::getInstance().getSlotForNode(node->nodeID.uid);
+        const auto stats = PerformanceMonitor::hasOwnSlot(slot) ? performanceMonitor.getStats(slot) : PerformanceMonitor::Stats();
+        report.nodes.push_back({ node->nodeID, node->getProcessor()->getName(), stats });
+    }
+    
+    return report;
+}
+
+void AudioEngine::resetPerformanceStats()
+{
+    performanceMonitor.reset();
+}
+
+bool AudioEngine::writePerformanceReport(const juce::File& file)
+{
+    auto toVar = [](const PerformanceMonitor::Stats& stats)
+    {
+        auto* object = new juce::DynamicObject();
+        object->setProperty("blocks", (juce::int64) stats.numBlocks);
+        object->setProperty("meanMicros", stats.meanMicros);
+        object->setProperty("p50Micros", stats.p50Micros);
+        object->setProperty("p99Micros", stats.p99Micros);
+        object->setProperty("maxMicros", stats.maxMicros);
+        object->setProperty("p50PercentOfDeadline", stats.p50PercentOfDeadline);
+        object->setProperty("p99PercentOfDeadline", stats.p99PercentOfDeadline);
+        object->setProperty("maxPercentOfDeadline", stats.maxPercentOfDeadline);
+        object->setProperty("blocksAsleep", (juce::int64) stats.numBlocksAsleep);
+        object->setProperty("percentAsleep", stats.percentAsleep);
+        object->setProperty("savedMicros", stats.savedMicros);
+        return juce::var(object);
+    };
+    
+    const auto report = getPerformanceReport();
+    
+    auto* root = new juce::DynamicObject();
+    root->setProperty("sampleRate", sampleRate);
+    root->setProperty("bufferSize", bufferSize);
+    root->setProperty("deadlineMicros", report.deadlineMicros);
+    root->setProperty("deviceXRuns", report.deviceXRuns);
+    root->setProperty("overruns", (juce::int64) report.overruns);
+    root->setProperty("lateCallbacks", (juce::int64) report.lateCallbacks);
+    root->setProperty("droppedRecords", (juce::int64) report.droppedRecords);
+    root->setProperty("callback", toVar(report.callback));
+    
+    juce::Array<juce::var> nodes;
+    for (const auto& node : report.nodes)
+    {
+        auto entry = toVar(node.stats);
+        entry.getDynamicObject()->setProperty("nodeID", (juce::int64) node.nodeID.uid);
+        entry.getDynamicObject()->setProperty("name", node.name);
+        nodes.add(entry);
+    }
+    
+    root->setProperty("nodes", nodes);
+    
+    return file.replaceWithText(juce::JSON::toString(juce::var(root)));
+}
+
+void AudioEngine::resetRealtimeSafetyCounters()
+{
+    RealtimeSafetyMonitor::getInstance().reset();
+    loggedViolations.clear();
+}
+
+void AudioEngine::logRealtimeSafetyViolations()
+{
+    for (const auto& entry : getRealtimeSafetyReport())
+    {
+        auto& logged = loggedViolations[entry.nodeID.uid];
+        if (logged.allocations == entry.counts.allocations
+            && logged.frees == entry.counts.frees
+            && logged.mutexWaits == entry.counts.mutexWaits)
+            continue;
+        
+        logged = entry.counts;
+        juce::Logger::writeToLog("Real-time violation in " + entry.name
+                                 + ": " + juce::String(entry.counts.allocations) + " allocations, "
+                                 + juce::String(entry.counts.frees) + " frees, "
+                                 + juce::String(entry.counts.mutexWaits) + " mutex waits on the audio thread");
+    }
+}
+
+void AudioEngine::createIONodes()
+{
+    using UpdateKind = juce::AudioProcessorGraph::UpdateKind;
+    
     auto audioInputNode = processorGraph.addNode(std::make_unique<juce::AudioProcessorGraph::AudioGraphIOProcessor>(
-        juce::AudioProcessorGraph::AudioGraphIOProcessor::audioInputNode));
+        juce::AudioProcessorGraph::AudioGraphIOProcessor::audioInputNode), std::nullopt, UpdateKind::none);
     
     auto audioOutputNode = processorGraph.addNode(std::make_unique<juce::AudioProcessorGraph::AudioGraphIOProcessor>(
-        juce::AudioProcessorGraph::AudioGraphIOProcessor::audioOutputNode));
+        juce::AudioProcessorGraph::AudioGraphIOProcessor::audioOutputNode), std::nullopt, UpdateKind::none);
     
     if (audioInputNode && audioOutputNode)
     {
@@ -178,48 +546,781 @@ void AudioEngine::clearPlugins()
     }
 }
 
-void AudioEngine::audioDeviceIOCallback(const float** inputChannelData,
-                                       int numInputChannels,
-                                       float** outputChannelData,
-                                       int numOutputChannels,
-                                       int numSamples)
+void AudioEngine::negotiateBusLayout(juce::AudioProcessor& processor)
 {
-    // Clear output buffers
+    // Multi-out instruments and side-chained effects: ask for every bus
+    auto layout = processor.getBusesLayout();
+    
+    for (int i = 0; i < processor.getBusCount(true); ++i)
+        if (layout.inputBuses.getReference(i).isDisabled())
+            layout.inputBuses.getReference(i) = processor.getBus(true, i)->getDefaultLayout();
+    
+    for (int i = 0; i < processor.getBusCount(false); ++i)
+        if (layout.outputBuses.getReference(i).isDisabled())
+            layout.outputBuses.getReference(i) = processor.getBus(false, i)->getDefaultLayout();
+    
+    if (layout != processor.getBusesLayout() && processor.checkBusesLayoutSupported(layout))
+        processor.setBusesLayout(layout);
+    
+    // A layout with some audio output is good enough as it is
+    if (processor.getTotalNumOutputChannels() == 0 && !processor.isMidiEffect())
+    {
+        juce::AudioProcessor::BusesLayout stereo;
+        stereo.inputBuses.add(juce::AudioChannelSet::stereo());
+        stereo.outputBuses.add(juce::AudioChannelSet::stereo());
+        
+        if (!processor.setBusesLayout(stereo))
+            juce::Logger::writeToLog("Could not find a usable bus layout for " + processor.getName());
+    }
+    
+    processor.setRateAndBufferSizeDetails(sampleRate, getMaximumBlockSize());
+}
+
+void AudioEngine::updateIOChannels()
+{
+    processorGraph.setPlayConfigDetails(numInputChannels, numOutputChannels, sampleRate, bufferSize);
+    
+    // The I/O nodes take their channel counts from the graph
+    for (auto* node : processorGraph.getNodes())
+        if (auto* ioProcessor = dynamic_cast<juce::AudioProcessorGraph::AudioGraphIOProcessor*>(node->getProcessor()))
+            ioProcessor->setParentGraph(&processorGraph);
+}
+
+void AudioEngine::connectToAudioIO(NodeID nodeID)
+{
+    auto* node = processorGraph.getNodeForId(nodeID);
+    if (node == nullptr)
+        return;
+    
+    using UpdateKind = juce::AudioProcessorGraph::UpdateKind;
+    auto* processor = node->getProcessor();
+    
+    const auto numInputs = juce::jmin(numInputChannels, processor->getMainBusNumInputChannels());
+    for (int channel = 0; channel < numInputs; ++channel)
+        processorGraph.addConnection({ { audioInputNodeID, channel }, { nodeID, channel } }, UpdateKind::none);
+    
+    const auto numOutputs = juce::jmin(numOutputChannels, processor->getMainBusNumOutputChannels());
+    for (int channel = 0; channel < numOutputs; ++channel)
+        processorGraph.addConnection({ { nodeID, channel }, { audioOutputNodeID, channel } }, UpdateKind::none);
+    
+    rebuildRenderPlan();
+}
+
+void AudioEngine::prepareProcessor(juce::AudioProcessor& processor, bool useDoublePrecision)
+{
+    prepareProcessor(processor, useDoublePrecision, sampleRate, getMaximumBlockSize());
+}
+
+void AudioEngine::prepareProcessor(juce::AudioProcessor& processor, bool useDoublePrecision,
+                                   double preparedSampleRate, int maximumBlockSize)
+{
+    // The render plan follows whatever precision the processor ends up prepared for
+    processor.setProcessingPrecision(useDoublePrecision && processor.supportsDoublePrecisionProcessing()
+                                         ? juce::AudioProcessor::doublePrecision
+                                         : juce::AudioProcessor::singlePrecision);
+    processor.setRateAndBufferSizeDetails(preparedSampleRate, maximumBlockSize);
+    processor.prepareToPlay(preparedSampleRate, maximumBlockSize);
+}
+
+int AudioEngine::getMaximumBlockSize() const
+{
+    return anticipativeRenderingEnabled && !offlineRendering ? juce::jmax(bufferSize, anticipativeBlockSize)
+                                                            : bufferSize;
+}
+
+void AudioEngine::updateAnticipativeRenderer()
+{
+    if (anticipativeRenderingEnabled && audioCallbackActive && !offlineRendering && !reconfiguring)
+        anticipativeRenderer.start(sampleRate, blockArenaBytes);
+    else
+        anticipativeRenderer.stop();
+}
+
+void AudioEngine::setAnticipativeRenderingEnabled(bool shouldBeEnabled, int newBlockSize)
+{
+    newBlockSize = juce::jmax(64, newBlockSize);
+    
+    if (shouldBeEnabled == anticipativeRenderingEnabled && newBlockSize == anticipativeBlockSize)
+        return;
+    
+    // Plugins have to be prepared again for the new largest block size
+    bool wasRunning = isRunning;
+    stop();
+    
+    anticipativeRenderingEnabled = shouldBeEnabled;
+    anticipativeBlockSize = newBlockSize;
+    rebuildRenderPlan();
+    
+    if (wasRunning)
+        start();
+}
+
+void AudioEngine::setNodeLive(NodeID nodeID, bool shouldBeLive)
+{
+    if (auto* node = processorGraph.getNodeForId(nodeID))
+    {
+        node->properties.set(RenderPlan::liveNodeProperty, shouldBeLive);
+        rebuildRenderPlan();
+    }
+}
+
+bool AudioEngine::wantsDoublePrecision(const juce::AudioProcessorGraph::Node& node) const
+{
+    const auto& preference = node.properties[doublePrecisionNodeProperty];
+    return preference.isVoid() ? doublePrecisionEnabled : (bool) preference;
+}
+
+void AudioEngine::setDoublePrecisionProcessingEnabled(bool shouldBeEnabled)
+{
+    if (shouldBeEnabled == doublePrecisionEnabled)
+        return;
+    
+    doublePrecisionEnabled = shouldBeEnabled;
+    reprepareAllNodes();
+}
+
+void AudioEngine::setNodeDoublePrecision(NodeID nodeID, bool shouldUseDoublePrecision)
+{
+    auto* node = processorGraph.getNodeForId(nodeID);
+    if (node == nullptr || wantsDoublePrecision(*node) == shouldUseDoublePrecision)
+        return;
+    
+    node->properties.set(doublePrecisionNodeProperty, shouldUseDoublePrecision);
+    reprepareAllNodes();
+}
+
+void AudioEngine::setSilentNodeSleepEnabled(bool shouldBeEnabled)
+{
+    if (shouldBeEnabled == silentNodeSleepEnabled)
+        return;
+    
+    silentNodeSleepEnabled = shouldBeEnabled;
+    rebuildRenderPlan();
+}
+
+void AudioEngine::setMidiRouting(std::shared_ptr<const MidiRoutingTable> table)
+{
+    midiRouting = std::move(table);
+    rebuildRenderPlan();
+}
+
+void AudioEngine::setNodeNeverSleeps(NodeID nodeID, bool shouldNeverSleep)
+{
+    if (auto* node = processorGraph.getNodeForId(nodeID))
+    {
+        node->properties.set(RenderPlan::neverSleepNodeProperty, shouldNeverSleep);
+        rebuildRenderPlan();
+    }
+}
+
+void AudioEngine::setDeadlineWatchdogEnabled(bool shouldBeEnabled)
+{
+    deadlineWatchdog.setEnabled(shouldBeEnabled);
+}
+
+bool AudioEngine::isDeadlineWatchdogEnabled() const
+{
+    return deadlineWatchdog.isEnabled();
+}
+
+void AudioEngine::setDeadlineWatchdogLimits(double fractionOfBlock, int maxViolations, double violationDecaySeconds)
+{
+    deadlineWatchdog.setBudget(fractionOfBlock);
+    deadlineWatchdog.setMaxViolations(maxViolations);
+    deadlineWatchdog.setViolationDecay(violationDecaySeconds);
+}
+
+void AudioEngine::setQuarantineCallback(std::function<void(const QuarantineEvent&)> callback)
+{
+    quarantineCallback = std::move(callback);
+}
+
+bool AudioEngine::isNodeQuarantined(NodeID nodeID) const
+{
+    return deadlineWatchdog.isQuarantined(RealtimeSafetyMonitor::getInstance().findSlotForNode(nodeID.uid));
+}
+
+void AudioEngine::releaseFromQuarantine(NodeID nodeID)
+{
+    if (processorGraph.getNodeForId(nodeID) == nullptr)
+        return;
+    
+    deadlineWatchdog.release(RealtimeSafetyMonitor::getInstance().findSlotForNode(nodeID.uid));
+}
+
+juce::AudioProcessorGraph::Node* AudioEngine::getNodeForSlot(int slot) const
+{
+    if (slot == RealtimeSafetyMonitor::engineSlot)
+        return nullptr;
+    
+    for (auto* node : processorGraph.getNodes())
+        if (RealtimeSafetyMonitor::getInstance().findSlotForNode(node->nodeID.uid) == slot)
+            return node;
+    
+    return nullptr;
+}
+
+void AudioEngine::handleQuarantine(int slot)
+{
+    auto* node = getNodeForSlot(slot);
+    if (node == nullptr)
+        return;
+    
+    const auto trace = deadlineWatchdog.getTrace(slot);
+    
+    QuarantineEvent event;
+    event.nodeID = node->nodeID;
+    event.name = node->getProcessor()->getName();
+    event.numViolations = trace.numViolations;
+    event.worstMicros = trace.worstMicros;
+    event.budgetMicros = trace.budgetMicros;
+    
+    juce::Logger::writeToLog("Quarantined " + event.name + " after " + juce::String((juce::int64) event.numViolations)
+                             + " blocks over its " + juce::String(event.budgetMicros, 1) + " us budget (worst "
+                             + juce::String(event.worstMicros, 1) + " us)");
+    
+    // Keep the trace, which shows the blocks either side of the quarantine
+    auto traceFile = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                         .getChildFile("VSTLinkHost")
+                         .getChildFile("Traces")
+                         .getChildFile(juce::File::createLegalFileName(event.name) + "-"
+                                       + juce::Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") + ".json");
+    
+    if (traceFile.getParentDirectory().createDirectory() && writeTimingTrace(event.nodeID, traceFile))
+        event.traceFile = traceFile;
+    
+    if (quarantineCallback)
+        quarantineCallback(event);
+}
+
+bool AudioEngine::writeTimingTrace(NodeID nodeID, const juce::File& file)
+{
+    auto* node = processorGraph.getNodeForId(nodeID);
+    if (node == nullptr)
+        return false;
+    
+    const auto trace = deadlineWatchdog.getTrace(RealtimeSafetyMonitor::getInstance().findSlotForNode(nodeID.uid));
+    
+    auto toVar = [](const std::vector<DeadlineWatchdog::TraceEntry>& entries)
+    {
+        juce::Array<juce::var> blocks;
+        
+        for (const auto& entry : entries)
+        {
+            auto* object = new juce::DynamicObject();
+            object->setProperty("block", (juce::int64) entry.block);
+            object->setProperty("micros", entry.micros);
+            blocks.add(juce::var(object));
+        }
+        
+        return blocks;
+    };
+    
+    auto* root = new juce::DynamicObject();
+    root->setProperty("nodeID", (juce::int64) nodeID.uid);
+    root->setProperty("name", node->getProcessor()->getName());
+    
+    if (auto* instance = dynamic_cast<juce::AudioPluginInstance*>(node->getProcessor()))
+    {
+        const auto description = instance->getPluginDescription();
+        root->setProperty("manufacturer", description.manufacturerName);
+        root->setProperty("version", description.version);
+        root->setProperty("format", description.pluginFormatName);
+    }
+    
+    root->setProperty("sampleRate", sampleRate);
+    root->setProperty("bufferSize", bufferSize);
+    root->setProperty("quarantined", deadlineWatchdog.isQuarantined(trace.slot));
+    root->setProperty("quarantineBlock", (juce::int64) trace.quarantineBlock);
+    root->setProperty("violations", (juce::int64) trace.numViolations);
+    root->setProperty("budgetMicros", trace.budgetMicros);
+    root->setProperty("worstMicros", trace.worstMicros);
+    root->setProperty("blocks", toVar(trace.node));
+    root->setProperty("callback", toVar(trace.callback));
+    
+    juce::Array<juce::var> others;
+    for (const auto& [slot, entries] : trace.otherNodes)
+    {
+        auto* other = new juce::DynamicObject();
+        
+        if (auto* otherNode = getNodeForSlot(slot))
+        {
+            other->setProperty("nodeID", (juce::int64) otherNode->nodeID.uid);
+            other->setProperty("name", otherNode->getProcessor()->getName());
+        }
+        
+        other->setProperty("blocks", toVar(entries));
+        others.add(juce::var(other));
+    }
+    
+    root->setProperty("otherNodes", others);
+    
+    return file.replaceWithText(juce::JSON::toString(juce::var(root)));
+}
+
+void AudioEngine::reprepareAllNodes()
+{
+    // Precision can only change while a plugin is unprepared, so wait for the next start if stopped
+    if (isRunning)
+        reconfigure([] { return juce::String(); });
+}
+
+uint64_t AudioEngine::getNumAnticipationUnderruns() const
+{
+    if (auto* plan = renderPlans.getLatestPlan())
+        return plan->getNumAnticipationUnderruns();
+    
+    return 0;
+}
+
+bool AudioEngine::prepareAllNodes(bool inBackground)
+{
+    updateIOChannels();
+    
+    blockArena.prepare(blockArenaBytes);
+    
+    // The graph is only used as a topology model, so its nodes are prepared here.
+    // Plugins can take a long time over it, so they are prepared in parallel.
+    auto nodes = processorGraph.getNodes();
+    
+    if (nodes.size() <= 2)
+    {
+        for (auto* node : nodes)
+            prepareProcessor(*node->getProcessor(), wantsDoublePrecision(*node));
+        
+        return true;
+    }
+    
+    if (prepareThreadPool == nullptr)
+        prepareThreadPool = std::make_unique<juce::ThreadPool>(juce::ThreadPoolOptions{}
+                                                                   .withThreadName("Plugin preparation")
+                                                                   .withNumberOfThreads(juce::SystemStats::getNumCpus()));
+    
+    // AudioUnits talk to CoreAudio while preparing and must be prepared on the main thread
+    auto mustPrepareOnThisThread = [](juce::AudioProcessor* processor)
+    {
+        auto* instance = dynamic_cast<juce::AudioPluginInstance*>(processor);
+        return instance != nullptr && instance->getPluginDescription().pluginFormatName == "AudioUnit";
+    };
+    
+    // Outlive this call when preparing in the background, as do the nodes themselves. The
+    // settings are taken now: the jobs must not read them while the message thread changes them.
+    const auto preparedSampleRate = sampleRate;
+    const auto maximumBlockSize = getMaximumBlockSize();
+    auto numRemaining = std::make_shared<std::atomic<int>>(1);
+    auto allPrepared = std::make_shared<juce::WaitableEvent>();
+    
+    for (auto* node : nodes)
+    {
+        if (mustPrepareOnThisThread(node->getProcessor()))
+            continue;
+        
+        ++*numRemaining;
+        prepareThreadPool->addJob([this, node = juce::AudioProcessorGraph::Node::Ptr(node), useDoublePrecision = wantsDoublePrecision(*node),
+                                   preparedSampleRate, maximumBlockSize, numRemaining, allPrepared, inBackground]
+        {
+            prepareProcessor(*node->getProcessor(), useDoublePrecision, preparedSampleRate, maximumBlockSize);
+            
+            if (--*numRemaining > 0)
+                return;
+            
+            if (inBackground)
+            {
+                backgroundPreparationDone = true;
+                triggerAsyncUpdate();
+            }
+            else
+            {
+                allPrepared->signal();
+            }
+        });
+    }
+    
+    for (auto* node : nodes)
+        if (mustPrepareOnThisThread(node->getProcessor()))
+            prepareProcessor(*node->getProcessor(), wantsDoublePrecision(*node));
+    
+    if (--*numRemaining == 0)
+        return true;
+    
+    if (inBackground)
+        return false;
+    
+    allPrepared->wait();
+    return true;
+}
+
+void AudioEngine::releaseAllNodes()
+{
+    for (auto* node : processorGraph.getNodes())
+        node->getProcessor()->releaseResources();
+}
+
+void AudioEngine::applyOutputFade(float* const* outputChannelData, int numOutputChannels, int numSamples, bool fadeOut)
+{
+    const auto target = fadeOut ? 0.0f : 1.0f;
+    if (outputGain == target)
+        return;
+    
+    const auto step = (float) (1.0 / (reconfigureFadeSeconds * sampleRate));
+    const auto startGain = outputGain;
+    
+    for (int channel = 0; channel < numOutputChannels; ++channel)
+    {
+        auto* samples = outputChannelData[channel];
+        if (samples == nullptr)
+            continue;
+        
+        auto gain = startGain;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            gain = fadeOut ? juce::jmax(0.0f, gain - step) : juce::jmin(1.0f, gain + step);
+            samples[i] *= gain;
+        }
+    }
+    
+    outputGain = fadeOut ? juce::jmax(0.0f, startGain - step * (float) numSamples)
+                         : juce::jmin(1.0f, startGain + step * (float) numSamples);
+}
+
+bool AudioEngine::suspendRendering()
+{
+    suspendAcknowledged = false;
+    renderingSuspended = true;
+    
+    // Give the fade-out a few blocks to finish; a stopped device never answers
+    const auto timeout = juce::Time::getMillisecondCounter() + 500;
+    while (audioCallbackActive && !suspendAcknowledged && juce::Time::getMillisecondCounter() < timeout)
+        juce::Thread::sleep(1);
+    
+    // A callback that is still rendering may be inside any plugin, so none can be touched
+    if (audioCallbackActive && !suspendAcknowledged)
+    {
+        renderingSuspended = false;
+        return false;
+    }
+    
+    // Nothing may render ahead while plugins are being prepared either
+    anticipativeRenderer.stop();
+    return true;
+}
+
+void AudioEngine::resumeRendering()
+{
+    renderingSuspended = false;
+}
+
+bool AudioEngine::reconfigure(const std::function<juce::String()>& changeDevice)
+{
+    // Already silent and waiting for plugins: change the device now, and prepare
+    // everything again for it once the current round is done
+    if (reconfiguring)
+    {
+        auto error = changeDevice();
+        if (error.isNotEmpty())
+            juce::Logger::writeToLog("Audio device change failed: " + error);
+        
+        prepareAgain = true;
+        return error.isEmpty();
+    }
+    
+    if (!suspendRendering())
+    {
+        juce::Logger::writeToLog("The audio callback didn't fade out in time, so the audio settings weren't changed");
+        return false;
+    }
+    
+    reconfiguring = true;
+    
+    auto error = changeDevice();
+    if (error.isNotEmpty())
+        juce::Logger::writeToLog("Audio device change failed: " + error);
+    
+    // The device, old or new, is back up and calling us for silence while this happens
+    preparingInBackground = !prepareAllNodes(true);
+    
+    if (!preparingInBackground)
+        finishReconfigure();
+    
+    return error.isEmpty();
+}
+
+void AudioEngine::finishReconfigure()
+{
+    preparingInBackground = false;
+    
+    // The settings changed again while the plugins were being prepared
+    while (prepareAgain)
+    {
+        prepareAgain = false;
+        
+        if (!prepareAllNodes(true))
+        {
+            preparingInBackground = true;
+            return;
+        }
+    }
+    
+    reconfiguring = false;
+    rebuildRenderPlan();
+    
+    updateAnticipativeRenderer();
+    resumeRendering();
+}
+
+bool AudioEngine::setAudioSettings(double newSampleRate, int newBufferSize)
+{
+    if (newSampleRate == sampleRate && newBufferSize == bufferSize)
+        return true;
+    
+    if (!isRunning)
+    {
+        // Applied, and everything prepared, when the engine next starts
+        sampleRate = newSampleRate;
+        bufferSize = newBufferSize;
+        rebuildRenderPlan();
+        return true;
+    }
+    
+    return reconfigure([this, newSampleRate, newBufferSize]
+    {
+        auto setup = deviceManager->getAudioDeviceSetup();
+        setup.sampleRate = newSampleRate;
+        setup.bufferSize = newBufferSize;
+        return deviceManager->setAudioDeviceSetup(setup, true);
+    });
+}
+
+bool AudioEngine::beginOfflineRender(double offlineSampleRate, int offlineBlockSize, juce::String& errorMessage)
+{
+    if (offlineRendering)
+    {
+        errorMessage = "The engine is already rendering offline";
+        return false;
+    }
+    
+    // Not while plugins are still being prepared for a reconfiguration either
+    if (reconfiguring)
+    {
+        errorMessage = "The engine is being reconfigured; try again once the new settings are in place";
+        return false;
+    }
+    
+    if (offlineSampleRate <= 0.0 || offlineBlockSize <= 0)
+    {
+        errorMessage = "Invalid render settings";
+        return false;
+    }
+    
+    // Plugins must never be driven by the device and the offline renderer at once
+    wasRunningBeforeOfflineRender = isRunning;
+    stop();
+    
+    deviceSampleRate = sampleRate;
+    deviceBufferSize = bufferSize;
+    sampleRate = offlineSampleRate;
+    bufferSize = offlineBlockSize;
+    offlineRendering = true;
+    
+    for (auto* node : processorGraph.getNodes())
+        node->getProcessor()->setNonRealtime(true);
+    
+    prepareAllNodes();
+    
+    // The calling thread now plays the part of the audio thread
+    audioCallbackActive = true;
+    rebuildRenderPlan();
+    
+    // The render starts from zero; the live position is put back afterwards
+    livePlayHeadPosition = *playHead.getPosition();
+    playHead.setPosition({});
+    return true;
+}
+
+void AudioEngine::renderOfflineBlock(const float* const* inputChannelData,
+                                     int numInputChannels,
+                                     float* const* outputChannelData,
+                                     int numOutputChannels,
+                                     int numSamples)
+{
+    jassert(offlineRendering);
+    
+    blockArena.reset();
+    
+    if (auto* plan = renderPlans.acquire())
+    {
+        // Nothing plays live MIDI into an offline render, and nothing sends what comes out
+        incomingMidi.clear();
+        outgoingMidi.clear();
+        plan->process(inputChannelData, numInputChannels, outputChannelData, numOutputChannels, numSamples,
+                      incomingMidi, outgoingMidi, playHead.getLatestTimeInSamples(), blockArena);
+        return;
+    }
+    
     for (int channel = 0; channel < numOutputChannels; ++channel)
         if (outputChannelData[channel])
             juce::FloatVectorOperations::clear(outputChannelData[channel], numSamples);
+}
+
+void AudioEngine::endOfflineRender()
+{
+    if (!offlineRendering)
+        return;
+    
+    audioCallbackActive = false;
+    releaseAllNodes();
+    
+    for (auto* node : processorGraph.getNodes())
+        node->getProcessor()->setNonRealtime(false);
+    
+    offlineRendering = false;
+    sampleRate = deviceSampleRate;
+    bufferSize = deviceBufferSize;
+    playHead.setPosition(livePlayHeadPosition);
+    
+    // Go back to the live settings; audioDeviceAboutToStart prepares everything again
+    rebuildRenderPlan();
+    
+    if (wasRunningBeforeOfflineRender)
+        start();
+}
+
+void AudioEngine::collectRetiredPlans(bool audioCallbackStopped)
+{
+    renderPlans.collectGarbage(audioCallbackStopped);
+    
+    // A slot handed out again while a plan still charged the old node to it would mix the
+    // two nodes' timings, and could quarantine the new one for the old one's overruns
+    const auto oldestGeneration = renderPlans.getOldestGeneration();
+    auto& safetyMonitor = RealtimeSafetyMonitor::getInstance();
     
-    // Create audio buffer
-    juce::AudioBuffer<float> buffer(outputChannelData, numOutputChannels, numSamples);
+    retiringNodeSlots.erase(std::remove_if(retiringNodeSlots.begin(), retiringNodeSlots.end(),
+                                           [&](const std::pair<uint64_t, juce::uint32>& retiring)
+                                           {
+                                               if (retiring.first > oldestGeneration)
+                                                   return false;
+                                               
+                                               const auto slot = safetyMonitor.releaseSlotForNode(retiring.second);
+                                               performanceMonitor.resetSlot(slot);
+                                               deadlineWatchdog.resetSlot(slot);
+                                               return true;
+                                           }),
+                            retiringNodeSlots.end());
+}
+
+void AudioEngine::timerCallback()
+{
+    collectRetiredPlans(!audioCallbackActive);
     
-    // Copy input to buffer (if available)
-    if (numInputChannels > 0)
+    if (areRealtimeSafetyChecksEnabled())
+        logRealtimeSafetyViolations();
+}
+
+void AudioEngine::audioDeviceIOCallbackWithContext(const float* const* inputChannelData,
+                                                   int numInputChannels,
+                                                   float* const* outputChannelData,
+                                                   int numOutputChannels,
+                                                   int numSamples,
+                                                   const juce::AudioIODeviceCallbackContext& context)
+{
+    juce::ignoreUnused(context);
+    
+    const auto isWatched = deadlineWatchdog.isEnabled();
+    const auto isTimed = performanceMonitor.isEnabled() || isWatched;
+    const auto start = isTimed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    
+    if (isWatched)
+        deadlineWatchdog.beginBlock(numSamples, sampleRate);
+    
+    const RealtimeSafetyMonitor::ScopedWatch watch(RealtimeSafetyMonitor::engineSlot);
+    const auto suspended = renderingSuspended.load(std::memory_order_acquire);
+    
+    // Take the MIDI that arrived during the last block's worth of time, even if it goes unheard
+    const auto blockTime = juce::Time::getMillisecondCounterHiRes() * 0.001;
+    midiInputPorts.popBlock(incomingMidi, blockTime, sampleRate, numSamples);
+    midiInputQuantizer.processBlock(incomingMidi, sampleRate, numSamples, deviceOutputLatency);
+    midiRecorder.recordBlock(incomingMidi, playHead.getPosition()->getTimeInSamples().orFallback(0), sampleRate, numSamples);
+    
+    // Once faded out, stay silent and leave the plan alone until reconfiguration is done
+    if (suspended && outputGain <= 0.0f)
     {
-        for (int channel = 0; channel < numInputChannels && channel < numOutputChannels; ++channel)
-            if (inputChannelData[channel] != nullptr && outputChannelData[channel] != nullptr)
-                juce::FloatVectorOperations::copy(outputChannelData[channel], 
-                                                 inputChannelData[channel], 
-                                                 numSamples);
+        for (int channel = 0; channel < numOutputChannels; ++channel)
+            if (outputChannelData[channel])
+                juce::FloatVectorOperations::clear(outputChannelData[channel], numSamples);
+        
+        suspendAcknowledged.store(true, std::memory_order_release);
+    }
+    else if (auto* plan = renderPlans.acquire())
+    {
+        // Pick up the newest plan at the block boundary; this never blocks or allocates
+        blockArena.reset();
+        outgoingMidi.clear();
+        plan->process(inputChannelData, numInputChannels, outputChannelData, numOutputChannels, numSamples,
+                      incomingMidi, outgoingMidi, playHead.getLatestTimeInSamples(), blockArena);
+        
+        // Outgoing MIDI is due when this block's audio is heard
+        if (! outgoingMidi.isEmpty())
+        {
+            const auto delaySamples = deviceOutputLatency + plan->getMidiOutputDelaySamples();
+            midiOutputQueue.pushBlock(outgoingMidi, blockTime + delaySamples / sampleRate, sampleRate);
+        }
+        
+        playHead.advance(numSamples, sampleRate);
+        applyOutputFade(outputChannelData, numOutputChannels, numSamples, suspended);
+    }
+    else
+    {
+        // Clear output buffers
+        for (int channel = 0; channel < numOutputChannels; ++channel)
+            if (outputChannelData[channel])
+                juce::FloatVectorOperations::clear(outputChannelData[channel], numSamples);
     }
     
-    // Create MIDI buffer
-    juce::MidiBuffer midiBuffer;
-    
-    // Process audio through the graph
-    // Older versions of JUCE used a different API for processing
-    processorGraph.processBlock(buffer, midiBuffer);
+    if (isTimed)
+    {
+        const auto end = std::chrono::steady_clock::now();
+        
+        if (performanceMonitor.isEnabled())
+            performanceMonitor.recordCallback(start, end, numSamples, sampleRate);
+        
+        if (isWatched)
+            deadlineWatchdog.recordCallback(end - start);
+    }
 }
 
 void AudioEngine::audioDeviceAboutToStart(juce::AudioIODevice* device)
 {
     sampleRate = device->getCurrentSampleRate();
     bufferSize = device->getCurrentBufferSizeSamples();
+    numInputChannels = device->getActiveInputChannels().countNumberOfSetBits();
+    numOutputChannels = device->getActiveOutputChannels().countNumberOfSetBits();
+    deviceOutputLatency = device->getOutputLatencyInSamples();
     
-    processorGraph.setPlayConfigDetails(2, 2, sampleRate, bufferSize);
-    processorGraph.prepareToPlay(sampleRate, bufferSize);
+    // reconfigure() prepares everything once the device is running, while the callback is silent
+    if (reconfiguring)
+    {
+        // Restarted while the plugins were being prepared for the old settings
+        if (preparingInBackground)
+            prepareAgain = true;
+        
+        audioCallbackActive = true;
+        return;
+    }
+    
+    prepareAllNodes();
+    rebuildRenderPlan();
+    audioCallbackActive = true;
+    updateAnticipativeRenderer();
 }
 
 void AudioEngine::audioDeviceStopped()
 {
-    processorGraph.releaseResources();
-}
\ No newline at end of file
+    audioCallbackActive = false;
+    updateAnticipativeRenderer();
+    
+    // Plugins are about to be prepared again anyway
+    if (!reconfiguring)
+        releaseAllNodes();
+    
+    collectRetiredPlans(true);
+}
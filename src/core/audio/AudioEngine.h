@@ -2,11 +2,27 @@
 
 #include <juce_audio_devices/juce_audio_devices.h>
 #include <juce_audio_processors/juce_audio_processors.h>
+#include "AnticipativeRenderer.h"
+#include "DeadlineWatchdog.h"
+#include "EnginePlayHead.h"
+#include "PerformanceMonitor.h"
+#include "RenderPlan.h"
+#include "VirtualAudioDevice.h"
+#include "../midi/MidiInputPorts.h"
+#include "../midi/MidiInputQuantizer.h"
+#include "../midi/MidiOutputQueue.h"
+#include "../midi/MidiRecorder.h"
+#include "../midi/MidiRoutingTable.h"
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <functional>
+#include <map>
 
-class AudioEngine : public juce::AudioIODeviceCallback
+class AudioEngine : public juce::AudioIODeviceCallback,
+                    private juce::AudioProcessorListener,
+                    private juce::AsyncUpdater,
+                    private juce::Timer
 {
 public:
     AudioEngine();
@@ -21,13 +37,18 @@ public:
 
     // Get the current buffer size
     int getBufferSize() const;
+    
+    // Number of active device channels, which is what the graph's I/O nodes offer
+    int getNumInputChannels() const { return numInputChannels; }
+    int getNumOutputChannels() const { return numOutputChannels; }
 
     // AudioIODeviceCallback implementation
-    void audioDeviceIOCallback(const float** inputChannelData,
-                              int numInputChannels,
-                              float** outputChannelData,
-                              int numOutputChannels,
-                              int numSamples);
+    void audioDeviceIOCallbackWithContext(const float* const* inputChannelData,
+                                          int numInputChannels,
+                                          float* const* outputChannelData,
+                                          int numOutputChannels,
+                                          int numSamples,
+                                          const juce::AudioIODeviceCallbackContext& context) override;
 
     void audioDeviceAboutToStart(juce::AudioIODevice* device) override;
     void audioDeviceStopped() override;
@@ -35,6 +56,18 @@ public:
     // Audio device management
     juce::StringArray getAvailableAudioDevices() const;
     bool setAudioDevice(int deviceIndex, int inputChannels, int outputChannels);
+    
+    // Change the sample rate and buffer size of the current device. While running, the
+    // output fades out, plugins are re-prepared in parallel and the output fades back in.
+    bool setAudioSettings(double newSampleRate, int newBufferSize);
+    
+    // Switch to the built-in virtual device, which needs no sound hardware.
+    // The engine falls back to it when no hardware device can be opened.
+    bool useVirtualAudioDevice(const VirtualAudioIODevice::Settings& settings);
+    bool isUsingVirtualAudioDevice() const;
+    
+    // Dropouts reported by the current device, or -1 if it can't tell
+    int getXRunCount() const;
 
     // Plugin management in the audio graph
     using NodeID = juce::AudioProcessorGraph::NodeID;
@@ -42,15 +75,150 @@ public:
     // Add a plugin processor to the graph
     NodeID addPluginProcessor(std::unique_ptr<juce::AudioPluginInstance> processor);
     
-    // Connect nodes in the graph
+    // Wire a node's main input and output buses to the device, one channel each,
+    // as far as both sides have channels
+    void connectToAudioIO(NodeID nodeID);
+    
+    // Connect nodes in the graph (connections that would create a feedback loop are refused)
     bool connectNodes(NodeID sourceNodeID, int sourceChannelIndex, 
                      NodeID destinationNodeID, int destinationChannelIndex);
                      
     // Remove a plugin from the graph
     bool removePlugin(NodeID nodeID);
     
-    // Get access to the processor graph
+    // Get access to the processor graph. After editing it directly, call rebuildRenderPlan().
     juce::AudioProcessorGraph& getProcessorGraph();
+
+    // Compile the current graph topology and hand it to the audio thread at the next block
+    void rebuildRenderPlan();
+    
+    // Render nodes that no live input reaches ahead of time on a background thread, in
+    // blocks of anticipativeBlockSize, so that only live nodes run in the callback.
+    // Changing this restarts the device, as plugins must be prepared for larger blocks.
+    void setAnticipativeRenderingEnabled(bool shouldBeEnabled, int anticipativeBlockSize = 2048);
+    bool isAnticipativeRenderingEnabled() const { return anticipativeRenderingEnabled; }
+    
+    // Keep a node (an armed track, say) and everything downstream of it in the callback
+    void setNodeLive(NodeID nodeID, bool shouldBeLive);
+    
+    // Blocks in which anticipated audio wasn't ready in time
+    uint64_t getNumAnticipationUnderruns() const;
+    
+    // Process plugins that support it in double precision. Float-only plugins keep
+    // running in single precision, with conversions only where the two meet.
+    // Changing this re-prepares every plugin behind a short fade.
+    void setDoublePrecisionProcessingEnabled(bool shouldBeEnabled);
+    bool isDoublePrecisionProcessingEnabled() const { return doublePrecisionEnabled; }
+    
+    // Override the engine-wide precision for one node, to run a single chain in double precision
+    void setNodeDoublePrecision(NodeID nodeID, bool shouldUseDoublePrecision);
+    
+    // Skip nodes whose inputs have been silent for longer than their tail length, with
+    // no MIDI coming in, until something arrives again. On by default; the blocks each
+    // node slept through are in the performance report.
+    void setSilentNodeSleepEnabled(bool shouldBeEnabled);
+    bool isSilentNodeSleepEnabled() const { return silentNodeSleepEnabled; }
+    
+    // Keep a node awake regardless, for plugins that make sound from silence
+    void setNodeNeverSleeps(NodeID nodeID, bool shouldNeverSleep);
+    
+    // Quarantine plugins that keep overrunning the block deadline: after maxViolations
+    // blocks in which a plugin took longer than fractionOfBlock of the block, it is no
+    // longer called and its input is passed through, delayed by its latency, instead.
+    // One violation is forgotten every violationDecaySeconds, so only overruns close
+    // together count. Off by default; the budget is the whole block, three violations
+    // and ten seconds.
+    void setDeadlineWatchdogEnabled(bool shouldBeEnabled);
+    bool isDeadlineWatchdogEnabled() const;
+    void setDeadlineWatchdogLimits(double fractionOfBlock, int maxViolations, double violationDecaySeconds = 10.0);
+    
+    struct QuarantineEvent
+    {
+        NodeID nodeID;
+        juce::String name;
+        uint64_t numViolations = 0;
+        double worstMicros = 0.0;
+        double budgetMicros = 0.0;
+        juce::File traceFile;   // timing trace of the blocks either side of it, if it could be written
+    };
+    
+    // Called on the message thread when a plugin is quarantined
+    void setQuarantineCallback(std::function<void(const QuarantineEvent&)> callback);
+    
+    bool isNodeQuarantined(NodeID nodeID) const;
+    
+    // Let a quarantined plugin run again, with a clean record
+    void releaseFromQuarantine(NodeID nodeID);
+    
+    // Write a node's recent timings, alongside the callback's and every other node's, as JSON
+    bool writeTimingTrace(NodeID nodeID, const juce::File& file);
+    
+    // Latency through the graph from the input node to the output node, after
+    // delay compensation. Updated whenever a plugin reports a new latency.
+    int getGraphLatencySamples() const;
+    
+    // Latency of one node's output relative to the input node, or -1 if it isn't rendered
+    int getNodeLatencySamples(NodeID nodeID) const;
+    
+    // Graph latency plus the device's own input and output latency
+    int getTotalLatencySamples() const;
+    
+    // Number of worker threads rendering independent graph branches alongside the
+    // audio thread. 0 renders serially; the default is one per spare physical core.
+    void setNumRenderThreads(int numThreads);
+    int getNumRenderThreads() const;
+    
+    // Graphs with fewer plugin nodes than this are always rendered serially
+    void setParallelRenderingThreshold(int minNumNodes);
+    
+    // Number of parallel-rendered blocks that finished after their deadline
+    uint64_t getNumRenderDeadlineMisses() const;
+    
+    // Count heap allocations, frees and mutex waits made while rendering audio,
+    // per node. Only available in builds with VSTLINKHOST_RT_SAFETY_CHECKS.
+    void setRealtimeSafetyChecksEnabled(bool shouldBeEnabled);
+    bool areRealtimeSafetyChecksEnabled() const;
+    
+    struct RealtimeSafetyReport
+    {
+        NodeID nodeID;          // invalid for work done by the engine outside of any node
+        juce::String name;
+        RealtimeSafetyMonitor::Counts counts;
+    };
+    
+    // Nodes that allocated, freed or waited on a lock on the audio thread since the last reset
+    std::vector<RealtimeSafetyReport> getRealtimeSafetyReport() const;
+    void resetRealtimeSafetyCounters();
+    
+    // Timing of the audio callback and of every node, gathered without touching the audio thread
+    void setPerformanceMonitoringEnabled(bool shouldBeEnabled);
+    bool isPerformanceMonitoringEnabled() const;
+    
+    struct NodePerformance
+    {
+        NodeID nodeID;
+        juce::String name;
+        PerformanceMonitor::Stats stats;
+    };
+    
+    struct PerformanceReport
+    {
+        PerformanceMonitor::Stats callback;
+        std::vector<NodePerformance> nodes;
+        double deadlineMicros = 0.0;
+        
+        int deviceXRuns = -1;           // as reported by the device, -1 if it can't tell
+        uint64_t overruns = 0;          // callbacks that took longer than their block
+        uint64_t lateCallbacks = 0;     // callbacks that started over half a block late
+        uint64_t droppedRecords = 0;
+    };
+    
+    // Statistics since the last reset (message thread only)
+    PerformanceReport getPerformanceReport();
+    void resetPerformanceStats();
+    
+    // Write the current report to a JSON file, for collecting metrics from test runs
+    bool writePerformanceReport(const juce::File& file);
     
     // Clear all plugins from the graph
     void clearPlugins();
@@ -61,18 +229,186 @@ public:
     
     // Get the audio device manager
     juce::AudioDeviceManager& getDeviceManager() { return *deviceManager; }
+    
+    // Get the play head shared by all processors in the graph
+    EnginePlayHead& getPlayHead() { return playHead; }
+    
+    // Incoming MIDI, one queue per input device. MidiManager pushes into them from the
+    // devices' threads and each callback takes what arrived during the block before,
+    // sample-accurately, for the graph's MIDI input node and the routing table.
+    MidiInputPorts& getMidiInputPorts() { return midiInputPorts; }
+    
+    // How far incoming MIDI landed from where its timestamps said
+    MidiInputQueue::TimingStats getMidiInputTimingStats() const { return midiInputPorts.getTimingStats(); }
+    
+    // Holds incoming MIDI from chosen ports until the next line of a grid on the Link
+    // session, before the graph, the routing table and the recorder see it
+    MidiInputQuantizer& getMidiInputQuantizer() { return midiInputQuantizer; }
+    
+    // Records everything arriving at the input ports, stamped with the play head's
+    // sample position and the Link beat; start and stop it from the message thread
+    MidiRecorder& getMidiRecorder() { return midiRecorder; }
+    
+    // MIDI reaching the graph's MIDI output node, stamped with the time the audio it
+    // goes with is heard: after the device's output latency, and delayed to match the
+    // plugin latency the audio was delayed by. MidiManager sends it on from here.
+    MidiOutputQueue& getMidiOutputQueue() { return midiOutputQueue; }
+    MidiOutputQueue::Stats getMidiOutputStats() const { return midiOutputQueue.getStats(); }
+    
+    // Send MIDI from input ports straight to nodes, as well as to the MIDI input node.
+    // Takes effect with the next render plan, without interrupting audio.
+    void setMidiRouting(std::shared_ptr<const MidiRoutingTable> table);
+    std::shared_ptr<const MidiRoutingTable> getMidiRouting() const { return midiRouting; }
+    
+    // Offline rendering: detach from the audio device and let the caller pull blocks
+    // as fast as it likes. The device is reattached by endOfflineRender(). Returns false,
+    // with the reason, if the engine can't be taken over right now.
+    bool beginOfflineRender(double offlineSampleRate, int offlineBlockSize, juce::String& errorMessage);
+    void renderOfflineBlock(const float* const* inputChannelData,
+                            int numInputChannels,
+                            float* const* outputChannelData,
+                            int numOutputChannels,
+                            int numSamples);
+    void endOfflineRender();
+    bool isRenderingOffline() const { return offlineRendering; }
 
 private:
     std::unique_ptr<juce::AudioDeviceManager> deviceManager;
+    VirtualAudioIODeviceType* virtualDeviceType = nullptr;
     juce::AudioProcessorGraph processorGraph;
+    PerformanceMonitor performanceMonitor;
+    DeadlineWatchdog deadlineWatchdog;
+    RenderPlanExchange renderPlans;
+    std::shared_ptr<RenderThreadPool> renderThreadPool;
+    
+    // Monitoring slots of removed nodes, by the first plan generation without them, to be
+    // handed back once every older plan has been freed
+    std::vector<std::pair<uint64_t, juce::uint32>> retiringNodeSlots;
+    BlockArena blockArena;
+    EnginePlayHead playHead;
+    MidiInputPorts midiInputPorts;
+    MidiInputBlock incomingMidi;
+    MidiInputQuantizer midiInputQuantizer;
+    MidiRecorder midiRecorder;
+    MidiOutputQueue midiOutputQueue;
+    juce::MidiBuffer outgoingMidi;
+    int deviceOutputLatency = 0;
+    std::shared_ptr<const MidiRoutingTable> midiRouting;
+    AnticipativeRenderer anticipativeRenderer { renderPlans, playHead };
+    bool anticipativeRenderingEnabled = false;
+    int anticipativeBlockSize = 2048;
+    bool doublePrecisionEnabled = false;
+    bool silentNodeSleepEnabled = true;
+    int parallelRenderingThreshold;
+    int graphLatencySamples = 0;
     double sampleRate;
     int bufferSize;
+    int numInputChannels = 2;
+    int numOutputChannels = 2;
     bool isRunning;
     
+    // True between audioDeviceAboutToStart and audioDeviceStopped, or while rendering offline
+    std::atomic<bool> audioCallbackActive;
+    
+    // While reconfiguring, the callback fades out and then stays silent without touching
+    // the plan or any plugin, so that they can be re-prepared behind its back
+    std::atomic<bool> renderingSuspended { false };
+    std::atomic<bool> suspendAcknowledged { false };
+    bool reconfiguring = false;
+    float outputGain = 1.0f;
+    std::unique_ptr<juce::ThreadPool> prepareThreadPool;
+    
+    // Plugins are being prepared on the pool for a reconfiguration, which handleAsyncUpdate()
+    // finishes once the last one is done; and whether the settings changed again meanwhile
+    bool preparingInBackground = false;
+    bool prepareAgain = false;
+    std::atomic<bool> backgroundPreparationDone { false };
+    
+    // Offline rendering state, and the device settings to go back to afterwards
+    bool offlineRendering = false;
+    bool wasRunningBeforeOfflineRender = false;
+    double deviceSampleRate = 44100.0;
+    int deviceBufferSize = 512;
+    juce::AudioPlayHead::PositionInfo livePlayHeadPosition;
+    
+    // Violation totals already written to the log, by node
+    std::map<juce::uint32, RealtimeSafetyMonitor::Counts> loggedViolations;
+    
     // Store node IDs for input and output nodes
     NodeID audioInputNodeID;
     NodeID audioOutputNodeID;
     
     // Callback for tempo changes
     std::function<void(double)> tempoChangeCallback;
+    
+    std::function<void(const QuarantineEvent&)> quarantineCallback;
+
+    // Add the audio input/output nodes to an empty graph
+    void createIONodes();
+
+    // Give a plugin every bus it offers if it can take them, otherwise its own default
+    // layout, and plain stereo as a last resort
+    void negotiateBusLayout(juce::AudioProcessor& processor);
+    
+    // Match the graph's I/O nodes to the device channel counts
+    void updateIOChannels();
+    
+    // Prepare a processor with the current sample rate and buffer size, in double
+    // precision if asked for and the processor supports it
+    void prepareProcessor(juce::AudioProcessor& processor, bool useDoublePrecision);
+    
+    // The same with given settings, for jobs that run while the engine's own may change
+    static void prepareProcessor(juce::AudioProcessor& processor, bool useDoublePrecision,
+                                 double preparedSampleRate, int maximumBlockSize);
+    
+    // Node property overriding the engine-wide precision for that node
+    static constexpr const char* doublePrecisionNodeProperty = "doublePrecision";
+    bool wantsDoublePrecision(const juce::AudioProcessorGraph::Node& node) const;
+    
+    // Re-prepare every node with the current settings, fading out around it if running
+    void reprepareAllNodes();
+    
+    // Fade out, apply a device change and re-prepare everything in the background, fading
+    // back in once that is done. If the callback doesn't fade out in time, nothing is
+    // changed and the old plan keeps playing.
+    bool reconfigure(const std::function<juce::String()>& changeDevice);
+    void finishReconfigure();
+    bool suspendRendering();
+    void resumeRendering();
+    
+    // Ramp the output towards silence or full level (audio thread only)
+    void applyOutputFade(float* const* outputChannelData, int numOutputChannels, int numSamples, bool fadeOut);
+    
+    // Largest block any processor may be asked to render
+    int getMaximumBlockSize() const;
+    
+    // Run the anticipative renderer if the current settings call for it
+    void updateAnticipativeRenderer();
+    
+    // Prepare every node and the per-block scratch memory for the current settings. With
+    // inBackground, this doesn't wait for plugins being prepared on other threads: it
+    // returns false while they are, and handleAsyncUpdate() is called once they're done.
+    bool prepareAllNodes(bool inBackground = false);
+    void releaseAllNodes();
+
+    // Write any new real-time safety violations to the log
+    void logRealtimeSafetyViolations();
+    
+    // The graph node whose timings and violations are charged to a slot, if any
+    juce::AudioProcessorGraph::Node* getNodeForSlot(int slot) const;
+    
+    // Log a quarantined plugin, save its timing trace and tell the UI
+    void handleQuarantine(int slot);
+    
+    // Plugins changing their latency trigger a plan rebuild on the message thread
+    void audioProcessorParameterChanged(juce::AudioProcessor*, int, float) override {}
+    void audioProcessorChanged(juce::AudioProcessor* processor, const ChangeDetails& details) override;
+    void handleAsyncUpdate() override;
+    
+    // Free render plans the audio thread has finished with, and the monitoring slots of
+    // removed nodes that only those plans still used
+    void collectRetiredPlans(bool audioCallbackStopped);
+    
+    // Periodically frees render plans the audio thread has finished with
+    void timerCallback() override;
 };
@@ -0,0 +1,68 @@
+#include "AudioRingBuffer.h"
+
+AudioRingBuffer::AudioRingBuffer(int capacity, int maxReadSize)
+    : buffer((size_t) juce::jmax(1, capacity), 0.0f),
+      output((size_t) juce::jmax(1, maxReadSize), 0.0f)
+{
+}
+
+int AudioRingBuffer::indexOf(juce::int64 position) const noexcept
+{
+    const auto capacity = (juce::int64) buffer.size();
+    return (int) (((position % capacity) + capacity) % capacity);
+}
+
+bool AudioRingBuffer::canWrite(juce::int64 position, int numSamples, juce::int64 readerPosition) const noexcept
+{
+    const auto reader = readEnd.load(std::memory_order_acquire);
+    return position + numSamples - (reader != notRead ? reader : readerPosition) <= getCapacity();
+}
+
+void AudioRingBuffer::write(const float* samples, int numSamples, juce::int64 position) noexcept
+{
+    // The timeline never runs backwards here, so a gap is the only discontinuity
+    jassert(position >= writeEnd.load(std::memory_order_relaxed));
+
+    // Nothing before a gap may be read as if it led up to this
+    if (position != writeEnd.load(std::memory_order_relaxed))
+        validStart.store(position, std::memory_order_release);
+
+    const auto start = indexOf(position);
+    const auto numFirst = juce::jmin(numSamples, getCapacity() - start);
+
+    juce::FloatVectorOperations::copy(buffer.data() + start, samples, numFirst);
+    juce::FloatVectorOperations::copy(buffer.data(), samples + numFirst, numSamples - numFirst);
+
+    writeEnd.store(position + numSamples, std::memory_order_release);
+}
+
+const float* AudioRingBuffer::read(juce::int64 position, int numSamples) noexcept
+{
+    jassert(numSamples <= getMaxReadSize());
+
+    auto* result = output.data();
+
+    // A gap is marked before anything is written after it, so this never sees new data under an old start
+    const auto end = writeEnd.load(std::memory_order_acquire);
+    const auto start = juce::jmax(validStart.load(std::memory_order_acquire), end - getCapacity());
+
+    const auto from = juce::jlimit(position, position + numSamples, start);
+    const auto to = juce::jlimit(from, position + numSamples, end);
+    const auto numReady = (int) (to - from);
+    const auto offset = (int) (from - position);
+
+    juce::FloatVectorOperations::clear(result, offset);
+
+    const auto index = indexOf(from);
+    const auto numFirst = juce::jmin(numReady, getCapacity() - index);
+    juce::FloatVectorOperations::copy(result + offset, buffer.data() + index, numFirst);
+    juce::FloatVectorOperations::copy(result + offset + numFirst, buffer.data(), numReady - numFirst);
+
+    juce::FloatVectorOperations::clear(result + offset + numReady, numSamples - offset - numReady);
+
+    if (numReady < numSamples)
+        numUnderruns.fetch_add(1, std::memory_order_relaxed);
+
+    readEnd.store(position + numSamples, std::memory_order_release);
+    return result;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <atomic>
+#include <limits>
+#include <vector>
+
+// Single-producer, single-consumer ring of samples for one channel, used to hand
+// audio rendered ahead of time on a background thread to the audio thread.
+// Samples are written and read at their position on the play head's timeline, so
+// every ring carries its audio to the same place however late it was created,
+// and a read that finds nothing still moves on. All memory is allocated up front.
+class AudioRingBuffer
+{
+public:
+    AudioRingBuffer(int capacity, int maxReadSize);
+
+    int getCapacity() const { return (int) buffer.size(); }
+    int getMaxReadSize() const { return (int) output.size(); }
+
+    // Whether numSamples more can be written at position without overwriting anything
+    // the reader hasn't had yet. Until the first read, the reader is taken to be at
+    // readerPosition (producer only).
+    bool canWrite(juce::int64 position, int numSamples, juce::int64 readerPosition) const noexcept;
+
+    // Put samples at their position on the timeline. Writing anywhere but straight
+    // after the previous write forgets what was there before (producer only).
+    void write(const float* samples, int numSamples, juce::int64 position) noexcept;
+
+    // Take the samples at a position. Any that weren't written in time are silent and an
+    // underrun is counted; either way they are gone. The result stays valid until the
+    // next read (consumer only).
+    const float* read(juce::int64 position, int numSamples) noexcept;
+
+    // Reads that found too little audio waiting
+    uint64_t getNumUnderruns() const { return numUnderruns.load(std::memory_order_relaxed); }
+
+private:
+    int indexOf(juce::int64 position) const noexcept;
+
+    std::vector<float> buffer;
+    std::vector<float> output;
+
+    // Timeline positions written so far, and where the reader has got to
+    static constexpr juce::int64 notRead = std::numeric_limits<juce::int64>::min();
+    std::atomic<juce::int64> validStart { 0 };
+    std::atomic<juce::int64> writeEnd { 0 };
+    std::atomic<juce::int64> readEnd { notRead };
+    std::atomic<uint64_t> numUnderruns { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(AudioRingBuffer)
+};
@@ -0,0 +1,43 @@
+#include "BlockArena.h"
+
+void BlockArena::prepare(size_t numBytes)
+{
+    if (numBytes != capacity)
+    {
+        storage.allocate(numBytes, false);
+        capacity = numBytes;
+    }
+
+    used = 0;
+    peakUsage = 0;
+    numFailedAllocations = 0;
+}
+
+void BlockArena::reset() noexcept
+{
+    const auto usedLastBlock = used.exchange(0, std::memory_order_relaxed);
+
+    if (usedLastBlock > peakUsage.load(std::memory_order_relaxed))
+        peakUsage.store(usedLastBlock, std::memory_order_relaxed);
+}
+
+void* BlockArena::allocateBytes(size_t numBytes, size_t alignment) noexcept
+{
+    const auto base = reinterpret_cast<uintptr_t>(storage.get());
+    auto offset = used.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+        const auto alignedStart = ((base + offset + alignment - 1) & ~(uintptr_t) (alignment - 1)) - base;
+        const auto end = alignedStart + numBytes;
+
+        if (end > capacity)
+        {
+            numFailedAllocations.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        if (used.compare_exchange_weak(offset, end, std::memory_order_relaxed))
+            return storage.get() + alignedStart;
+    }
+}
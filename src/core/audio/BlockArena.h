@@ -0,0 +1,50 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+// Bump allocator for per-block scratch memory on the audio thread, for scratch
+// whose size changes from block to block (event lists being merged). Memory is
+// reserved when the device starts and handed out until the next reset(); nothing
+// is freed individually. Allocation is wait-free, so the render worker threads
+// can share one arena with the audio thread.
+class BlockArena
+{
+public:
+    BlockArena() = default;
+
+    // Reserve the arena's memory. Not to be called while a block is being rendered.
+    void prepare(size_t numBytes);
+
+    // Start a new block, forgetting everything handed out during the previous one
+    void reset() noexcept;
+
+    // Get uninitialised storage for `count` objects, or nullptr if the arena is exhausted
+    template <typename Type>
+    Type* allocate(size_t count) noexcept
+    {
+        static_assert(std::is_trivially_destructible<Type>::value, "Arena objects are never destroyed");
+        return static_cast<Type*>(allocateBytes(count * sizeof(Type), alignof(Type)));
+    }
+
+    void* allocateBytes(size_t numBytes, size_t alignment) noexcept;
+
+    size_t getCapacity() const { return capacity; }
+
+    // Largest amount used by a single block since prepare()
+    size_t getPeakUsage() const { return peakUsage.load(std::memory_order_relaxed); }
+
+    // Requests that did not fit, and had to fall back to something slower
+    uint64_t getNumFailedAllocations() const { return numFailedAllocations.load(std::memory_order_relaxed); }
+
+private:
+    juce::HeapBlock<char> storage;
+    size_t capacity = 0;
+    std::atomic<size_t> used { 0 };
+    std::atomic<size_t> peakUsage { 0 };
+    std::atomic<uint64_t> numFailedAllocations { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(BlockArena)
+};
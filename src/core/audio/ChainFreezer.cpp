@@ -0,0 +1,611 @@
+#include "ChainFreezer.h"
+#include "AudioEngine.h"
+#include "FreezeCache.h"
+#include "FrozenChainProcessor.h"
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+namespace
+{
+    // How often the connections into frozen chains and the sample rate are checked
+    constexpr int checkIntervalMs = 500;
+
+    // 64-bit FNV-1a, to name cache files after what went into them
+    uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+        return hash;
+    }
+
+    uint64_t hashStream(const juce::MemoryOutputStream& stream)
+    {
+        return hashBytes(stream.getData(), stream.getDataSize());
+    }
+
+    // Records the tail of a chain into a cache file during the freeze render, at the
+    // play head's position
+    class CaptureProcessor : public juce::AudioPluginInstance
+    {
+    public:
+        explicit CaptureProcessor(std::shared_ptr<FreezeCache> cacheToWrite)
+            : juce::AudioPluginInstance(BusesProperties().withInput("Input",
+                                                                    juce::AudioChannelSet::canonicalChannelSet(cacheToWrite->getNumChannels()),
+                                                                    true)),
+              cache(std::move(cacheToWrite))
+        {
+        }
+
+        const juce::String getName() const override { return "Freeze capture"; }
+
+        void fillInPluginDescription(juce::PluginDescription& description) const override
+        {
+            description.name = getName();
+            description.pluginFormatName = "Internal";
+            description.numInputChannels = cache->getNumChannels();
+        }
+
+        void prepareToPlay(double, int) override {}
+        void releaseResources() override {}
+
+        void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&) override
+        {
+            if (auto* playHead = getPlayHead())
+                if (const auto position = playHead->getPosition())
+                    if (const auto timeInSamples = position->getTimeInSamples())
+                        cache->write(buffer, buffer.getNumSamples(), *timeInSamples);
+        }
+
+        using juce::AudioPluginInstance::processBlock;
+
+        bool isBusesLayoutSupported(const BusesLayout& layouts) const override
+        {
+            return layouts.getMainInputChannels() == cache->getNumChannels() && layouts.getMainOutputChannels() == 0;
+        }
+
+        double getTailLengthSeconds() const override { return 0.0; }
+        bool acceptsMidi() const override { return false; }
+        bool producesMidi() const override { return false; }
+        bool hasEditor() const override { return false; }
+        juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram(int) override {}
+        const juce::String getProgramName(int) override { return {}; }
+        void changeProgramName(int, const juce::String&) override {}
+        void getStateInformation(juce::MemoryBlock&) override {}
+        void setStateInformation(const void*, int) override {}
+
+    private:
+        // Shared, as the node can outlive the render until the engine collects old plans
+        std::shared_ptr<FreezeCache> cache;
+
+        JUCE_DECLARE_NON_COPYABLE(CaptureProcessor)
+    };
+}
+
+//==============================================================================
+// A chain that is currently frozen, and the listener that notices when it shouldn't be
+struct ChainFreezer::FrozenChain : private juce::AudioProcessorListener
+{
+    FrozenChain(ChainFreezer& ownerToNotify, std::vector<Graph::Node::Ptr> chainNodes, std::vector<Graph::Node::Ptr> nodesToWatch)
+        : owner(ownerToNotify), chain(std::move(chainNodes)), watchedNodes(std::move(nodesToWatch))
+    {
+        for (auto& node : watchedNodes)
+            node->getProcessor()->addListener(this);
+    }
+
+    ~FrozenChain() override
+    {
+        // The nodes are held on to, so their processors are still here even if the graph dropped them
+        for (auto& node : watchedNodes)
+            node->getProcessor()->removeListener(this);
+    }
+
+    std::vector<NodeID> getChainIDs() const
+    {
+        std::vector<NodeID> ids;
+
+        for (auto& node : chain)
+            ids.push_back(node->nodeID);
+
+        return ids;
+    }
+
+    bool contains(NodeID nodeID) const
+    {
+        return nodeID == streamNodeID
+            || std::any_of(chain.begin(), chain.end(), [nodeID](const Graph::Node::Ptr& node) { return node->nodeID == nodeID; });
+    }
+
+    ChainFreezer& owner;
+    const std::vector<Graph::Node::Ptr> chain;
+    const std::vector<Graph::Node::Ptr> watchedNodes;
+
+    NodeID streamNodeID;
+    juce::File cacheFile;
+    double sampleRate = 0.0;
+    uint64_t connectionFingerprint = 0;
+
+    // Set from whichever thread the change was reported on
+    std::atomic<const char*> changeReason { nullptr };
+
+private:
+    void audioProcessorParameterChanged(juce::AudioProcessor*, int, float) override
+    {
+        reportChange("a parameter changed");
+    }
+
+    void audioProcessorChanged(juce::AudioProcessor*, const juce::AudioProcessorListener::ChangeDetails& details) override
+    {
+        if (details.programChanged)
+            reportChange("the program changed");
+        else if (details.nonParameterStateChanged)
+            reportChange("a plugin's state changed");
+        else if (details.latencyChanged)
+            reportChange("a plugin's latency changed");
+    }
+
+    void reportChange(const char* reason)
+    {
+        const char* expected = nullptr;
+        changeReason.compare_exchange_strong(expected, reason);
+        owner.triggerAsyncUpdate();
+    }
+
+    JUCE_DECLARE_NON_COPYABLE(FrozenChain)
+};
+
+//==============================================================================
+ChainFreezer::ChainFreezer(AudioEngine& engineToUse)
+    : engine(engineToUse),
+      cacheDirectory(juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                         .getChildFile("VSTLinkHost")
+                         .getChildFile("Freeze"))
+{
+}
+
+ChainFreezer::~ChainFreezer()
+{
+    stopTimer();
+    cancelPendingUpdate();
+
+    while (! frozenChains.empty())
+        restore(*frozenChains.back());
+}
+
+ChainFreezer::NodeID ChainFreezer::freeze(const std::vector<NodeID>& chainIDs,
+                                          const Options& options,
+                                          juce::String& errorMessage,
+                                          OfflineRenderer::ProgressCallback progressCallback)
+{
+    auto& graph = engine.getProcessorGraph();
+    std::vector<Graph::Node::Ptr> watchedNodes;
+
+    if (! checkChain(chainIDs, errorMessage) || ! findWatchedNodes(chainIDs, watchedNodes, errorMessage))
+        return {};
+
+    if (options.lengthSeconds <= 0.0)
+    {
+        errorMessage = "Nothing to render";
+        return {};
+    }
+
+    std::vector<Graph::Node::Ptr> chain;
+    juce::StringArray names;
+
+    for (auto nodeID : chainIDs)
+    {
+        chain.push_back(graph.getNodeForId(nodeID));
+        names.add(chain.back()->getProcessor()->getName());
+    }
+
+    const auto tail = chainIDs.back();
+    const auto numChannels = chain.back()->getProcessor()->getTotalNumOutputChannels();
+    const auto sampleRate = engine.getSampleRate();
+    const auto numSamples = (int64_t) std::llround(options.lengthSeconds * sampleRate);
+
+    // Delay compensation downstream expects the chain's output this late
+    const auto latency = juce::jmax(0, engine.getNodeLatencySamples(tail));
+
+    // Name the cache after everything that went into it, so an unchanged chain finds its old one
+    juce::MemoryOutputStream key;
+    key.writeInt64((juce::int64) getContentFingerprint(watchedNodes));
+    key.writeInt64((juce::int64) getConnectionFingerprint(watchedNodes));
+    key.writeDouble(sampleRate);
+    key.writeInt64(options.startSample);
+    key.writeInt64(numSamples);
+    key.writeDouble(options.tempo);
+    key.writeDouble(options.startBeat);
+
+    for (auto nodeID : chainIDs)
+        key.writeInt((int) nodeID.uid);
+
+    const auto cacheFile = cacheDirectory.getChildFile(juce::String::toHexString((juce::int64) hashStream(key)) + ".freeze");
+    auto cache = FreezeCache::open(cacheFile);
+
+    if (cache != nullptr && cache->getNumChannels() == numChannels && cache->getNumSamples() == numSamples
+        && cache->getTimelineStart() == options.startSample && cache->getSampleRate() == sampleRate)
+    {
+        juce::Logger::writeToLog("Reusing the freeze cache for " + names.joinIntoString(" > "));
+    }
+    else
+    {
+        cache = render(tail, cacheFile, numChannels, numSamples, options, errorMessage, std::move(progressCallback));
+
+        if (cache == nullptr)
+            return {};
+    }
+
+    auto frozen = std::make_unique<FrozenChain>(*this, chain, watchedNodes);
+    frozen->cacheFile = cacheFile;
+    frozen->sampleRate = sampleRate;
+    frozen->connectionFingerprint = getConnectionFingerprint(watchedNodes);
+    frozen->streamNodeID = engine.addPluginProcessor(std::make_unique<FrozenChainProcessor>(std::move(cache),
+                                                                                            names.joinIntoString(" > "),
+                                                                                            latency));
+
+    if (frozen->streamNodeID == NodeID())
+    {
+        errorMessage = "Could not add the streaming node";
+        return {};
+    }
+
+    // The streaming node takes over the tail's audio destinations. The chain's own
+    // connections stay, so unfreezing doesn't have to put them back.
+    for (const auto& connection : graph.getConnections())
+        if (connection.source.nodeID == tail && ! connection.source.isMIDI())
+            graph.addConnection({ { frozen->streamNodeID, connection.source.channelIndex }, connection.destination },
+                                Graph::UpdateKind::none);
+
+    for (auto& node : chain)
+    {
+        node->properties.set(RenderPlan::frozenNodeProperty, true);
+        node->getProcessor()->suspendProcessing(true);
+    }
+
+    engine.rebuildRenderPlan();
+
+    const auto streamNodeID = frozen->streamNodeID;
+    frozenChains.push_back(std::move(frozen));
+
+    if (! isTimerRunning())
+        startTimer(checkIntervalMs);
+
+    juce::Logger::writeToLog("Froze " + names.joinIntoString(" > "));
+    return streamNodeID;
+}
+
+bool ChainFreezer::unfreeze(NodeID nodeID)
+{
+    if (auto* frozen = findFrozenChain(nodeID))
+    {
+        restore(*frozen);
+        return true;
+    }
+
+    return false;
+}
+
+bool ChainFreezer::isFrozen(NodeID nodeID) const
+{
+    return findFrozenChain(nodeID) != nullptr;
+}
+
+ChainFreezer::NodeID ChainFreezer::getStreamingNode(NodeID nodeID) const
+{
+    if (auto* frozen = findFrozenChain(nodeID))
+        return frozen->streamNodeID;
+
+    return {};
+}
+
+bool ChainFreezer::checkChain(const std::vector<NodeID>& chain, juce::String& errorMessage) const
+{
+    auto& graph = engine.getProcessorGraph();
+    const std::set<NodeID> members(chain.begin(), chain.end());
+
+    if (chain.empty() || members.size() != chain.size())
+    {
+        errorMessage = "A chain needs at least one node, each only once";
+        return false;
+    }
+
+    for (size_t i = 0; i < chain.size(); ++i)
+    {
+        auto* node = graph.getNodeForId(chain[i]);
+
+        if (node == nullptr || dynamic_cast<Graph::AudioGraphIOProcessor*>(node->getProcessor()) != nullptr)
+        {
+            errorMessage = "Only plugins in the graph can be frozen";
+            return false;
+        }
+
+        if (isFrozen(chain[i]))
+        {
+            errorMessage = node->getProcessor()->getName() + " is already frozen";
+            return false;
+        }
+
+        if (i + 1 == chain.size())
+            break;
+
+        if (! graph.isConnected(chain[i], chain[i + 1]))
+        {
+            errorMessage = node->getProcessor()->getName() + " doesn't feed the next node in the chain";
+            return false;
+        }
+
+        // Whatever else it fed would lose its input while the chain is frozen
+        for (const auto& connection : graph.getConnections())
+        {
+            if (connection.source.nodeID == chain[i] && members.count(connection.destination.nodeID) == 0)
+            {
+                errorMessage = node->getProcessor()->getName() + " also feeds something outside the chain";
+                return false;
+            }
+        }
+    }
+
+    if (graph.getNodeForId(chain.back())->getProcessor()->getTotalNumOutputChannels() <= 0)
+    {
+        errorMessage = "The last node in the chain has no audio output";
+        return false;
+    }
+
+    return true;
+}
+
+bool ChainFreezer::findWatchedNodes(const std::vector<NodeID>& chain,
+                                    std::vector<Graph::Node::Ptr>& watchedNodes,
+                                    juce::String& errorMessage) const
+{
+    auto& graph = engine.getProcessorGraph();
+    const auto connections = graph.getConnections();
+
+    std::set<NodeID> found(chain.begin(), chain.end());
+    std::vector<NodeID> pending(chain.begin(), chain.end());
+
+    while (! pending.empty())
+    {
+        const auto nodeID = pending.back();
+        pending.pop_back();
+
+        for (const auto& connection : connections)
+            if (connection.destination.nodeID == nodeID && found.insert(connection.source.nodeID).second)
+                pending.push_back(connection.source.nodeID);
+    }
+
+    watchedNodes.clear();
+
+    for (auto nodeID : found)
+    {
+        auto* node = graph.getNodeForId(nodeID);
+
+        if (node == nullptr)
+            continue;
+
+        // Audio or MIDI from a device can't be rendered ahead of time
+        if (dynamic_cast<Graph::AudioGraphIOProcessor*>(node->getProcessor()) != nullptr)
+        {
+            errorMessage = "The chain is fed by the device's audio or MIDI input, which can't be rendered ahead of time";
+            return false;
+        }
+
+        watchedNodes.push_back(node);
+    }
+
+    return true;
+}
+
+uint64_t ChainFreezer::getContentFingerprint(const std::vector<Graph::Node::Ptr>& watchedNodes) const
+{
+    juce::MemoryOutputStream data;
+
+    for (auto& node : watchedNodes)
+    {
+        auto* processor = node->getProcessor();
+        data.writeInt((int) node->nodeID.uid);
+
+        if (auto* plugin = dynamic_cast<juce::AudioPluginInstance*>(processor))
+            data.writeString(plugin->getPluginDescription().createIdentifierString());
+
+        juce::MemoryBlock state;
+        processor->getStateInformation(state);
+        data << state;
+
+        data.writeInt(processor->getCurrentProgram());
+
+        for (auto* parameter : processor->getParameters())
+            data.writeFloat(parameter->getValue());
+
+        data.writeInt(processor->getLatencySamples());
+    }
+
+    return hashStream(data);
+}
+
+uint64_t ChainFreezer::getConnectionFingerprint(const std::vector<Graph::Node::Ptr>& watchedNodes) const
+{
+    std::set<NodeID> watched;
+
+    for (auto& node : watchedNodes)
+        watched.insert(node->nodeID);
+
+    juce::MemoryOutputStream data;
+
+    // getConnections() comes sorted, so the same connections always hash the same
+    for (const auto& connection : engine.getProcessorGraph().getConnections())
+    {
+        if (watched.count(connection.destination.nodeID) == 0)
+            continue;
+
+        data.writeInt((int) connection.source.nodeID.uid);
+        data.writeInt(connection.source.channelIndex);
+        data.writeInt((int) connection.destination.nodeID.uid);
+        data.writeInt(connection.destination.channelIndex);
+    }
+
+    return hashStream(data);
+}
+
+std::unique_ptr<FreezeCache> ChainFreezer::render(NodeID tail,
+                                                  const juce::File& file,
+                                                  int numChannels,
+                                                  int64_t numSamples,
+                                                  const Options& options,
+                                                  juce::String& errorMessage,
+                                                  OfflineRenderer::ProgressCallback progressCallback)
+{
+    auto& graph = engine.getProcessorGraph();
+    const auto sampleRate = engine.getSampleRate();
+
+    std::shared_ptr<FreezeCache> writable;
+
+    if (file.getParentDirectory().createDirectory())
+        writable = FreezeCache::create(file, numChannels, options.startSample, numSamples, sampleRate);
+
+    if (writable == nullptr)
+    {
+        errorMessage = "Could not create " + file.getFullPathName();
+        return nullptr;
+    }
+
+    // Tap the tail of the chain while the whole graph renders
+    const auto captureID = engine.addPluginProcessor(std::make_unique<CaptureProcessor>(writable));
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        graph.addConnection({ { tail, channel }, { captureID, channel } }, Graph::UpdateKind::none);
+
+    engine.rebuildRenderPlan();
+
+    OfflineRenderer::Options renderOptions;
+    renderOptions.sampleRate = sampleRate;
+    renderOptions.blockSize = engine.getBufferSize();
+    renderOptions.numChannels = juce::jmax(1, engine.getNumOutputChannels());
+    renderOptions.startSample = options.startSample;
+    renderOptions.lengthSeconds = (double) numSamples / sampleRate;
+    renderOptions.tempo = options.tempo;
+    renderOptions.startBeat = options.startBeat;
+
+    const auto result = OfflineRenderer(engine).render(renderOptions, std::move(progressCallback));
+    engine.removePlugin(captureID);
+
+    if (! result.success)
+    {
+        writable.reset();
+        file.deleteFile();
+        errorMessage = result.errorMessage;
+        return nullptr;
+    }
+
+    writable->markComplete();
+    writable.reset();
+
+    auto cache = FreezeCache::open(file);
+
+    if (cache == nullptr)
+        errorMessage = "Could not read back " + file.getFullPathName();
+
+    return cache;
+}
+
+ChainFreezer::FrozenChain* ChainFreezer::findFrozenChain(NodeID nodeID) const
+{
+    for (auto& frozen : frozenChains)
+        if (frozen->contains(nodeID))
+            return frozen.get();
+
+    return nullptr;
+}
+
+void ChainFreezer::restore(FrozenChain& frozen)
+{
+    engine.removePlugin(frozen.streamNodeID);
+
+    for (auto& node : frozen.chain)
+    {
+        // Start again from silence rather than wherever the plugins were when frozen
+        node->getProcessor()->reset();
+        node->properties.remove(RenderPlan::frozenNodeProperty);
+        node->getProcessor()->suspendProcessing(false);
+    }
+
+    engine.rebuildRenderPlan();
+
+    frozenChains.erase(std::find_if(frozenChains.begin(), frozenChains.end(),
+                                    [&frozen](const std::unique_ptr<FrozenChain>& f) { return f.get() == &frozen; }));
+
+    if (frozenChains.empty())
+        stopTimer();
+}
+
+void ChainFreezer::invalidate(FrozenChain& frozen, const juce::String& reason)
+{
+    const auto chain = frozen.getChainIDs();
+    const auto cacheFile = frozen.cacheFile;
+
+    restore(frozen);
+    cacheFile.deleteFile();
+
+    juce::Logger::writeToLog("Unfroze a chain because " + reason);
+
+    if (invalidationCallback)
+        invalidationCallback(chain, reason);
+}
+
+void ChainFreezer::checkFrozenChains()
+{
+    auto& graph = engine.getProcessorGraph();
+    std::vector<std::pair<FrozenChain*, juce::String>> invalidated;
+    std::vector<FrozenChain*> outOfRange;
+
+    for (auto& frozen : frozenChains)
+    {
+        const auto removed = std::any_of(frozen->watchedNodes.begin(), frozen->watchedNodes.end(),
+                                         [&graph](const Graph::Node::Ptr& node) { return graph.getNodeForId(node->nodeID) != node.get(); });
+
+        if (auto* reason = frozen->changeReason.load())
+            invalidated.push_back({ frozen.get(), reason });
+        else if (removed || graph.getNodeForId(frozen->streamNodeID) == nullptr)
+            invalidated.push_back({ frozen.get(), "a node it depends on was removed" });
+        else if (engine.getSampleRate() != frozen->sampleRate)
+            invalidated.push_back({ frozen.get(), "the sample rate changed" });
+        else if (getConnectionFingerprint(frozen->watchedNodes) != frozen->connectionFingerprint)
+            invalidated.push_back({ frozen.get(), "its inputs were reconnected" });
+        else if (! isPlayHeadInside(*frozen))
+            outOfRange.push_back(frozen.get());
+    }
+
+    for (auto& entry : invalidated)
+        invalidate(*entry.first, entry.second);
+
+    // The plugins take over again where there is nothing rendered; the cache is still good
+    for (auto* frozen : outOfRange)
+    {
+        juce::Logger::writeToLog("Unfroze a chain because the play head left its frozen audio");
+        restore(*frozen);
+    }
+}
+
+bool ChainFreezer::isPlayHeadInside(const FrozenChain& frozen) const
+{
+    auto* node = engine.getProcessorGraph().getNodeForId(frozen.streamNodeID);
+    auto* streaming = node != nullptr ? dynamic_cast<FrozenChainProcessor*>(node->getProcessor()) : nullptr;
+
+    return streaming != nullptr && streaming->getCache().covers(engine.getPlayHead().getLatestTimeInSamples());
+}
+
+void ChainFreezer::handleAsyncUpdate()
+{
+    checkFrozenChains();
+}
+
+void ChainFreezer::timerCallback()
+{
+    checkFrozenChains();
+}
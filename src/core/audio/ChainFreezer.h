@@ -0,0 +1,118 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "OfflineRenderer.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class AudioEngine;
+class FreezeCache;
+
+// Freezes chains of plugins: the chain is rendered offline through the engine into
+// a memory-mapped cache file, and replaced in the render plan by a node that plays
+// the cache back. The plugins stay in the graph, suspended, so unfreezing only has
+// to swap them back in.
+//
+// The cache holds a stretch of the play head's timeline. Anything live can't be
+// rendered ahead of time, so a chain fed by the device's audio or MIDI input, say a
+// synth played from a keyboard, can't be frozen.
+//
+// A frozen chain is watched for anything that would change what it renders: a
+// parameter, program or state change in the chain or in anything feeding it, a
+// change to the connections into it, or a new sample rate. Any of these unfreezes
+// it and throws its cache away. It is also unfrozen, keeping the cache, once the
+// play head leaves the stretch that was rendered. Caches are named after a
+// fingerprint of all of that, so freezing an unchanged chain again reuses the one
+// already on disk.
+class ChainFreezer : private juce::AsyncUpdater,
+                     private juce::Timer
+{
+public:
+    using NodeID = juce::AudioProcessorGraph::NodeID;
+
+    struct Options
+    {
+        // Timeline rendered into the cache: lengthSeconds from startSample on the play
+        // head, with startBeat and tempo for its musical position
+        juce::int64 startSample = 0;
+        double lengthSeconds = 60.0;
+        double tempo = 120.0;
+        double startBeat = 0.0;
+    };
+
+    explicit ChainFreezer(AudioEngine& engine);
+
+    // Unfreezes everything still frozen
+    ~ChainFreezer() override;
+
+    // Freeze a chain given in signal order. Each node must feed the next, and only the
+    // last may feed anything outside the chain; nothing feeding the chain may be a live
+    // device input. Blocks while rendering, with the device detached as for
+    // OfflineRenderer. Returns the streaming node, or an invalid ID and the reason.
+    NodeID freeze(const std::vector<NodeID>& chain,
+                  const Options& options,
+                  juce::String& errorMessage,
+                  OfflineRenderer::ProgressCallback progressCallback = nullptr);
+
+    // Put a frozen chain back, given any node in it or its streaming node. The cache
+    // stays on disk for the next freeze.
+    bool unfreeze(NodeID nodeID);
+
+    bool isFrozen(NodeID nodeID) const;
+
+    // The streaming node standing in for a node's chain, or an invalid ID
+    NodeID getStreamingNode(NodeID nodeID) const;
+
+    // Where cache files are kept
+    void setCacheDirectory(const juce::File& directory) { cacheDirectory = directory; }
+    const juce::File& getCacheDirectory() const { return cacheDirectory; }
+
+    // Called on the message thread after a chain was unfrozen because something it
+    // depends on changed, with the chain so that it can be frozen again
+    using InvalidationCallback = std::function<void(const std::vector<NodeID>& chain, const juce::String& reason)>;
+    void setInvalidationCallback(InvalidationCallback callback) { invalidationCallback = std::move(callback); }
+
+private:
+    using Graph = juce::AudioProcessorGraph;
+
+    struct FrozenChain;
+
+    bool checkChain(const std::vector<NodeID>& chain, juce::String& errorMessage) const;
+
+    // The chain and every node feeding it, directly or not
+    bool findWatchedNodes(const std::vector<NodeID>& chain,
+                          std::vector<Graph::Node::Ptr>& watchedNodes,
+                          juce::String& errorMessage) const;
+
+    // Everything the rendered audio depends on, other than the connections
+    uint64_t getContentFingerprint(const std::vector<Graph::Node::Ptr>& watchedNodes) const;
+
+    // The connections into the watched nodes
+    uint64_t getConnectionFingerprint(const std::vector<Graph::Node::Ptr>& watchedNodes) const;
+
+    std::unique_ptr<FreezeCache> render(NodeID tail,
+                                        const juce::File& file,
+                                        int numChannels,
+                                        int64_t numSamples,
+                                        const Options& options,
+                                        juce::String& errorMessage,
+                                        OfflineRenderer::ProgressCallback progressCallback);
+
+    FrozenChain* findFrozenChain(NodeID nodeID) const;
+    void restore(FrozenChain& frozen);
+    void invalidate(FrozenChain& frozen, const juce::String& reason);
+    void checkFrozenChains();
+    bool isPlayHeadInside(const FrozenChain& frozen) const;
+
+    void handleAsyncUpdate() override;
+    void timerCallback() override;
+
+    AudioEngine& engine;
+    juce::File cacheDirectory;
+    std::vector<std::unique_ptr<FrozenChain>> frozenChains;
+    InvalidationCallback invalidationCallback;
+
+    JUCE_DECLARE_NON_COPYABLE(ChainFreezer)
+};
@@ -0,0 +1,287 @@
+#include "DeadlineWatchdog.h"
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+    uint32_t toNanos(std::chrono::steady_clock::duration duration) noexcept
+    {
+        const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        return (uint32_t) juce::jlimit<int64_t>(0, std::numeric_limits<uint32_t>::max(), nanos);
+    }
+
+    int64_t getNowNanos() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // How long a node's report waits for blocks after its quarantine, in case they stop coming
+    constexpr juce::int64 maxReportDelayMillis = 2000;
+}
+
+DeadlineWatchdog::DeadlineWatchdog()
+{
+    slots.reserve((size_t) maxSlots);
+
+    for (int i = 0; i < maxSlots; ++i)
+        slots.push_back(std::make_unique<Slot>());
+
+    startTimer(100);
+}
+
+DeadlineWatchdog::~DeadlineWatchdog()
+{
+    stopTimer();
+}
+
+void DeadlineWatchdog::setEnabled(bool shouldBeEnabled)
+{
+    enabled = shouldBeEnabled;
+}
+
+void DeadlineWatchdog::setBudget(double fractionOfBlock)
+{
+    budget = juce::jmax(0.01, fractionOfBlock);
+}
+
+void DeadlineWatchdog::setMaxViolations(int numViolations)
+{
+    maxViolations = juce::jmax(1, numViolations);
+}
+
+void DeadlineWatchdog::setViolationDecay(double seconds)
+{
+    violationDecaySeconds = juce::jmax(0.001, seconds);
+}
+
+void DeadlineWatchdog::beginBlock(int numSamples, double sampleRate) noexcept
+{
+    // Block numbers start at 1, so that a zero trace entry means "never written"
+    currentBlock.fetch_add(1, std::memory_order_relaxed);
+    nanosPerSample.store(sampleRate > 0.0 ? 1.0e9 / sampleRate : 0.0, std::memory_order_relaxed);
+    blockSize.store(numSamples, std::memory_order_relaxed);
+}
+
+void DeadlineWatchdog::recordCallback(std::chrono::steady_clock::duration duration) noexcept
+{
+    record(*slots[(size_t) callbackSlot], toNanos(duration));
+}
+
+void DeadlineWatchdog::recordNode(int slot, std::chrono::steady_clock::duration duration, int numSamples) noexcept
+{
+    if (! isEnabled() || slot == callbackSlot || ! juce::isPositiveAndBelow(slot, maxSlots))
+        return;
+
+    auto& target = *slots[(size_t) slot];
+    const auto nanos = toNanos(duration);
+    record(target, nanos);
+
+    // A node is only ever rendered by one thread at a time
+    if (nanos > target.worstNanos.load(std::memory_order_relaxed))
+        target.worstNanos.store(nanos, std::memory_order_relaxed);
+
+    const auto budgetNanos = getBudget() * nanosPerSample.load(std::memory_order_relaxed) * numSamples;
+
+    if (budgetNanos <= 0.0 || nanos <= budgetNanos)
+        return;
+
+    // Violations are rare, so the clock is only read for them
+    const auto now = getNowNanos();
+    const auto numViolations = getDecayedViolations(target, now) + 1;
+    target.numViolations.store(numViolations, std::memory_order_relaxed);
+    target.lastViolationNanos.store(now, std::memory_order_relaxed);
+
+    if (numViolations >= (uint64_t) getMaxViolations())
+    {
+        target.quarantineBlock.store(currentBlock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        target.quarantined.store(true, std::memory_order_release);
+    }
+}
+
+uint64_t DeadlineWatchdog::getDecayedViolations(const Slot& slot, int64_t nowNanos) const noexcept
+{
+    const auto numViolations = slot.numViolations.load(std::memory_order_relaxed);
+
+    // A quarantined node keeps the record that put it there
+    if (numViolations == 0 || slot.quarantined.load(std::memory_order_acquire))
+        return numViolations;
+
+    const auto elapsedSeconds = (double) (nowNanos - slot.lastViolationNanos.load(std::memory_order_relaxed)) * 1.0e-9;
+    const auto numForgotten = (uint64_t) juce::jmax(0.0, elapsedSeconds / getViolationDecay());
+
+    return numForgotten < numViolations ? numViolations - numForgotten : 0;
+}
+
+bool DeadlineWatchdog::isQuarantined(int slot) const noexcept
+{
+    return slot != callbackSlot
+        && juce::isPositiveAndBelow(slot, maxSlots)
+        && slots[(size_t) slot]->quarantined.load(std::memory_order_acquire);
+}
+
+void DeadlineWatchdog::release(int slot)
+{
+    if (slot == callbackSlot || ! juce::isPositiveAndBelow(slot, maxSlots))
+        return;
+
+    auto& target = *slots[(size_t) slot];
+    target.numViolations = 0;
+    target.lastViolationNanos = 0;
+    target.worstNanos = 0;
+    target.quarantineBlock = 0;
+    target.reported = false;
+    target.quarantineSeenMillis = 0;
+    target.reportedTrace = {};
+    target.quarantined.store(false, std::memory_order_release);
+}
+
+void DeadlineWatchdog::resetSlot(int slot)
+{
+    if (slot == callbackSlot || ! juce::isPositiveAndBelow(slot, maxSlots))
+        return;
+
+    release(slot);
+
+    auto& target = *slots[(size_t) slot];
+
+    for (auto& entry : target.trace)
+        entry.store(0, std::memory_order_relaxed);
+
+    target.nextEntry.store(0, std::memory_order_release);
+}
+
+uint64_t DeadlineWatchdog::getNumViolations(int slot) const
+{
+    if (! juce::isPositiveAndBelow(slot, maxSlots))
+        return 0;
+
+    return getDecayedViolations(*slots[(size_t) slot], getNowNanos());
+}
+
+DeadlineWatchdog::Trace DeadlineWatchdog::getTrace(int slot) const
+{
+    if (slot == callbackSlot || ! juce::isPositiveAndBelow(slot, maxSlots))
+        return {};
+
+    // The blocks around the quarantine have long been overwritten by the time anyone asks
+    const auto& target = *slots[(size_t) slot];
+
+    if (target.reported && target.quarantined.load(std::memory_order_acquire))
+        return target.reportedTrace;
+
+    return captureTrace(slot);
+}
+
+DeadlineWatchdog::Trace DeadlineWatchdog::captureTrace(int slot) const
+{
+    Trace trace;
+    const auto& target = *slots[(size_t) slot];
+    trace.slot = slot;
+    trace.numViolations = getDecayedViolations(target, getNowNanos());
+    trace.worstMicros = target.worstNanos.load(std::memory_order_relaxed) / 1000.0;
+    trace.node = readTrace(target);
+
+    trace.budgetMicros = getBudget() * nanosPerSample.load(std::memory_order_relaxed)
+                       * blockSize.load(std::memory_order_relaxed) / 1000.0;
+
+    if (trace.node.empty())
+        return trace;
+
+    // Pick out what else happened in the same blocks, and after the quarantine, when
+    // the node's own trace stops
+    const auto firstBlock = trace.node.front().block;
+    auto lastBlock = trace.node.back().block;
+
+    if (target.quarantined.load(std::memory_order_acquire))
+    {
+        trace.quarantineBlock = target.quarantineBlock.load(std::memory_order_relaxed);
+        lastBlock = juce::jmax(lastBlock, trace.quarantineBlock + (uint32_t) blocksAfterQuarantine);
+    }
+
+    auto inWindow = [firstBlock, lastBlock](std::vector<TraceEntry> entries)
+    {
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [firstBlock, lastBlock](const TraceEntry& entry)
+                                     {
+                                         return entry.block < firstBlock || entry.block > lastBlock;
+                                     }),
+                      entries.end());
+        return entries;
+    };
+
+    trace.callback = inWindow(readTrace(*slots[(size_t) callbackSlot]));
+
+    for (int other = callbackSlot + 1; other < maxSlots; ++other)
+    {
+        if (other == slot)
+            continue;
+
+        auto entries = inWindow(readTrace(*slots[(size_t) other]));
+
+        if (! entries.empty())
+            trace.otherNodes[other] = std::move(entries);
+    }
+
+    return trace;
+}
+
+void DeadlineWatchdog::record(Slot& slot, uint32_t nanos) noexcept
+{
+    const auto block = (uint64_t) currentBlock.load(std::memory_order_relaxed);
+    const auto index = slot.nextEntry.load(std::memory_order_relaxed);
+
+    slot.trace[(size_t) (index % traceLength)].store((block << 32) | nanos, std::memory_order_relaxed);
+    slot.nextEntry.store(index + 1, std::memory_order_release);
+}
+
+std::vector<DeadlineWatchdog::TraceEntry> DeadlineWatchdog::readTrace(const Slot& slot) const
+{
+    std::vector<TraceEntry> entries;
+    entries.reserve((size_t) traceLength);
+
+    // Oldest first. Entries can be overwritten while this runs, but each one is read whole.
+    const auto next = slot.nextEntry.load(std::memory_order_acquire);
+
+    for (uint32_t i = 0; i < (uint32_t) traceLength; ++i)
+    {
+        const auto packed = slot.trace[(size_t) ((next + i) % traceLength)].load(std::memory_order_relaxed);
+
+        if (packed != 0)
+            entries.push_back({ (uint32_t) (packed >> 32), (uint32_t) packed / 1000.0 });
+    }
+
+    std::stable_sort(entries.begin(), entries.end(), [](const TraceEntry& a, const TraceEntry& b)
+    {
+        return a.block < b.block;
+    });
+
+    return entries;
+}
+
+void DeadlineWatchdog::timerCallback()
+{
+    for (int slot = callbackSlot + 1; slot < maxSlots; ++slot)
+    {
+        auto& target = *slots[(size_t) slot];
+
+        if (target.reported || ! target.quarantined.load(std::memory_order_acquire))
+            continue;
+
+        // Hold the report back until the trace shows the blocks after the quarantine too,
+        // unless the blocks have stopped coming
+        const auto now = juce::Time::currentTimeMillis();
+
+        if (target.quarantineSeenMillis == 0)
+            target.quarantineSeenMillis = now;
+
+        const auto blocksSince = currentBlock.load(std::memory_order_relaxed) - target.quarantineBlock.load(std::memory_order_relaxed);
+
+        if (blocksSince < (uint32_t) blocksAfterQuarantine && now - target.quarantineSeenMillis < maxReportDelayMillis)
+            continue;
+
+        target.reportedTrace = captureTrace(slot);
+        target.reported = true;
+
+        if (quarantineCallback != nullptr)
+            quarantineCallback(slot);
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <juce_events/juce_events.h>
+#include "RealtimeSafetyMonitor.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+// Watches each node's processing time against the block deadline. A node that
+// takes longer than its budget too many times in close succession is quarantined:
+// the render plan stops calling it and passes its input through a latency-matched
+// dry path instead, until it is released on the message thread. Violations leak
+// away over time, so that occasional overruns never add up to a quarantine.
+//
+// The last few timings of every node are kept, so that each quarantine comes
+// with a trace of the blocks either side of it. Nodes use the slots that
+// RealtimeSafetyMonitor hands out; slot 0 holds the whole callback.
+class DeadlineWatchdog : private juce::Timer
+{
+public:
+    static constexpr int callbackSlot = RealtimeSafetyMonitor::engineSlot;
+    static constexpr int maxSlots = RealtimeSafetyMonitor::maxSlots;
+    static constexpr int traceLength = 128;
+
+    // Blocks after a quarantine that its trace waits for, to show what it changed
+    static constexpr int blocksAfterQuarantine = traceLength / 2;
+
+    // One block's timing in a trace
+    struct TraceEntry
+    {
+        uint32_t block;
+        double micros;
+    };
+
+    struct Trace
+    {
+        int slot = -1;
+        uint64_t numViolations = 0;
+        double budgetMicros = 0.0;
+        double worstMicros = 0.0;
+
+        // Block in which the node was quarantined, or 0 if it isn't
+        uint32_t quarantineBlock = 0;
+
+        // The node's last blocks, oldest first, and what the whole callback and every
+        // other node took from the first of them until a while after the quarantine
+        std::vector<TraceEntry> node;
+        std::vector<TraceEntry> callback;
+        std::map<int, std::vector<TraceEntry>> otherNodes;
+    };
+
+    DeadlineWatchdog();
+    ~DeadlineWatchdog() override;
+
+    // Start or stop checking. Checking is off by default; nodes stay quarantined when it is switched off.
+    void setEnabled(bool shouldBeEnabled);
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // A node violates its deadline when it takes longer than this fraction of a block
+    void setBudget(double fractionOfBlock);
+    double getBudget() const { return budget.load(std::memory_order_relaxed); }
+
+    // Number of violations after which a node is quarantined
+    void setMaxViolations(int numViolations);
+    int getMaxViolations() const { return maxViolations.load(std::memory_order_relaxed); }
+
+    // One of a node's violations is forgotten for every this many seconds that go by
+    void setViolationDecay(double seconds);
+    double getViolationDecay() const { return violationDecaySeconds.load(std::memory_order_relaxed); }
+
+    // Start timing a new device block (audio thread only)
+    void beginBlock(int numSamples, double sampleRate) noexcept;
+
+    // Record how long the whole callback took (audio thread only)
+    void recordCallback(std::chrono::steady_clock::duration duration) noexcept;
+
+    // Record how long a node took to render numSamples, and quarantine it if it has
+    // overrun its budget too often (audio or render worker thread)
+    void recordNode(int slot, std::chrono::steady_clock::duration duration, int numSamples) noexcept;
+
+    bool isQuarantined(int slot) const noexcept;
+
+    // Let a node run again, forgetting its violations (message thread only)
+    void release(int slot);
+
+    // Forget everything about a slot, trace included, before it goes to another node (message thread only)
+    void resetSlot(int slot);
+
+    // A node's violations that haven't been forgotten yet
+    uint64_t getNumViolations(int slot) const;
+
+    // The trace around a node's quarantine, kept from when it was reported, or its latest
+    // timings if it isn't quarantined (message thread only)
+    Trace getTrace(int slot) const;
+
+    // Called on the message thread for each node that has been quarantined, once the
+    // blocks after it are in its trace
+    using QuarantineCallback = std::function<void(int slot)>;
+    void setQuarantineCallback(QuarantineCallback callback) { quarantineCallback = std::move(callback); }
+
+private:
+    // Each trace entry packs the block number into the top half and nanoseconds into the bottom
+    struct Slot
+    {
+        std::array<std::atomic<uint64_t>, traceLength> trace {};
+        std::atomic<uint32_t> nextEntry { 0 };
+        std::atomic<uint64_t> numViolations { 0 };
+        std::atomic<int64_t> lastViolationNanos { 0 };
+        std::atomic<uint32_t> worstNanos { 0 };
+        std::atomic<uint32_t> quarantineBlock { 0 };
+        std::atomic<bool> quarantined { false };
+
+        // Message thread only
+        bool reported = false;
+        juce::int64 quarantineSeenMillis = 0;
+        Trace reportedTrace;
+    };
+
+    void record(Slot& slot, uint32_t nanos) noexcept;
+    std::vector<TraceEntry> readTrace(const Slot& slot) const;
+    Trace captureTrace(int slot) const;
+
+    // The node's violations, less those that have leaked away since its last one
+    uint64_t getDecayedViolations(const Slot& slot, int64_t nowNanos) const noexcept;
+    void timerCallback() override;
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::atomic<bool> enabled { false };
+    std::atomic<double> budget { 1.0 };
+    std::atomic<int> maxViolations { 3 };
+    std::atomic<double> violationDecaySeconds { 10.0 };
+
+    // Set by the audio thread at the start of each block
+    std::atomic<uint32_t> currentBlock { 0 };
+    std::atomic<double> nanosPerSample { 0.0 };
+    std::atomic<int> blockSize { 0 };
+
+    QuarantineCallback quarantineCallback;
+
+    JUCE_DECLARE_NON_COPYABLE(DeadlineWatchdog)
+};
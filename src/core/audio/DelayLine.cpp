@@ -0,0 +1,59 @@
+#include "DelayLine.h"
+
+DelayLine::DelayLine(int delaySamples, int maxBlockSize)
+    : history((size_t) juce::jmax(1, delaySamples), 0.0f),
+      output((size_t) juce::jmax(1, maxBlockSize), 0.0f),
+      delay((int) history.size())
+{
+}
+
+DelayLine::DelayLine(int delaySamples, int maxBlockSize, int maxDelaySamples)
+    : history((size_t) juce::jmax(1, delaySamples, maxDelaySamples), 0.0f),
+      output((size_t) juce::jmax(1, maxBlockSize), 0.0f),
+      delay(juce::jlimit(0, getMaxDelay(), delaySamples))
+{
+}
+
+const float* DelayLine::process(const float* input, int numSamples) noexcept
+{
+    jassert(numSamples <= getMaxBlockSize());
+
+    auto* ring = history.data();
+    auto* result = output.data();
+
+    if (delay == 0)
+    {
+        juce::FloatVectorOperations::copy(result, input, numSamples);
+        return result;
+    }
+
+    // The oldest min(delay, numSamples) samples come out of the ring...
+    const auto numFromHistory = juce::jmin(delay, numSamples);
+    const auto firstPart = juce::jmin(numFromHistory, delay - position);
+
+    juce::FloatVectorOperations::copy(result, ring + position, firstPart);
+    juce::FloatVectorOperations::copy(result + firstPart, ring, numFromHistory - firstPart);
+
+    // ...followed by the start of this input when the block is longer than the delay
+    juce::FloatVectorOperations::copy(result + numFromHistory, input, numSamples - numFromHistory);
+
+    // The newest min(delay, numSamples) input samples replace what was just read
+    const auto* newest = input + (numSamples - numFromHistory);
+    juce::FloatVectorOperations::copy(ring + position, newest, firstPart);
+    juce::FloatVectorOperations::copy(ring, newest + firstPart, numFromHistory - firstPart);
+
+    position = (position + numFromHistory) % delay;
+    return result;
+}
+
+void DelayLine::setDelay(int newDelay) noexcept
+{
+    delay = juce::jlimit(0, getMaxDelay(), newDelay);
+    clear();
+}
+
+void DelayLine::clear() noexcept
+{
+    std::fill(history.begin(), history.end(), 0.0f);
+    position = 0;
+}
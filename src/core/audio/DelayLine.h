@@ -0,0 +1,38 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <vector>
+
+// A fixed integer delay for one channel of audio, used to line up signal paths
+// with different latencies. All memory is allocated up front.
+class DelayLine
+{
+public:
+    DelayLine(int delaySamples, int maxBlockSize);
+
+    // With room for delays of up to maxDelaySamples, for setDelay()
+    DelayLine(int delaySamples, int maxBlockSize, int maxDelaySamples);
+
+    int getDelay() const { return delay; }
+    int getMaxDelay() const { return (int) history.size(); }
+    int getMaxBlockSize() const { return (int) output.size(); }
+
+    // Change the delay, up to getMaxDelay(), forgetting the delayed signal. A delay
+    // of 0 passes the input straight through (audio thread only).
+    void setDelay(int newDelay) noexcept;
+
+    // Delay a chunk of up to maxBlockSize samples. The result stays valid until the
+    // next call (audio thread only).
+    const float* process(const float* input, int numSamples) noexcept;
+
+    // Forget the delayed signal
+    void clear() noexcept;
+
+private:
+    std::vector<float> history;
+    std::vector<float> output;
+    int delay = 0;
+    int position = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(DelayLine)
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <atomic>
+
+// The play head handed to every processor in the graph. Whoever drives the
+// render (the audio device or the offline renderer) sets the position at the
+// start of each block; processors read it while that block is being rendered.
+class EnginePlayHead : public juce::AudioPlayHead
+{
+public:
+    EnginePlayHead() = default;
+
+    // Set the position for the next block (rendering thread only)
+    void setPosition(const PositionInfo& newPosition) noexcept
+    {
+        position = newPosition;
+        publish();
+    }
+
+    // Move a free-running play head on by a block, when nothing else drives the timeline
+    void advance(int numSamples, double sampleRate) noexcept
+    {
+        const auto samples = position.getTimeInSamples().orFallback(0) + numSamples;
+        position.setTimeInSamples(samples);
+        position.setTimeInSeconds((double) samples / sampleRate);
+        publish();
+    }
+
+    // Where the rendering thread's play head has got to, for any other thread
+    juce::int64 getLatestTimeInSamples() const noexcept { return timeInSamples.load(std::memory_order_relaxed); }
+
+    // The rest of the rendering thread's position, tempo and time signature included, for any other thread
+    PositionInfo getLatestPosition() const noexcept
+    {
+        for (;;)
+        {
+            const auto before = sequence.load(std::memory_order_acquire);
+
+            PositionInfo latest;
+            latest.setTimeInSamples(timeInSamples.load(std::memory_order_relaxed));
+            latest.setTimeInSeconds(timeInSeconds.load(std::memory_order_relaxed));
+            latest.setIsPlaying(isPlaying.load(std::memory_order_relaxed));
+
+            if (const auto tempo = bpm.load(std::memory_order_relaxed); tempo > 0.0)
+                latest.setBpm(tempo);
+
+            if (hasPpq.load(std::memory_order_relaxed))
+            {
+                latest.setPpqPosition(ppqPosition.load(std::memory_order_relaxed));
+                latest.setPpqPositionOfLastBarStart(ppqOfLastBarStart.load(std::memory_order_relaxed));
+            }
+
+            if (const auto numerator = timeSigNumerator.load(std::memory_order_relaxed); numerator > 0)
+                latest.setTimeSignature(juce::AudioPlayHead::TimeSignature { numerator, timeSigDenominator.load(std::memory_order_relaxed) });
+
+            // Torn by a block starting part way through: try again
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if ((before & 1) == 0 && sequence.load(std::memory_order_relaxed) == before)
+                return latest;
+        }
+    }
+
+    juce::Optional<PositionInfo> getPosition() const override
+    {
+        if (positionOverride != nullptr)
+            return *positionOverride;
+
+        return position;
+    }
+
+    // Shows the calling thread a different position while it is in scope, for
+    // threads that render ahead of the one driving the play head
+    class ScopedPositionOverride
+    {
+    public:
+        explicit ScopedPositionOverride(const PositionInfo& overridingPosition) noexcept
+            : previous(positionOverride)
+        {
+            positionOverride = &overridingPosition;
+        }
+
+        ~ScopedPositionOverride() { positionOverride = previous; }
+
+    private:
+        const PositionInfo* previous;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedPositionOverride)
+    };
+
+private:
+    // Copy the position where other threads can see it, a field at a time. The
+    // sequence number is odd while that is going on.
+    void publish() noexcept
+    {
+        sequence.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        timeInSamples.store(position.getTimeInSamples().orFallback(0), std::memory_order_relaxed);
+        timeInSeconds.store(position.getTimeInSeconds().orFallback(0.0), std::memory_order_relaxed);
+        isPlaying.store(position.getIsPlaying(), std::memory_order_relaxed);
+        bpm.store(position.getBpm().orFallback(0.0), std::memory_order_relaxed);
+        hasPpq.store(position.getPpqPosition().hasValue(), std::memory_order_relaxed);
+        ppqPosition.store(position.getPpqPosition().orFallback(0.0), std::memory_order_relaxed);
+        ppqOfLastBarStart.store(position.getPpqPositionOfLastBarStart().orFallback(0.0), std::memory_order_relaxed);
+
+        const auto timeSignature = position.getTimeSignature();
+        timeSigNumerator.store(timeSignature.hasValue() ? timeSignature->numerator : 0, std::memory_order_relaxed);
+        timeSigDenominator.store(timeSignature.hasValue() ? timeSignature->denominator : 4, std::memory_order_relaxed);
+
+        sequence.fetch_add(1, std::memory_order_release);
+    }
+
+    PositionInfo position;
+    std::atomic<uint32_t> sequence { 0 };
+    std::atomic<juce::int64> timeInSamples { 0 };
+    std::atomic<double> timeInSeconds { 0.0 };
+    std::atomic<bool> isPlaying { false };
+    std::atomic<double> bpm { 0.0 };
+    std::atomic<bool> hasPpq { false };
+    std::atomic<double> ppqPosition { 0.0 };
+    std::atomic<double> ppqOfLastBarStart { 0.0 };
+    std::atomic<int> timeSigNumerator { 0 };
+    std::atomic<int> timeSigDenominator { 4 };
+    static inline thread_local const PositionInfo* positionOverride = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(EnginePlayHead)
+};
@@ -0,0 +1,185 @@
+#include "FreezeCache.h"
+#include <cstring>
+
+struct FreezeCache::Header
+{
+    char magic[8];
+    int32_t numChannels;
+    int32_t isComplete;
+    int64_t numSamples;
+    double sampleRate;
+
+    // Zero in caches from before it was stored, which all started there
+    int64_t timelineStart;
+};
+
+namespace
+{
+    constexpr char cacheMagic[8] = { 'V', 'L', 'H', 'F', 'R', 'E', 'E', 'Z' };
+
+    // Channels start on their own cache line
+    constexpr size_t dataOffset = 64;
+
+    constexpr size_t pageSize = 4096;
+
+    size_t getTotalSize(int numChannels, int64_t numSamples)
+    {
+        return dataOffset + (size_t) numChannels * (size_t) numSamples * sizeof(float);
+    }
+}
+
+FreezeCache::~FreezeCache() = default;
+
+std::unique_ptr<FreezeCache> FreezeCache::create(const juce::File& file, int numChannels, int64_t timelineStart,
+                                                 int64_t numSamples, double sampleRate)
+{
+    if (numChannels <= 0 || numSamples <= 0)
+        return nullptr;
+
+    file.deleteFile();
+
+    {
+        juce::FileOutputStream stream(file);
+
+        if (! stream.openedOk() || ! stream.writeRepeatedByte(0, getTotalSize(numChannels, numSamples)))
+            return nullptr;
+    }
+
+    std::unique_ptr<FreezeCache> cache(new FreezeCache());
+    cache->mapping.reset(new juce::MemoryMappedFile(file, juce::MemoryMappedFile::readWrite, false));
+
+    if (cache->mapping->getData() == nullptr)
+        return nullptr;
+
+    auto* header = static_cast<Header*>(cache->mapping->getData());
+    std::memcpy(header->magic, cacheMagic, sizeof(cacheMagic));
+    header->numChannels = numChannels;
+    header->isComplete = 0;
+    header->numSamples = numSamples;
+    header->sampleRate = sampleRate;
+    header->timelineStart = timelineStart;
+
+    if (! cache->map(file))
+        return nullptr;
+
+    return cache;
+}
+
+std::unique_ptr<FreezeCache> FreezeCache::open(const juce::File& file)
+{
+    std::unique_ptr<FreezeCache> cache(new FreezeCache());
+    cache->mapping.reset(new juce::MemoryMappedFile(file, juce::MemoryMappedFile::readOnly, false));
+
+    if (cache->mapping->getData() == nullptr
+        || cache->mapping->getSize() < dataOffset
+        || ! cache->map(file)
+        || cache->header->isComplete == 0)
+        return nullptr;
+
+    return cache;
+}
+
+bool FreezeCache::map(const juce::File& mappedFile)
+{
+    // Here rather than beside dataOffset, as only members can see Header
+    static_assert(sizeof(Header) <= dataOffset, "the header must fit in front of the audio");
+
+    file = mappedFile;
+
+    auto* base = static_cast<char*>(mapping->getData());
+    header = reinterpret_cast<Header*>(base);
+    samples = reinterpret_cast<float*>(base + dataOffset);
+
+    return std::memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) == 0
+        && header->numChannels > 0
+        && header->numSamples > 0
+        && mapping->getSize() >= getTotalSize(header->numChannels, header->numSamples);
+}
+
+int FreezeCache::getNumChannels() const noexcept
+{
+    return header->numChannels;
+}
+
+int64_t FreezeCache::getTimelineStart() const noexcept
+{
+    return header->timelineStart;
+}
+
+int64_t FreezeCache::getNumSamples() const noexcept
+{
+    return header->numSamples;
+}
+
+double FreezeCache::getSampleRate() const noexcept
+{
+    return header->sampleRate;
+}
+
+bool FreezeCache::covers(int64_t position) const noexcept
+{
+    return position >= header->timelineStart && position - header->timelineStart < header->numSamples;
+}
+
+float* FreezeCache::getChannel(int channel) const noexcept
+{
+    jassert(juce::isPositiveAndBelow(channel, header->numChannels));
+    return samples + (size_t) channel * (size_t) header->numSamples;
+}
+
+void FreezeCache::write(const juce::AudioBuffer<float>& buffer, int numSamples, int64_t timelinePosition) noexcept
+{
+    const auto position = timelinePosition - header->timelineStart;
+    const auto start = juce::jmax((int64_t) 0, position);
+    const auto end = juce::jmin(header->numSamples, position + numSamples);
+
+    if (start >= end)
+        return;
+
+    const auto numChannels = juce::jmin(buffer.getNumChannels(), (int) header->numChannels);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        juce::FloatVectorOperations::copy(getChannel(channel) + start,
+                                          buffer.getReadPointer(channel, (int) (start - position)),
+                                          (int) (end - start));
+}
+
+void FreezeCache::read(juce::AudioBuffer<float>& buffer, int numSamples, int64_t timelinePosition) const noexcept
+{
+    const auto position = timelinePosition - header->timelineStart;
+    buffer.clear(0, numSamples);
+
+    const auto start = juce::jmax((int64_t) 0, position);
+    const auto end = juce::jmin(header->numSamples, position + numSamples);
+
+    if (start >= end)
+        return;
+
+    const auto numChannels = juce::jmin(buffer.getNumChannels(), (int) header->numChannels);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        juce::FloatVectorOperations::copy(buffer.getWritePointer(channel, (int) (start - position)),
+                                          getChannel(channel) + start,
+                                          (int) (end - start));
+}
+
+void FreezeCache::markComplete() noexcept
+{
+    header->isComplete = 1;
+}
+
+void FreezeCache::prefetch(int64_t timelinePosition, int64_t numSamples) const noexcept
+{
+    const auto position = timelinePosition - header->timelineStart;
+    const auto start = juce::jlimit((int64_t) 0, header->numSamples, position);
+    const auto end = juce::jlimit((int64_t) 0, header->numSamples, position + numSamples);
+    volatile float sink = 0.0f;
+
+    for (int channel = 0; channel < header->numChannels; ++channel)
+    {
+        const auto* data = getChannel(channel);
+
+        for (auto i = start; i < end; i += (int64_t) (pageSize / sizeof(float)))
+            sink = sink + data[i];
+    }
+}
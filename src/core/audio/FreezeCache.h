@@ -0,0 +1,59 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <cstdint>
+#include <memory>
+
+// A frozen chain's rendered audio on disk, memory-mapped for writing while it is
+// rendered and for reading while it plays back. Each channel is stored in one
+// piece, so a block is a straight copy out of the mapping. The audio covers a span
+// of the play head's timeline, and positions are given on that timeline.
+class FreezeCache
+{
+public:
+    ~FreezeCache();
+
+    // Create a cache file for numSamples of audio from timelineStart, ready to be written
+    static std::unique_ptr<FreezeCache> create(const juce::File& file, int numChannels, int64_t timelineStart,
+                                               int64_t numSamples, double sampleRate);
+
+    // Open a finished cache file for reading, or nullptr if it isn't one
+    static std::unique_ptr<FreezeCache> open(const juce::File& file);
+
+    const juce::File& getFile() const noexcept { return file; }
+    int getNumChannels() const noexcept;
+    int64_t getTimelineStart() const noexcept;
+    int64_t getNumSamples() const noexcept;
+    double getSampleRate() const noexcept;
+
+    // Whether the cache has audio for a position on the timeline
+    bool covers(int64_t position) const noexcept;
+
+    float* getChannel(int channel) const noexcept;
+
+    // Copy a block into the cache at a position, or out of it. Anything outside the
+    // cache's length is left out, or read as silence.
+    void write(const juce::AudioBuffer<float>& buffer, int numSamples, int64_t position) noexcept;
+    void read(juce::AudioBuffer<float>& buffer, int numSamples, int64_t position) const noexcept;
+
+    // Mark a written cache as complete, so that open() will accept it
+    void markComplete() noexcept;
+
+    // Touch the pages holding a range of samples, so that reading them later doesn't
+    // have to wait for the disk (not for the audio thread)
+    void prefetch(int64_t position, int64_t numSamples) const noexcept;
+
+private:
+    struct Header;
+
+    FreezeCache() = default;
+
+    bool map(const juce::File& mappedFile);
+
+    juce::File file;
+    std::unique_ptr<juce::MemoryMappedFile> mapping;
+    Header* header = nullptr;
+    float* samples = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(FreezeCache)
+};
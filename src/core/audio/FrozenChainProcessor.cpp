@@ -0,0 +1,102 @@
+#include "FrozenChainProcessor.h"
+
+namespace
+{
+    // How far ahead of the play head the read-ahead thread keeps the cache paged in
+    constexpr double readAheadSeconds = 2.0;
+}
+
+FrozenChainProcessor::FrozenChainProcessor(std::unique_ptr<FreezeCache> cacheToPlay,
+                                           const juce::String& chainName,
+                                           int latencySamples)
+    : juce::AudioPluginInstance(createBuses(cacheToPlay->getNumChannels())),
+      juce::Thread("Freeze read-ahead"),
+      cache(std::move(cacheToPlay)),
+      name("Frozen: " + chainName)
+{
+    setLatencySamples(latencySamples);
+}
+
+FrozenChainProcessor::~FrozenChainProcessor()
+{
+    stopThread(1000);
+}
+
+juce::AudioProcessor::BusesProperties FrozenChainProcessor::createBuses(int numChannels)
+{
+    return BusesProperties().withOutput("Output", juce::AudioChannelSet::canonicalChannelSet(numChannels), true);
+}
+
+void FrozenChainProcessor::fillInPluginDescription(juce::PluginDescription& description) const
+{
+    description.name = name;
+    description.descriptiveName = name;
+    description.pluginFormatName = "Internal";
+    description.category = "Frozen";
+    description.manufacturerName = "VSTLinkHost";
+    description.fileOrIdentifier = cache->getFile().getFullPathName();
+    description.uniqueId = description.fileOrIdentifier.hashCode();
+    description.numInputChannels = 0;
+    description.numOutputChannels = cache->getNumChannels();
+    description.isInstrument = true;
+}
+
+void FrozenChainProcessor::prepareToPlay(double sampleRate, int)
+{
+    sampleRateMatches = sampleRate == cache->getSampleRate();
+
+    if (! sampleRateMatches)
+        juce::Logger::writeToLog(name + " was rendered at " + juce::String(cache->getSampleRate())
+                                 + " Hz and stays silent at " + juce::String(sampleRate) + " Hz");
+
+    cache->prefetch(nextPosition, (int64_t) (readAheadSeconds * cache->getSampleRate()));
+    startThread();
+}
+
+void FrozenChainProcessor::releaseResources()
+{
+    stopThread(1000);
+}
+
+void FrozenChainProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    const auto numSamples = buffer.getNumSamples();
+    midiMessages.clear();
+
+    juce::Optional<juce::AudioPlayHead::PositionInfo> position;
+
+    if (auto* playHead = getPlayHead())
+        position = playHead->getPosition();
+
+    const auto timeInSamples = position.hasValue() ? position->getTimeInSamples() : juce::Optional<int64_t>();
+
+    if (! sampleRateMatches || ! timeInSamples.hasValue())
+    {
+        buffer.clear();
+        return;
+    }
+
+    cache->read(buffer, numSamples, *timeInSamples);
+
+    for (int channel = cache->getNumChannels(); channel < buffer.getNumChannels(); ++channel)
+        buffer.clear(channel, 0, numSamples);
+
+    nextPosition.store(*timeInSamples + numSamples, std::memory_order_relaxed);
+}
+
+bool FrozenChainProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
+{
+    return layouts.getMainInputChannels() == 0
+        && layouts.getMainOutputChannels() == cache->getNumChannels();
+}
+
+void FrozenChainProcessor::run()
+{
+    const auto readAheadSamples = (int64_t) (readAheadSeconds * cache->getSampleRate());
+
+    while (! threadShouldExit())
+    {
+        cache->prefetch(nextPosition.load(std::memory_order_relaxed), readAheadSamples);
+        wait(50);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "FreezeCache.h"
+#include <atomic>
+#include <memory>
+
+// Stands in for a frozen chain in the graph, playing back its cache at the play
+// head's sample position and silence outside it. It reports the chain's latency,
+// so delay compensation around it stays as it was.
+//
+// The cache is read straight out of its mapping in the audio callback; a background
+// thread keeps touching the pages just ahead of the play head so that reading them
+// doesn't mean waiting for the disk.
+class FrozenChainProcessor : public juce::AudioPluginInstance,
+                             private juce::Thread
+{
+public:
+    FrozenChainProcessor(std::unique_ptr<FreezeCache> cache, const juce::String& chainName, int latencySamples);
+    ~FrozenChainProcessor() override;
+
+    const FreezeCache& getCache() const { return *cache; }
+
+    //==============================================================================
+    const juce::String getName() const override { return name; }
+    void fillInPluginDescription(juce::PluginDescription& description) const override;
+
+    void prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) override;
+    void releaseResources() override;
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override;
+    using juce::AudioPluginInstance::processBlock;
+
+    bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
+
+    double getTailLengthSeconds() const override { return 0.0; }
+    bool acceptsMidi() const override { return false; }
+    bool producesMidi() const override { return false; }
+
+    bool hasEditor() const override { return false; }
+    juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+
+    int getNumPrograms() override { return 1; }
+    int getCurrentProgram() override { return 0; }
+    void setCurrentProgram(int) override {}
+    const juce::String getProgramName(int) override { return {}; }
+    void changeProgramName(int, const juce::String&) override {}
+
+    // Everything worth keeping is in the cache file
+    void getStateInformation(juce::MemoryBlock&) override {}
+    void setStateInformation(const void*, int) override {}
+
+private:
+    static BusesProperties createBuses(int numChannels);
+
+    void run() override;
+
+    std::unique_ptr<FreezeCache> cache;
+    const juce::String name;
+
+    // Where the audio thread will read next, for the read-ahead thread
+    std::atomic<int64_t> nextPosition { 0 };
+
+    // The cache only holds audio at the rate it was rendered at
+    std::atomic<bool> sampleRateMatches { false };
+
+    JUCE_DECLARE_NON_COPYABLE(FrozenChainProcessor)
+};
@@ -0,0 +1,207 @@
+#include "OfflineRenderer.h"
+#include "AudioEngine.h"
+#include "../sync/LinkManager.h"
+#include <cmath>
+
+OfflineRenderer::OfflineRenderer(AudioEngine& engineToRender)
+    : engine(engineToRender)
+{
+}
+
+OfflineRenderer::~OfflineRenderer()
+{
+}
+
+OfflineRenderer::Result OfflineRenderer::render(const Options& options, ProgressCallback progressCallback)
+{
+    Result result;
+    
+    if (options.sampleRate <= 0.0 || options.blockSize <= 0 || options.numChannels <= 0 || options.lengthSeconds <= 0.0)
+    {
+        result.errorMessage = "Invalid render settings";
+        return result;
+    }
+    
+    // Nothing is touched on disk unless the engine could be taken over
+    if (!engine.beginOfflineRender(options.sampleRate, options.blockSize, result.errorMessage))
+        return result;
+    
+    // Without an output file the graph is rendered for whatever captures it along the way
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    
+    if (options.outputFile != juce::File())
+    {
+        writer = createWriter(options, result.errorMessage);
+        
+        if (writer == nullptr)
+        {
+            engine.endOfflineRender();
+            return result;
+        }
+    }
+    
+    const auto totalSamples = (juce::int64) std::llround(options.lengthSeconds * options.sampleRate);
+    
+    // Everything comes out of the plan this late, so render that much further and leave
+    // the start out, so the file lines up with the timeline
+    const auto latency = (juce::int64) juce::jmax(0, engine.getGraphLatencySamples());
+    const auto totalToRender = totalSamples + latency;
+    juce::int64 position = 0;
+    const auto linkStartTime = options.linkManager != nullptr ? options.linkManager->getClockMicros()
+                                                              : std::chrono::microseconds(0);
+    
+    juce::AudioBuffer<float> buffer(options.numChannels, options.blockSize);
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+    bool cancelled = false;
+    bool writeFailed = false;
+    
+    while (position < totalToRender)
+    {
+        const auto numSamples = (int) juce::jmin((juce::int64) options.blockSize, totalToRender - position);
+        
+        updatePlayHead(options, position, linkStartTime);
+        engine.renderOfflineBlock(nullptr, 0, buffer.getArrayOfWritePointers(), buffer.getNumChannels(), numSamples);
+        
+        const auto numToSkip = (int) juce::jlimit((juce::int64) 0, (juce::int64) numSamples, latency - position);
+        const auto numToWrite = numSamples - numToSkip;
+        position += numSamples;
+        
+        if (writer != nullptr && numToWrite > 0)
+        {
+            if (options.dither && options.bitDepth < 32)
+                applyDither(buffer, numSamples, options.bitDepth);
+            
+            if (!writer->writeFromAudioSampleBuffer(buffer, numToSkip, numToWrite))
+            {
+                writeFailed = true;
+                break;
+            }
+        }
+        
+        result.numSamplesRendered += numToWrite;
+        
+        if (progressCallback && !progressCallback((double) position / (double) totalToRender))
+        {
+            cancelled = true;
+            break;
+        }
+    }
+    
+    result.renderSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+    
+    engine.endOfflineRender();
+    writer.reset();
+    
+    if (result.renderSeconds > 0.0)
+        result.realtimeFactor = ((double) result.numSamplesRendered / options.sampleRate) / result.renderSeconds;
+    
+    if (writeFailed)
+        result.errorMessage = "Writing to " + options.outputFile.getFullPathName() + " failed";
+    else if (cancelled)
+        result.errorMessage = "Render cancelled";
+    else
+        result.success = true;
+    
+    juce::Logger::writeToLog("Offline render: " + juce::String(result.numSamplesRendered) + " samples in "
+                             + juce::String(result.renderSeconds, 3) + " s ("
+                             + juce::String(result.realtimeFactor, 1) + "x realtime)");
+    
+    return result;
+}
+
+std::unique_ptr<juce::AudioFormatWriter> OfflineRenderer::createWriter(const Options& options, juce::String& errorMessage) const
+{
+    auto format = createFormat(options.format);
+    
+    if (!format->getPossibleBitDepths().contains(options.bitDepth))
+    {
+        errorMessage = format->getFormatName() + " can't be written at " + juce::String(options.bitDepth) + " bits";
+        return nullptr;
+    }
+    
+    if (!format->getPossibleSampleRates().isEmpty()
+        && !format->getPossibleSampleRates().contains((int) options.sampleRate))
+    {
+        errorMessage = format->getFormatName() + " can't be written at " + juce::String(options.sampleRate) + " Hz";
+        return nullptr;
+    }
+    
+    options.outputFile.deleteFile();
+    auto stream = options.outputFile.createOutputStream();
+    
+    if (stream == nullptr)
+    {
+        errorMessage = "Could not open " + options.outputFile.getFullPathName() + " for writing";
+        return nullptr;
+    }
+    
+    std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(),
+                                                                            options.sampleRate,
+                                                                            (unsigned int) options.numChannels,
+                                                                            options.bitDepth,
+                                                                            {},
+                                                                            0));
+    
+    if (writer == nullptr)
+    {
+        errorMessage = "Could not create a " + format->getFormatName() + " writer";
+        return nullptr;
+    }
+    
+    // The writer owns the stream from here on
+    stream.release();
+    return writer;
+}
+
+std::unique_ptr<juce::AudioFormat> OfflineRenderer::createFormat(FileFormat format) const
+{
+    if (format == FileFormat::flac)
+        return std::make_unique<juce::FlacAudioFormat>();
+    
+    return std::make_unique<juce::WavAudioFormat>();
+}
+
+void OfflineRenderer::updatePlayHead(const Options& options, juce::int64 samplePosition, std::chrono::microseconds linkStartTime)
+{
+    const auto seconds = (double) samplePosition / options.sampleRate;
+    
+    double tempo = options.tempo;
+    double beat = options.startBeat + seconds * options.tempo / 60.0;
+    
+    // Follow Link's timeline as it would unfold in realtime from the moment the render started
+    if (options.linkManager != nullptr)
+    {
+        const auto elapsed = std::chrono::microseconds((juce::int64) std::llround(seconds * 1.0e6));
+        tempo = options.linkManager->getTempo();
+        beat = options.linkManager->getBeatTimeAtTimestamp(linkStartTime + elapsed);
+    }
+    
+    juce::AudioPlayHead::PositionInfo position;
+    position.setIsPlaying(true);
+    position.setTimeInSamples(options.startSample + samplePosition);
+    position.setTimeInSeconds((double) (options.startSample + samplePosition) / options.sampleRate);
+    position.setBpm(tempo);
+    position.setTimeSignature(juce::AudioPlayHead::TimeSignature{});
+    position.setPpqPosition(beat);
+    position.setPpqPositionOfLastBarStart(std::floor(beat / 4.0) * 4.0);
+    position.setBarCount((juce::int64) std::floor(beat / 4.0));
+    
+    engine.getPlayHead().setPosition(position);
+}
+
+void OfflineRenderer::applyDither(juce::AudioBuffer<float>& buffer, int numSamples, int bitDepth)
+{
+    // Triangular (TPDF) dither of one LSB at the target bit depth
+    const auto lsb = 1.0f / (float) (1 << (bitDepth - 1));
+    
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+    {
+        auto* samples = buffer.getWritePointer(channel);
+        
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto noise = (random.nextFloat() - random.nextFloat()) * lsb;
+            samples[i] = juce::jlimit(-1.0f, 1.0f - lsb, samples[i] + noise);
+        }
+    }
+}
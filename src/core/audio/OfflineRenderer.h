@@ -0,0 +1,75 @@
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <functional>
+
+class AudioEngine;
+class LinkManager;
+
+// Renders the engine's graph into an audio file as fast as the CPU allows,
+// without an audio device. The engine is detached from its device for the
+// duration of the render and reattached afterwards.
+class OfflineRenderer
+{
+public:
+    enum class FileFormat
+    {
+        wav,
+        flac
+    };
+
+    struct Options
+    {
+        // Left empty, the graph is rendered without writing a file (see ChainFreezer)
+        juce::File outputFile;
+        FileFormat format = FileFormat::wav;
+        int bitDepth = 24;
+
+        // Add TPDF dither before truncating to an integer bit depth
+        bool dither = true;
+
+        double sampleRate = 44100.0;
+        int blockSize = 512;
+        int numChannels = 2;
+        double lengthSeconds = 10.0;
+
+        // Timeline for the play head: from startSample, at a fixed tempo from startBeat,
+        // or Link's session timeline when a LinkManager is given
+        juce::int64 startSample = 0;
+        double tempo = 120.0;
+        double startBeat = 0.0;
+        LinkManager* linkManager = nullptr;
+    };
+
+    struct Result
+    {
+        bool success = false;
+        juce::String errorMessage;
+        juce::int64 numSamplesRendered = 0;
+        double renderSeconds = 0.0;
+
+        // Seconds of audio rendered per second of wall-clock time
+        double realtimeFactor = 0.0;
+    };
+
+    // Called after each block with the progress so far (0-1); return false to cancel
+    using ProgressCallback = std::function<bool(double)>;
+
+    explicit OfflineRenderer(AudioEngine& engine);
+    ~OfflineRenderer();
+
+    // Render to options.outputFile, if any, blocking until finished or cancelled
+    Result render(const Options& options, ProgressCallback progressCallback = nullptr);
+
+private:
+    AudioEngine& engine;
+
+    std::unique_ptr<juce::AudioFormatWriter> createWriter(const Options& options, juce::String& errorMessage) const;
+    std::unique_ptr<juce::AudioFormat> createFormat(FileFormat format) const;
+    void updatePlayHead(const Options& options, juce::int64 samplePosition, std::chrono::microseconds linkStartTime);
+    void applyDither(juce::AudioBuffer<float>& buffer, int numSamples, int bitDepth);
+
+    juce::Random random;
+
+    JUCE_DECLARE_NON_COPYABLE(OfflineRenderer)
+};
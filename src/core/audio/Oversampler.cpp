@@ -0,0 +1,435 @@
+#include "Oversampler.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstring>
+
+namespace
+{
+    // The first stage has to stop everything above the original Nyquist frequency;
+    // later ones only have to clear images far away from any content
+    constexpr int firstStageTaps = 95;
+    constexpr int laterStageTaps = 27;
+
+    // About 100 dB of stopband attenuation
+    constexpr double kaiserBeta = 10.0;
+
+    float dotProduct(const float* a, const float* b, int numSamples) noexcept
+    {
+        int i = 0;
+        float sum = 0.0f;
+
+       #if VSTLINKHOST_SIMD_SSE2
+        auto sums = _mm_setzero_ps();
+
+        for (; i + 4 <= numSamples; i += 4)
+            sums = _mm_add_ps(sums, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+        sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+        sums = _mm_add_ss(sums, _mm_shuffle_ps(sums, sums, 1));
+        sum = _mm_cvtss_f32(sums);
+       #elif VSTLINKHOST_SIMD_NEON
+        auto sums = vdupq_n_f32(0.0f);
+
+        for (; i + 4 <= numSamples; i += 4)
+            sums = vmlaq_f32(sums, vld1q_f32(a + i), vld1q_f32(b + i));
+
+        sum = vaddvq_f32(sums);
+       #endif
+
+        for (; i < numSamples; ++i)
+            sum += a[i] * b[i];
+
+        return sum;
+    }
+
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+
+        for (int k = 1; k < 50 && term > sum * 1.0e-12; ++k)
+        {
+            term *= (x * x) / (4.0 * k * k);
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    // A Kaiser-windowed half-band lowpass. numTaps is 4m + 3, so that the centre tap
+    // sits at an odd index and every other tap away from it is exactly zero.
+    std::vector<double> designHalfband(int numTaps)
+    {
+        jassert(numTaps % 4 == 3);
+
+        const auto centre = (numTaps - 1) / 2;
+        std::vector<double> taps((size_t) numTaps, 0.0);
+        double oddSum = 0.0;
+
+        for (int n = 0; n < numTaps; ++n)
+        {
+            const auto k = n - centre;
+
+            if (k == 0 || k % 2 == 0)
+                continue;
+
+            const auto position = 2.0 * n / (numTaps - 1) - 1.0;
+            const auto window = besselI0(kaiserBeta * std::sqrt(1.0 - position * position)) / besselI0(kaiserBeta);
+
+            taps[(size_t) n] = std::sin(juce::MathConstants<double>::halfPi * k) / (juce::MathConstants<double>::pi * k) * window;
+            oddSum += taps[(size_t) n];
+        }
+
+        // Both polyphase branches get a gain of exactly one half, so DC passes unchanged
+        for (auto& tap : taps)
+            tap *= 0.5 / oddSum;
+
+        taps[(size_t) centre] = 0.5;
+        return taps;
+    }
+
+    void fft(std::vector<std::complex<double>>& data, bool inverse)
+    {
+        const auto size = data.size();
+
+        for (size_t i = 1, j = 0; i < size; ++i)
+        {
+            auto bit = size >> 1;
+
+            for (; (j & bit) != 0; bit >>= 1)
+                j ^= bit;
+
+            j ^= bit;
+
+            if (i < j)
+                std::swap(data[i], data[j]);
+        }
+
+        for (size_t length = 2; length <= size; length <<= 1)
+        {
+            const auto angle = (inverse ? 2.0 : -2.0) * juce::MathConstants<double>::pi / (double) length;
+            const std::complex<double> step(std::cos(angle), std::sin(angle));
+
+            for (size_t start = 0; start < size; start += length)
+            {
+                std::complex<double> twiddle(1.0);
+
+                for (size_t k = 0; k < length / 2; ++k)
+                {
+                    const auto even = data[start + k];
+                    const auto odd = data[start + k + length / 2] * twiddle;
+                    data[start + k] = even + odd;
+                    data[start + k + length / 2] = even - odd;
+                    twiddle *= step;
+                }
+            }
+        }
+
+        if (inverse)
+            for (auto& value : data)
+                value /= (double) size;
+    }
+
+    // The minimum phase filter with the same magnitude response, by folding the
+    // real cepstrum onto positive time
+    std::vector<double> toMinimumPhase(const std::vector<double>& taps)
+    {
+        constexpr size_t size = 8192;
+        std::vector<std::complex<double>> spectrum(size);
+        std::copy(taps.begin(), taps.end(), spectrum.begin());
+        fft(spectrum, false);
+
+        // Zeros in the stopband would have no logarithm; -200 dB is as good as nothing
+        for (auto& bin : spectrum)
+            bin = std::log(std::max(std::abs(bin), 1.0e-10));
+
+        fft(spectrum, true);
+
+        for (size_t n = 1; n < size / 2; ++n)
+            spectrum[n] = 2.0 * spectrum[n].real();
+
+        for (size_t n = size / 2 + 1; n < size; ++n)
+            spectrum[n] = 0.0;
+
+        spectrum[0] = spectrum[0].real();
+        spectrum[size / 2] = spectrum[size / 2].real();
+
+        fft(spectrum, false);
+
+        for (auto& bin : spectrum)
+            bin = std::exp(bin);
+
+        fft(spectrum, true);
+
+        std::vector<double> minimum(taps.size());
+
+        for (size_t n = 0; n < minimum.size(); ++n)
+            minimum[n] = spectrum[n].real();
+
+        return minimum;
+    }
+}
+
+//==============================================================================
+// One 2x step: a half-band filter split into its even and odd polyphase branches,
+// with separate history for the way up and the way down
+class Oversampler::Stage
+{
+public:
+    Stage(int numChannelsToUse, const std::vector<double>& taps)
+        : numChannels(numChannelsToUse)
+    {
+        std::vector<double> phases[2];
+
+        for (size_t n = 0; n < taps.size(); ++n)
+            phases[n % 2].push_back(taps[n]);
+
+        for (int p = 0; p < 2; ++p)
+        {
+            down[p] = Branch(phases[p], 1.0);
+
+            // Zero stuffing halves the level, which the way up makes good
+            up[p] = Branch(phases[p], 2.0);
+        }
+
+        // The odd phase of the input reaches the down filter one sample later
+        upHistoryLength = std::max(up[0].getSpan(), up[1].getSpan());
+        downHistoryLength = std::max(down[0].getSpan(), down[1].getSpan() + 1);
+
+        double sum = 0.0, weightedSum = 0.0;
+
+        for (size_t n = 0; n < taps.size(); ++n)
+        {
+            sum += taps[n];
+            weightedSum += (double) n * taps[n];
+        }
+
+        delay = weightedSum / sum;
+    }
+
+    void prepare(int maxInputSamples)
+    {
+        upHistory.assign((size_t) numChannels, std::vector<float>((size_t) (upHistoryLength + maxInputSamples), 0.0f));
+        downEven.assign((size_t) numChannels, std::vector<float>((size_t) (downHistoryLength + maxInputSamples), 0.0f));
+        downOdd = downEven;
+    }
+
+    void reset() noexcept
+    {
+        for (auto* histories : { &upHistory, &downEven, &downOdd })
+            for (auto& history : *histories)
+                std::fill(history.begin(), history.end(), 0.0f);
+    }
+
+    // Delay at the stage's higher rate
+    double getDelay() const { return delay; }
+
+    int getNumMultiplies() const
+    {
+        return up[0].size() + up[1].size() + down[0].size() + down[1].size();
+    }
+
+    // numSamples in, twice as many out
+    void processUp(int channel, const float* input, float* output, int numSamples) noexcept
+    {
+        auto* history = upHistory[(size_t) channel].data();
+        std::memcpy(history + upHistoryLength, input, (size_t) numSamples * sizeof(float));
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto* newest = history + upHistoryLength + i;
+            output[2 * i] = up[0].process(newest);
+            output[2 * i + 1] = up[1].process(newest);
+        }
+
+        std::memmove(history, history + numSamples, (size_t) upHistoryLength * sizeof(float));
+    }
+
+    // Twice numSamples in, numSamples out
+    void processDown(int channel, const float* input, float* output, int numSamples) noexcept
+    {
+        auto* even = downEven[(size_t) channel].data();
+        auto* odd = downOdd[(size_t) channel].data();
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            even[downHistoryLength + i] = input[2 * i];
+            odd[downHistoryLength + i] = input[2 * i + 1];
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto newest = downHistoryLength + i;
+            output[i] = down[0].process(even + newest) + down[1].process(odd + newest - 1);
+        }
+
+        std::memmove(even, even + numSamples, (size_t) downHistoryLength * sizeof(float));
+        std::memmove(odd, odd + numSamples, (size_t) downHistoryLength * sizeof(float));
+    }
+
+private:
+    // One polyphase branch, without the zero taps at either end. For a linear phase
+    // half-band, that leaves a single tap in the odd branch.
+    class Branch
+    {
+    public:
+        Branch() = default;
+
+        Branch(const std::vector<double>& taps, double gain)
+        {
+            auto first = taps.begin();
+            auto last = taps.end();
+
+            while (first != last && *first == 0.0)
+                ++first;
+
+            while (last != first && *(last - 1) == 0.0)
+                --last;
+
+            offset = (int) (first - taps.begin());
+
+            // Reversed, so that each output is a dot product with the history in order
+            for (auto tap = last; tap != first; --tap)
+                reversedTaps.push_back((float) (*(tap - 1) * gain));
+        }
+
+        int size() const { return (int) reversedTaps.size(); }
+
+        // How far back from the newest sample the branch reaches
+        int getSpan() const { return offset + juce::jmax(0, size() - 1); }
+
+        float process(const float* newest) const noexcept
+        {
+            if (reversedTaps.empty())
+                return 0.0f;
+
+            return dotProduct(reversedTaps.data(), newest - getSpan(), size());
+        }
+
+    private:
+        int offset = 0;
+        std::vector<float> reversedTaps;
+    };
+
+    const int numChannels;
+    Branch up[2], down[2];
+    int upHistoryLength = 0;
+    int downHistoryLength = 0;
+    double delay = 0.0;
+
+    std::vector<std::vector<float>> upHistory, downEven, downOdd;
+};
+
+//==============================================================================
+Oversampler::Oversampler(int numChannelsToUse, int factorToUse, Phase phaseToUse)
+    : numChannels(juce::jmax(0, numChannelsToUse)),
+      factor(juce::nextPowerOfTwo(juce::jlimit(2, 8, factorToUse))),
+      phase(phaseToUse)
+{
+    for (int stageFactor = 2; stageFactor <= factor; stageFactor *= 2)
+    {
+        auto taps = designHalfband(stageFactor == 2 ? firstStageTaps : laterStageTaps);
+
+        if (phase == Phase::minimum)
+            taps = toMinimumPhase(taps);
+
+        stages.push_back(std::make_unique<Stage>(numChannels, taps));
+    }
+
+    buffers.resize(stages.size());
+}
+
+Oversampler::~Oversampler() = default;
+
+void Oversampler::prepare(int maxBlockSize)
+{
+    auto stageInputSize = juce::jmax(1, maxBlockSize);
+
+    for (size_t s = 0; s < stages.size(); ++s)
+    {
+        stages[s]->prepare(stageInputSize);
+        stageInputSize *= 2;
+        buffers[s].setSize(numChannels, stageInputSize);
+        buffers[s].clear();
+    }
+}
+
+void Oversampler::reset() noexcept
+{
+    for (auto& stage : stages)
+        stage->reset();
+}
+
+double Oversampler::getLatencyInOversampledSamples() const
+{
+    // Each stage delays the signal on the way up and again on the way down, at its own rate
+    double latency = 0.0;
+    auto stageFactor = 2;
+
+    for (auto& stage : stages)
+    {
+        latency += 2.0 * stage->getDelay() * factor / stageFactor;
+        stageFactor *= 2;
+    }
+
+    return latency;
+}
+
+int Oversampler::getNumMultipliesPerSample() const
+{
+    // A stage runs once for every sample at its lower rate
+    int multiplies = 0;
+    auto samplesPerBaseSample = 1;
+
+    for (auto& stage : stages)
+    {
+        multiplies += stage->getNumMultiplies() * samplesPerBaseSample;
+        samplesPerBaseSample *= 2;
+    }
+
+    return multiplies;
+}
+
+juce::AudioBuffer<float>& Oversampler::processUp(const juce::AudioBuffer<float>& input, int numSamples) noexcept
+{
+    jassert(numSamples * factor <= buffers.back().getNumSamples());
+
+    const auto channelsToRead = juce::jmin(numChannels, input.getNumChannels());
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        auto stageSamples = numSamples;
+
+        if (ch < channelsToRead)
+            stages[0]->processUp(ch, input.getReadPointer(ch), buffers[0].getWritePointer(ch), stageSamples);
+        else
+            buffers[0].clear(ch, 0, stageSamples * 2);
+
+        for (size_t s = 1; s < stages.size(); ++s)
+        {
+            stageSamples *= 2;
+            stages[s]->processUp(ch, buffers[s - 1].getReadPointer(ch), buffers[s].getWritePointer(ch), stageSamples);
+        }
+    }
+
+    return buffers.back();
+}
+
+void Oversampler::processDown(juce::AudioBuffer<float>& output, int numSamples) noexcept
+{
+    const auto channelsToWrite = juce::jmin(numChannels, output.getNumChannels());
+
+    for (int ch = 0; ch < channelsToWrite; ++ch)
+    {
+        auto stageSamples = numSamples * factor / 2;
+
+        for (auto s = stages.size() - 1; s > 0; --s)
+        {
+            stages[s]->processDown(ch, buffers[s].getReadPointer(ch), buffers[s - 1].getWritePointer(ch), stageSamples);
+            stageSamples /= 2;
+        }
+
+        stages[0]->processDown(ch, buffers[0].getReadPointer(ch), output.getWritePointer(ch), numSamples);
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <memory>
+#include <vector>
+
+// Takes audio up to 2, 4 or 8 times its sample rate and back down again, in
+// cascaded 2x stages. Each stage filters with a polyphase half-band FIR, so only
+// the taps that meet real samples are ever multiplied.
+//
+// Linear phase keeps transients intact at the cost of latency. Minimum phase has
+// almost none, but smears the phase near the top of the band.
+class Oversampler
+{
+public:
+    enum class Phase
+    {
+        linear,
+        minimum
+    };
+
+    Oversampler(int numChannels, int factor, Phase phase);
+    ~Oversampler();
+
+    int getFactor() const { return factor; }
+    Phase getPhase() const { return phase; }
+
+    // Allocate for blocks of up to maxBlockSize samples at the base rate
+    void prepare(int maxBlockSize);
+
+    // Forget the filters' history
+    void reset() noexcept;
+
+    // How far going up and back down delays the signal, in oversampled samples. Exact
+    // for linear phase; for minimum phase, the delay at low frequencies.
+    double getLatencyInOversampledSamples() const;
+
+    // Filter taps multiplied per base-rate sample and channel, up and down together
+    int getNumMultipliesPerSample() const;
+
+    // Upsample a block and return the oversampled buffer, numSamples * factor long
+    juce::AudioBuffer<float>& processUp(const juce::AudioBuffer<float>& input, int numSamples) noexcept;
+
+    // Bring the oversampled buffer back down into output
+    void processDown(juce::AudioBuffer<float>& output, int numSamples) noexcept;
+
+private:
+    class Stage;
+
+    const int numChannels;
+    const int factor;
+    const Phase phase;
+
+    std::vector<std::unique_ptr<Stage>> stages;
+
+    // The signal after each upsampling stage
+    std::vector<juce::AudioBuffer<float>> buffers;
+
+    JUCE_DECLARE_NON_COPYABLE(Oversampler)
+};
@@ -0,0 +1,191 @@
+#include "PerformanceMonitor.h"
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    constexpr double smallestBinNanos = 100.0;
+    constexpr double binRatio = 1.05;
+
+    uint32_t toNanos(std::chrono::steady_clock::duration duration) noexcept
+    {
+        const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        return (uint32_t) juce::jlimit<int64_t>(0, std::numeric_limits<uint32_t>::max(), nanos);
+    }
+}
+
+void PerformanceMonitor::Histogram::add(uint32_t nanos)
+{
+    const auto bin = nanos <= smallestBinNanos ? 0
+                                               : (int) (std::log(nanos / smallestBinNanos) / std::log(binRatio));
+
+    ++bins[(size_t) juce::jlimit(0, numBins - 1, bin)];
+    ++count;
+    totalNanos += nanos;
+    maxNanos = juce::jmax(maxNanos, nanos);
+}
+
+double PerformanceMonitor::Histogram::getPercentileNanos(double fraction) const
+{
+    if (count == 0)
+        return 0.0;
+
+    const auto target = (uint64_t) std::ceil(fraction * (double) count);
+    uint64_t seen = 0;
+
+    for (int bin = 0; bin < numBins; ++bin)
+    {
+        seen += bins[(size_t) bin];
+
+        // Report the top of the bin, but never more than the largest value seen
+        if (seen >= target)
+            return juce::jmin((double) maxNanos, smallestBinNanos * std::pow(binRatio, bin + 1));
+    }
+
+    return maxNanos;
+}
+
+PerformanceMonitor::PerformanceMonitor()
+{
+    slots.reserve((size_t) maxSlots);
+
+    for (int i = 0; i < maxSlots; ++i)
+        slots.push_back(std::make_unique<Slot>());
+
+    // Often enough that a ring never fills up, even with 32-sample blocks
+    startTimer(100);
+}
+
+PerformanceMonitor::~PerformanceMonitor()
+{
+    stopTimer();
+}
+
+void PerformanceMonitor::setEnabled(bool shouldBeEnabled)
+{
+    enabled = shouldBeEnabled;
+}
+
+void PerformanceMonitor::recordNode(int slot, std::chrono::steady_clock::duration duration) noexcept
+{
+    if (hasOwnSlot(slot))
+        push(slot, toNanos(duration));
+}
+
+void PerformanceMonitor::recordSleep(int slot) noexcept
+{
+    if (hasOwnSlot(slot))
+        slots[(size_t) slot]->numBlocksAsleep.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PerformanceMonitor::recordCallback(std::chrono::steady_clock::time_point start,
+                                        std::chrono::steady_clock::time_point end,
+                                        int numSamples,
+                                        double sampleRate) noexcept
+{
+    const auto deadline = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(numSamples / sampleRate));
+
+    if (end - start > deadline)
+        numOverruns.fetch_add(1, std::memory_order_relaxed);
+
+    if (lastCallbackStart.time_since_epoch().count() != 0 && start - lastCallbackStart > deadline + deadline / 2)
+        numLateCallbacks.fetch_add(1, std::memory_order_relaxed);
+
+    lastCallbackStart = start;
+    deadlineMicros.store(numSamples * 1.0e6 / sampleRate, std::memory_order_relaxed);
+    push(callbackSlot, toNanos(end - start));
+}
+
+void PerformanceMonitor::push(int slot, uint32_t nanos) noexcept
+{
+    if (!juce::isPositiveAndBelow(slot, maxSlots))
+        return;
+
+    auto& target = *slots[(size_t) slot];
+    const auto scope = target.fifo.write(1);
+
+    if (scope.blockSize1 > 0)
+        target.ring[(size_t) scope.startIndex1] = nanos;
+    else
+        numDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PerformanceMonitor::collect()
+{
+    for (auto& slot : slots)
+    {
+        const auto scope = slot->fifo.read(slot->fifo.getNumReady());
+
+        for (int i = 0; i < scope.blockSize1; ++i)
+            slot->histogram.add(slot->ring[(size_t) (scope.startIndex1 + i)]);
+
+        for (int i = 0; i < scope.blockSize2; ++i)
+            slot->histogram.add(slot->ring[(size_t) (scope.startIndex2 + i)]);
+    }
+}
+
+PerformanceMonitor::Stats PerformanceMonitor::getStats(int slot) const
+{
+    Stats stats;
+
+    if (!juce::isPositiveAndBelow(slot, maxSlots))
+        return stats;
+
+    const auto& histogram = slots[(size_t) slot]->histogram;
+    stats.numBlocksAsleep = slots[(size_t) slot]->numBlocksAsleep.load(std::memory_order_relaxed);
+
+    if (stats.numBlocksAsleep > 0)
+        stats.percentAsleep = 100.0 * (double) stats.numBlocksAsleep / (double) (stats.numBlocksAsleep + histogram.count);
+
+    if (histogram.count == 0)
+        return stats;
+
+    stats.numBlocks = histogram.count;
+    stats.meanMicros = histogram.totalNanos / (double) histogram.count / 1000.0;
+    stats.p50Micros = histogram.getPercentileNanos(0.5) / 1000.0;
+    stats.p99Micros = histogram.getPercentileNanos(0.99) / 1000.0;
+    stats.maxMicros = histogram.maxNanos / 1000.0;
+    stats.savedMicros = stats.meanMicros * (double) stats.numBlocksAsleep;
+
+    if (const auto deadline = getDeadlineMicros(); deadline > 0.0)
+    {
+        stats.p50PercentOfDeadline = 100.0 * stats.p50Micros / deadline;
+        stats.p99PercentOfDeadline = 100.0 * stats.p99Micros / deadline;
+        stats.maxPercentOfDeadline = 100.0 * stats.maxMicros / deadline;
+    }
+
+    return stats;
+}
+
+void PerformanceMonitor::reset()
+{
+    // Drain the rings first so that nothing recorded before the reset shows up after it
+    collect();
+
+    for (auto& slot : slots)
+    {
+        slot->histogram = {};
+        slot->numBlocksAsleep = 0;
+    }
+
+    numOverruns = 0;
+    numLateCallbacks = 0;
+    numDroppedRecords = 0;
+}
+
+void PerformanceMonitor::resetSlot(int slot)
+{
+    if (! hasOwnSlot(slot))
+        return;
+
+    collect();
+
+    slots[(size_t) slot]->histogram = {};
+    slots[(size_t) slot]->numBlocksAsleep = 0;
+}
+
+void PerformanceMonitor::timerCallback()
+{
+    collect();
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <juce_events/juce_events.h>
+#include "RealtimeSafetyMonitor.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Times every audio callback and every graph node without locking or allocating
+// on the audio thread. Durations go into one lock-free ring per slot; a timer on
+// the message thread drains the rings into histograms that can be read at leisure.
+//
+// Nodes use the same slots that RealtimeSafetyMonitor hands out; slot 0 times the
+// whole callback. Each ring has a single producer, so nodes left sharing slot 0
+// once the slots have run out aren't recorded at all.
+class PerformanceMonitor : private juce::Timer
+{
+public:
+    static constexpr int callbackSlot = RealtimeSafetyMonitor::engineSlot;
+    static constexpr int maxSlots = RealtimeSafetyMonitor::maxSlots;
+
+    struct Stats
+    {
+        uint64_t numBlocks = 0;
+        double meanMicros = 0.0;
+        double p50Micros = 0.0;
+        double p99Micros = 0.0;
+        double maxMicros = 0.0;
+
+        // The same figures as a percentage of the time available for one block
+        double p50PercentOfDeadline = 0.0;
+        double p99PercentOfDeadline = 0.0;
+        double maxPercentOfDeadline = 0.0;
+
+        // Blocks skipped because the node was asleep, and the time that saved going by
+        // the node's mean processing time
+        uint64_t numBlocksAsleep = 0;
+        double percentAsleep = 0.0;
+        double savedMicros = 0.0;
+    };
+
+    PerformanceMonitor();
+    ~PerformanceMonitor() override;
+
+    // Start or stop recording. Recording is on by default.
+    void setEnabled(bool shouldBeEnabled);
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Whether a node's slot is its own, so that its timings can be recorded
+    static bool hasOwnSlot(int slot) noexcept { return slot != callbackSlot && juce::isPositiveAndBelow(slot, maxSlots); }
+
+    // Record how long a node took (audio or render worker thread)
+    void recordNode(int slot, std::chrono::steady_clock::duration duration) noexcept;
+
+    // Record a block that a node skipped while asleep (audio or render worker thread)
+    void recordSleep(int slot) noexcept;
+
+    // Record a whole callback, and check it against the block deadline (audio thread only)
+    void recordCallback(std::chrono::steady_clock::time_point start,
+                        std::chrono::steady_clock::time_point end,
+                        int numSamples,
+                        double sampleRate) noexcept;
+
+    // Move everything recorded so far into the histograms (message thread only)
+    void collect();
+
+    // Statistics since the last reset (message thread only)
+    Stats getStats(int slot) const;
+
+    // Callbacks that took longer than the block they were rendering
+    uint64_t getNumOverruns() const { return numOverruns.load(std::memory_order_relaxed); }
+
+    // Callbacks that started more than half a block later than expected
+    uint64_t getNumLateCallbacks() const { return numLateCallbacks.load(std::memory_order_relaxed); }
+
+    // Timings lost because a ring filled up before the message thread drained it
+    uint64_t getNumDroppedRecords() const { return numDroppedRecords.load(std::memory_order_relaxed); }
+
+    // Time available for the most recent block
+    double getDeadlineMicros() const { return deadlineMicros.load(std::memory_order_relaxed); }
+
+    // Clear all statistics (message thread only)
+    void reset();
+
+    // Clear one node's statistics, before its slot goes to another node (message thread only)
+    void resetSlot(int slot);
+
+private:
+    static constexpr int ringSize = 4096;
+    static constexpr int numBins = 400;
+
+    // Log-spaced bins from 100 ns, 5% apart
+    struct Histogram
+    {
+        std::array<uint64_t, numBins> bins {};
+        uint64_t count = 0;
+        double totalNanos = 0.0;
+        uint32_t maxNanos = 0;
+
+        void add(uint32_t nanos);
+        double getPercentileNanos(double fraction) const;
+    };
+
+    struct Slot
+    {
+        juce::AbstractFifo fifo { ringSize };
+        std::array<uint32_t, ringSize> ring {};
+        Histogram histogram;
+        std::atomic<uint64_t> numBlocksAsleep { 0 };
+    };
+
+    void push(int slot, uint32_t nanos) noexcept;
+    void timerCallback() override;
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::atomic<bool> enabled { true };
+
+    std::atomic<uint64_t> numOverruns { 0 };
+    std::atomic<uint64_t> numLateCallbacks { 0 };
+    std::atomic<uint64_t> numDroppedRecords { 0 };
+    std::atomic<double> deadlineMicros { 0.0 };
+
+    // Audio thread only
+    std::chrono::steady_clock::time_point lastCallbackStart;
+
+    JUCE_DECLARE_NON_COPYABLE(PerformanceMonitor)
+};
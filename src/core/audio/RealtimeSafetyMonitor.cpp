@@ -0,0 +1,416 @@
+#include "RealtimeSafetyMonitor.h"
+#include <cstdlib>
+#include <new>
+
+#if VSTLINKHOST_RT_SAFETY_CHECKS && JUCE_LINUX
+  #include <cerrno>
+  #include <cstdint>
+  #include <dlfcn.h>
+  #include <pthread.h>
+  #include <sched.h>
+  #include <unistd.h>
+#elif VSTLINKHOST_RT_SAFETY_CHECKS && JUCE_WINDOWS
+  #include <malloc.h>
+#endif
+
+namespace
+{
+    // Plain zero-initialised globals, so the interposed functions never run a static initialiser
+    std::atomic<bool> checksEnabled;
+    std::atomic<uint64_t> allocationCounts[RealtimeSafetyMonitor::maxSlots];
+    std::atomic<uint64_t> freeCounts[RealtimeSafetyMonitor::maxSlots];
+    std::atomic<uint64_t> mutexWaitCounts[RealtimeSafetyMonitor::maxSlots];
+
+    // The slot the current thread's activity is charged to, or -1 when it isn't watched
+    thread_local int watchedSlot = -1;
+
+    [[maybe_unused]] inline void noteAllocation() noexcept
+    {
+        if (watchedSlot >= 0)
+            allocationCounts[watchedSlot].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[maybe_unused]] inline void noteFree() noexcept
+    {
+        if (watchedSlot >= 0)
+            freeCounts[watchedSlot].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[maybe_unused]] inline void noteMutexWait() noexcept
+    {
+        if (watchedSlot >= 0)
+            mutexWaitCounts[watchedSlot].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+RealtimeSafetyMonitor& RealtimeSafetyMonitor::getInstance()
+{
+    static RealtimeSafetyMonitor instance;
+    return instance;
+}
+
+bool RealtimeSafetyMonitor::isCompiledIn()
+{
+   #if VSTLINKHOST_RT_SAFETY_CHECKS
+    return true;
+   #else
+    return false;
+   #endif
+}
+
+void RealtimeSafetyMonitor::setEnabled(bool shouldBeEnabled)
+{
+    checksEnabled = shouldBeEnabled && isCompiledIn();
+}
+
+bool RealtimeSafetyMonitor::isEnabled() const
+{
+    return checksEnabled;
+}
+
+int RealtimeSafetyMonitor::getSlotForNode(juce::uint32 nodeUid)
+{
+    auto existing = nodeSlots.find(nodeUid);
+    if (existing != nodeSlots.end())
+        return existing->second;
+
+    // Slots of removed nodes are handed out again before new ones
+    if (! releasedSlots.empty())
+    {
+        const auto slot = releasedSlots.back();
+        releasedSlots.pop_back();
+        nodeSlots[nodeUid] = slot;
+        return slot;
+    }
+
+    if (nextFreeSlot >= maxSlots)
+    {
+        if (! reportedOutOfSlots)
+            juce::Logger::writeToLog("Out of monitoring slots: nodes added from now on aren't timed or checked individually");
+
+        reportedOutOfSlots = true;
+        nodeSlots[nodeUid] = engineSlot;
+        return engineSlot;
+    }
+
+    nodeSlots[nodeUid] = nextFreeSlot;
+    return nextFreeSlot++;
+}
+
+int RealtimeSafetyMonitor::releaseSlotForNode(juce::uint32 nodeUid)
+{
+    auto existing = nodeSlots.find(nodeUid);
+    if (existing == nodeSlots.end())
+        return -1;
+
+    const auto slot = existing->second;
+    nodeSlots.erase(existing);
+
+    if (slot == engineSlot)
+        return -1;
+
+    allocationCounts[slot] = 0;
+    freeCounts[slot] = 0;
+    mutexWaitCounts[slot] = 0;
+
+    releasedSlots.push_back(slot);
+    reportedOutOfSlots = false;
+    return slot;
+}
+
+int RealtimeSafetyMonitor::findSlotForNode(juce::uint32 nodeUid) const
+{
+    auto existing = nodeSlots.find(nodeUid);
+    return existing != nodeSlots.end() ? existing->second : -1;
+}
+
+RealtimeSafetyMonitor::Counts RealtimeSafetyMonitor::getCounts(int slot) const
+{
+    Counts counts;
+
+    if (juce::isPositiveAndBelow(slot, maxSlots))
+    {
+        counts.allocations = allocationCounts[slot].load(std::memory_order_relaxed);
+        counts.frees = freeCounts[slot].load(std::memory_order_relaxed);
+        counts.mutexWaits = mutexWaitCounts[slot].load(std::memory_order_relaxed);
+    }
+
+    return counts;
+}
+
+void RealtimeSafetyMonitor::reset()
+{
+    for (int slot = 0; slot < maxSlots; ++slot)
+    {
+        allocationCounts[slot] = 0;
+        freeCounts[slot] = 0;
+        mutexWaitCounts[slot] = 0;
+    }
+}
+
+RealtimeSafetyMonitor::ScopedWatch::ScopedWatch(int slot) noexcept
+    : previousSlot(watchedSlot)
+{
+    watchedSlot = checksEnabled.load(std::memory_order_relaxed) ? slot : -1;
+}
+
+RealtimeSafetyMonitor::ScopedWatch::~ScopedWatch()
+{
+    watchedSlot = previousSlot;
+}
+
+#if VSTLINKHOST_RT_SAFETY_CHECKS && JUCE_LINUX
+
+// Interpose the C allocator and pthread locking for the whole process, plugins included.
+// These are exported from the executable through cmake/RealtimeSafetyExports.list.
+extern "C"
+{
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void __libc_free(void*);
+    void* __libc_memalign(size_t, size_t);
+
+    void* malloc(size_t size) noexcept
+    {
+        noteAllocation();
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t numElements, size_t elementSize) noexcept
+    {
+        noteAllocation();
+        return __libc_calloc(numElements, elementSize);
+    }
+
+    void* realloc(void* pointer, size_t size) noexcept
+    {
+        noteAllocation();
+        return __libc_realloc(pointer, size);
+    }
+
+    // The aligned allocators, which plugins use for SIMD buffers and libstdc++ for
+    // over-aligned operator new, all come down to glibc's memalign
+    void* memalign(size_t alignment, size_t size) noexcept
+    {
+        noteAllocation();
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) noexcept
+    {
+        noteAllocation();
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** pointer, size_t alignment, size_t size) noexcept
+    {
+        if (alignment == 0 || alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+
+        noteAllocation();
+
+        auto* allocated = __libc_memalign(alignment, size);
+
+        if (allocated == nullptr)
+            return ENOMEM;
+
+        *pointer = allocated;
+        return 0;
+    }
+
+    // The obsolete page-aligned ones, which glibc doesn't route through memalign above
+    void* valloc(size_t size) noexcept
+    {
+        noteAllocation();
+        return __libc_memalign((size_t) sysconf(_SC_PAGESIZE), size);
+    }
+
+    void* pvalloc(size_t size) noexcept
+    {
+        const auto pageSize = (size_t) sysconf(_SC_PAGESIZE);
+
+        if (size > SIZE_MAX - pageSize)
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+
+        noteAllocation();
+
+        // Rounded up to whole pages, and at least one
+        return __libc_memalign(pageSize, juce::jmax(pageSize, (size + pageSize - 1) & ~(pageSize - 1)));
+    }
+
+    void free(void* pointer) noexcept
+    {
+        if (pointer != nullptr)
+            noteFree();
+
+        __libc_free(pointer);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+    {
+        using LockFunction = int (*)(pthread_mutex_t*);
+        static std::atomic<LockFunction> realLock { nullptr };
+        static thread_local bool isResolving = false;
+
+        auto lock = realLock.load(std::memory_order_acquire);
+
+        if (lock == nullptr)
+        {
+            // dlsym may take a lock itself; spin on trylock while it resolves
+            if (isResolving)
+            {
+                while (pthread_mutex_trylock(mutex) != 0)
+                    sched_yield();
+
+                return 0;
+            }
+
+            isResolving = true;
+            lock = reinterpret_cast<LockFunction>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+            isResolving = false;
+            realLock.store(lock, std::memory_order_release);
+        }
+
+        if (watchedSlot >= 0)
+        {
+            if (pthread_mutex_trylock(mutex) == 0)
+                return 0;
+
+            noteMutexWait();
+        }
+
+        return lock(mutex);
+    }
+}
+
+#elif VSTLINKHOST_RT_SAFETY_CHECKS
+
+// Without symbol interposition, the best we can see is C++ allocations made by this binary
+void* operator new(std::size_t size)
+{
+    noteAllocation();
+
+    if (auto* pointer = std::malloc(size == 0 ? 1 : size))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    noteAllocation();
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    if (pointer != nullptr)
+        noteFree();
+
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+// Over-aligned types, such as SIMD-friendly buffers, come through these
+namespace
+{
+    void* allocateAligned(std::size_t size, std::align_val_t alignment) noexcept
+    {
+        noteAllocation();
+
+        const auto numBytes = size == 0 ? 1 : size;
+        const auto alignmentBytes = juce::jmax((std::size_t) alignment, sizeof(void*));
+
+       #if JUCE_WINDOWS
+        return _aligned_malloc(numBytes, alignmentBytes);
+       #else
+        void* pointer = nullptr;
+        return posix_memalign(&pointer, alignmentBytes, numBytes) == 0 ? pointer : nullptr;
+       #endif
+    }
+
+    void freeAligned(void* pointer) noexcept
+    {
+        if (pointer != nullptr)
+            noteFree();
+
+       #if JUCE_WINDOWS
+        _aligned_free(pointer);
+       #else
+        std::free(pointer);
+       #endif
+    }
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (auto* pointer = allocateAligned(size, alignment))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    freeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    freeAligned(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    freeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    freeAligned(pointer);
+}
+
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Counts heap allocations, frees and contended mutex locks made by threads that
+// are rendering audio, attributed to the graph node that was running at the time.
+//
+// The trap is compiled in with VSTLINKHOST_RT_SAFETY_CHECKS (on by default in Debug
+// builds) and switched on at runtime with setEnabled(). On Linux it interposes
+// malloc/free, the aligned allocators and pthread_mutex_lock, so it also sees plugins;
+// elsewhere it replaces the global operator new/delete, aligned forms included, and
+// can't see lock waits.
+class RealtimeSafetyMonitor
+{
+public:
+    // Slot 0 collects everything the engine itself does outside of a node
+    static constexpr int engineSlot = 0;
+    static constexpr int maxSlots = 256;
+
+    struct Counts
+    {
+        uint64_t allocations = 0;
+        uint64_t frees = 0;
+        uint64_t mutexWaits = 0;
+
+        bool isClean() const { return allocations == 0 && frees == 0 && mutexWaits == 0; }
+    };
+
+    static RealtimeSafetyMonitor& getInstance();
+
+    // Whether the trap was compiled into this build
+    static bool isCompiledIn();
+
+    // Start or stop counting
+    void setEnabled(bool shouldBeEnabled);
+    bool isEnabled() const;
+
+    // Get the counter slot for a graph node, assigning one on first use (message thread only).
+    // When all slots are taken, nodes share the engine slot, which PerformanceMonitor and
+    // DeadlineWatchdog don't record nodes into.
+    int getSlotForNode(juce::uint32 nodeUid);
+
+    // Give a removed node's slot back, with its counters cleared, once no render plan that
+    // charges anything to it can run any more (message thread only). Returns the slot it
+    // had, or -1 if it had none of its own.
+    int releaseSlotForNode(juce::uint32 nodeUid);
+
+    // The slot a node has been given, or -1 if it hasn't been given one yet (message thread only)
+    int findSlotForNode(juce::uint32 nodeUid) const;
+
+    Counts getCounts(int slot) const;
+
+    // Clear all counters
+    void reset();
+
+    // Attributes anything the current thread does to a slot until it goes out of scope
+    class ScopedWatch
+    {
+    public:
+        explicit ScopedWatch(int slot) noexcept;
+        ~ScopedWatch();
+
+    private:
+        int previousSlot;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedWatch)
+    };
+
+private:
+    RealtimeSafetyMonitor() = default;
+
+    std::map<juce::uint32, int> nodeSlots;
+    std::vector<int> releasedSlots;
+    int nextFreeSlot = engineSlot + 1;
+    bool reportedOutOfSlots = false;
+
+    JUCE_DECLARE_NON_COPYABLE(RealtimeSafetyMonitor)
+};
@@ -0,0 +1,1126 @@
+#include "RenderPlan.h"
+#include "SampleConversion.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+
+namespace
+{
+    // Room for a few hundred short MIDI events per node before MidiBuffer has to grow
+    constexpr size_t midiBufferBytes = 4096;
+
+    template <typename SampleType>
+    bool isDigitalSilence(const SampleType* samples, int numSamples) noexcept
+    {
+        const auto range = juce::FloatVectorOperations::findMinAndMax(samples, numSamples);
+        return range.getStart() == SampleType() && range.getEnd() == SampleType();
+    }
+}
+
+std::unique_ptr<RenderPlan> RenderPlan::compile(const Graph& graph,
+                                                const Settings& settings,
+                                                std::shared_ptr<RenderThreadPool> threadPool,
+                                                const RenderPlan* previousPlan)
+{
+    std::unique_ptr<RenderPlan> plan(new RenderPlan());
+    plan->settings = settings;
+
+    // Frozen nodes are left out, along with their connections; a streaming node plays
+    // back what they rendered
+    std::vector<Graph::Node::Ptr> nodes;
+
+    for (auto* node : graph.getNodes())
+        if (! node->properties[frozenNodeProperty])
+            nodes.push_back(node);
+
+    const auto connections = graph.getConnections();
+    const auto numNodes = (int) nodes.size();
+
+    std::map<NodeID, int> nodeIndices;
+    for (int i = 0; i < numNodes; ++i)
+        nodeIndices[nodes[(size_t) i]->nodeID] = i;
+
+    // Order the nodes so that every node comes after all of the nodes feeding it
+    std::vector<std::vector<int>> destinations((size_t) numNodes);
+    std::vector<int> numPendingSources((size_t) numNodes, 0);
+    std::set<std::pair<int, int>> edges;
+
+    for (const auto& connection : connections)
+    {
+        auto source = nodeIndices.find(connection.source.nodeID);
+        auto destination = nodeIndices.find(connection.destination.nodeID);
+
+        if (source == nodeIndices.end() || destination == nodeIndices.end())
+            continue;
+
+        if (edges.insert({ source->second, destination->second }).second)
+        {
+            destinations[(size_t) source->second].push_back(destination->second);
+            ++numPendingSources[(size_t) destination->second];
+        }
+    }
+
+    std::vector<int> order;
+    order.reserve((size_t) numNodes);
+
+    for (int i = 0; i < numNodes; ++i)
+        if (numPendingSources[(size_t) i] == 0)
+            order.push_back(i);
+
+    for (size_t i = 0; i < order.size(); ++i)
+        for (auto destination : destinations[(size_t) order[i]])
+            if (--numPendingSources[(size_t) destination] == 0)
+                order.push_back(destination);
+
+    // AudioEngine::connectNodes refuses feedback loops, so every node should be reachable
+    jassert((int) order.size() == numNodes);
+
+    // Create one step per node, each with its own preallocated MIDI buffer
+    std::map<NodeID, int> stepIndices;
+    plan->steps.resize(order.size());
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        auto& step = plan->steps[i];
+        step.node = nodes[(size_t) order[i]];
+        step.processor = step.node->getProcessor();
+        step.numInputChannels = step.processor->getTotalNumInputChannels();
+        step.numOutputChannels = step.processor->getTotalNumOutputChannels();
+
+        using IOProcessor = Graph::AudioGraphIOProcessor;
+        if (auto* ioProcessor = dynamic_cast<IOProcessor*>(step.processor))
+        {
+            switch (ioProcessor->getType())
+            {
+                case IOProcessor::audioInputNode:  step.kind = StepKind::audioInput; break;
+                case IOProcessor::audioOutputNode: step.kind = StepKind::audioOutput; break;
+                case IOProcessor::midiInputNode:   step.kind = StepKind::midiInput; break;
+                case IOProcessor::midiOutputNode:  step.kind = StepKind::midiOutput; break;
+            }
+        }
+
+        // The engine decides each plugin's precision when it prepares it
+        step.isDoublePrecision = step.kind == StepKind::processor && step.processor->isUsingDoublePrecision();
+
+        step.midi.ensureSize(midiBufferBytes);
+        step.audioSources.resize((size_t) step.numInputChannels);
+        step.safetySlot = step.kind == StepKind::processor
+                            ? RealtimeSafetyMonitor::getInstance().getSlotForNode(step.node->nodeID.uid)
+                            : RealtimeSafetyMonitor::engineSlot;
+
+        stepIndices[step.node->nodeID] = (int) i;
+    }
+
+    for (const auto& connection : connections)
+    {
+        auto source = stepIndices.find(connection.source.nodeID);
+        auto destination = stepIndices.find(connection.destination.nodeID);
+
+        if (source == stepIndices.end() || destination == stepIndices.end())
+            continue;
+
+        auto& sourceStep = plan->steps[(size_t) source->second];
+        auto& destinationStep = plan->steps[(size_t) destination->second];
+
+        if (connection.source.isMIDI() && connection.destination.isMIDI())
+        {
+            destinationStep.midiSources.push_back(source->second);
+        }
+        else if (juce::isPositiveAndBelow(connection.source.channelIndex, sourceStep.numOutputChannels)
+                 && juce::isPositiveAndBelow(connection.destination.channelIndex, destinationStep.numInputChannels))
+        {
+            destinationStep.audioSources[(size_t) connection.destination.channelIndex]
+                .push_back({ source->second, connection.source.channelIndex });
+        }
+    }
+
+    // MIDI routed straight from input ports, into buffers sized up front
+    if (auto* routing = settings.midiRouting.get())
+    {
+        const auto& destinations = routing->getDestinations();
+        plan->routedMidi.resize(destinations.size());
+
+        for (auto& buffer : plan->routedMidi)
+            buffer.ensureSize(midiBufferBytes);
+
+        for (auto& step : plan->steps)
+        {
+            auto found = std::find(destinations.begin(), destinations.end(), step.node->nodeID);
+
+            if (step.kind == StepKind::processor && found != destinations.end())
+                step.routedMidiSlot = (int) (found - destinations.begin());
+        }
+    }
+
+    plan->findLiveSteps(previousPlan);
+    plan->allocateBuffers();
+    plan->compensateLatency(previousPlan);
+    plan->resolvePrecision();
+    plan->findSleepingPoints();
+    plan->createDryPaths();
+
+    // Work out what each live step waits for, and how wide that part of the graph gets.
+    // Steps rendered ahead of time are done by the time the audio thread needs them.
+    std::vector<int> depths(plan->steps.size(), 0);
+    std::vector<int> numProcessorsAtDepth(plan->steps.size() + 1, 0);
+    int numProcessorSteps = 0;
+
+    for (auto index : plan->liveSteps)
+    {
+        const auto i = (size_t) index;
+        auto& step = plan->steps[i];
+
+        std::set<int> sources;
+        for (auto source : step.midiSources)
+            if (plan->steps[(size_t) source].isLive)
+                sources.insert(source);
+
+        for (const auto& channelSources : step.audioSources)
+            for (const auto& source : channelSources)
+                if (plan->steps[(size_t) source.step].isLive)
+                    sources.insert(source.step);
+
+        step.numDependencies = (int) sources.size();
+
+        for (auto source : sources)
+        {
+            plan->steps[(size_t) source].dependents.push_back((int) i);
+            depths[i] = juce::jmax(depths[i], depths[(size_t) source] + 1);
+        }
+
+        if (step.numDependencies == 0)
+            plan->initialSteps.push_back((int) i);
+
+        if (step.kind == StepKind::processor)
+        {
+            ++numProcessorSteps;
+            plan->parallelism = juce::jmax(plan->parallelism, ++numProcessorsAtDepth[(size_t) depths[i]]);
+        }
+    }
+
+    // Small or purely serial graphs gain nothing from the pool but the handover cost
+    if (threadPool != nullptr
+        && threadPool->getNumWorkers() > 0
+        && plan->parallelism > 1
+        && numProcessorSteps >= settings.minNodesForParallelRendering
+        && (int) plan->liveSteps.size() <= RenderThreadPool::maxTasksPerRound)
+    {
+        plan->threadPool = std::move(threadPool);
+        plan->pendingDependencies.reset(new std::atomic<int>[plan->steps.size()]);
+    }
+
+    return plan;
+}
+
+void RenderPlan::findLiveSteps(const RenderPlan* previousPlan)
+{
+    for (auto& step : steps)
+        step.isLive = ! settings.anticipativeRendering
+                   || step.kind != StepKind::processor
+                   || step.routedMidiSlot >= 0
+                   || (bool) step.node->properties[liveNodeProperty];
+
+    // Nodes the previous plan rendered ahead of time, which may now have to wait for the
+    // anticipating thread to let go of them, and nodes still waiting since an earlier plan.
+    // That thread may be several plans behind, so each keeps the generation it became live in.
+    std::set<NodeID> previouslyAnticipated;
+    std::map<NodeID, uint64_t> previouslyMoved;
+
+    if (previousPlan != nullptr)
+    {
+        for (auto index : previousPlan->anticipativeSteps)
+            previouslyAnticipated.insert(previousPlan->steps[(size_t) index].node->nodeID);
+
+        for (auto index : previousPlan->liveSteps)
+            if (const auto& previous = previousPlan->steps[(size_t) index]; previous.liveSinceGeneration > 0)
+                previouslyMoved[previous.node->nodeID] = previous.liveSinceGeneration;
+    }
+
+    // Anything fed by a live step is live. MIDI can't be passed through the rings, so
+    // a live step's MIDI sources are live too. Repeat until both rules agree.
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+
+        for (auto& step : steps)
+        {
+            if (step.isLive)
+                continue;
+
+            for (auto source : step.midiSources)
+                step.isLive = step.isLive || steps[(size_t) source].isLive;
+
+            for (const auto& channelSources : step.audioSources)
+                for (const auto& source : channelSources)
+                    step.isLive = step.isLive || steps[(size_t) source.step].isLive;
+
+            changed = changed || step.isLive;
+        }
+
+        for (auto i = steps.size(); i-- > 0;)
+        {
+            if (! steps[i].isLive)
+                continue;
+
+            for (auto source : steps[i].midiSources)
+            {
+                if (! steps[(size_t) source].isLive)
+                {
+                    steps[(size_t) source].isLive = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < steps.size(); ++i)
+    {
+        auto& step = steps[i];
+
+        if (step.isLive)
+        {
+            liveSteps.push_back((int) i);
+            step.movedToLive = previouslyAnticipated.count(step.node->nodeID) > 0;
+
+            if (auto moved = previouslyMoved.find(step.node->nodeID); moved != previouslyMoved.end())
+                step.liveSinceGeneration = moved->second;
+        }
+        else
+        {
+            anticipativeSteps.push_back((int) i);
+            continue;
+        }
+
+        // Audio arriving from steps rendered ahead of time comes through a ring
+        for (size_t channel = 0; channel < step.audioSources.size(); ++channel)
+        {
+            for (auto& source : step.audioSources[channel])
+            {
+                if (steps[(size_t) source.step].isLive)
+                    continue;
+
+                const Graph::Connection connection { { steps[(size_t) source.step].node->nodeID, source.channel },
+                                                     { step.node->nodeID, (int) channel } };
+                std::shared_ptr<AudioRingBuffer> ring;
+
+                if (previousPlan != nullptr)
+                {
+                    auto previous = previousPlan->rings.find(connection);
+
+                    if (previous != previousPlan->rings.end()
+                        && previous->second->getCapacity() == settings.anticipationLookahead
+                        && previous->second->getMaxReadSize() >= settings.blockSize)
+                        ring = previous->second;
+                }
+
+                if (ring == nullptr)
+                    ring = std::make_shared<AudioRingBuffer>(settings.anticipationLookahead, settings.blockSize);
+
+                source.ring = ring.get();
+                ringFeeds.push_back({ source.step, source.channel, ring.get() });
+                rings[connection] = std::move(ring);
+            }
+        }
+    }
+}
+
+void RenderPlan::allocateBuffers()
+{
+    silence.assign((size_t) settings.blockSize, 0.0f);
+
+    for (auto& step : steps)
+    {
+        const auto blockSize = step.isLive ? settings.blockSize : settings.anticipativeBlockSize;
+
+        // Device inputs are read in place, and the output node writes straight into the device
+        const auto numChannels = step.kind == StepKind::processor ? juce::jmax(step.numInputChannels, step.numOutputChannels)
+                                                                   : 0;
+
+        // Every channel gets storage of its own, outputs nobody reads included, so a plugin
+        // that reads back what it wrote to one never finds another output's samples there.
+        // The buffers own their channel lists too, so resizing them never allocates.
+        if (step.isDoublePrecision)
+            step.doubleBuffer.setSize(numChannels, blockSize);
+
+        step.buffer.setSize(numChannels, blockSize);
+        step.buffer.clear();
+    }
+}
+
+void RenderPlan::compensateLatency(const RenderPlan* previousPlan)
+{
+    // Steps are in processing order, so every source's latency is known before it is needed
+    for (size_t i = 0; i < steps.size(); ++i)
+    {
+        auto& step = steps[i];
+        int inputLatency = 0;
+
+        for (auto source : step.midiSources)
+            inputLatency = juce::jmax(inputLatency, steps[(size_t) source].latency);
+
+        for (const auto& channelSources : step.audioSources)
+            for (const auto& source : channelSources)
+                inputLatency = juce::jmax(inputLatency, steps[(size_t) source.step].latency);
+
+        // Delay every audio input that arrives earlier than the latest one
+        const auto maxBlockSize = step.isLive ? settings.blockSize : settings.anticipativeBlockSize;
+
+        for (size_t channel = 0; channel < step.audioSources.size(); ++channel)
+        {
+            for (auto& source : step.audioSources[channel])
+            {
+                const auto delay = inputLatency - steps[(size_t) source.step].latency;
+                if (delay <= 0)
+                    continue;
+
+                const Graph::Connection connection { { steps[(size_t) source.step].node->nodeID, source.channel },
+                                                     { step.node->nodeID, (int) channel } };
+                std::shared_ptr<DelayLine> line;
+
+                if (previousPlan != nullptr)
+                {
+                    auto previous = previousPlan->delayLines.find(connection);
+
+                    if (previous != previousPlan->delayLines.end()
+                        && previous->second->getDelay() == delay
+                        && previous->second->getMaxBlockSize() >= maxBlockSize)
+                        line = previous->second;
+                }
+
+                if (line == nullptr)
+                    line = std::make_shared<DelayLine>(delay, maxBlockSize);
+
+                source.delay = line.get();
+                delayLines[connection] = std::move(line);
+            }
+        }
+
+        step.latency = inputLatency;
+
+        if (step.kind == StepKind::processor)
+            step.latency += juce::jmax(0, step.processor->getLatencySamples());
+
+        if (step.kind == StepKind::audioOutput)
+            latencySamples = juce::jmax(latencySamples, inputLatency);
+    }
+
+    // MIDI isn't delayed along with the audio, so it leaves this much early
+    for (const auto& step : steps)
+        if (step.kind == StepKind::midiOutput)
+            midiOutputDelaySamples = juce::jmax(0, latencySamples - step.latency);
+}
+
+void RenderPlan::resolvePrecision()
+{
+    for (auto& step : steps)
+    {
+        if (step.isDoublePrecision)
+            ++numDoublePrecisionSteps;
+
+        for (auto& channelSources : step.audioSources)
+        {
+            for (auto& source : channelSources)
+            {
+                auto& sourceStep = steps[(size_t) source.step];
+
+                if (! sourceStep.isDoublePrecision)
+                    continue;
+
+                // Delay lines and rings carry single precision, so those paths are narrowed too
+                source.readsDouble = step.isDoublePrecision && source.delay == nullptr && source.ring == nullptr;
+
+                auto& narrowed = sourceStep.narrowedChannels;
+                if (! source.readsDouble && std::find(narrowed.begin(), narrowed.end(), source.channel) == narrowed.end())
+                    narrowed.push_back(source.channel);
+            }
+        }
+    }
+}
+
+void RenderPlan::findSleepingPoints()
+{
+    if (! settings.sleepSilentNodes)
+        return;
+
+    // Plugins with an unbounded tail report it as infinite or absurdly long
+    constexpr double maxTailSeconds = 600.0;
+
+    for (auto& step : steps)
+    {
+        if (step.kind != StepKind::processor || (bool) step.node->properties[neverSleepNodeProperty])
+            continue;
+
+        // A node with nothing connected to it is generating sound on its own
+        const auto hasInputs = ! step.midiSources.empty()
+                            || std::any_of(step.audioSources.begin(), step.audioSources.end(),
+                                           [](const std::vector<Source>& sources) { return ! sources.empty(); });
+
+        const auto tailSeconds = step.processor->getTailLengthSeconds();
+
+        if (! hasInputs || ! (tailSeconds >= 0.0 && tailSeconds < maxTailSeconds))
+            continue;
+
+        // Whatever went in last still has to make it through the plugin's latency
+        step.sleepAfterSamples = (int64_t) std::ceil(tailSeconds * settings.sampleRate)
+                               + juce::jmax(0, step.processor->getLatencySamples());
+    }
+}
+
+void RenderPlan::createDryPaths()
+{
+    if (settings.watchdog == nullptr)
+        return;
+
+    for (auto& step : steps)
+    {
+        const auto latency = step.kind == StepKind::processor ? step.processor->getLatencySamples() : 0;
+
+        if (latency <= 0)
+            continue;
+
+        const auto maxBlockSize = step.isLive ? settings.blockSize : settings.anticipativeBlockSize;
+
+        for (int channel = 0; channel < juce::jmin(step.numInputChannels, step.numOutputChannels); ++channel)
+            step.dryDelays.push_back(std::make_unique<DelayLine>(latency, maxBlockSize));
+    }
+}
+
+void RenderPlan::process(const float* const* inputChannelData,
+                         int numInputChannels,
+                         float* const* outputChannelData,
+                         int numOutputChannels,
+                         int numSamples,
+                         const MidiInputBlock& midiInput,
+                         juce::MidiBuffer& midiOutput,
+                         juce::int64 timelinePosition,
+                         BlockArena& arena) noexcept
+{
+    // Devices may occasionally deliver more samples than we prepared for
+    for (int startSample = 0; startSample < numSamples; startSample += settings.blockSize)
+    {
+        const auto numThisTime = juce::jmin(settings.blockSize, numSamples - startSample);
+
+        currentChunk = { inputChannelData, numInputChannels,
+                         outputChannelData, numOutputChannels,
+                         &midiInput, &midiOutput, startSample, numThisTime, &arena };
+        currentChunk.timelinePosition = timelinePosition + startSample;
+
+        routeMidiInput(currentChunk);
+
+        if (threadPool == nullptr)
+        {
+            for (auto index : liveSteps)
+                processStep(steps[(size_t) index], currentChunk);
+
+            continue;
+        }
+
+        for (auto index : liveSteps)
+            pendingDependencies[(size_t) index].store(steps[(size_t) index].numDependencies, std::memory_order_relaxed);
+
+        const auto blockDuration = std::chrono::duration<double>(numThisTime / settings.sampleRate);
+        const auto deadline = std::chrono::steady_clock::now()
+                            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockDuration);
+
+        threadPool->run(*this, initialSteps.data(), (int) initialSteps.size(), (int) liveSteps.size(), deadline);
+    }
+}
+
+bool RenderPlan::renderAhead(BlockArena& arena, juce::int64 position, juce::int64 livePosition) noexcept
+{
+    if (ringFeeds.empty())
+        return false;
+
+    const auto numSamples = settings.anticipativeBlockSize;
+
+    for (const auto& feed : ringFeeds)
+        if (! feed.ring->canWrite(position, numSamples, livePosition))
+            return false;
+
+    Chunk chunk;
+    chunk.numSamples = numSamples;
+    chunk.arena = &arena;
+    chunk.isRealtime = false;
+    chunk.timelinePosition = position;
+
+    for (auto index : anticipativeSteps)
+        processStep(steps[(size_t) index], chunk);
+
+    // Rings this plan created start at the same position as the ones it carried over
+    for (const auto& feed : ringFeeds)
+        feed.ring->write(steps[(size_t) feed.step].buffer.getReadPointer(feed.channel), numSamples, position);
+
+    return true;
+}
+
+int RenderPlan::getNodeLatencySamples(NodeID nodeID) const
+{
+    for (const auto& step : steps)
+        if (step.node->nodeID == nodeID)
+            return step.latency;
+
+    return -1;
+}
+
+uint64_t RenderPlan::getNumAnticipationUnderruns() const
+{
+    uint64_t total = 0;
+
+    for (const auto& ring : rings)
+        total += ring.second->getNumUnderruns();
+
+    return total;
+}
+
+void RenderPlan::runTask(int taskIndex, RenderThreadPool::TaskQueue& queue) noexcept
+{
+    auto& step = steps[(size_t) taskIndex];
+    processStep(step, currentChunk);
+
+    for (auto dependent : step.dependents)
+        if (pendingDependencies[(size_t) dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            queue.push(dependent);
+}
+
+void RenderPlan::processStep(Step& step, const Chunk& chunk) noexcept
+{
+    const auto numSamples = chunk.numSamples;
+
+    // Anything this step allocates or waits for is charged to its node, unless it is
+    // being rendered ahead of time, where that does no harm
+    const RealtimeSafetyMonitor::ScopedWatch watch(chunk.isRealtime ? step.safetySlot : -1);
+
+    // Only happens for odd-sized device blocks. Shrinking or regrowing within the size
+    // the plan was compiled for never reallocates, whatever the number of channels.
+    if (step.buffer.getNumSamples() != numSamples)
+        step.buffer.setSize(step.buffer.getNumChannels(), numSamples, false, false, true);
+
+    if (step.isDoublePrecision && step.doubleBuffer.getNumSamples() != numSamples)
+        step.doubleBuffer.setSize(step.doubleBuffer.getNumChannels(), numSamples, false, false, true);
+
+    switch (step.kind)
+    {
+        case StepKind::audioInput:
+        {
+            // Nothing to do: the steps it feeds read the device inputs in place
+            break;
+        }
+
+        case StepKind::audioOutput:
+        {
+            const auto numChannels = juce::jmax(chunk.numOutputChannels, (int) step.audioSources.size());
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto* destination = channel < chunk.numOutputChannels ? chunk.outputChannelData[channel] : nullptr;
+
+                if (destination != nullptr)
+                {
+                    destination += chunk.startSample;
+                    juce::FloatVectorOperations::clear(destination, numSamples);
+                }
+
+                if (channel >= (int) step.audioSources.size())
+                    continue;
+
+                // Sources are read even if the device has nowhere to put them, so rings keep draining
+                for (const auto& source : step.audioSources[(size_t) channel])
+                {
+                    const auto* samples = readSource(source, chunk);
+
+                    if (destination != nullptr)
+                        juce::FloatVectorOperations::add(destination, samples, numSamples);
+                }
+            }
+            break;
+        }
+
+        case StepKind::midiInput:
+        {
+            // The events that fall in this chunk, relative to its start, as bytes for the plugins
+            step.midi.clear();
+
+            if (chunk.midiInput != nullptr)
+            {
+                const auto& merged = chunk.midiInput->merged;
+                const auto end = chunk.startSample + chunk.numSamples;
+
+                for (auto* event = merged.findNextSamplePosition(chunk.startSample); event != merged.end() && event->samplePosition < end; ++event)
+                {
+                    inputTranslator.toMidi1(event->words, [&](const juce::uint8* data, int numBytes)
+                    {
+                        step.midi.addEvent(data, numBytes, event->samplePosition - chunk.startSample);
+                    });
+                }
+            }
+
+            break;
+        }
+
+        case StepKind::midiOutput:
+        {
+            // Handed to the caller at its place in the whole block
+            gatherInputs(step, chunk);
+
+            if (chunk.midiOutput != nullptr)
+                chunk.midiOutput->addEvents(step.midi, 0, numSamples, chunk.startSample);
+
+            break;
+        }
+
+        case StepKind::processor:
+        {
+            // Still in the anticipating thread's hands: never call a plugin from two threads at
+            // once, nor touch the delay lines on its inputs, which that thread's plan shares
+            if (step.liveSinceGeneration > anticipationGeneration)
+            {
+                step.buffer.clear();
+                step.doubleBuffer.clear();
+                step.midi.clear();
+                break;
+            }
+
+            gatherInputs(step, chunk);
+
+            if (step.sleepAfterSamples >= 0 && shouldSleep(step, numSamples))
+            {
+                // Skipped: the output is silence, and so is any MIDI it would have sent
+                step.buffer.clear();
+                step.doubleBuffer.clear();
+                step.midi.clear();
+
+                if (auto* monitor = settings.performanceMonitor;
+                    monitor != nullptr && monitor->isEnabled() && PerformanceMonitor::hasOwnSlot(step.safetySlot))
+                    monitor->recordSleep(step.safetySlot);
+
+                break;
+            }
+
+            if (step.isDoublePrecision)
+            {
+                for (int channel = step.numInputChannels; channel < step.doubleBuffer.getNumChannels(); ++channel)
+                    step.doubleBuffer.clear(channel, 0, numSamples);
+            }
+            else
+            {
+                for (int channel = step.numInputChannels; channel < step.buffer.getNumChannels(); ++channel)
+                    step.buffer.clear(channel, 0, numSamples);
+            }
+
+            // A quarantined plugin isn't called at all; its input goes straight through
+            const auto isQuarantined = settings.watchdog != nullptr && settings.watchdog->isQuarantined(step.safetySlot);
+
+            if (isQuarantined)
+                renderDryPath(step, numSamples);
+            else
+                renderProcessor(step, chunk);
+
+            step.wasQuarantined = isQuarantined;
+
+            for (auto channel : step.narrowedChannels)
+                SampleConversion::convert(step.doubleBuffer.getReadPointer(channel),
+                                          step.buffer.getWritePointer(channel), numSamples);
+            break;
+        }
+    }
+}
+
+void RenderPlan::renderProcessor(Step& step, const Chunk& chunk) noexcept
+{
+    // Never wait for a plugin's callback lock: skip the block instead
+    const juce::ScopedTryLock lock(step.processor->getCallbackLock());
+
+    if (! lock.isLocked() || step.processor->isSuspended())
+    {
+        step.buffer.clear();
+        step.doubleBuffer.clear();
+        step.midi.clear();
+    }
+    else
+    {
+        auto* monitor = settings.performanceMonitor;
+        auto* watchdog = settings.watchdog;
+        const auto isMonitored = monitor != nullptr && monitor->isEnabled()
+                              && PerformanceMonitor::hasOwnSlot(step.safetySlot);
+        const auto isWatched = watchdog != nullptr && watchdog->isEnabled() && chunk.isRealtime;
+        const auto isTimed = isMonitored || isWatched;
+        const auto start = isTimed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+        if (step.isDoublePrecision)
+        {
+            if (step.node->isBypassed())
+                step.processor->processBlockBypassed(step.doubleBuffer, step.midi);
+            else
+                step.processor->processBlock(step.doubleBuffer, step.midi);
+        }
+        else
+        {
+            if (step.node->isBypassed())
+                step.processor->processBlockBypassed(step.buffer, step.midi);
+            else
+                step.processor->processBlock(step.buffer, step.midi);
+        }
+
+        const auto duration = isTimed ? std::chrono::steady_clock::now() - start : std::chrono::steady_clock::duration();
+
+        if (isMonitored)
+            monitor->recordNode(step.safetySlot, duration);
+
+        // Only blocks rendered against the device deadline count against a plugin
+        if (isWatched)
+            watchdog->recordNode(step.safetySlot, duration, chunk.numSamples);
+    }
+}
+
+void RenderPlan::renderDryPath(Step& step, int numSamples) noexcept
+{
+    // Start from silence, rather than whatever was left from the last quarantine
+    if (! step.wasQuarantined)
+        for (auto& line : step.dryDelays)
+            line->clear();
+
+    // Inputs are processed in place, so channels without a delay line are already through
+    for (int channel = 0; channel < (int) step.dryDelays.size(); ++channel)
+    {
+        auto& line = *step.dryDelays[(size_t) channel];
+
+        if (step.isDoublePrecision)
+        {
+            // The channel's single-precision storage is free to use until it is narrowed into
+            auto* scratch = step.buffer.getWritePointer(channel);
+            SampleConversion::convert(step.doubleBuffer.getReadPointer(channel), scratch, numSamples);
+            SampleConversion::convert(line.process(scratch, numSamples), step.doubleBuffer.getWritePointer(channel), numSamples);
+        }
+        else
+        {
+            step.buffer.copyFrom(channel, 0, line.process(step.buffer.getReadPointer(channel), numSamples), numSamples);
+        }
+    }
+}
+
+bool RenderPlan::shouldSleep(Step& step, int numSamples) noexcept
+{
+    auto isSilent = [&]
+    {
+        if (! step.midi.isEmpty())
+            return false;
+
+        for (int channel = 0; channel < (int) step.audioSources.size(); ++channel)
+        {
+            // Channels fed only by sleeping steps are known to be silent without looking
+            const auto& sources = step.audioSources[(size_t) channel];
+            const auto allAsleep = std::all_of(sources.begin(), sources.end(), [this](const Source& source)
+            {
+                return source.delay == nullptr && source.ring == nullptr && steps[(size_t) source.step].isAsleep;
+            });
+
+            if (allAsleep)
+                continue;
+
+            const auto silent = step.isDoublePrecision ? isDigitalSilence(step.doubleBuffer.getReadPointer(channel), numSamples)
+                                                       : isDigitalSilence(step.buffer.getReadPointer(channel), numSamples);
+
+            if (! silent)
+                return false;
+        }
+
+        return true;
+    };
+
+    if (! isSilent())
+    {
+        // Wake up straight away, for this very block
+        step.silentInputSamples = 0;
+        step.isAsleep = false;
+        return false;
+    }
+
+    // Asleep once the input was already silent for the whole tail before this block started
+    step.isAsleep = step.silentInputSamples >= step.sleepAfterSamples;
+    step.silentInputSamples += numSamples;
+    return step.isAsleep;
+}
+
+void RenderPlan::gatherInputs(Step& step, const Chunk& chunk) noexcept
+{
+    if (step.isDoublePrecision)
+        gatherDoubleInputs(step, chunk);
+    else
+        gatherFloatInputs(step, chunk);
+
+    gatherMidi(step, chunk);
+}
+
+void RenderPlan::gatherMidi(Step& step, const Chunk& chunk) noexcept
+{
+    const auto numSamples = chunk.numSamples;
+    const auto* routed = step.routedMidiSlot >= 0 ? &routedMidi[(size_t) step.routedMidiSlot] : nullptr;
+
+    step.midi.clear();
+
+    if (step.midiSources.size() + (routed != nullptr ? 1 : 0) == 1)
+    {
+        step.midi.addEvents(routed != nullptr ? *routed : steps[(size_t) step.midiSources.front()].midi, 0, numSamples, 0);
+        return;
+    }
+
+    // Merging several sources: sort all their events once in arena scratch space, then
+    // append them in order, rather than inserting each source into the middle of the buffer
+    int numEvents = routed != nullptr ? routed->getNumEvents() : 0;
+    for (auto source : step.midiSources)
+        numEvents += steps[(size_t) source].midi.getNumEvents();
+
+    if (numEvents == 0)
+        return;
+
+    struct PendingEvent
+    {
+        const juce::uint8* data;
+        int numBytes;
+        int samplePosition;
+        int order;
+    };
+
+    auto* events = chunk.arena->allocate<PendingEvent>((size_t) numEvents);
+
+    if (events == nullptr)
+    {
+        for (auto source : step.midiSources)
+            step.midi.addEvents(steps[(size_t) source].midi, 0, numSamples, 0);
+
+        if (routed != nullptr)
+            step.midi.addEvents(*routed, 0, numSamples, 0);
+
+        return;
+    }
+
+    int numGathered = 0;
+    const auto gather = [&](const juce::MidiBuffer& source)
+    {
+        for (const auto metadata : source)
+        {
+            events[numGathered] = { metadata.data, metadata.numBytes, metadata.samplePosition, numGathered };
+            ++numGathered;
+        }
+    };
+
+    for (auto source : step.midiSources)
+        gather(steps[(size_t) source].midi);
+
+    if (routed != nullptr)
+        gather(*routed);
+
+    std::sort(events, events + numGathered, [](const PendingEvent& a, const PendingEvent& b)
+    {
+        return a.samplePosition != b.samplePosition ? a.samplePosition < b.samplePosition
+                                                    : a.order < b.order;
+    });
+
+    for (int i = 0; i < numGathered; ++i)
+        step.midi.addEvent(events[i].data, events[i].numBytes, events[i].samplePosition);
+}
+
+void RenderPlan::routeMidiInput(const Chunk& chunk) noexcept
+{
+    auto* routing = settings.midiRouting.get();
+
+    if (routing == nullptr || chunk.midiInput == nullptr)
+        return;
+
+    for (auto& buffer : routedMidi)
+        buffer.clear();
+
+    const auto start = chunk.startSample;
+    const auto end = chunk.startSample + chunk.numSamples;
+    const auto numPorts = juce::jmin(routing->getNumPorts(), chunk.midiInput->numPorts);
+
+    for (int port = 0; port < numPorts; ++port)
+    {
+        const auto& events = chunk.midiInput->ports[(size_t) port];
+
+        for (auto* event = events.findNextSamplePosition(start); event != events.end() && event->samplePosition < end; ++event)
+        {
+            const auto targets = routing->lookup(port, *event);
+
+            if (targets.first == targets.second)
+                continue;
+
+            // Converted once, however many destinations it has
+            routingTranslators[(size_t) port].toMidi1(event->words, [&](const juce::uint8* data, int numBytes)
+            {
+                for (auto* target = targets.first; target != targets.second; ++target)
+                    routedMidi[*target].addEvent(data, numBytes, event->samplePosition - start);
+            });
+        }
+    }
+}
+
+void RenderPlan::gatherFloatInputs(Step& step, const Chunk& chunk) noexcept
+{
+    const auto numSamples = chunk.numSamples;
+
+    for (int channel = 0; channel < (int) step.audioSources.size(); ++channel)
+    {
+        const auto& sources = step.audioSources[(size_t) channel];
+
+        if (sources.empty())
+        {
+            step.buffer.clear(channel, 0, numSamples);
+            continue;
+        }
+
+        step.buffer.copyFrom(channel, 0, readSource(sources.front(), chunk), numSamples);
+
+        for (size_t i = 1; i < sources.size(); ++i)
+            step.buffer.addFrom(channel, 0, readSource(sources[i], chunk), numSamples);
+    }
+}
+
+void RenderPlan::gatherDoubleInputs(Step& step, const Chunk& chunk) noexcept
+{
+    const auto numSamples = chunk.numSamples;
+
+    for (int channel = 0; channel < (int) step.audioSources.size(); ++channel)
+    {
+        const auto& sources = step.audioSources[(size_t) channel];
+        auto* destination = step.doubleBuffer.getWritePointer(channel);
+
+        if (sources.empty())
+            juce::FloatVectorOperations::clear(destination, numSamples);
+
+        // Audio from other double-precision steps is summed as it is; anything else is widened on the way in
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            const auto& source = sources[i];
+
+            if (source.readsDouble)
+            {
+                const auto* samples = steps[(size_t) source.step].doubleBuffer.getReadPointer(source.channel);
+
+                if (i == 0)
+                    juce::FloatVectorOperations::copy(destination, samples, numSamples);
+                else
+                    juce::FloatVectorOperations::add(destination, samples, numSamples);
+            }
+            else
+            {
+                const auto* samples = readSource(source, chunk);
+
+                if (i == 0)
+                    SampleConversion::convert(samples, destination, numSamples);
+                else
+                    SampleConversion::add(samples, destination, numSamples);
+            }
+        }
+    }
+}
+
+const float* RenderPlan::readSource(const Source& source, const Chunk& chunk) noexcept
+{
+    const auto numSamples = chunk.numSamples;
+    const float* samples = nullptr;
+
+    if (source.ring != nullptr)
+    {
+        samples = source.ring->read(chunk.timelinePosition, numSamples);
+    }
+    else if (steps[(size_t) source.step].kind == StepKind::audioInput)
+    {
+        samples = source.channel < chunk.numInputChannels && chunk.inputChannelData[source.channel] != nullptr
+                    ? chunk.inputChannelData[source.channel] + chunk.startSample
+                    : silence.data();
+    }
+    else
+    {
+        samples = steps[(size_t) source.step].buffer.getReadPointer(source.channel);
+    }
+
+    if (source.delay != nullptr)
+        return source.delay->process(samples, numSamples);
+
+    return samples;
+}
+
+void RenderPlanExchange::publish(std::unique_ptr<RenderPlan> plan)
+{
+    jassert(plan != nullptr);
+
+    plan->generation = nextGeneration++;
+
+    // Steps that have just moved to the live side wait for the anticipating thread to reach this plan
+    for (auto& step : plan->steps)
+        if (step.movedToLive)
+            step.liveSinceGeneration = plan->generation;
+
+    auto* newest = plan.get();
+    plans.push_back(std::move(plan));
+
+    latestPlan.store(newest, std::memory_order_release);
+}
+
+RenderPlan* RenderPlanExchange::acquire() noexcept
+{
+    auto* plan = latestPlan.load(std::memory_order_acquire);
+
+    // Once the audio thread has seen a plan it never looks at an older one again
+    if (plan != nullptr && plan->generation != audioThreadGeneration)
+    {
+        audioThreadGeneration = plan->generation;
+        acknowledgedGeneration.store(audioThreadGeneration, std::memory_order_release);
+    }
+
+    // The anticipating thread only takes a plan up once it has finished a block on the
+    // previous one, so once it has reached the plan a step became live in, nothing it
+    // renders can be that step any more
+    if (plan != nullptr)
+        plan->anticipationGeneration = anticipationGeneration.load(std::memory_order_acquire);
+
+    return plan;
+}
+
+void RenderPlanExchange::beginAnticipation() noexcept
+{
+    // Hold on to everything until the anticipating thread says which plan it is on
+    anticipationPlan = nullptr;
+    anticipationGeneration.store(0, std::memory_order_release);
+}
+
+RenderPlan* RenderPlanExchange::acquireForAnticipation() noexcept
+{
+    auto* plan = latestPlan.load(std::memory_order_acquire);
+
+    // Only move on once the audio thread has, so that a node that moved to this side
+    // is never rendered by both threads. Nodes moving the other way are held back by
+    // the audio thread until this thread has acknowledged the new plan.
+    if (plan != nullptr && plan->generation <= acknowledgedGeneration.load(std::memory_order_acquire))
+    {
+        anticipationPlan = plan;
+        anticipationGeneration.store(plan->generation, std::memory_order_release);
+    }
+
+    return anticipationPlan;
+}
+
+void RenderPlanExchange::endAnticipation() noexcept
+{
+    anticipationPlan = nullptr;
+    anticipationGeneration.store(notAnticipating, std::memory_order_release);
+}
+
+void RenderPlanExchange::collectGarbage(bool audioCallbackStopped)
+{
+    if (plans.size() <= 1)
+        return;
+
+    auto oldestVisible = audioCallbackStopped ? plans.back()->generation
+                                              : acknowledgedGeneration.load(std::memory_order_acquire);
+    oldestVisible = std::min(oldestVisible, anticipationGeneration.load(std::memory_order_acquire));
+
+    plans.erase(std::remove_if(plans.begin(), plans.end(),
+                               [oldestVisible](const std::unique_ptr<RenderPlan>& plan)
+                               {
+                                   return plan->generation < oldestVisible;
+                               }),
+                plans.end());
+}
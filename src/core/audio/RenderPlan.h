@@ -0,0 +1,388 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "AudioRingBuffer.h"
+#include "BlockArena.h"
+#include "DeadlineWatchdog.h"
+#include "DelayLine.h"
+#include "PerformanceMonitor.h"
+#include "RealtimeSafetyMonitor.h"
+#include "RenderThreadPool.h"
+#include "../midi/MidiInputPorts.h"
+#include "../midi/MidiRoutingTable.h"
+#include "../midi/UmpTranslator.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+// A compiled, immutable snapshot of the processor graph topology.
+// Plans are built on the message thread and rendered by the audio thread,
+// which never locks or allocates while doing so.
+class RenderPlan : private RenderThreadPool::Job
+{
+public:
+    using Graph = juce::AudioProcessorGraph;
+    using NodeID = Graph::NodeID;
+
+    struct Settings
+    {
+        double sampleRate = 44100.0;
+        int blockSize = 512;
+
+        // Smallest number of processor nodes worth spreading over the thread pool
+        static constexpr int defaultMinNodesForParallelRendering = 4;
+        int minNodesForParallelRendering = defaultMinNodesForParallelRendering;
+
+        // Where each node's processing time is recorded, if anywhere
+        PerformanceMonitor* performanceMonitor = nullptr;
+
+        // Render nodes that no live input reaches ahead of time, in larger blocks, on
+        // the anticipative render thread. Nodes with the "live" property set (armed
+        // tracks, say) always render in the audio callback.
+        bool anticipativeRendering = false;
+        int anticipativeBlockSize = 2048;
+
+        // How far ahead of the audio thread the anticipated audio may get
+        int anticipationLookahead = 8192;
+
+        // Skip nodes whose inputs have been silent for longer than their tail, with no MIDI coming in
+        bool sleepSilentNodes = false;
+
+        // Checks each node against the block deadline, and says which ones to leave out, if anything
+        DeadlineWatchdog* watchdog = nullptr;
+
+        // Where MIDI from each input port goes besides the MIDI input node, if anywhere
+        std::shared_ptr<const MidiRoutingTable> midiRouting;
+    };
+
+    // Node property that keeps a node, and everything it feeds, in the audio callback
+    static constexpr const char* liveNodeProperty = "live";
+
+    // Node property that keeps a node awake however long its inputs are silent
+    static constexpr const char* neverSleepNodeProperty = "neverSleep";
+
+    // Node property that leaves a node out of the plan altogether (see ChainFreezer)
+    static constexpr const char* frozenNodeProperty = "frozen";
+
+    // Compile the current topology of a graph. Nodes must already be prepared.
+    // If a thread pool is given and the graph is wide enough, independent
+    // branches are rendered on it in parallel.
+    //
+    // Paths with different plugin latencies are lined up with delay lines. Lines
+    // whose delay hasn't changed since the previous plan carry on from it, so only
+    // the paths affected by a latency change are disturbed.
+    static std::unique_ptr<RenderPlan> compile(const Graph& graph,
+                                               const Settings& settings,
+                                               std::shared_ptr<RenderThreadPool> threadPool = nullptr,
+                                               const RenderPlan* previousPlan = nullptr);
+
+    // Render one block from the device inputs into the device outputs (audio thread only),
+    // with midiInput coming out of the MIDI input node and going wherever the routing
+    // table sends it, and whatever reaches the MIDI output node added to midiOutput.
+    // Anticipated audio is taken from where the block starts on the play head's timeline.
+    // Per-block scratch memory comes from the arena, which the caller resets each block.
+    void process(const float* const* inputChannelData,
+                 int numInputChannels,
+                 float* const* outputChannelData,
+                 int numOutputChannels,
+                 int numSamples,
+                 const MidiInputBlock& midiInput,
+                 juce::MidiBuffer& midiOutput,
+                 juce::int64 timelinePosition,
+                 BlockArena& arena) noexcept;
+
+    const Settings& getSettings() const { return settings; }
+    int getNumSteps() const { return (int) steps.size(); }
+
+    // Largest number of nodes that can run at the same time
+    int getParallelism() const { return parallelism; }
+
+    // Latency from the audio input node to the audio output node, in samples
+    int getLatencySamples() const { return latencySamples; }
+
+    // How far the MIDI output node's events are ahead of the audio output, in samples
+    int getMidiOutputDelaySamples() const { return midiOutputDelaySamples; }
+
+    // Latency of a node's output relative to the audio input, or -1 if the node isn't in the plan
+    int getNodeLatencySamples(NodeID nodeID) const;
+
+    // Number of delay lines inserted to compensate for plugin latency
+    int getNumDelayLines() const { return (int) delayLines.size(); }
+
+    // Number of steps rendered ahead of time rather than in the audio callback
+    int getNumAnticipativeSteps() const { return (int) anticipativeSteps.size(); }
+
+    // Number of steps whose processors were prepared for double precision
+    int getNumDoublePrecisionSteps() const { return numDoublePrecisionSteps; }
+
+    // Render the non-live steps one large block ahead, to be heard at position on the
+    // play head's timeline, if every ring they feed has room for it while the audio
+    // thread is at livePosition. Returns false if there was nothing to do
+    // (anticipative render thread only).
+    bool renderAhead(BlockArena& arena, juce::int64 position, juce::int64 livePosition) noexcept;
+
+    // Blocks in which the audio thread found less anticipated audio than it needed
+    uint64_t getNumAnticipationUnderruns() const;
+
+    // Whether blocks are spread over the thread pool or rendered serially
+    bool isRenderingInParallel() const { return threadPool != nullptr; }
+
+    // Generation number assigned by the RenderPlanExchange that published this plan
+    uint64_t getGeneration() const { return generation; }
+
+private:
+    friend class RenderPlanExchange;
+
+    RenderPlan() = default;
+
+    enum class StepKind
+    {
+        processor,
+        audioInput,
+        audioOutput,
+        midiInput,
+        midiOutput
+    };
+
+    // A (step, channel) pair that feeds an input channel of another step, with the
+    // delay line that lines it up with the step's other inputs, if it needs one, and
+    // the ring it arrives through if it was rendered ahead of time
+    struct Source
+    {
+        int step;
+        int channel;
+        DelayLine* delay = nullptr;
+        AudioRingBuffer* ring = nullptr;
+
+        // Passed from one double-precision step to another without narrowing
+        bool readsDouble = false;
+    };
+
+    struct Step
+    {
+        Graph::Node::Ptr node;
+        juce::AudioProcessor* processor = nullptr;
+        StepKind kind = StepKind::processor;
+
+        // Sources summed into each input channel, and the steps feeding MIDI
+        std::vector<std::vector<Source>> audioSources;
+        std::vector<int> midiSources;
+
+        // Events routed straight from input ports, as an index into routedMidi, or -1
+        int routedMidiSlot = -1;
+
+        // Steps that read from this one, and the number of distinct steps this one reads from
+        std::vector<int> dependents;
+        int numDependencies = 0;
+
+        int numInputChannels = 0;
+        int numOutputChannels = 0;
+
+        // Latency of this step's output relative to the audio input, in samples
+        int latency = 0;
+
+        // Rendered in the audio callback rather than ahead of time
+        bool isLive = true;
+
+        // Rendered ahead of time in the previous plan. The anticipating thread may still be
+        // rendering it in any plan before the one it became live in, so it stays silent until
+        // that thread has taken up liveSinceGeneration, which publish() fills in for moved steps
+        // and later plans carry over. 0 for steps that were never anticipated.
+        bool movedToLive = false;
+        uint64_t liveSinceGeneration = 0;
+
+        // Processed through doubleBuffer. Output channels that something reads in single
+        // precision are narrowed into `buffer` after each block.
+        bool isDoublePrecision = false;
+        juce::AudioBuffer<double> doubleBuffer;
+        std::vector<int> narrowedChannels;
+
+        // Samples of silent input after which this step's output is silent too, or -1 if
+        // it never sleeps; and how long its input has been silent. A step that is asleep
+        // isn't processed, and its output is silence.
+        int64_t sleepAfterSamples = -1;
+        int64_t silentInputSamples = 0;
+        bool isAsleep = false;
+
+        // While the watchdog has the node in quarantine, its inputs are passed through
+        // these, one per channel, so that the dry signal keeps the plugin's latency
+        std::vector<std::unique_ptr<DelayLine>> dryDelays;
+        bool wasQuarantined = false;
+
+        // RealtimeSafetyMonitor slot that this step's violations and timings are charged to
+        int safetySlot = RealtimeSafetyMonitor::engineSlot;
+
+        // A channel for every input and output, allocated when the plan is compiled
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+    };
+
+    // The range of samples being rendered, shared with the worker threads
+    struct Chunk
+    {
+        const float* const* inputChannelData = nullptr;
+        int numInputChannels = 0;
+        float* const* outputChannelData = nullptr;
+        int numOutputChannels = 0;
+        const MidiInputBlock* midiInput = nullptr;
+        juce::MidiBuffer* midiOutput = nullptr;
+        int startSample = 0;
+        int numSamples = 0;
+        BlockArena* arena = nullptr;
+
+        // Rendered against the device deadline, rather than ahead of time
+        bool isRealtime = true;
+
+        // Where startSample falls on the play head's timeline, for reading the rings
+        juce::int64 timelinePosition = 0;
+    };
+
+    // Render a step for a chunk
+    void processStep(Step& step, const Chunk& chunk) noexcept;
+
+    // Call a processor step's plugin, or pass its input through in its place
+    void renderProcessor(Step& step, const Chunk& chunk) noexcept;
+    void renderDryPath(Step& step, int numSamples) noexcept;
+
+    // Sum each input channel's sources and merge the incoming MIDI
+    void gatherInputs(Step& step, const Chunk& chunk) noexcept;
+    void gatherMidi(Step& step, const Chunk& chunk) noexcept;
+
+    // Sort a chunk's incoming MIDI into routedMidi through the routing table
+    void routeMidiInput(const Chunk& chunk) noexcept;
+    void gatherFloatInputs(Step& step, const Chunk& chunk) noexcept;
+    void gatherDoubleInputs(Step& step, const Chunk& chunk) noexcept;
+
+    // Read a source for the current chunk, through its ring and delay line if it has
+    // them. Device inputs are read in place. Each source must be read exactly once per chunk.
+    const float* readSource(const Source& source, const Chunk& chunk) noexcept;
+
+    // Give each processor step a buffer for all of its channels
+    void allocateBuffers();
+
+    // Decide which steps have to run in the audio callback, and connect the rest to it through rings
+    void findLiveSteps(const RenderPlan* previousPlan);
+
+    // Work out each step's latency and add delay lines where paths meet out of line
+    void compensateLatency(const RenderPlan* previousPlan);
+
+    // Decide where audio has to change precision between steps
+    void resolvePrecision();
+
+    // Work out how long each step has to hear silence before it may sleep
+    void findSleepingPoints();
+
+    // Give plugins with latency the delay lines their dry path needs if they are quarantined
+    void createDryPaths();
+
+    // Update a step's silence count from its gathered inputs, and decide whether to skip it
+    bool shouldSleep(Step& step, int numSamples) noexcept;
+
+    // RenderThreadPool::Job
+    void runTask(int taskIndex, RenderThreadPool::TaskQueue& queue) noexcept override;
+
+    Settings settings;
+    std::vector<Step> steps;
+    uint64_t generation = 0;
+
+    // Read in place of device input channels that don't exist
+    std::vector<float> silence;
+
+    // Delay lines by the connection they delay. Shared with the plans before and
+    // after this one; only the plan being rendered ever touches their contents.
+    std::map<Graph::Connection, std::shared_ptr<DelayLine>> delayLines;
+    int latencySamples = 0;
+    int midiOutputDelaySamples = 0;
+
+    // Steps rendered by the audio callback and ahead of time, in processing order
+    std::vector<int> liveSteps;
+    std::vector<int> anticipativeSteps;
+
+    // The plan the anticipating thread had taken up when the audio thread acquired this one,
+    // set by RenderPlanExchange::acquire() to keep steps it may still be rendering silent
+    // (audio thread only)
+    uint64_t anticipationGeneration = 0;
+    int numDoublePrecisionSteps = 0;
+
+    // Rings carrying anticipated audio to live steps, by connection, shared between
+    // plans like the delay lines; and the step output channel that fills each one
+    struct RingFeed
+    {
+        int step;
+        int channel;
+        AudioRingBuffer* ring;
+    };
+
+    std::map<Graph::Connection, std::shared_ptr<AudioRingBuffer>> rings;
+    std::vector<RingFeed> ringFeeds;
+
+    // Parallel rendering state; threadPool is null when rendering serially
+    std::shared_ptr<RenderThreadPool> threadPool;
+    std::unique_ptr<std::atomic<int>[]> pendingDependencies;
+    std::vector<int> initialSteps;
+    int parallelism = 1;
+
+    // The chunk the audio callback is rendering
+    Chunk currentChunk;
+
+    // Incoming MIDI for each of the routing table's destinations, for the current chunk
+    std::vector<juce::MidiBuffer> routedMidi;
+
+    // Turn incoming packets back into bytes for the plugins: for the MIDI input node,
+    // and for each port being routed. One per stream, so split SysEx goes back together.
+    UmpTranslator inputTranslator;
+    std::array<UmpTranslator, MidiInputPorts::maxPorts> routingTranslators;
+
+    JUCE_DECLARE_NON_COPYABLE(RenderPlan)
+};
+
+// Hands compiled plans from the message thread to the audio thread.
+// The audio thread picks up the newest plan at the start of a block with a
+// single atomic load; plans it can no longer see are freed on the message thread.
+class RenderPlanExchange
+{
+public:
+    RenderPlanExchange() = default;
+    ~RenderPlanExchange() = default;
+
+    // Make a plan current from the next block on (message thread only)
+    void publish(std::unique_ptr<RenderPlan> plan);
+
+    // Get the plan to render the current block with (audio thread only)
+    RenderPlan* acquire() noexcept;
+
+    // A second reader, rendering ahead of the audio thread, follows it onto each new
+    // plan once the audio thread has picked it up. Plans it may still be using are
+    // not collected between beginAnticipation() and endAnticipation().
+    void beginAnticipation() noexcept;
+    RenderPlan* acquireForAnticipation() noexcept;
+    void endAnticipation() noexcept;
+
+    // The most recently published plan, or nullptr (message thread only)
+    const RenderPlan* getLatestPlan() const { return plans.empty() ? nullptr : plans.back().get(); }
+
+    // The generation the next plan will get, and the oldest one not yet freed. Once the oldest
+    // reaches a generation, nothing from before it can be rendered any more (message thread only).
+    uint64_t getNextGeneration() const { return nextGeneration; }
+    uint64_t getOldestGeneration() const { return plans.empty() ? nextGeneration : plans.front()->generation; }
+
+    // Free plans the audio thread has moved past. If the audio callback is known
+    // not to be running, everything but the newest plan is freed (message thread only).
+    void collectGarbage(bool audioCallbackStopped);
+
+private:
+    std::vector<std::unique_ptr<RenderPlan>> plans;
+    std::atomic<RenderPlan*> latestPlan { nullptr };
+    std::atomic<uint64_t> acknowledgedGeneration { 0 };
+    std::atomic<uint64_t> anticipationGeneration { notAnticipating };
+    RenderPlan* anticipationPlan = nullptr;
+    static constexpr uint64_t notAnticipating = std::numeric_limits<uint64_t>::max();
+    uint64_t audioThreadGeneration = 0;
+    uint64_t nextGeneration = 1;
+
+    JUCE_DECLARE_NON_COPYABLE(RenderPlanExchange)
+};
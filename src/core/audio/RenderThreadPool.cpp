@@ -0,0 +1,322 @@
+#include "RenderThreadPool.h"
+#include <thread>
+
+#if JUCE_WINDOWS
+  #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+  #include <dispatch/dispatch.h>
+#else
+  #include <semaphore.h>
+#endif
+
+namespace
+{
+    // How long a worker spins looking for a task before it parks
+    constexpr auto spinBeforeParking = std::chrono::microseconds(50);
+}
+
+// Counting semaphore whose signal never blocks, so the audio thread can wake the workers
+class RenderThreadPool::Semaphore
+{
+public:
+#if JUCE_WINDOWS
+    Semaphore() : handle(CreateSemaphore(nullptr, 0, LONG_MAX, nullptr)) {}
+    ~Semaphore() { CloseHandle(handle); }
+    void signal(int count) noexcept { if (count > 0) ReleaseSemaphore(handle, count, nullptr); }
+    void wait() noexcept { WaitForSingleObject(handle, INFINITE); }
+
+private:
+    HANDLE handle;
+#elif JUCE_MAC || JUCE_IOS
+    Semaphore() : semaphore(dispatch_semaphore_create(0)) {}
+    ~Semaphore() { dispatch_release(semaphore); }
+    void signal(int count) noexcept { for (int i = 0; i < count; ++i) dispatch_semaphore_signal(semaphore); }
+    void wait() noexcept { dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER); }
+
+private:
+    dispatch_semaphore_t semaphore;
+#else
+    Semaphore() { sem_init(&semaphore, 0, 0); }
+    ~Semaphore() { sem_destroy(&semaphore); }
+    void signal(int count) noexcept { for (int i = 0; i < count; ++i) sem_post(&semaphore); }
+    void wait() noexcept { while (sem_wait(&semaphore) != 0) {} }
+
+private:
+    sem_t semaphore;
+#endif
+};
+
+class RenderThreadPool::Worker : public juce::Thread
+{
+public:
+    Worker(RenderThreadPool& poolToUse, int participantIndex)
+        : juce::Thread("Render Worker " + juce::String(participantIndex)),
+          pool(poolToUse),
+          index(participantIndex)
+    {
+    }
+
+    void run() override
+    {
+        pool.workerLoop(index);
+    }
+
+private:
+    RenderThreadPool& pool;
+    const int index;
+};
+
+RenderThreadPool::WorkDeque::WorkDeque()
+    : tasks(new std::atomic<int>[(size_t) maxTasksPerRound])
+{
+}
+
+void RenderThreadPool::WorkDeque::reset() noexcept
+{
+    top.store(0, std::memory_order_relaxed);
+    bottom.store(0, std::memory_order_relaxed);
+}
+
+void RenderThreadPool::WorkDeque::push(int taskIndex) noexcept
+{
+    // Every task is pushed at most once per round, so the deque never wraps
+    const auto b = bottom.load(std::memory_order_relaxed);
+    jassert(b < maxTasksPerRound);
+
+    tasks[(size_t) b].store(taskIndex, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+}
+
+bool RenderThreadPool::WorkDeque::pop(int& taskIndex) noexcept
+{
+    const auto b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    taskIndex = tasks[(size_t) b].load(std::memory_order_relaxed);
+
+    // Racing thieves for the last task
+    if (t == b)
+    {
+        const auto won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    return true;
+}
+
+bool RenderThreadPool::WorkDeque::steal(int& taskIndex) noexcept
+{
+    auto t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const auto b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b)
+        return false;
+
+    taskIndex = tasks[(size_t) t].load(std::memory_order_relaxed);
+    return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+int RenderThreadPool::WorkDeque::getApproximateSize() const noexcept
+{
+    return juce::jmax(0, bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed));
+}
+
+RenderThreadPool::RenderThreadPool(int numWorkers)
+    : wakeUp(std::make_unique<Semaphore>()),
+      taskReady(std::make_unique<Semaphore>())
+{
+    for (int i = 0; i <= numWorkers; ++i)
+        deques.push_back(std::make_unique<WorkDeque>());
+
+    for (int i = 1; i <= numWorkers; ++i)
+    {
+        auto worker = std::make_unique<Worker>(*this, i);
+
+        // Without real-time permissions, fall back to the highest normal priority
+        if (! worker->startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(9)))
+            worker->startThread(juce::Thread::Priority::highest);
+
+        workers.push_back(std::move(worker));
+    }
+}
+
+RenderThreadPool::~RenderThreadPool()
+{
+    shouldExit = true;
+    wakeUp->signal(getNumWorkers());
+
+    for (auto& worker : workers)
+        worker->stopThread(-1);
+}
+
+int RenderThreadPool::getDefaultNumWorkers()
+{
+    return juce::jlimit(0, 15, juce::SystemStats::getNumPhysicalCpus() - 1);
+}
+
+bool RenderThreadPool::run(Job& job,
+                           const int* initialTasks,
+                           int numInitialTasks,
+                           int numTasks,
+                           std::chrono::steady_clock::time_point deadline) noexcept
+{
+    jassert(numTasks <= maxTasksPerRound);
+
+    for (auto& deque : deques)
+        deque->reset();
+
+    currentJob = &job;
+    currentDeadline = deadline;
+    remainingTasks.store(numTasks, std::memory_order_relaxed);
+
+    for (int i = 0; i < numInitialTasks; ++i)
+        deques.front()->push(initialTasks[i]);
+
+    roundOpen.store(true);
+    roundNumber.fetch_add(1);
+    wakeUp->signal(getNumWorkers());
+
+    participate(0);
+
+    // Don't reuse the deques until every worker has left this round
+    roundOpen.store(false);
+
+    while (activeWorkers.load() != 0)
+        std::this_thread::yield();
+
+    if (std::chrono::steady_clock::now() <= deadline)
+        return true;
+
+    numDeadlineMisses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void RenderThreadPool::participate(int index) noexcept
+{
+    auto idleSince = std::chrono::steady_clock::time_point();
+
+    while (remainingTasks.load(std::memory_order_acquire) > 0)
+    {
+        int taskIndex = 0;
+
+        if (findTask(index, taskIndex))
+        {
+            idleSince = {};
+            auto& deque = *deques[(size_t) index];
+            currentJob->runTask(taskIndex, deque);
+
+            // This participant takes one of the tasks it unblocked; the others are for whoever is parked
+            wakeParkedWorkers(deque.getApproximateSize() - 1);
+
+            // The round is over, so nobody should stay parked in it. Sequentially consistent,
+            // like the parking worker's announcement: either it sees the round end or we see it.
+            if (remainingTasks.fetch_sub(1) == 1)
+                taskReady->signal(numParkedWorkers.load());
+
+            continue;
+        }
+
+        // The audio thread never parks: it has to see the round through
+        if (index == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+
+        // Stop spinning once the block is late; the audio thread finishes the round
+        if (now > currentDeadline)
+            break;
+
+        if (idleSince == std::chrono::steady_clock::time_point())
+            idleSince = now;
+
+        if (now - idleSince < spinBeforeParking)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Announce the wait before looking once more, so a task queued meanwhile, or the
+        // end of the round, is sure to signal it
+        numParkedWorkers.fetch_add(1);
+
+        if (remainingTasks.load() > 0 && ! hasQueuedTasks())
+            taskReady->wait();
+
+        numParkedWorkers.fetch_sub(1);
+        idleSince = {};
+    }
+}
+
+void RenderThreadPool::wakeParkedWorkers(int numTasksQueued) noexcept
+{
+    if (numTasksQueued <= 0)
+        return;
+
+    // Pairs with the parking worker's announcement: either it sees the tasks or we see it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const auto numParked = numParkedWorkers.load();
+
+    if (numParked > 0)
+        taskReady->signal(juce::jmin(numParked, numTasksQueued));
+}
+
+bool RenderThreadPool::hasQueuedTasks() const noexcept
+{
+    for (auto& deque : deques)
+        if (deque->getApproximateSize() > 0)
+            return true;
+
+    return false;
+}
+
+bool RenderThreadPool::findTask(int index, int& taskIndex) noexcept
+{
+    if (deques[(size_t) index]->pop(taskIndex))
+        return true;
+
+    const auto numParticipants = (int) deques.size();
+
+    for (int i = 1; i < numParticipants; ++i)
+        if (deques[(size_t) ((index + i) % numParticipants)]->steal(taskIndex))
+            return true;
+
+    return false;
+}
+
+void RenderThreadPool::workerLoop(int index)
+{
+    uint64_t lastRound = 0;
+
+    while (! shouldExit.load())
+    {
+        wakeUp->wait();
+
+        const auto round = roundNumber.load();
+        if (shouldExit.load() || round == lastRound)
+            continue;
+
+        lastRound = round;
+
+        // Announce ourselves before checking the round is still open, so run() can't
+        // reset the deques underneath us
+        activeWorkers.fetch_add(1);
+
+        if (roundOpen.load())
+            participate(index);
+
+        activeWorkers.fetch_sub(1);
+    }
+}
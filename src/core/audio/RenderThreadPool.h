@@ -0,0 +1,111 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// A pool of real-time worker threads that helps the audio thread run the
+// independent parts of a block in parallel. Each participant owns a
+// work-stealing deque; a task that finishes pushes the tasks it unblocked onto
+// its own deque, and idle participants steal from the others.
+class RenderThreadPool
+{
+public:
+    // Largest number of tasks a single round can hold
+    static constexpr int maxTasksPerRound = 1024;
+
+    // Lets a running task hand newly ready tasks back to the pool
+    class TaskQueue
+    {
+    public:
+        virtual ~TaskQueue() = default;
+        virtual void push(int taskIndex) noexcept = 0;
+    };
+
+    // A set of dependent tasks making up one round of work
+    class Job
+    {
+    public:
+        virtual ~Job() = default;
+
+        // Run a task, then push any tasks it made ready onto the queue
+        virtual void runTask(int taskIndex, TaskQueue& queue) noexcept = 0;
+    };
+
+    explicit RenderThreadPool(int numWorkers);
+    ~RenderThreadPool();
+
+    int getNumWorkers() const { return (int) workers.size(); }
+
+    // Run a round from the audio thread, which takes part in it too. Returns once all
+    // tasks have completed; returns false if that happened after the deadline.
+    bool run(Job& job,
+             const int* initialTasks,
+             int numInitialTasks,
+             int numTasks,
+             std::chrono::steady_clock::time_point deadline) noexcept;
+
+    // Number of rounds that finished after their deadline
+    uint64_t getNumDeadlineMisses() const { return numDeadlineMisses.load(std::memory_order_relaxed); }
+
+    // Suggested worker count for this machine, leaving one core for the audio thread
+    static int getDefaultNumWorkers();
+
+private:
+    class Worker;
+    class Semaphore;
+
+    // Fixed-capacity Chase-Lev deque of task indices. The owner pushes and pops
+    // at the bottom, thieves take from the top.
+    class WorkDeque : public TaskQueue
+    {
+    public:
+        WorkDeque();
+
+        void reset() noexcept;
+        void push(int taskIndex) noexcept override;
+        bool pop(int& taskIndex) noexcept;
+        bool steal(int& taskIndex) noexcept;
+
+        // Tasks waiting, which may already be out of date
+        int getApproximateSize() const noexcept;
+
+    private:
+        std::unique_ptr<std::atomic<int>[]> tasks;
+        std::atomic<int> top { 0 };
+        std::atomic<int> bottom { 0 };
+    };
+
+    // Work on the current round as participant `index` until it completes
+    void participate(int index) noexcept;
+    bool findTask(int index, int& taskIndex) noexcept;
+    bool hasQueuedTasks() const noexcept;
+    void workerLoop(int index);
+
+    // Let parked workers come back for the tasks a participant just queued
+    void wakeParkedWorkers(int numTasksQueued) noexcept;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::unique_ptr<Semaphore> wakeUp;
+
+    // Workers that found nothing to do for a while wait here until there is, or the
+    // round ends, rather than spinning on a core
+    std::unique_ptr<Semaphore> taskReady;
+    std::atomic<int> numParkedWorkers { 0 };
+
+    // Participant 0 is the audio thread, the rest are the workers
+    std::vector<std::unique_ptr<WorkDeque>> deques;
+
+    Job* currentJob = nullptr;
+    std::chrono::steady_clock::time_point currentDeadline;
+    std::atomic<uint64_t> roundNumber { 0 };
+    std::atomic<bool> roundOpen { false };
+    std::atomic<int> remainingTasks { 0 };
+    std::atomic<int> activeWorkers { 0 };
+    std::atomic<bool> shouldExit { false };
+    std::atomic<uint64_t> numDeadlineMisses { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(RenderThreadPool)
+};
@@ -0,0 +1,101 @@
+#include "SampleConversion.h"
+#include "Simd.h"
+
+// Each loop handles four samples at a time and finishes the remainder one by one.
+// Loads and stores are unaligned, as channel pointers carry no alignment guarantee.
+
+void SampleConversion::convert(const float* source, double* destination, int numSamples) noexcept
+{
+    int i = 0;
+
+   #if VSTLINKHOST_SIMD_SSE2
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto samples = _mm_loadu_ps(source + i);
+        _mm_storeu_pd(destination + i, _mm_cvtps_pd(samples));
+        _mm_storeu_pd(destination + i + 2, _mm_cvtps_pd(_mm_movehl_ps(samples, samples)));
+    }
+   #elif VSTLINKHOST_SIMD_NEON
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto samples = vld1q_f32(source + i);
+        vst1q_f64(destination + i, vcvt_f64_f32(vget_low_f32(samples)));
+        vst1q_f64(destination + i + 2, vcvt_high_f64_f32(samples));
+    }
+   #endif
+
+    for (; i < numSamples; ++i)
+        destination[i] = (double) source[i];
+}
+
+void SampleConversion::convert(const double* source, float* destination, int numSamples) noexcept
+{
+    int i = 0;
+
+   #if VSTLINKHOST_SIMD_SSE2
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto low = _mm_cvtpd_ps(_mm_loadu_pd(source + i));
+        const auto high = _mm_cvtpd_ps(_mm_loadu_pd(source + i + 2));
+        _mm_storeu_ps(destination + i, _mm_movelh_ps(low, high));
+    }
+   #elif VSTLINKHOST_SIMD_NEON
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto low = vcvt_f32_f64(vld1q_f64(source + i));
+        vst1q_f32(destination + i, vcvt_high_f32_f64(low, vld1q_f64(source + i + 2)));
+    }
+   #endif
+
+    for (; i < numSamples; ++i)
+        destination[i] = (float) source[i];
+}
+
+void SampleConversion::add(const float* source, double* destination, int numSamples) noexcept
+{
+    int i = 0;
+
+   #if VSTLINKHOST_SIMD_SSE2
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto samples = _mm_loadu_ps(source + i);
+        const auto low = _mm_add_pd(_mm_loadu_pd(destination + i), _mm_cvtps_pd(samples));
+        const auto high = _mm_add_pd(_mm_loadu_pd(destination + i + 2), _mm_cvtps_pd(_mm_movehl_ps(samples, samples)));
+        _mm_storeu_pd(destination + i, low);
+        _mm_storeu_pd(destination + i + 2, high);
+    }
+   #elif VSTLINKHOST_SIMD_NEON
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto samples = vld1q_f32(source + i);
+        vst1q_f64(destination + i, vaddq_f64(vld1q_f64(destination + i), vcvt_f64_f32(vget_low_f32(samples))));
+        vst1q_f64(destination + i + 2, vaddq_f64(vld1q_f64(destination + i + 2), vcvt_high_f64_f32(samples)));
+    }
+   #endif
+
+    for (; i < numSamples; ++i)
+        destination[i] += (double) source[i];
+}
+
+void SampleConversion::add(const double* source, float* destination, int numSamples) noexcept
+{
+    int i = 0;
+
+   #if VSTLINKHOST_SIMD_SSE2
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto low = _mm_cvtpd_ps(_mm_loadu_pd(source + i));
+        const auto high = _mm_cvtpd_ps(_mm_loadu_pd(source + i + 2));
+        _mm_storeu_ps(destination + i, _mm_add_ps(_mm_loadu_ps(destination + i), _mm_movelh_ps(low, high)));
+    }
+   #elif VSTLINKHOST_SIMD_NEON
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto samples = vcvt_high_f32_f64(vcvt_f32_f64(vld1q_f64(source + i)), vld1q_f64(source + i + 2));
+        vst1q_f32(destination + i, vaddq_f32(vld1q_f32(destination + i), samples));
+    }
+   #endif
+
+    for (; i < numSamples; ++i)
+        destination[i] += (float) source[i];
+}
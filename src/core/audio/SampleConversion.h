@@ -0,0 +1,15 @@
+#pragma once
+
+// Vectorised conversion between single- and double-precision samples, for the
+// points in the graph where a float-only plugin meets a double-precision one.
+// Source and destination must not overlap.
+namespace SampleConversion
+{
+    // Widen or narrow samples into a destination
+    void convert(const float* source, double* destination, int numSamples) noexcept;
+    void convert(const double* source, float* destination, int numSamples) noexcept;
+
+    // Widen or narrow samples and add them to a destination
+    void add(const float* source, double* destination, int numSamples) noexcept;
+    void add(const double* source, float* destination, int numSamples) noexcept;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Which vector instructions the hand-written loops can use. SSE2 comes with every
+// x86-64 target and NEON with every AArch64 one, so neither needs a runtime check.
+// Without either, the loops fall back to plain C++.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define VSTLINKHOST_SIMD_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  #include <arm_neon.h>
+  #define VSTLINKHOST_SIMD_NEON 1
+#endif
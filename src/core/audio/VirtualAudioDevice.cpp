@@ -0,0 +1,320 @@
+#include "VirtualAudioDevice.h"
+#include <thread>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Wake this long before the target time and spin the rest, as sleeping alone
+    // overshoots by more than a whole period at the smallest buffer sizes
+    constexpr auto spinMargin = std::chrono::microseconds(200);
+
+    void sleepUntil(Clock::time_point target)
+    {
+        if (target - Clock::now() > spinMargin)
+            std::this_thread::sleep_until(target - spinMargin);
+
+        while (Clock::now() < target)
+            std::this_thread::yield();
+    }
+
+    juce::StringArray makeChannelNames(const juce::String& prefix, int numChannels)
+    {
+        juce::StringArray names;
+
+        for (int i = 0; i < numChannels; ++i)
+            names.add(prefix + " " + juce::String(i + 1));
+
+        return names;
+    }
+}
+
+VirtualAudioIODevice::VirtualAudioIODevice(const juce::String& deviceName, const juce::String& typeName, const Settings& deviceSettings)
+    : juce::AudioIODevice(deviceName, typeName),
+      juce::Thread("Virtual audio device"),
+      settings(deviceSettings),
+      jitter(deviceSettings.jitterMicroseconds)
+{
+}
+
+VirtualAudioIODevice::~VirtualAudioIODevice()
+{
+    close();
+}
+
+juce::StringArray VirtualAudioIODevice::getOutputChannelNames()
+{
+    return makeChannelNames("Output", settings.numOutputChannels);
+}
+
+juce::StringArray VirtualAudioIODevice::getInputChannelNames()
+{
+    return makeChannelNames("Input", settings.numInputChannels);
+}
+
+juce::Array<double> VirtualAudioIODevice::getAvailableSampleRates()
+{
+    juce::Array<double> rates { 22050.0, 32000.0, 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0 };
+    rates.addIfNotAlreadyThere(settings.sampleRate);
+    rates.sort();
+    return rates;
+}
+
+juce::Array<int> VirtualAudioIODevice::getAvailableBufferSizes()
+{
+    juce::Array<int> sizes;
+
+    for (int size = 16; size <= 8192; size *= 2)
+    {
+        sizes.add(size);
+
+        if (size >= 32 && size <= 2048)
+            sizes.add(size + size / 2);
+    }
+
+    sizes.addIfNotAlreadyThere(settings.bufferSize);
+    sizes.sort();
+    return sizes;
+}
+
+int VirtualAudioIODevice::getDefaultBufferSize()
+{
+    return settings.bufferSize;
+}
+
+juce::String VirtualAudioIODevice::open(const juce::BigInteger& inputChannels,
+                                        const juce::BigInteger& outputChannels,
+                                        double sampleRate,
+                                        int bufferSizeSamples)
+{
+    close();
+
+    currentSampleRate = sampleRate > 0.0 ? sampleRate : settings.sampleRate;
+    currentBufferSize = bufferSizeSamples > 0 ? bufferSizeSamples : settings.bufferSize;
+
+    activeInputChannels = inputChannels;
+    activeInputChannels.setRange(settings.numInputChannels, juce::jmax(0, activeInputChannels.getHighestBit() + 1 - settings.numInputChannels), false);
+    activeOutputChannels = outputChannels;
+    activeOutputChannels.setRange(settings.numOutputChannels, juce::jmax(0, activeOutputChannels.getHighestBit() + 1 - settings.numOutputChannels), false);
+
+    // Callbacks only see the active channels, packed together
+    inputBuffer.setSize(juce::jmax(1, activeInputChannels.countNumberOfSetBits()), currentBufferSize);
+    outputBuffer.setSize(juce::jmax(1, activeOutputChannels.countNumberOfSetBits()), currentBufferSize);
+    inputBuffer.clear();
+
+    inputPointers.clearQuick();
+    outputPointers.clearQuick();
+
+    for (int i = 0; i < activeInputChannels.countNumberOfSetBits(); ++i)
+        inputPointers.add(inputBuffer.getReadPointer(i));
+
+    for (int i = 0; i < activeOutputChannels.countNumberOfSetBits(); ++i)
+        outputPointers.add(outputBuffer.getWritePointer(i));
+
+    xrunCount = 0;
+    lastError.clear();
+    deviceIsOpen = true;
+
+    // Without real-time permissions, fall back to the highest normal priority
+    if (! startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(9)))
+        startThread(juce::Thread::Priority::highest);
+
+    return {};
+}
+
+void VirtualAudioIODevice::close()
+{
+    if (!deviceIsOpen)
+        return;
+
+    stop();
+    stopThread(2000);
+    deviceIsOpen = false;
+}
+
+bool VirtualAudioIODevice::isOpen()
+{
+    return deviceIsOpen;
+}
+
+void VirtualAudioIODevice::start(juce::AudioIODeviceCallback* newCallback)
+{
+    if (!deviceIsOpen || newCallback == callback)
+        return;
+
+    stop();
+
+    if (newCallback != nullptr)
+    {
+        newCallback->audioDeviceAboutToStart(this);
+
+        const juce::ScopedLock lock(callbackLock);
+        callback = newCallback;
+    }
+}
+
+void VirtualAudioIODevice::stop()
+{
+    juce::AudioIODeviceCallback* oldCallback = nullptr;
+
+    {
+        const juce::ScopedLock lock(callbackLock);
+        std::swap(oldCallback, callback);
+    }
+
+    if (oldCallback != nullptr)
+        oldCallback->audioDeviceStopped();
+}
+
+bool VirtualAudioIODevice::isPlaying()
+{
+    const juce::ScopedLock lock(callbackLock);
+    return callback != nullptr;
+}
+
+juce::String VirtualAudioIODevice::getLastError()
+{
+    return lastError;
+}
+
+int VirtualAudioIODevice::getCurrentBufferSizeSamples()
+{
+    return currentBufferSize;
+}
+
+double VirtualAudioIODevice::getCurrentSampleRate()
+{
+    return currentSampleRate;
+}
+
+int VirtualAudioIODevice::getCurrentBitDepth()
+{
+    return 32;
+}
+
+juce::BigInteger VirtualAudioIODevice::getActiveOutputChannels() const
+{
+    return activeOutputChannels;
+}
+
+juce::BigInteger VirtualAudioIODevice::getActiveInputChannels() const
+{
+    return activeInputChannels;
+}
+
+int VirtualAudioIODevice::getOutputLatencyInSamples()
+{
+    // A buffer is played out one period after it was requested
+    return currentBufferSize;
+}
+
+int VirtualAudioIODevice::getInputLatencyInSamples()
+{
+    return 0;
+}
+
+int VirtualAudioIODevice::getXRunCount() const noexcept
+{
+    return xrunCount.load(std::memory_order_relaxed);
+}
+
+void VirtualAudioIODevice::setJitter(double jitterMicroseconds)
+{
+    jitter = juce::jmax(0.0, jitterMicroseconds);
+}
+
+void VirtualAudioIODevice::run()
+{
+    const auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>((double) currentBufferSize / currentSampleRate));
+
+    juce::Random random;
+    auto periodStart = Clock::now();
+
+    while (!threadShouldExit())
+    {
+        const auto deadline = periodStart + period;
+        const auto jitterMicros = jitter.load(std::memory_order_relaxed);
+        auto wakeTime = periodStart;
+
+        if (jitterMicros > 0.0)
+            wakeTime += std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double, std::micro>(random.nextDouble() * jitterMicros));
+
+        sleepUntil(wakeTime);
+
+        const auto hostTimeNs = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            periodStart.time_since_epoch()).count();
+        renderBuffer(hostTimeNs);
+
+        // A buffer that wasn't ready by its deadline was played as a dropout. Skip the
+        // periods that went by meanwhile, rather than trying to catch up on them.
+        const auto finished = Clock::now();
+        periodStart = deadline;
+
+        if (finished > deadline)
+        {
+            int numMissed = 1;
+
+            while (periodStart + period <= finished)
+            {
+                periodStart += period;
+                ++numMissed;
+            }
+
+            xrunCount.fetch_add(numMissed, std::memory_order_relaxed);
+        }
+    }
+}
+
+void VirtualAudioIODevice::renderBuffer(uint64_t hostTimeNs)
+{
+    const juce::ScopedLock lock(callbackLock);
+
+    if (callback == nullptr)
+        return;
+
+    juce::AudioIODeviceCallbackContext context;
+    context.hostTimeNs = &hostTimeNs;
+
+    callback->audioDeviceIOCallbackWithContext(inputPointers.getRawDataPointer(),
+                                               inputPointers.size(),
+                                               outputPointers.getRawDataPointer(),
+                                               outputPointers.size(),
+                                               currentBufferSize,
+                                               context);
+}
+
+//==============================================================================
+VirtualAudioIODeviceType::VirtualAudioIODeviceType()
+    : juce::AudioIODeviceType(typeName)
+{
+}
+
+juce::StringArray VirtualAudioIODeviceType::getDeviceNames(bool) const
+{
+    return { deviceName };
+}
+
+int VirtualAudioIODeviceType::getDefaultDeviceIndex(bool) const
+{
+    return 0;
+}
+
+int VirtualAudioIODeviceType::getIndexOfDevice(juce::AudioIODevice* device, bool) const
+{
+    return dynamic_cast<VirtualAudioIODevice*>(device) != nullptr ? 0 : -1;
+}
+
+bool VirtualAudioIODeviceType::hasSeparateInputsAndOutputs() const
+{
+    return false;
+}
+
+juce::AudioIODevice* VirtualAudioIODeviceType::createDevice(const juce::String& outputDeviceName, const juce::String& inputDeviceName)
+{
+    if (outputDeviceName != deviceName && inputDeviceName != deviceName)
+        return nullptr;
+
+    return new VirtualAudioIODevice(deviceName, typeName, settings);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <juce_audio_devices/juce_audio_devices.h>
+#include <atomic>
+#include <chrono>
+
+// An audio device with no hardware behind it. A high-priority thread calls the
+// device callback once per buffer period, so the engine runs exactly as it would
+// on a sound card: headless machines can run soak tests, and small buffers can be
+// used to reproduce xruns.
+//
+// A callback that is still running when its buffer was due counts as an xrun, and
+// the buffers that would have been lost are skipped, as a real device would.
+class VirtualAudioIODevice : public juce::AudioIODevice,
+                             private juce::Thread
+{
+public:
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int bufferSize = 512;
+        int numInputChannels = 2;
+        int numOutputChannels = 2;
+
+        // Each callback is started up to this much later than the start of its period
+        double jitterMicroseconds = 0.0;
+    };
+
+    VirtualAudioIODevice(const juce::String& deviceName, const juce::String& typeName, const Settings& settings);
+    ~VirtualAudioIODevice() override;
+
+    // AudioIODevice implementation
+    juce::StringArray getOutputChannelNames() override;
+    juce::StringArray getInputChannelNames() override;
+    juce::Array<double> getAvailableSampleRates() override;
+    juce::Array<int> getAvailableBufferSizes() override;
+    int getDefaultBufferSize() override;
+
+    juce::String open(const juce::BigInteger& inputChannels,
+                      const juce::BigInteger& outputChannels,
+                      double sampleRate,
+                      int bufferSizeSamples) override;
+    void close() override;
+    bool isOpen() override;
+
+    void start(juce::AudioIODeviceCallback* callback) override;
+    void stop() override;
+    bool isPlaying() override;
+
+    juce::String getLastError() override;
+    int getCurrentBufferSizeSamples() override;
+    double getCurrentSampleRate() override;
+    int getCurrentBitDepth() override;
+    juce::BigInteger getActiveOutputChannels() const override;
+    juce::BigInteger getActiveInputChannels() const override;
+    int getOutputLatencyInSamples() override;
+    int getInputLatencyInSamples() override;
+    int getXRunCount() const noexcept override;
+
+    // Change the injected jitter while the device is running
+    void setJitter(double jitterMicroseconds);
+
+private:
+    void run() override;
+    void renderBuffer(uint64_t hostTimeNs);
+
+    Settings settings;
+    juce::String lastError;
+    bool deviceIsOpen = false;
+
+    double currentSampleRate = 0.0;
+    int currentBufferSize = 0;
+    juce::BigInteger activeInputChannels, activeOutputChannels;
+
+    // Silent input, and output that goes nowhere
+    juce::AudioBuffer<float> inputBuffer, outputBuffer;
+    juce::Array<const float*> inputPointers;
+    juce::Array<float*> outputPointers;
+
+    juce::CriticalSection callbackLock;
+    juce::AudioIODeviceCallback* callback = nullptr;
+
+    std::atomic<double> jitter;
+    std::atomic<int> xrunCount { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(VirtualAudioIODevice)
+};
+
+// Device type that makes the virtual device available through juce::AudioDeviceManager
+class VirtualAudioIODeviceType : public juce::AudioIODeviceType
+{
+public:
+    static constexpr const char* typeName = "Virtual";
+    static constexpr const char* deviceName = "Virtual Audio Device";
+
+    VirtualAudioIODeviceType();
+
+    // Settings for devices created from now on
+    void setSettings(const VirtualAudioIODevice::Settings& newSettings) { settings = newSettings; }
+    const VirtualAudioIODevice::Settings& getSettings() const { return settings; }
+
+    // AudioIODeviceType implementation
+    void scanForDevices() override {}
+    juce::StringArray getDeviceNames(bool wantInputNames = false) const override;
+    int getDefaultDeviceIndex(bool forInput) const override;
+    int getIndexOfDevice(juce::AudioIODevice* device, bool asInput) const override;
+    bool hasSeparateInputsAndOutputs() const override;
+    juce::AudioIODevice* createDevice(const juce::String& outputDeviceName, const juce::String& inputDeviceName) override;
+
+private:
+    VirtualAudioIODevice::Settings settings;
+
+    JUCE_DECLARE_NON_COPYABLE(VirtualAudioIODeviceType)
+};
@@ -0,0 +1,508 @@
+#include "MidiClockGenerator.h"
+#include "MidiManager.h"
+#include <algorithm>
+#include <cmath>
+
+using Micros = std::chrono::microseconds;
+
+namespace
+{
+    constexpr double ticksPerBeat = 24.0;
+
+    // Sleep until this close to the next message, then spin
+    constexpr Micros spinWindow { 1500 };
+
+    // Look at the timeline at least this often, for tempo and transport changes
+    constexpr Micros maxSleep { 5000 };
+
+    // Messages due within this much of each other go out together, in order
+    constexpr Micros sameTime { 20 };
+
+    int getFramesPerSecond(juce::MidiMessage::SmpteTimecodeType type)
+    {
+        switch (type)
+        {
+            case juce::MidiMessage::fps24: return 24;
+            case juce::MidiMessage::fps25: return 25;
+            default:                       return 30;
+        }
+    }
+}
+
+//==============================================================================
+struct MidiClockGenerator::Output
+{
+    juce::String identifier;
+    OutputSettings settings;
+    Micros offset { 0 };
+
+    // The transport state last sent
+    bool isPlaying = false;
+
+    // A start or stop waiting for its time
+    bool transportPending = false;
+    bool pendingStart = false;
+    int64_t startTick = 0;
+    Micros transportDue { 0 };
+
+    bool clockRunning = false;
+    int64_t nextTick = 0;
+    Micros nextTickDue { 0 };
+
+    bool timecodeRunning = false;
+    int64_t startFrame = 0;
+    int64_t nextQuarterFrame = 0;
+    Micros timecodeOrigin { 0 };
+    Micros nextQuarterFrameDue { 0 };
+};
+
+//==============================================================================
+// An input wired back to an output, timing the clock messages as they arrive
+class MidiClockGenerator::LoopbackProbe : private juce::MidiInputCallback
+{
+public:
+    LoopbackProbe(const juce::String& identifier, const std::atomic<double>& tempoToFollow)
+        : tempo(tempoToFollow)
+    {
+        device = juce::MidiInput::openDevice(identifier, this);
+
+        if (device != nullptr)
+            device->start();
+    }
+
+    ~LoopbackProbe() override
+    {
+        if (device != nullptr)
+            device->stop();
+    }
+
+    bool isOpen() const { return device != nullptr; }
+
+    JitterStats getStats() const
+    {
+        const juce::ScopedLock sl(lock);
+        JitterStats result;
+        result.numIntervals = numIntervals;
+
+        if (numIntervals > 0)
+        {
+            result.meanAbsErrorMicros = sumAbsError / (double) numIntervals;
+            result.maxAbsErrorMicros = maxAbsError;
+            result.stdDevMicros = std::sqrt(sumSquaredDeviation / (double) numIntervals);
+        }
+
+        return result;
+    }
+
+    void reset()
+    {
+        const juce::ScopedLock sl(lock);
+        numIntervals = 0;
+        sumAbsError = maxAbsError = meanError = sumSquaredDeviation = 0.0;
+        lastArrival = -1.0;
+    }
+
+private:
+    void handleIncomingMidiMessage(juce::MidiInput*, const juce::MidiMessage& message) override
+    {
+        if (! message.isMidiClock())
+            return;
+
+        const juce::ScopedLock sl(lock);
+        const auto arrival = message.getTimeStamp();
+
+        if (lastArrival >= 0.0)
+        {
+            const auto expected = 60.0e6 / (tempo.load() * ticksPerBeat);
+            const auto error = (arrival - lastArrival) * 1.0e6 - expected;
+
+            // Gaps from stopping or a tempo jump aren't jitter
+            if (std::abs(error) < expected * 0.5)
+            {
+                ++numIntervals;
+                sumAbsError += std::abs(error);
+                maxAbsError = std::max(maxAbsError, std::abs(error));
+
+                const auto delta = error - meanError;
+                meanError += delta / (double) numIntervals;
+                sumSquaredDeviation += delta * (error - meanError);
+            }
+        }
+
+        lastArrival = arrival;
+    }
+
+    const std::atomic<double>& tempo;
+    std::unique_ptr<juce::MidiInput> device;
+
+    juce::CriticalSection lock;
+    uint64_t numIntervals = 0;
+    double sumAbsError = 0.0, maxAbsError = 0.0;
+    double meanError = 0.0, sumSquaredDeviation = 0.0;
+    double lastArrival = -1.0;
+
+    JUCE_DECLARE_NON_COPYABLE(LoopbackProbe)
+};
+
+//==============================================================================
+MidiClockGenerator::MidiClockGenerator(MidiManager& manager)
+    : juce::Thread("MIDI clock"),
+      midiManager(manager)
+{
+}
+
+MidiClockGenerator::~MidiClockGenerator()
+{
+    stop();
+    loopbackProbe.reset();
+}
+
+void MidiClockGenerator::start(LinkManager& linkToFollow)
+{
+    stop();
+    linkManager = &linkToFollow;
+
+    if (! startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(9)))
+        startThread(juce::Thread::Priority::highest);
+}
+
+void MidiClockGenerator::stop()
+{
+    stopThread(1000);
+
+    // Start over from the transport as it is when started again
+    const juce::ScopedLock sl(outputLock);
+
+    for (auto& output : outputs)
+    {
+        const auto identifier = output->identifier;
+        const auto settings = output->settings;
+        *output = {};
+        output->identifier = identifier;
+        output->settings = settings;
+        output->offset = Micros((int64_t) std::llround(settings.latencyOffsetMs * 1000.0));
+    }
+}
+
+void MidiClockGenerator::setOutput(const juce::String& identifier, const OutputSettings& settings)
+{
+    const juce::ScopedLock sl(outputLock);
+
+    auto existing = std::find_if(outputs.begin(), outputs.end(), [&](const std::unique_ptr<Output>& output)
+    {
+        return output->identifier == identifier;
+    });
+
+    if (existing == outputs.end())
+    {
+        outputs.push_back(std::make_unique<Output>());
+        existing = outputs.end() - 1;
+        (*existing)->identifier = identifier;
+    }
+
+    (*existing)->settings = settings;
+    (*existing)->offset = Micros((int64_t) std::llround(settings.latencyOffsetMs * 1000.0));
+}
+
+void MidiClockGenerator::removeOutput(const juce::String& identifier)
+{
+    const juce::ScopedLock sl(outputLock);
+
+    outputs.erase(std::remove_if(outputs.begin(), outputs.end(), [&](const std::unique_ptr<Output>& output)
+    {
+        return output->identifier == identifier;
+    }), outputs.end());
+}
+
+MidiClockGenerator::SchedulingStats MidiClockGenerator::getSchedulingStats() const
+{
+    SchedulingStats stats;
+    stats.numMessages = numMessagesSent.load();
+
+    if (stats.numMessages > 0)
+    {
+        stats.meanLatenessMicros = totalLatenessMicros.load() / (double) stats.numMessages;
+        stats.maxLatenessMicros = maxLatenessMicros.load();
+    }
+
+    return stats;
+}
+
+bool MidiClockGenerator::startLoopbackMeasurement(const juce::String& inputIdentifier)
+{
+    loopbackProbe.reset();
+
+    auto probe = std::make_unique<LoopbackProbe>(inputIdentifier, currentTempo);
+
+    if (! probe->isOpen())
+    {
+        juce::Logger::writeToLog("Couldn't open MIDI loopback input " + inputIdentifier);
+        return false;
+    }
+
+    loopbackProbe = std::move(probe);
+    return true;
+}
+
+void MidiClockGenerator::stopLoopbackMeasurement()
+{
+    loopbackProbe.reset();
+}
+
+MidiClockGenerator::JitterStats MidiClockGenerator::getLoopbackJitter() const
+{
+    return loopbackProbe != nullptr ? loopbackProbe->getStats() : JitterStats{};
+}
+
+void MidiClockGenerator::resetStats()
+{
+    numMessagesSent = 0;
+    totalLatenessMicros = 0.0;
+    maxLatenessMicros = 0.0;
+
+    if (loopbackProbe != nullptr)
+        loopbackProbe->reset();
+}
+
+//==============================================================================
+void MidiClockGenerator::run()
+{
+    while (! threadShouldExit())
+    {
+        const auto timeline = linkManager->captureTimeline();
+
+        if (! timeline)
+        {
+            wait(10);
+            continue;
+        }
+
+        currentTempo = timeline->getTempo();
+
+        auto now = linkManager->getClockMicros();
+        auto nextDue = now + maxSleep;
+
+        {
+            const juce::ScopedLock sl(outputLock);
+
+            for (auto& output : outputs)
+                nextDue = std::min(nextDue, schedule(*output, *timeline, now));
+        }
+
+        // Sleep through most of the wait, looking at the timeline again afterwards
+        const auto remaining = nextDue - now;
+
+        if (remaining > spinWindow + Micros(1000))
+        {
+            wait((int) ((remaining - spinWindow).count() / 1000));
+            continue;
+        }
+
+        // Spin through the rest, so the message leaves on time
+        while (now < nextDue && ! threadShouldExit())
+            now = linkManager->getClockMicros();
+
+        const juce::ScopedLock sl(outputLock);
+
+        for (auto& output : outputs)
+            sendDue(*output, *timeline, now);
+    }
+}
+
+Micros MidiClockGenerator::schedule(Output& output, const LinkManager::Timeline& timeline, Micros now)
+{
+    const auto& settings = output.settings;
+    const auto playing = timeline.isPlaying();
+    const auto beatNow = timeline.getBeatAtTime(now + output.offset);
+
+    const auto dueAtBeat = [&](double beat) { return timeline.getTimeAtBeat(beat) - output.offset; };
+
+    // Transport: a start waits for the next sixteenth, which a song position pointer
+    // can point at; a stop goes out when the session stopped
+    if (playing != output.isPlaying)
+    {
+        if (! output.transportPending || output.pendingStart != playing)
+        {
+            output.transportPending = true;
+            output.pendingStart = playing;
+
+            if (playing)
+            {
+                const auto startBeat = std::max(timeline.getBeatAtTime(timeline.getTimeForIsPlaying()), beatNow);
+                output.startTick = (int64_t) std::ceil(startBeat * 4.0 - 1.0e-6) * 6;
+            }
+        }
+
+        output.transportDue = output.pendingStart ? dueAtBeat((double) output.startTick / ticksPerBeat)
+                                                  : timeline.getTimeForIsPlaying() - output.offset;
+    }
+    else
+    {
+        output.transportPending = false;
+    }
+
+    // Clock: keeps running until a pending stop is out
+    const auto stopping = output.transportPending && ! output.pendingStart;
+    const auto wantsClock = settings.sendClock && (playing || stopping || settings.clockWhileStopped);
+
+    if (wantsClock)
+    {
+        // Pick the tick up from the timeline when starting, or when the beat jumped
+        const auto tickBeat = (double) output.nextTick / ticksPerBeat;
+
+        if (! output.clockRunning || std::abs(tickBeat - beatNow) > 2.0 / ticksPerBeat)
+        {
+            output.nextTick = (int64_t) std::ceil(beatNow * ticksPerBeat - 1.0e-6);
+            output.clockRunning = true;
+        }
+
+        // Without a clock while stopped, the first tick is the one after the start
+        if (! settings.clockWhileStopped && output.transportPending && output.pendingStart)
+            output.nextTick = std::max(output.nextTick, output.startTick);
+
+        output.nextTickDue = dueAtBeat((double) output.nextTick / ticksPerBeat);
+    }
+    else
+    {
+        output.clockRunning = false;
+    }
+
+    if (output.timecodeRunning)
+    {
+        const auto fps = getFramesPerSecond(settings.timecodeType);
+        output.nextQuarterFrameDue = output.timecodeOrigin + Micros(output.nextQuarterFrame * 250000 / fps);
+    }
+
+    auto nextDue = Micros::max();
+
+    if (output.transportPending)
+        nextDue = std::min(nextDue, output.transportDue);
+
+    if (output.clockRunning)
+        nextDue = std::min(nextDue, output.nextTickDue);
+
+    if (output.timecodeRunning)
+        nextDue = std::min(nextDue, output.nextQuarterFrameDue);
+
+    return nextDue;
+}
+
+void MidiClockGenerator::sendDue(Output& output, const LinkManager::Timeline& timeline, Micros now)
+{
+    const auto& settings = output.settings;
+    const auto limit = now + sameTime;
+
+    if (output.transportPending && output.transportDue <= limit)
+    {
+        if (output.pendingStart)
+        {
+            const auto position = std::max((int64_t) 0, output.startTick / 6);
+
+            if (settings.sendTransport)
+            {
+                if (position == 0)
+                {
+                    send(output, juce::MidiMessage::midiStart(), output.transportDue);
+                }
+                else
+                {
+                    send(output, juce::MidiMessage::songPositionPointer((int) std::min(position, (int64_t) 0x3fff)), output.transportDue);
+                    send(output, juce::MidiMessage::midiContinue(), output.transportDue);
+                }
+            }
+
+            if (settings.sendTimecode)
+            {
+                // Timecode counts from the song position at the current tempo
+                const auto fps = getFramesPerSecond(settings.timecodeType);
+                const auto seconds = (double) position / 4.0 * 60.0 / timeline.getTempo();
+
+                output.startFrame = std::llround(seconds * fps);
+                output.nextQuarterFrame = 0;
+                output.timecodeOrigin = output.transportDue;
+                output.nextQuarterFrameDue = output.transportDue;
+                output.timecodeRunning = true;
+
+                const auto frames = output.startFrame;
+                send(output, juce::MidiMessage::fullFrame((int) (frames / (fps * 3600)) % 24,
+                                                          (int) (frames / (fps * 60)) % 60,
+                                                          (int) (frames / fps) % 60,
+                                                          (int) (frames % fps),
+                                                          settings.timecodeType),
+                     output.transportDue);
+            }
+
+            // The first tick after the start is the one at the song position
+            if (output.clockRunning)
+            {
+                output.nextTick = output.startTick;
+                output.nextTickDue = output.transportDue;
+            }
+        }
+        else
+        {
+            if (settings.sendTransport)
+                send(output, juce::MidiMessage::midiStop(), output.transportDue);
+
+            output.timecodeRunning = false;
+        }
+
+        output.isPlaying = output.pendingStart;
+        output.transportPending = false;
+    }
+
+    if (output.timecodeRunning && output.nextQuarterFrameDue <= limit)
+    {
+        // Each run of eight quarter frames spans two frames and carries the time of the first
+        const auto fps = getFramesPerSecond(settings.timecodeType);
+        const auto piece = (int) (output.nextQuarterFrame % 8);
+        const auto frames = output.startFrame + (output.nextQuarterFrame / 8) * 2;
+
+        const auto hours = (int) (frames / (fps * 3600)) % 24;
+        const auto minutes = (int) (frames / (fps * 60)) % 60;
+        const auto secs = (int) (frames / fps) % 60;
+        const auto frame = (int) (frames % fps);
+
+        int value = 0;
+
+        switch (piece)
+        {
+            case 0: value = frame & 0x0f; break;
+            case 1: value = frame >> 4; break;
+            case 2: value = secs & 0x0f; break;
+            case 3: value = secs >> 4; break;
+            case 4: value = minutes & 0x0f; break;
+            case 5: value = minutes >> 4; break;
+            case 6: value = hours & 0x0f; break;
+            default: value = (hours >> 4) | ((int) settings.timecodeType << 1); break;
+        }
+
+        send(output, juce::MidiMessage::quarterFrame(piece, value), output.nextQuarterFrameDue);
+        ++output.nextQuarterFrame;
+    }
+
+    if (output.clockRunning && output.nextTickDue <= limit)
+    {
+        send(output, juce::MidiMessage::midiClock(), output.nextTickDue);
+        ++output.nextTick;
+    }
+}
+
+void MidiClockGenerator::send(const Output& output, const juce::MidiMessage& message, Micros dueTime)
+{
+    const auto sent = midiManager.withOutput(output.identifier, [&](juce::MidiOutput& device)
+    {
+        device.sendMessageNow(message);
+    });
+
+    if (! sent)
+        return;
+
+    const auto lateness = (double) std::max((int64_t) 0, (linkManager->getClockMicros() - dueTime).count());
+
+    numMessagesSent.fetch_add(1);
+    totalLatenessMicros = totalLatenessMicros.load() + lateness;
+
+    if (lateness > maxLatenessMicros.load())
+        maxLatenessMicros = lateness;
+}
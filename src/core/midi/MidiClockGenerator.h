@@ -0,0 +1,111 @@
+#pragma once
+
+#include <juce_audio_devices/juce_audio_devices.h>
+#include "../sync/LinkManager.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class MidiManager;
+
+// Sends MIDI clock (24 per beat), start/stop/continue with song position, and
+// optionally MIDI timecode to MIDI outputs, all derived from the Link session
+// timeline, for hardware that doesn't speak Link.
+//
+// Messages are timed against Link's host clock on a realtime thread, which sleeps
+// until shortly before each one is due and spins for the rest, so they leave within
+// microseconds of their time. Each output can be sent to early, to make up for its
+// latency.
+class MidiClockGenerator : private juce::Thread
+{
+public:
+    struct OutputSettings
+    {
+        bool sendClock = true;
+
+        // Keep the clock running while the transport is stopped, for devices that follow tempo
+        bool clockWhileStopped = true;
+
+        // Start, stop and continue, with a song position pointer before continuing
+        bool sendTransport = true;
+
+        // MTC quarter frames while playing, with a full frame whenever playback starts
+        bool sendTimecode = false;
+        juce::MidiMessage::SmpteTimecodeType timecodeType = juce::MidiMessage::fps25;
+
+        // Send this much ahead of time, for the device's own latency
+        double latencyOffsetMs = 0.0;
+    };
+
+    explicit MidiClockGenerator(MidiManager& midiManager);
+    ~MidiClockGenerator() override;
+
+    // Follow a Link session until stopped
+    void start(LinkManager& linkManager);
+    void stop();
+    bool isRunning() const { return isThreadRunning(); }
+
+    // Send to an output of the MIDI manager, by identifier, or stop sending to it
+    void setOutput(const juce::String& identifier, const OutputSettings& settings);
+    void removeOutput(const juce::String& identifier);
+
+    // How late messages left after the time they were due, on Link's clock
+    struct SchedulingStats
+    {
+        uint64_t numMessages = 0;
+        double meanLatenessMicros = 0.0;
+        double maxLatenessMicros = 0.0;
+    };
+
+    SchedulingStats getSchedulingStats() const;
+
+    // Jitter measured at an input wired back to one of the outputs: how far the time
+    // between clock messages arriving there strays from the tempo's tick length
+    struct JitterStats
+    {
+        uint64_t numIntervals = 0;
+        double meanAbsErrorMicros = 0.0;
+        double maxAbsErrorMicros = 0.0;
+        double stdDevMicros = 0.0;
+    };
+
+    // Open a loopback input and measure until the measurement is stopped. The input
+    // mustn't be open in the MIDI manager as well.
+    bool startLoopbackMeasurement(const juce::String& inputIdentifier);
+    void stopLoopbackMeasurement();
+    JitterStats getLoopbackJitter() const;
+
+    void resetStats();
+
+private:
+    struct Output;
+    class LoopbackProbe;
+
+    void run() override;
+
+    // Work out when an output's next messages are due; returns the earliest
+    std::chrono::microseconds schedule(Output& output, const LinkManager::Timeline& timeline, std::chrono::microseconds now);
+
+    // Send whatever an output has due by now
+    void sendDue(Output& output, const LinkManager::Timeline& timeline, std::chrono::microseconds now);
+    void send(const Output& output, const juce::MidiMessage& message, std::chrono::microseconds dueTime);
+
+    MidiManager& midiManager;
+    LinkManager* linkManager = nullptr;
+
+    juce::CriticalSection outputLock;
+    std::vector<std::unique_ptr<Output>> outputs;
+
+    // Read by the loopback probe, for the expected tick length
+    std::atomic<double> currentTempo { 120.0 };
+
+    std::atomic<uint64_t> numMessagesSent { 0 };
+    std::atomic<double> totalLatenessMicros { 0.0 };
+    std::atomic<double> maxLatenessMicros { 0.0 };
+
+    std::unique_ptr<LoopbackProbe> loopbackProbe;
+
+    JUCE_DECLARE_NON_COPYABLE(MidiClockGenerator)
+};
@@ -0,0 +1,118 @@
+#include "MidiInputPorts.h"
+
+namespace
+{
+    // Events a block can take from one port, and from all of them together
+    constexpr int eventsPerPort = 1024;
+    constexpr int eventsMerged = 4096;
+}
+
+MidiInputPorts::MidiInputPorts() = default;
+MidiInputPorts::~MidiInputPorts() = default;
+
+int MidiInputPorts::getPort(const juce::String& deviceIdentifier)
+{
+    const auto existing = findPort(deviceIdentifier);
+
+    if (existing >= 0)
+        return existing;
+
+    if (identifiers.size() >= maxPorts)
+        return -1;
+
+    identifiers.add(deviceIdentifier);
+    return identifiers.size() - 1;
+}
+
+MidiInputQueue* MidiInputPorts::getQueue(int port)
+{
+    if (! juce::isPositiveAndBelow(port, identifiers.size()))
+        return nullptr;
+
+    auto& owned = ownedQueues[(size_t) port];
+
+    // Queues are never freed while the engine runs, so the audio thread can't be caught reading one
+    if (owned == nullptr)
+    {
+        owned = std::make_unique<MidiInputQueue>();
+        queues[(size_t) port].store(owned.get(), std::memory_order_release);
+        numPorts.store(juce::jmax(numPorts.load(std::memory_order_relaxed), port + 1), std::memory_order_release);
+    }
+
+    return owned.get();
+}
+
+void MidiInputPorts::popBlock(MidiInputBlock& block, double blockEndTime, double sampleRate, int numSamples) noexcept
+{
+    block.clear();
+    block.numPorts = getNumPorts();
+
+    for (int port = 0; port < block.numPorts; ++port)
+    {
+        auto* queue = queues[(size_t) port].load(std::memory_order_acquire);
+
+        if (queue == nullptr)
+            continue;
+
+        auto& events = block.ports[(size_t) port];
+        queue->popBlock(events, blockEndTime, sampleRate, numSamples);
+
+        if (! events.isEmpty())
+            block.merged.addEvents(events, 0, -1, 0);
+    }
+}
+
+MidiInputQueue::TimingStats MidiInputPorts::getTimingStats() const
+{
+    MidiInputQueue::TimingStats total;
+    double totalError = 0.0;
+
+    for (auto& queue : queues)
+    {
+        if (auto* q = queue.load(std::memory_order_acquire))
+        {
+            const auto stats = q->getTimingStats();
+            total.numEvents += stats.numEvents;
+            total.numDropped += stats.numDropped;
+            total.numDisplaced += stats.numDisplaced;
+            total.maxErrorSamples = juce::jmax(total.maxErrorSamples, stats.maxErrorSamples);
+            totalError += stats.meanErrorSamples * (double) stats.numEvents;
+        }
+    }
+
+    if (total.numEvents > 0)
+        total.meanErrorSamples = totalError / (double) total.numEvents;
+
+    return total;
+}
+
+void MidiInputPorts::resetTimingStats()
+{
+    for (auto& queue : queues)
+        if (auto* q = queue.load(std::memory_order_acquire))
+            q->resetTimingStats();
+}
+
+//==============================================================================
+MidiInputBlock::MidiInputBlock()
+    : merged(eventsMerged)
+{
+    for (auto& buffer : ports)
+        buffer.setCapacity(eventsPerPort);
+
+    for (auto& beats : releaseBeats)
+        beats.resize((size_t) eventsPerPort);
+}
+
+void MidiInputBlock::clear() noexcept
+{
+    merged.clear();
+
+    for (int port = 0; port < numPorts; ++port)
+    {
+        ports[(size_t) port].clear();
+        hasReleaseBeats[(size_t) port] = false;
+    }
+
+    numPorts = 0;
+}
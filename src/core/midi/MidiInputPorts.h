@@ -0,0 +1,71 @@
+#pragma once
+
+#include "MidiInputQueue.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+struct MidiInputBlock;
+
+// The engine's MIDI inputs: up to maxPorts devices, each pushing into a queue of its
+// own so that every device thread is the single producer of one queue. Ports are
+// numbered for the session, by device identifier, so a device that is unplugged and
+// plugged back in gets its old port and keeps its routes.
+class MidiInputPorts
+{
+public:
+    static constexpr int maxPorts = 32;
+
+    MidiInputPorts();
+    ~MidiInputPorts();
+
+    // The port for a device, assigned on first use; -1 once all are taken (message thread only)
+    int getPort(const juce::String& deviceIdentifier);
+
+    // The port a device already has, or -1
+    int findPort(const juce::String& deviceIdentifier) const { return identifiers.indexOf(deviceIdentifier); }
+
+    juce::String getDeviceIdentifier(int port) const { return identifiers[port]; }
+    int getNumPorts() const { return numPorts.load(std::memory_order_acquire); }
+
+    // The queue a port's device pushes into (message thread only)
+    MidiInputQueue* getQueue(int port);
+
+    // Take one block from every port, each on its own and all merged (audio thread only)
+    void popBlock(MidiInputBlock& block, double blockEndTime, double sampleRate, int numSamples) noexcept;
+
+    // Timing over all ports
+    MidiInputQueue::TimingStats getTimingStats() const;
+    void resetTimingStats();
+
+private:
+    juce::StringArray identifiers;
+    std::array<std::unique_ptr<MidiInputQueue>, maxPorts> ownedQueues;
+    std::array<std::atomic<MidiInputQueue*>, maxPorts> queues {};
+    std::atomic<int> numPorts { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiInputPorts)
+};
+
+// One block of incoming MIDI as Universal MIDI Packets, preallocated so the audio
+// thread can fill it. It only becomes MIDI 1.0 bytes at the plugins that need them.
+struct MidiInputBlock
+{
+    MidiInputBlock();
+
+    void clear() noexcept;
+
+    // Everything, for the graph's MIDI input node
+    UmpBuffer merged;
+
+    // Each port's events, for the routing table
+    std::array<UmpBuffer, MidiInputPorts::maxPorts> ports;
+    int numPorts = 0;
+
+    // For ports that MidiInputQuantizer holds events on: the Link beat each event was
+    // released on, index for index with the port's events, or NaN for events that went
+    // straight through and were placed by when they arrived
+    std::array<std::vector<double>, MidiInputPorts::maxPorts> releaseBeats;
+    std::array<bool, MidiInputPorts::maxPorts> hasReleaseBeats {};
+};
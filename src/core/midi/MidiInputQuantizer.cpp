@@ -0,0 +1,306 @@
+#include "MidiInputQuantizer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    // Phases this close to a grid line count as on it
+    constexpr double onGridBeats = 1.0e-6;
+
+    // Beat noted for events that went straight through, placed by when they arrived
+    constexpr double notReleased = std::numeric_limits<double>::quiet_NaN();
+
+    int getNoteSlot(const UmpEvent& event) noexcept
+    {
+        return (int) event.getChannel() * 128 + (int) event.getIndex();
+    }
+}
+
+MidiInputQuantizer::MidiInputQuantizer(int maxHeld)
+    : maxHeldPerPort(juce::jmax(1, maxHeld)),
+      scratch(1024)
+{
+}
+
+MidiInputQuantizer::~MidiInputQuantizer() = default;
+
+void MidiInputQuantizer::setSettings(int port, const Settings& settings)
+{
+    if (! juce::isPositiveAndBelow(port, MidiInputPorts::maxPorts))
+        return;
+
+    auto& owned = ownedStates[(size_t) port];
+
+    if (owned == nullptr)
+    {
+        if (settings.grid <= 0.0)
+            return;
+
+        owned = std::make_unique<PortState>(maxHeldPerPort);
+    }
+
+    owned->holdAllMessages.store(settings.holdAllMessages, std::memory_order_relaxed);
+    owned->grid.store(juce::jmax(0.0, settings.grid), std::memory_order_relaxed);
+    states[(size_t) port].store(owned.get(), std::memory_order_release);
+}
+
+MidiInputQuantizer::Settings MidiInputQuantizer::getSettings(int port) const
+{
+    Settings settings;
+
+    if (juce::isPositiveAndBelow(port, MidiInputPorts::maxPorts))
+    {
+        if (const auto* state = ownedStates[(size_t) port].get())
+        {
+            settings.grid = state->grid.load(std::memory_order_relaxed);
+            settings.holdAllMessages = state->holdAllMessages.load(std::memory_order_relaxed);
+        }
+    }
+
+    return settings;
+}
+
+void MidiInputQuantizer::processBlock(MidiInputBlock& block, double sampleRate, int numSamples, int outputLatencySamples) noexcept
+{
+    // Captured once a block, and only if some port needs it
+    if (! needsProcessing(block))
+        return;
+
+    blockTimeline.reset();
+
+    if (linkManager != nullptr)
+    {
+        blockTimeline = linkManager->captureAudioTimeline();
+        blockNow = linkManager->getClockMicros();
+    }
+
+    processPorts(block, sampleRate, numSamples, outputLatencySamples);
+}
+
+void MidiInputQuantizer::processBlock(MidiInputBlock& block, double sampleRate, int numSamples, int outputLatencySamples,
+                                      const LinkManager::Timeline& timeline, std::chrono::microseconds now) noexcept
+{
+    if (! needsProcessing(block))
+        return;
+
+    blockTimeline = timeline;
+    blockNow = now;
+    processPorts(block, sampleRate, numSamples, outputLatencySamples);
+}
+
+bool MidiInputQuantizer::needsProcessing(const MidiInputBlock& block) const noexcept
+{
+    for (int port = 0; port < block.numPorts; ++port)
+    {
+        const auto* state = states[(size_t) port].load(std::memory_order_acquire);
+
+        if (state != nullptr && (state->grid.load(std::memory_order_relaxed) > 0.0 || state->numHeld > 0 || state->numDelayedNotes > 0))
+            return true;
+    }
+
+    return false;
+}
+
+void MidiInputQuantizer::processPorts(MidiInputBlock& block, double sampleRate, int numSamples, int outputLatencySamples) noexcept
+{
+    bool changed = false;
+
+    for (int port = 0; port < block.numPorts; ++port)
+    {
+        auto* state = states[(size_t) port].load(std::memory_order_acquire);
+
+        if (state == nullptr)
+            continue;
+
+        if (state->grid.load(std::memory_order_relaxed) <= 0.0 && state->numHeld == 0 && state->numDelayedNotes == 0)
+            continue;
+
+        const auto portChanged = processPort(*state, block.ports[(size_t) port], block.releaseBeats[(size_t) port].data(),
+                                             sampleRate, numSamples, outputLatencySamples);
+
+        // MidiRecorder stamps released events with the beat they were quantized to
+        block.hasReleaseBeats[(size_t) port] = portChanged && blockTimeline.has_value();
+        changed = portChanged || changed;
+    }
+
+    // The graph's MIDI input node gets the ports merged again, as MidiInputPorts merges them
+    if (changed)
+    {
+        block.merged.clear();
+
+        for (int port = 0; port < block.numPorts; ++port)
+            if (! block.ports[(size_t) port].isEmpty())
+                block.merged.addEvents(block.ports[(size_t) port], 0, -1, 0);
+    }
+}
+
+bool MidiInputQuantizer::processPort(PortState& state, UmpBuffer& events, double* beats, double sampleRate, int numSamples, int outputLatencySamples) noexcept
+{
+    const auto& timeline = blockTimeline;
+    const auto now = blockNow;
+    const auto grid = state.grid.load(std::memory_order_relaxed);
+    const auto holdAll = state.holdAllMessages.load(std::memory_order_relaxed);
+
+    // Nothing is held with the grid off, so beats are always counted against it
+    const auto quantum = grid;
+
+    // Keeps beats in step with the events, which go in after any others at the same position
+    const auto release = [&](const UmpEvent& event, int samplePosition, double beat = notReleased)
+    {
+        const auto index = (int) (events.findNextSamplePosition(samplePosition + 1) - events.begin());
+
+        if (! events.add(samplePosition, event.words))
+        {
+            numOverflowed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        const auto numEvents = events.getNumEvents();
+        std::move_backward(beats + index, beats + numEvents - 1, beats + numEvents);
+        beats[index] = beat;
+    };
+
+    // Returns false if it went straight through, because too many were waiting
+    const auto hold = [&](const UmpEvent& event, double releaseBeat)
+    {
+        if (state.numHeld >= (int) state.held.size())
+        {
+            numOverflowed.fetch_add(1, std::memory_order_relaxed);
+
+            // A note-off can't overtake its note-on, or the note would never stop
+            if (event.isNoteOff())
+            {
+                for (int i = 0; i < state.numHeld; ++i)
+                {
+                    const auto& noteOn = state.held[(size_t) i].event;
+
+                    if (noteOn.isNoteOn() && noteOn.getGroup() == event.getGroup() && getNoteSlot(noteOn) == getNoteSlot(event))
+                    {
+                        release(noteOn, event.samplePosition);
+                        std::move(state.held.begin() + i + 1, state.held.begin() + state.numHeld, state.held.begin() + i);
+                        --state.numHeld;
+                        break;
+                    }
+                }
+            }
+
+            release(event, event.samplePosition);
+            return false;
+        }
+
+        state.held[(size_t) state.numHeld++] = { event, releaseBeat, quantum };
+        return true;
+    };
+
+    // Without a session there is no grid, so let everything go
+    if (! timeline)
+    {
+        for (int i = 0; i < state.numHeld; ++i)
+            release(state.held[(size_t) i].event, 0);
+
+        const auto hadHeld = state.numHeld > 0;
+        state.numHeld = 0;
+        state.noteDelays.fill(0.0f);
+        state.numDelayedNotes = 0;
+        return hadHeld;
+    }
+
+    scratch.clear();
+    scratch.addEvents(events, 0, -1, 0);
+    events.clear();
+
+    for (const auto& event : scratch)
+    {
+        // The events in this block arrived during the block before it
+        const auto age = std::chrono::microseconds((int64_t) ((numSamples - event.samplePosition) * 1.0e6 / sampleRate));
+        const auto arrival = now - age;
+
+        if (event.isNoteOff())
+        {
+            auto& delay = state.noteDelays[(size_t) getNoteSlot(event)];
+
+            // Once the grid is off, a note-off that was to follow its note-on goes now
+            if (delay > 0.0f)
+            {
+                if (grid > 0.0)
+                    hold(event, timeline->getBeatAtTime(arrival, quantum) + delay);
+                else
+                    release(event, event.samplePosition);
+
+                delay = 0.0f;
+                --state.numDelayedNotes;
+            }
+            else
+            {
+                release(event, event.samplePosition);
+            }
+
+            continue;
+        }
+
+        if (grid <= 0.0 || ! (event.isNoteOn() || holdAll))
+        {
+            release(event, event.samplePosition);
+            continue;
+        }
+
+        const auto phase = timeline->getPhaseAtTime(arrival, grid);
+
+        // Already on a grid line
+        if (phase < onGridBeats || grid - phase < onGridBeats)
+        {
+            auto& noteDelay = state.noteDelays[(size_t) getNoteSlot(event)];
+
+            // Struck again on a grid line, so its note-off mustn't wait either
+            if (event.isNoteOn() && noteDelay > 0.0f)
+            {
+                noteDelay = 0.0f;
+                --state.numDelayedNotes;
+            }
+
+            release(event, event.samplePosition);
+            continue;
+        }
+
+        const auto delay = grid - phase;
+
+        if (hold(event, timeline->getBeatAtTime(arrival, grid) + delay) && event.isNoteOn())
+        {
+            auto& noteDelay = state.noteDelays[(size_t) getNoteSlot(event)];
+
+            if (noteDelay <= 0.0f)
+                ++state.numDelayedNotes;
+
+            noteDelay = (float) delay;
+        }
+    }
+
+    // Nothing waiting, so the events went back as they were
+    if (state.numHeld == 0)
+        return false;
+
+    // Release what is heard in this block, keeping the rest in the order it arrived.
+    // With the grid turned off, everything still held goes now.
+    int numKept = 0;
+
+    for (int i = 0; i < state.numHeld; ++i)
+    {
+        auto& held = state.held[(size_t) i];
+        const auto releaseTime = timeline->getTimeAtBeat(held.releaseBeat, held.quantum);
+        const auto offset = std::ceil((double) (releaseTime - now).count() * sampleRate * 1.0e-6 - outputLatencySamples);
+
+        // More than a grid away means the session's beat jumped back; don't wait for it
+        const auto hasJumped = held.releaseBeat > timeline->getBeatAtTime(now, held.quantum) + held.quantum + onGridBeats;
+
+        if (grid <= 0.0 || hasJumped)
+            release(held.event, 0);
+        else if (offset < (double) numSamples)
+            release(held.event, juce::jlimit(0, numSamples - 1, (int) offset), timeline->getBeatAtTime(releaseTime));
+        else
+            state.held[(size_t) numKept++] = held;
+    }
+
+    state.numHeld = numKept;
+    return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "MidiInputPorts.h"
+#include "../sync/LinkManager.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Holds incoming MIDI from chosen input ports until the next line of a grid on the
+// Link session timeline, so that something triggered from a controller (a note that
+// launches a clip or a pattern, say) lands on the next beat or bar instead of
+// whenever it happened to arrive. Each port has a grid of its own.
+//
+// Works on the audio thread, on each block as MidiInputPorts fills it: an event's
+// release beat is found from the phase of the beat it arrived at, and turned into a
+// sample offset in whichever block is heard at that beat, so tempo changes while it
+// waits are followed. Note-offs are delayed as much as their note-ons were, to keep
+// note lengths.
+class MidiInputQuantizer
+{
+public:
+    struct Settings
+    {
+        // Grid in beats: 4 for a bar of 4/4, 1 for a beat, 0.25 for a sixteenth.
+        // 0 lets events straight through.
+        double grid = 0.0;
+
+        // Hold controllers, program changes and the rest as well as notes, for
+        // controllers that launch things with them
+        bool holdAllMessages = false;
+    };
+
+    explicit MidiInputQuantizer(int maxHeldPerPort = 256);
+    ~MidiInputQuantizer();
+
+    // Where the grid comes from. Without a Link session nothing is held. Set it while
+    // the engine isn't running; it has to outlive this.
+    void setLinkManager(LinkManager* linkManagerToUse) { linkManager = linkManagerToUse; }
+
+    // Quantize a port of MidiInputPorts (message thread). Events already held keep
+    // their release beat; turning the grid off lets them go with the next block.
+    void setSettings(int port, const Settings& settings);
+    Settings getSettings(int port) const;
+
+    // Take held events out of a block and put in those due in it. The block is
+    // heard outputLatencySamples after the callback starts (audio thread only).
+    void processBlock(MidiInputBlock& block, double sampleRate, int numSamples, int outputLatencySamples) noexcept;
+
+    // The same against a timeline already captured, with now the time on Link's clock
+    // when the callback started, rather than the LinkManager's live session
+    void processBlock(MidiInputBlock& block, double sampleRate, int numSamples, int outputLatencySamples,
+                      const LinkManager::Timeline& timeline, std::chrono::microseconds now) noexcept;
+
+    // Events let through unquantized because too many were waiting
+    uint64_t getNumOverflowed() const { return numOverflowed.load(std::memory_order_relaxed); }
+
+private:
+    struct HeldEvent
+    {
+        UmpEvent event;
+        double releaseBeat;
+        double quantum;
+    };
+
+    struct PortState
+    {
+        explicit PortState(int maxHeld) : held((size_t) maxHeld) {}
+
+        std::atomic<double> grid { 0.0 };
+        std::atomic<bool> holdAllMessages { false };
+
+        // Audio thread only: events waiting, in the order they arrived
+        std::vector<HeldEvent> held;
+        int numHeld = 0;
+
+        // Beats each sounding note's note-on was delayed by, by channel and note
+        std::array<float, 16 * 128> noteDelays {};
+        int numDelayedNotes = 0;
+    };
+
+    // Whether any port has something to quantize or let go in this block
+    bool needsProcessing(const MidiInputBlock& block) const noexcept;
+
+    // Run each port against blockTimeline
+    void processPorts(MidiInputBlock& block, double sampleRate, int numSamples, int outputLatencySamples) noexcept;
+
+    // Split one port's events into those that go now and those held, then release
+    // what is due, noting the beat each went on in beats; returns whether the port's
+    // events changed
+    bool processPort(PortState& state, UmpBuffer& events, double* beats, double sampleRate, int numSamples, int outputLatencySamples) noexcept;
+
+    const int maxHeldPerPort;
+    LinkManager* linkManager = nullptr;
+
+    // Created when a port is first quantized, and kept while the engine runs so that
+    // the audio thread is never left holding a freed one
+    std::array<std::unique_ptr<PortState>, MidiInputPorts::maxPorts> ownedStates;
+    std::array<std::atomic<PortState*>, MidiInputPorts::maxPorts> states {};
+
+    // Audio thread only: the Link timeline for the block being processed, and Link's
+    // clock when the block's callback started
+    std::optional<LinkManager::Timeline> blockTimeline;
+    std::chrono::microseconds blockNow { 0 };
+
+    // Audio thread only: a port's events while they are sorted out
+    UmpBuffer scratch;
+
+    std::atomic<uint64_t> numOverflowed { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiInputQuantizer)
+};
@@ -0,0 +1,138 @@
+#include "MidiInputQueue.h"
+#include "UmpTranslator.h"
+#include <cmath>
+#include <cstring>
+
+MidiInputQueue::MidiInputQueue(int capacity)
+    : fifo(juce::jmax(1, capacity) + 1),
+      events((size_t) juce::jmax(1, capacity) + 1)
+{
+}
+
+bool MidiInputQueue::push(const juce::MidiMessage& message) noexcept
+{
+    const auto* data = message.getRawData();
+    const auto numBytes = message.getRawDataSize();
+    const auto numPackets = UmpTranslator::getNumPackets(data, numBytes);
+
+    if (numPackets == 0)
+        return true;
+
+    // Too long to be put back together for the plugins
+    if (numBytes > UmpTranslator::maxSysExBytes || fifo.getFreeSpace() < numPackets)
+    {
+        numDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // All of a SysEx becomes visible to the audio thread at once
+    const auto scope = fifo.write(numPackets);
+    int index = 0;
+
+    UmpTranslator::fromMidi1(data, numBytes, [&](const uint32_t* words)
+    {
+        const auto slot = index < scope.blockSize1 ? scope.startIndex1 + index : scope.startIndex2 + index - scope.blockSize1;
+        auto& event = events[(size_t) slot];
+        event.timestamp = message.getTimeStamp();
+        std::memcpy(event.words, words, sizeof(uint32_t) * (size_t) UmpEvent::getNumWords(words[0]));
+        ++index;
+    });
+
+    jassert(index == numPackets);
+    return true;
+}
+
+bool MidiInputQueue::push(const uint32_t* words, double timestamp) noexcept
+{
+    if (fifo.getFreeSpace() < 1)
+    {
+        numDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const auto scope = fifo.write(1);
+    auto& event = events[(size_t) scope.startIndex1];
+    event.timestamp = timestamp;
+    std::memcpy(event.words, words, sizeof(uint32_t) * (size_t) UmpEvent::getNumWords(words[0]));
+    return true;
+}
+
+void MidiInputQueue::popBlock(UmpBuffer& destination, double blockEndTime, double sampleRate, int numSamples) noexcept
+{
+    if (resetRequested.exchange(false, std::memory_order_acquire))
+    {
+        numEvents.store(0, std::memory_order_relaxed);
+        numDisplaced.store(0, std::memory_order_relaxed);
+        totalErrorSamples.store(0.0, std::memory_order_relaxed);
+        maxErrorSamples.store(0.0, std::memory_order_relaxed);
+    }
+
+    const auto numReady = fifo.getNumReady();
+
+    if (numReady == 0 || numSamples <= 0)
+        return;
+
+    const auto windowStart = blockEndTime - (double) numSamples / sampleRate;
+    auto total = totalErrorSamples.load(std::memory_order_relaxed);
+    auto worst = maxErrorSamples.load(std::memory_order_relaxed);
+    int numTaken = 0;
+    uint64_t numMoved = 0;
+
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(numReady, start1, size1, start2, size2);
+
+    for (int i = 0; i < size1 + size2; ++i)
+    {
+        const auto& event = events[(size_t) (i < size1 ? start1 + i : start2 + i - size1)];
+
+        // Arrived after this block's window; it belongs to the next one
+        if (event.timestamp >= blockEndTime)
+            break;
+
+        const auto exactPosition = (event.timestamp - windowStart) * sampleRate;
+        const auto position = juce::jlimit(0, numSamples - 1, (int) std::lround(exactPosition));
+        const auto error = std::abs(exactPosition - (double) position);
+
+        if (exactPosition < -0.5 || exactPosition > (double) numSamples - 0.5)
+            ++numMoved;
+
+        if (! destination.add(position, event.words))
+            numDropped.fetch_add(1, std::memory_order_relaxed);
+
+        total += error;
+        worst = juce::jmax(worst, error);
+        ++numTaken;
+    }
+
+    fifo.finishedRead(numTaken);
+
+    numEvents.fetch_add((uint64_t) numTaken, std::memory_order_relaxed);
+    numDisplaced.fetch_add(numMoved, std::memory_order_relaxed);
+    totalErrorSamples.store(total, std::memory_order_relaxed);
+    maxErrorSamples.store(worst, std::memory_order_relaxed);
+}
+
+void MidiInputQueue::clear() noexcept
+{
+    fifo.finishedRead(fifo.getNumReady());
+}
+
+MidiInputQueue::TimingStats MidiInputQueue::getTimingStats() const
+{
+    TimingStats stats;
+    stats.numEvents = numEvents.load(std::memory_order_relaxed);
+    stats.numDropped = numDropped.load(std::memory_order_relaxed);
+    stats.numDisplaced = numDisplaced.load(std::memory_order_relaxed);
+    stats.maxErrorSamples = maxErrorSamples.load(std::memory_order_relaxed);
+
+    if (stats.numEvents > 0)
+        stats.meanErrorSamples = totalErrorSamples.load(std::memory_order_relaxed) / (double) stats.numEvents;
+
+    return stats;
+}
+
+void MidiInputQueue::resetTimingStats()
+{
+    numDropped.store(0, std::memory_order_relaxed);
+    resetRequested.store(true, std::memory_order_release);
+}
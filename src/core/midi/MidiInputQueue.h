@@ -0,0 +1,77 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "UmpBuffer.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Single-producer, single-consumer queue of incoming MIDI, used to hand events from
+// the MIDI device thread to the audio thread with their device timestamps. Neither
+// side ever waits or allocates. Events are turned into Universal MIDI Packets on the
+// way in, so the queue holds fixed-size packets and the engine never parses bytes.
+//
+// Each block takes the events that arrived during the block before it, placed at
+// the sample matching their timestamp. That costs one block of latency, but every
+// event gets the same latency, instead of being pulled forward to a block start.
+class MidiInputQueue
+{
+public:
+    explicit MidiInputQueue(int capacity = 1024);
+
+    // Add an event stamped in seconds on the Time::getMillisecondCounterHiRes() clock, as
+    // MidiInput stamps them. A SysEx goes in as all its packets or none of them. Returns
+    // false if it was dropped (MIDI thread only).
+    bool push(const juce::MidiMessage& message) noexcept;
+
+    // Add one packet from a source that already speaks UMP (MIDI thread only)
+    bool push(const uint32_t* words, double timestamp) noexcept;
+
+    // Move every packet stamped before blockEndTime into a block of numSamples that ends
+    // then, one block after they arrived (audio thread only)
+    void popBlock(UmpBuffer& destination, double blockEndTime, double sampleRate, int numSamples) noexcept;
+
+    // Throw away anything waiting (audio thread only, or while it isn't running)
+    void clear() noexcept;
+
+    struct TimingStats
+    {
+        // Packets, so a SysEx counts once for every six bytes
+        uint64_t numEvents = 0;
+
+        // Full queue, full block or oversized SysEx
+        uint64_t numDropped = 0;
+
+        // Events that fell outside the block they were due in and were moved to its edge,
+        // because a callback came late or early
+        uint64_t numDisplaced = 0;
+
+        // Distance between where an event was placed and where its timestamp said, in samples
+        double meanErrorSamples = 0.0;
+        double maxErrorSamples = 0.0;
+    };
+
+    TimingStats getTimingStats() const;
+    void resetTimingStats();
+
+private:
+    struct Event
+    {
+        double timestamp;
+        uint32_t words[4];
+    };
+
+    juce::AbstractFifo fifo;
+    std::vector<Event> events;
+
+    std::atomic<uint64_t> numEvents { 0 };
+    std::atomic<uint64_t> numDropped { 0 };
+    std::atomic<uint64_t> numDisplaced { 0 };
+    std::atomic<double> totalErrorSamples { 0.0 };
+    std::atomic<double> maxErrorSamples { 0.0 };
+
+    // Set by resetTimingStats(), acted on by the audio thread
+    std::atomic<bool> resetRequested { false };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiInputQueue)
+};
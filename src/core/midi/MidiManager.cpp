@@ -1,74 +1,376 @@
 #include "MidiManager.h"
+#include "MidiClockGenerator.h"
+#include <algorithm>
 
+//==============================================================================
+// An open input device, pushing into its own port's queue from the device's thread
+class MidiManager::OpenInput : private juce::MidiInputCallback
+{
+public:
+    OpenInput(const juce::String& identifier, MidiInputQueue* queueToFill)
+        : queue(queueToFill)
+    {
+        device = juce::MidiInput::openDevice(identifier, this);
+
+        if (device != nullptr)
+            device->start();
+    }
+
+    ~OpenInput() override
+    {
+        if (device != nullptr)
+            device->stop();
+    }
+
+    bool isOpen() const { return device != nullptr; }
+
+private:
+    void handleIncomingMidiMessage(juce::MidiInput*, const juce::MidiMessage& message) override
+    {
+        if (queue != nullptr)
+            queue->push(message);
+    }
+
+    MidiInputQueue* const queue;
+    std::unique_ptr<juce::MidiInput> device;
+
+    JUCE_DECLARE_NON_COPYABLE(OpenInput)
+};
+
+//==============================================================================
+namespace
+{
+    // Outputs send timestamped blocks from their own background thread
+    std::unique_ptr<juce::MidiOutput> openOutputDevice(const juce::String& identifier)
+    {
+        auto device = juce::MidiOutput::openDevice(identifier);
+
+        if (device != nullptr)
+            device->startBackgroundThread();
+
+        return device;
+    }
+}
+
+//==============================================================================
 MidiManager::MidiManager()
 {
+    clockGenerator = std::make_unique<MidiClockGenerator>(*this);
+    outputScheduler = std::make_unique<MidiOutputScheduler>(*this);
 }
 
 MidiManager::~MidiManager()
 {
-    // Close any open MIDI connections
-    midiInput.reset();
-    midiOutput.reset();
+    // Stop sending before closing any open MIDI connections
+    clockGenerator.reset();
+    outputScheduler.reset();
+    deviceListConnection.reset();
+    inputs.clear();
+
+    const juce::ScopedLock sl(outputLock);
+    outputs.clear();
 }
 
 bool MidiManager::initialize()
 {
-    return true; // Basic initialization successful
+    // Follow devices coming and going
+    deviceListConnection = juce::MidiDeviceListConnection::make([this] { handleDevicesChanged(); });
+    return true;
+}
+
+juce::Array<juce::MidiDeviceInfo> MidiManager::getAvailableInputs() const
+{
+    return juce::MidiInput::getAvailableDevices();
+}
+
+juce::Array<juce::MidiDeviceInfo> MidiManager::getAvailableOutputs() const
+{
+    return juce::MidiOutput::getAvailableDevices();
 }
 
 juce::StringArray MidiManager::getMidiInputDevices() const
 {
-    return juce::MidiInput::getDevices();
+    juce::StringArray names;
+
+    for (const auto& device : getAvailableInputs())
+        names.add(device.name);
+
+    return names;
 }
 
 juce::StringArray MidiManager::getMidiOutputDevices() const
 {
-    return juce::MidiOutput::getDevices();
+    juce::StringArray names;
+
+    for (const auto& device : getAvailableOutputs())
+        names.add(device.name);
+
+    return names;
+}
+
+bool MidiManager::openInput(const juce::String& identifier)
+{
+    if (identifier.isEmpty())
+        return false;
+
+    if (isInputActive(identifier))
+        return true;
+
+    inputs[identifier] = nullptr;
+    return connectInput(identifier);
+}
+
+void MidiManager::closeInput(const juce::String& identifier)
+{
+    // The port stays assigned, so the device's routes still apply if it is opened again
+    inputs.erase(identifier);
+}
+
+bool MidiManager::openOutput(const juce::String& identifier)
+{
+    if (identifier.isEmpty())
+        return false;
+
+    if (getOutput(identifier) != nullptr)
+        return true;
+
+    // Open it before taking the lock, which the clock generator's thread shares
+    auto device = openOutputDevice(identifier);
+    const auto isOpen = device != nullptr;
+
+    const juce::ScopedLock sl(outputLock);
+    outputs[identifier] = std::move(device);
+    return isOpen;
+}
+
+void MidiManager::closeOutput(const juce::String& identifier)
+{
+    std::unique_ptr<juce::MidiOutput> device;
+
+    {
+        const juce::ScopedLock sl(outputLock);
+        auto output = outputs.find(identifier);
+
+        if (output == outputs.end())
+            return;
+
+        device = std::move(output->second);
+        outputs.erase(output);
+    }
+}
+
+juce::StringArray MidiManager::getOpenInputs() const
+{
+    juce::StringArray identifiers;
+
+    for (const auto& input : inputs)
+        identifiers.add(input.first);
+
+    return identifiers;
+}
+
+juce::StringArray MidiManager::getOpenOutputs() const
+{
+    juce::StringArray identifiers;
+
+    for (const auto& output : outputs)
+        identifiers.add(output.first);
+
+    return identifiers;
+}
+
+bool MidiManager::isInputActive(const juce::String& identifier) const
+{
+    auto input = inputs.find(identifier);
+    return input != inputs.end() && input->second != nullptr;
+}
+
+juce::MidiOutput* MidiManager::getOutput(const juce::String& identifier) const
+{
+    auto output = outputs.find(identifier);
+    return output != outputs.end() ? output->second.get() : nullptr;
 }
 
 bool MidiManager::enableMidiInput(int index, bool enable)
 {
-    if (index < 0 || index >= juce::MidiInput::getDevices().size())
+    const auto devices = getAvailableInputs();
+
+    if (! juce::isPositiveAndBelow(index, devices.size()))
         return false;
-    
-    if (enable)
+
+    if (! enable)
     {
-        // Close any existing connection
-        midiInput.reset();
-        
-        // Create a new MIDI input connection
-        auto deviceName = juce::MidiInput::getDevices()[index];
-        midiInput = juce::MidiInput::openDevice(index, nullptr);
-        
-        if (midiInput == nullptr)
-            return false;
-        
-        midiInput->start();
+        closeInput(devices[index].identifier);
+        return true;
+    }
+
+    return openInput(devices[index].identifier);
+}
+
+bool MidiManager::setMidiOutput(int index)
+{
+    const auto devices = getAvailableOutputs();
+
+    if (! juce::isPositiveAndBelow(index, devices.size()))
+        return false;
+
+    return openOutput(devices[index].identifier);
+}
+
+void MidiManager::addRoute(const juce::String& inputIdentifier, int channel, NodeID destination)
+{
+    for (const auto& route : routes)
+        if (route.inputIdentifier == inputIdentifier && route.channel == channel && route.destination == destination)
+            return;
+
+    routes.push_back({ inputIdentifier, juce::jlimit(0, 16, channel), destination });
+    compileRouting();
+}
+
+void MidiManager::removeRoute(const juce::String& inputIdentifier, int channel, NodeID destination)
+{
+    routes.erase(std::remove_if(routes.begin(), routes.end(), [&](const RouteEntry& route)
+    {
+        return route.inputIdentifier == inputIdentifier && route.channel == channel && route.destination == destination;
+    }), routes.end());
+
+    compileRouting();
+}
+
+void MidiManager::removeRoutesTo(NodeID destination)
+{
+    routes.erase(std::remove_if(routes.begin(), routes.end(), [destination](const RouteEntry& route)
+    {
+        return route.destination == destination;
+    }), routes.end());
+
+    compileRouting();
+}
+
+void MidiManager::clearRoutes()
+{
+    routes.clear();
+    compileRouting();
+}
+
+void MidiManager::setRoutingCallback(std::function<void(std::shared_ptr<const MidiRoutingTable>)> callback)
+{
+    routingCallback = std::move(callback);
+    compileRouting();
+}
+
+void MidiManager::setInputQuantization(const juce::String& inputIdentifier, const MidiInputQuantizer::Settings& settings)
+{
+    if (inputPorts == nullptr || inputQuantizer == nullptr)
+        return;
+
+    const auto port = inputPorts->getPort(inputIdentifier);
+
+    if (port < 0)
+    {
+        juce::Logger::writeToLog("No MIDI input port left for " + inputIdentifier);
+        return;
     }
-    else
+
+    inputQuantizer->setSettings(port, settings);
+}
+
+MidiInputQuantizer::Settings MidiManager::getInputQuantization(const juce::String& inputIdentifier) const
+{
+    if (inputPorts == nullptr || inputQuantizer == nullptr)
+        return {};
+
+    return inputQuantizer->getSettings(inputPorts->findPort(inputIdentifier));
+}
+
+bool MidiManager::connectInput(const juce::String& identifier)
+{
+    MidiInputQueue* queue = nullptr;
+
+    if (inputPorts != nullptr)
     {
-        // Close the MIDI input
-        if (midiInput != nullptr)
+        const auto port = inputPorts->getPort(identifier);
+
+        if (port < 0)
         {
-            midiInput->stop();
-            midiInput.reset();
+            juce::Logger::writeToLog("No MIDI input port left for " + identifier);
+            return false;
         }
+
+        queue = inputPorts->getQueue(port);
     }
-    
+
+    auto input = std::make_unique<OpenInput>(identifier, queue);
+
+    if (! input->isOpen())
+        return false;
+
+    inputs[identifier] = std::move(input);
     return true;
 }
 
-bool MidiManager::setMidiOutput(int index)
+void MidiManager::handleDevicesChanged()
 {
-    if (index < 0 || index >= juce::MidiOutput::getDevices().size())
-        return false;
-    
-    // Close any existing connection
-    midiOutput.reset();
-    
-    // Create a new MIDI output connection
-    auto deviceName = juce::MidiOutput::getDevices()[index];
-    midiOutput = juce::MidiOutput::openDevice(index);
-    
-    return midiOutput != nullptr;
-}
\ No newline at end of file
+    juce::StringArray availableInputs, availableOutputs;
+
+    for (const auto& device : getAvailableInputs())
+        availableInputs.add(device.identifier);
+
+    for (const auto& device : getAvailableOutputs())
+        availableOutputs.add(device.identifier);
+
+    // Close what went away and reopen what came back; the port and its queue stay put
+    for (auto& input : inputs)
+    {
+        const auto isAvailable = availableInputs.contains(input.first);
+
+        if (input.second != nullptr && ! isAvailable)
+        {
+            input.second = nullptr;
+            juce::Logger::writeToLog("MIDI input disconnected: " + input.first);
+        }
+        else if (input.second == nullptr && isAvailable && connectInput(input.first))
+        {
+            juce::Logger::writeToLog("MIDI input reconnected: " + input.first);
+        }
+    }
+
+    for (auto& output : outputs)
+    {
+        const auto isAvailable = availableOutputs.contains(output.first);
+
+        if (output.second != nullptr && ! isAvailable)
+        {
+            std::unique_ptr<juce::MidiOutput> device;
+            const juce::ScopedLock sl(outputLock);
+            std::swap(device, output.second);
+        }
+        else if (output.second == nullptr && isAvailable)
+        {
+            auto device = openOutputDevice(output.first);
+            const juce::ScopedLock sl(outputLock);
+            output.second = std::move(device);
+        }
+    }
+
+    if (devicesChangedCallback)
+        devicesChangedCallback();
+}
+
+void MidiManager::compileRouting()
+{
+    if (! routingCallback || inputPorts == nullptr)
+        return;
+
+    std::vector<MidiRoutingTable::Route> compiled;
+
+    for (const auto& route : routes)
+    {
+        const auto port = inputPorts->getPort(route.inputIdentifier);
+
+        if (port >= 0)
+            compiled.push_back({ port, route.channel, route.destination });
+    }
+
+    routingCallback(std::make_shared<const MidiRoutingTable>(compiled));
+}
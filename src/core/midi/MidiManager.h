@@ -1,31 +1,161 @@
 #pragma once
 
 #include <juce_audio_devices/juce_audio_devices.h>
+#include "MidiInputPorts.h"
+#include "MidiInputQuantizer.h"
+#include "MidiOutputScheduler.h"
+#include "MidiRoutingTable.h"
+#include <functional>
+#include <map>
 #include <vector>
 #include <memory>
 
+class MidiClockGenerator;
+
+// Opens any number of MIDI inputs and outputs by their stable device identifiers and
+// keeps them open across unplugging: a device that disappears is closed, and opened
+// again when it comes back. None of this touches the audio device.
+//
+// Incoming MIDI goes to the engine's input ports, one per input device, and from there
+// to the MIDI input node and to wherever the routing matrix sends it.
 class MidiManager
 {
 public:
+    using NodeID = juce::AudioProcessorGraph::NodeID;
+
     MidiManager();
     ~MidiManager();
 
     // Initialize MIDI devices
     bool initialize();
 
-    // Get available MIDI input devices
-    juce::StringArray getMidiInputDevices() const;
+    // Where incoming MIDI goes, normally AudioEngine::getMidiInputPorts(). Set it before
+    // opening inputs; it has to outlive this.
+    void setInputPorts(MidiInputPorts* ports) { inputPorts = ports; }
+
+    // What holds incoming MIDI to the Link grid, normally AudioEngine::getMidiInputQuantizer().
+    // Set it after the input ports; it has to outlive this.
+    void setInputQuantizer(MidiInputQuantizer* quantizer) { inputQuantizer = quantizer; }
 
-    // Get available MIDI output devices
+    // Where the graph's outgoing MIDI comes from, normally AudioEngine::getMidiOutputQueue().
+    // It goes to every open output; nullptr stops sending it. The queue has to outlive this.
+    void setOutputQueue(MidiOutputQueue* queue) { outputScheduler->setQueue(queue); }
+
+    // Devices currently connected
+    juce::Array<juce::MidiDeviceInfo> getAvailableInputs() const;
+    juce::Array<juce::MidiDeviceInfo> getAvailableOutputs() const;
+
+    // Get available MIDI input/output device names
+    juce::StringArray getMidiInputDevices() const;
     juce::StringArray getMidiOutputDevices() const;
 
-    // Enable a MIDI input device by index
+    // Open a device and keep it open, across unplugging, until it is closed again.
+    // Returns false if it can't be opened right now (it will be when it appears).
+    bool openInput(const juce::String& identifier);
+    void closeInput(const juce::String& identifier);
+    bool openOutput(const juce::String& identifier);
+    void closeOutput(const juce::String& identifier);
+
+    // Devices asked for, whether or not they are connected
+    juce::StringArray getOpenInputs() const;
+    juce::StringArray getOpenOutputs() const;
+
+    // Whether a device asked for is connected and open
+    bool isInputActive(const juce::String& identifier) const;
+
+    // An open output, or nullptr while it isn't connected
+    juce::MidiOutput* getOutput(const juce::String& identifier) const;
+
+    // Call something with an open output, from any thread, holding it open meanwhile.
+    // Returns false if the output isn't connected.
+    template <typename Callback>
+    bool withOutput(const juce::String& identifier, Callback&& callback) const
+    {
+        const juce::ScopedLock sl(outputLock);
+        auto output = outputs.find(identifier);
+
+        if (output == outputs.end() || output->second == nullptr)
+            return false;
+
+        callback(*output->second);
+        return true;
+    }
+
+    // Call something with each open output and its identifier, from any thread
+    template <typename Callback>
+    void forEachOutput(Callback&& callback) const
+    {
+        const juce::ScopedLock sl(outputLock);
+
+        for (const auto& output : outputs)
+            if (output.second != nullptr)
+                callback(output.first, *output.second);
+    }
+
+    // Enable a MIDI input device by index in getMidiInputDevices()
     bool enableMidiInput(int index, bool enable = true);
 
-    // Set a MIDI output device by index
+    // Open a MIDI output device by index in getMidiOutputDevices()
     bool setMidiOutput(int index);
 
+    // Routing matrix: send one channel (1-16) of an input device, or all of it (0), to a
+    // node's MIDI input. Each change compiles a new table for the routing callback.
+    void addRoute(const juce::String& inputIdentifier, int channel, NodeID destination);
+    void removeRoute(const juce::String& inputIdentifier, int channel, NodeID destination);
+    void removeRoutesTo(NodeID destination);
+    void clearRoutes();
+
+    // Quantize an input device to a grid on the Link session, so what it triggers lands
+    // on the next beat or bar. Like routes, it applies whenever the device is open.
+    void setInputQuantization(const juce::String& inputIdentifier, const MidiInputQuantizer::Settings& settings);
+    MidiInputQuantizer::Settings getInputQuantization(const juce::String& inputIdentifier) const;
+
+    // Called on the message thread with each newly compiled routing table, normally
+    // to pass it to AudioEngine::setMidiRouting()
+    void setRoutingCallback(std::function<void(std::shared_ptr<const MidiRoutingTable>)> callback);
+
+    // Called on the message thread after devices were connected or disconnected
+    void setDevicesChangedCallback(std::function<void()> callback) { devicesChangedCallback = std::move(callback); }
+
+    // MIDI clock and timecode for the open outputs, following Link
+    MidiClockGenerator& getClockGenerator() { return *clockGenerator; }
+
+    // Timing of the graph's outgoing MIDI, per output
+    MidiOutputScheduler& getOutputScheduler() { return *outputScheduler; }
+
 private:
-    std::unique_ptr<juce::MidiInput> midiInput;
-    std::unique_ptr<juce::MidiOutput> midiOutput;
+    class OpenInput;
+
+    struct RouteEntry
+    {
+        juce::String inputIdentifier;
+        int channel;
+        NodeID destination;
+    };
+
+    bool connectInput(const juce::String& identifier);
+    void handleDevicesChanged();
+    void compileRouting();
+
+    MidiInputPorts* inputPorts = nullptr;
+    MidiInputQuantizer* inputQuantizer = nullptr;
+
+    // Everything asked for is a key; the value is null while the device is missing
+    std::map<juce::String, std::unique_ptr<OpenInput>> inputs;
+    std::map<juce::String, std::unique_ptr<juce::MidiOutput>> outputs;
+
+    // Held while outputs change, since the clock generator and the output scheduler
+    // send from their own threads
+    juce::CriticalSection outputLock;
+
+    std::vector<RouteEntry> routes;
+    std::function<void(std::shared_ptr<const MidiRoutingTable>)> routingCallback;
+    std::function<void()> devicesChangedCallback;
+
+    juce::MidiDeviceListConnection deviceListConnection;
+
+    std::unique_ptr<MidiClockGenerator> clockGenerator;
+    std::unique_ptr<MidiOutputScheduler> outputScheduler;
+
+    JUCE_DECLARE_NON_COPYABLE(MidiManager)
 };
@@ -0,0 +1,78 @@
+#include "MidiOutputQueue.h"
+#include <cmath>
+#include <cstring>
+
+MidiOutputQueue::MidiOutputQueue(int capacity)
+    : fifo(juce::jmax(1, capacity) + 1),
+      events((size_t) juce::jmax(1, capacity) + 1)
+{
+}
+
+void MidiOutputQueue::pushBlock(const juce::MidiBuffer& buffer, double blockStartTime, double sampleRate) noexcept
+{
+    for (const auto metadata : buffer)
+    {
+        if (metadata.numBytes > maxEventBytes || fifo.getFreeSpace() < 1)
+        {
+            numDropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        const auto scope = fifo.write(1);
+        auto& event = events[(size_t) scope.startIndex1];
+        event.timestamp = blockStartTime + (double) metadata.samplePosition / sampleRate;
+        event.numBytes = metadata.numBytes;
+        std::memcpy(event.data, metadata.data, (size_t) metadata.numBytes);
+    }
+}
+
+int MidiOutputQueue::popAll(juce::MidiBuffer& destination, double startTime, double positionsPerSecond) noexcept
+{
+    const auto numReady = fifo.getNumReady();
+
+    if (numReady == 0)
+        return 0;
+
+    uint64_t numOverdue = 0;
+
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(numReady, start1, size1, start2, size2);
+
+    for (int i = 0; i < size1 + size2; ++i)
+    {
+        const auto& event = events[(size_t) (i < size1 ? start1 + i : start2 + i - size1)];
+        const auto position = (event.timestamp - startTime) * positionsPerSecond;
+
+        if (position < 0.0)
+            ++numOverdue;
+
+        destination.addEvent(event.data, event.numBytes, juce::jmax(0, (int) std::lround(position)));
+    }
+
+    fifo.finishedRead(numReady);
+
+    numEvents.fetch_add((uint64_t) numReady, std::memory_order_relaxed);
+    numLate.fetch_add(numOverdue, std::memory_order_relaxed);
+    return numReady;
+}
+
+void MidiOutputQueue::clear() noexcept
+{
+    fifo.finishedRead(fifo.getNumReady());
+}
+
+MidiOutputQueue::Stats MidiOutputQueue::getStats() const
+{
+    Stats stats;
+    stats.numEvents = numEvents.load(std::memory_order_relaxed);
+    stats.numDropped = numDropped.load(std::memory_order_relaxed);
+    stats.numLate = numLate.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void MidiOutputQueue::resetStats()
+{
+    numEvents.store(0, std::memory_order_relaxed);
+    numDropped.store(0, std::memory_order_relaxed);
+    numLate.store(0, std::memory_order_relaxed);
+}
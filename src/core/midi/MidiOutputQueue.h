@@ -0,0 +1,61 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Single-producer, single-consumer queue of MIDI leaving the graph, used to hand each
+// block's events from the audio thread to the MIDI output scheduler with the time
+// they should be heard. Neither side ever waits or allocates.
+class MidiOutputQueue
+{
+public:
+    // Longer SysEx messages are dropped
+    static constexpr int maxEventBytes = 32;
+
+    explicit MidiOutputQueue(int capacity = 2048);
+
+    // Add a block's events, stamped in seconds on the Time::getMillisecondCounterHiRes()
+    // clock from the time its first sample is heard (audio thread only)
+    void pushBlock(const juce::MidiBuffer& buffer, double blockStartTime, double sampleRate) noexcept;
+
+    // Move everything waiting into a buffer, at positions counted from startTime in
+    // positionsPerSecond. Events already due go at position 0. Returns the number of
+    // events taken (scheduler thread only).
+    int popAll(juce::MidiBuffer& destination, double startTime, double positionsPerSecond) noexcept;
+
+    // Throw away anything waiting (scheduler thread only, or while it isn't running)
+    void clear() noexcept;
+
+    struct Stats
+    {
+        uint64_t numEvents = 0;
+
+        // Full queue or oversized SysEx
+        uint64_t numDropped = 0;
+
+        // Events that reached the scheduler after their time, and went out straight away
+        uint64_t numLate = 0;
+    };
+
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    struct Event
+    {
+        double timestamp;
+        int numBytes;
+        uint8_t data[maxEventBytes];
+    };
+
+    juce::AbstractFifo fifo;
+    std::vector<Event> events;
+
+    std::atomic<uint64_t> numEvents { 0 };
+    std::atomic<uint64_t> numDropped { 0 };
+    std::atomic<uint64_t> numLate { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiOutputQueue)
+};
@@ -0,0 +1,67 @@
+#include "MidiOutputScheduler.h"
+#include "MidiManager.h"
+
+namespace
+{
+    // Positions in the blocks handed to the outputs are microseconds
+    constexpr double positionsPerSecond = 1.0e6;
+}
+
+MidiOutputScheduler::MidiOutputScheduler(MidiManager& manager)
+    : juce::Thread("MIDI output"),
+      midiManager(manager)
+{
+    pending.ensureSize(4096);
+}
+
+MidiOutputScheduler::~MidiOutputScheduler()
+{
+    stopThread(1000);
+}
+
+void MidiOutputScheduler::setQueue(MidiOutputQueue* queueToUse)
+{
+    stopThread(1000);
+    queue = queueToUse;
+
+    if (queue == nullptr)
+        return;
+
+    // Whatever was waiting is too late to be useful now
+    queue->clear();
+    startThread(juce::Thread::Priority::high);
+}
+
+void MidiOutputScheduler::setLatencyOffset(const juce::String& identifier, double milliseconds)
+{
+    const juce::ScopedLock sl(offsetLock);
+    latencyOffsets[identifier] = milliseconds;
+}
+
+double MidiOutputScheduler::getLatencyOffset(const juce::String& identifier) const
+{
+    const juce::ScopedLock sl(offsetLock);
+    auto offset = latencyOffsets.find(identifier);
+    return offset != latencyOffsets.end() ? offset->second : 0.0;
+}
+
+void MidiOutputScheduler::run()
+{
+    while (! threadShouldExit())
+    {
+        wait(1);
+
+        const auto now = juce::Time::getMillisecondCounterHiRes();
+        pending.clear();
+
+        if (queue->popAll(pending, now * 0.001, positionsPerSecond) == 0)
+            continue;
+
+        // Each output's background thread sends the events at their times
+        midiManager.forEachOutput([&](const juce::String& identifier, juce::MidiOutput& output)
+        {
+            const auto startTime = juce::jmax(1.0, now - getLatencyOffset(identifier));
+            output.sendBlockOfMessages(pending, startTime, positionsPerSecond);
+        });
+    }
+}
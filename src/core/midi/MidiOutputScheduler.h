@@ -0,0 +1,43 @@
+#pragma once
+
+#include <juce_audio_devices/juce_audio_devices.h>
+#include "MidiOutputQueue.h"
+#include <map>
+
+class MidiManager;
+
+// Sends the MIDI that plugins in the graph produce to every open MIDI output, at the
+// time the audio it goes with is heard.
+//
+// A high priority thread takes each block's events off the engine's queue within a
+// millisecond or so and passes them to each output's background thread, which sends
+// every event at its own timestamp. Each output can be sent to early, to make up for
+// its latency.
+class MidiOutputScheduler : private juce::Thread
+{
+public:
+    explicit MidiOutputScheduler(MidiManager& midiManager);
+    ~MidiOutputScheduler() override;
+
+    // Take events from a queue, normally AudioEngine::getMidiOutputQueue(), or stop with
+    // nullptr. The queue has to outlive this.
+    void setQueue(MidiOutputQueue* queueToUse);
+
+    // Send to an output this much before the audio is heard, by identifier
+    void setLatencyOffset(const juce::String& identifier, double milliseconds);
+    double getLatencyOffset(const juce::String& identifier) const;
+
+private:
+    void run() override;
+
+    MidiManager& midiManager;
+    MidiOutputQueue* queue = nullptr;
+
+    juce::CriticalSection offsetLock;
+    std::map<juce::String, double> latencyOffsets;
+
+    // Events taken off the queue, in microseconds from when they were taken
+    juce::MidiBuffer pending;
+
+    JUCE_DECLARE_NON_COPYABLE(MidiOutputScheduler)
+};
@@ -0,0 +1,597 @@
+#include "MidiRecorder.h"
+#include "../sync/LinkManager.h"
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <limits>
+
+namespace
+{
+    // Room for a page's SysEx, addressed by 16-bit offsets
+    constexpr int sysexBytesPerPage = 65536;
+
+    // Tempo changes kept for the exported file
+    constexpr int maxTempoChanges = 4096;
+
+    // Beats counted without a Link session
+    constexpr double fallbackBeatsPerSecond = 2.0;
+
+    constexpr int ticksPerBeat = 960;
+}
+
+//==============================================================================
+struct MidiRecorder::Page
+{
+    explicit Page(int capacity)
+        : sampleOffsets(new uint32_t[(size_t) capacity]()),
+          beats(new double[(size_t) capacity]()),
+          messages(new uint32_t[(size_t) capacity]()),
+          sysex(new uint8_t[(size_t) sysexBytesPerPage]())
+    {
+    }
+
+    static size_t getNumBytes(int capacity)
+    {
+        return (size_t) capacity * (sizeof(uint32_t) * 2 + sizeof(double)) + (size_t) sysexBytesPerPage;
+    }
+
+    // Set by the audio thread when it starts filling the page
+    int64_t firstIndex = 0;
+    int64_t baseSample = 0;
+    int numEvents = 0;
+    int sysexUsed = 0;
+
+    // Latest sample position on the page; positions go back when the play head is moved
+    std::atomic<int64_t> maxSample { 0 };
+
+    std::unique_ptr<uint32_t[]> sampleOffsets;
+    std::unique_ptr<double[]> beats;
+    std::unique_ptr<uint32_t[]> messages;
+    std::unique_ptr<uint8_t[]> sysex;
+};
+
+//==============================================================================
+// Counts the calling thread as reading the recording while in scope, so that the
+// audio thread doesn't clear it underneath. Waits out a clear that is going on.
+class MidiRecorder::ScopedReader
+{
+public:
+    explicit ScopedReader(const MidiRecorder& recorderToRead)
+        : recorder(recorderToRead)
+    {
+        // Both sides announce themselves before looking at the other, so they never both go ahead
+        for (;;)
+        {
+            recorder.numReaders.fetch_add(1);
+
+            if (! recorder.clearing.load())
+                return;
+
+            recorder.numReaders.fetch_sub(1);
+
+            while (recorder.clearing.load(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+    }
+
+    ~ScopedReader()
+    {
+        recorder.numReaders.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    const MidiRecorder& recorder;
+
+    JUCE_DECLARE_NON_COPYABLE(ScopedReader)
+};
+
+//==============================================================================
+class MidiRecorder::ExportThread : public juce::Thread
+{
+public:
+    ExportThread(const MidiRecorder& recorderToExport,
+                 const juce::File& fileToWrite,
+                 const juce::StringArray& names,
+                 std::function<void(bool, const juce::String&)> callback)
+        : juce::Thread("MIDI export"),
+          recorder(recorderToExport),
+          file(fileToWrite),
+          trackNames(names),
+          onFinished(std::move(callback))
+    {
+    }
+
+private:
+    void run() override
+    {
+        juce::String errorMessage;
+        const auto succeeded = recorder.exportToMidiFile(file, trackNames, errorMessage);
+
+        juce::MessageManager::callAsync([callback = onFinished, succeeded, errorMessage]
+        {
+            if (callback)
+                callback(succeeded, errorMessage);
+        });
+    }
+
+    const MidiRecorder& recorder;
+    const juce::File file;
+    const juce::StringArray trackNames;
+    const std::function<void(bool, const juce::String&)> onFinished;
+
+    JUCE_DECLARE_NON_COPYABLE(ExportThread)
+};
+
+//==============================================================================
+MidiRecorder::MidiRecorder(int pageCapacity, int maxNumPages)
+    : eventsPerPage(juce::jmax(1, pageCapacity)),
+      pages(new std::atomic<Page*>[(size_t) juce::jmax(1, maxNumPages)]()),
+      maxPages(juce::jmax(1, maxNumPages)),
+      tempoChanges((size_t) maxTempoChanges)
+{
+    for (int i = 0; i < maxPages; ++i)
+        pages[(size_t) i].store(nullptr, std::memory_order_relaxed);
+
+    allocateSparePages();
+}
+
+MidiRecorder::~MidiRecorder()
+{
+    stopTimer();
+
+    // An export in progress reads the pages
+    if (exportThread != nullptr)
+        exportThread->stopThread(-1);
+}
+
+void MidiRecorder::start()
+{
+    allocateSparePages();
+    recording.store(true, std::memory_order_release);
+    startTimer(250);
+}
+
+void MidiRecorder::stop()
+{
+    recording.store(false);
+    stopTimer();
+
+    // There may be no more blocks to do a clear that is waiting
+    if (clearRequested.load(std::memory_order_acquire))
+        clear();
+}
+
+void MidiRecorder::clear()
+{
+    clearRequested.store(true, std::memory_order_release);
+
+    // Not recording, there may be no block to do it, so it's done here, or retried from
+    // the timer. Nothing is appended once appending is seen clear, as a block starting
+    // after that sees recording off.
+    if (! recording.load() && (appending.load() || ! clearIfUnread()))
+        startTimer(250);
+}
+
+bool MidiRecorder::clearIfUnread() noexcept
+{
+    // Pages are reused from the first, so nothing may be reading them
+    bool wasClearing = false;
+
+    if (! clearing.compare_exchange_strong(wasClearing, true))
+        return false;
+
+    const auto cleared = numReaders.load() == 0;
+
+    if (cleared)
+    {
+        numPagesUsed.store(0, std::memory_order_release);
+        numEvents.store(0, std::memory_order_release);
+        numTempoChanges.store(0, std::memory_order_release);
+        lastTempo = 0.0;
+        clearRequested.store(false, std::memory_order_relaxed);
+    }
+
+    clearing.store(false, std::memory_order_release);
+    return cleared;
+}
+
+//==============================================================================
+void MidiRecorder::recordBlock(const MidiInputBlock& block, int64_t blockStartSample, double sampleRate, int numSamples) noexcept
+{
+    // Tried again next block if something is reading
+    if (clearRequested.load(std::memory_order_acquire))
+        clearIfUnread();
+
+    // Announced before looking at recording, so that clear() sees one or the other
+    appending.store(true);
+
+    if (! recording.load())
+    {
+        appending.store(false, std::memory_order_release);
+        return;
+    }
+
+    std::optional<LinkManager::Timeline> timeline;
+    std::chrono::microseconds now { 0 };
+
+    if (linkManager != nullptr)
+    {
+        timeline = linkManager->captureAudioTimeline();
+        now = linkManager->getClockMicros();
+    }
+
+    // The events in this block arrived during the block before it
+    const auto beatAt = [&](int position)
+    {
+        if (! timeline)
+            return (double) (blockStartSample + position) / sampleRate * fallbackBeatsPerSecond;
+
+        const auto age = std::chrono::microseconds((int64_t) ((numSamples - position) * 1.0e6 / sampleRate));
+        return timeline->getBeatAtTime(now - age);
+    };
+
+    if (timeline && timeline->getTempo() != lastTempo)
+    {
+        const auto index = numTempoChanges.load(std::memory_order_relaxed);
+
+        if (index < maxTempoChanges)
+        {
+            lastTempo = timeline->getTempo();
+            tempoChanges[(size_t) index] = { timeline->getBeatAtTime(now), lastTempo };
+            numTempoChanges.store(index + 1, std::memory_order_release);
+        }
+    }
+
+    // Merge the ports in time order, so the sample column stays sorted
+    const auto numPorts = juce::jmin(block.numPorts, MidiInputPorts::maxPorts);
+    std::array<const UmpEvent*, MidiInputPorts::maxPorts> positions, ends;
+
+    for (int port = 0; port < numPorts; ++port)
+    {
+        positions[(size_t) port] = block.ports[(size_t) port].begin();
+        ends[(size_t) port] = block.ports[(size_t) port].end();
+    }
+
+    for (;;)
+    {
+        int next = -1;
+
+        for (int port = 0; port < numPorts; ++port)
+            if (positions[(size_t) port] != ends[(size_t) port]
+                && (next < 0 || positions[(size_t) port]->samplePosition < positions[(size_t) next]->samplePosition))
+                next = port;
+
+        if (next < 0)
+            break;
+
+        const auto index = (size_t) (positions[(size_t) next] - block.ports[(size_t) next].begin());
+        const auto& event = *positions[(size_t) next]++;
+
+        // Events the quantizer held come out where they are heard, not when they arrived,
+        // and go down on the beat they were quantized to
+        auto beat = block.hasReleaseBeats[(size_t) next] ? block.releaseBeats[(size_t) next][index]
+                                                          : std::numeric_limits<double>::quiet_NaN();
+
+        if (std::isnan(beat))
+            beat = beatAt(event.samplePosition);
+
+        // Stored as MIDI 1.0, which is what the exported file holds
+        translators[(size_t) next].toMidi1(event.words, [&](const uint8_t* data, int numBytes)
+        {
+            if (! append(blockStartSample + event.samplePosition, beat, next, data, numBytes))
+                numDropped.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    appending.store(false, std::memory_order_release);
+}
+
+bool MidiRecorder::append(int64_t samplePosition, double beat, int port, const uint8_t* data, int numBytes) noexcept
+{
+    if (numBytes <= 0 || numBytes > UmpTranslator::maxSysExBytes)
+        return false;
+
+    const auto isSysex = numBytes > 3 || data[0] == 0xf0;
+    const auto used = numPagesUsed.load(std::memory_order_relaxed);
+    auto* page = used > 0 ? pages[(size_t) (used - 1)].load(std::memory_order_acquire) : nullptr;
+
+    const auto needsNewPage = page == nullptr
+                           || page->numEvents == eventsPerPage
+                           || samplePosition < page->baseSample
+                           || samplePosition - page->baseSample > maxPageSpan
+                           || (isSysex && page->sysexUsed + numBytes + 2 > sysexBytesPerPage);
+
+    if (needsNewPage)
+    {
+        page = used < maxPages ? pages[(size_t) used].load(std::memory_order_acquire) : nullptr;
+
+        if (page == nullptr)
+            return false;
+
+        page->firstIndex = numEvents.load(std::memory_order_relaxed);
+        page->baseSample = samplePosition;
+        page->numEvents = 0;
+        page->sysexUsed = 0;
+        page->maxSample.store(samplePosition, std::memory_order_relaxed);
+        numPagesUsed.store(used + 1, std::memory_order_release);
+    }
+
+    const auto slot = (size_t) page->numEvents++;
+    auto word = (uint32_t) (port & 0x3f) << 24;
+
+    if (isSysex)
+    {
+        auto* destination = page->sysex.get() + page->sysexUsed;
+        destination[0] = (uint8_t) numBytes;
+        destination[1] = (uint8_t) (numBytes >> 8);
+        std::memcpy(destination + 2, data, (size_t) numBytes);
+
+        word |= sysexFlag | (uint32_t) page->sysexUsed;
+        page->sysexUsed += numBytes + 2;
+    }
+    else
+    {
+        word |= data[0];
+
+        if (numBytes > 1)
+            word |= (uint32_t) data[1] << 8;
+
+        if (numBytes > 2)
+            word |= (uint32_t) data[2] << 16;
+    }
+
+    page->sampleOffsets[slot] = (uint32_t) (samplePosition - page->baseSample);
+    page->beats[slot] = beat;
+    page->messages[slot] = word;
+
+    if (samplePosition > page->maxSample.load(std::memory_order_relaxed))
+        page->maxSample.store(samplePosition, std::memory_order_relaxed);
+
+    numEvents.store(page->firstIndex + page->numEvents, std::memory_order_release);
+    return true;
+}
+
+//==============================================================================
+const MidiRecorder::Page& MidiRecorder::findPage(int64_t index, int& slot) const noexcept
+{
+    // The last page starting at or before the event
+    int low = 0, high = juce::jmax(0, numPagesUsed.load(std::memory_order_acquire) - 1);
+
+    while (low < high)
+    {
+        const auto middle = (low + high + 1) / 2;
+
+        if (pages[(size_t) middle].load(std::memory_order_acquire)->firstIndex <= index)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+
+    const auto* page = pages[(size_t) low].load(std::memory_order_acquire);
+    slot = (int) (index - page->firstIndex);
+    return *page;
+}
+
+double MidiRecorder::getBeat(int64_t index) const noexcept
+{
+    int slot = 0;
+    return findPage(index, slot).beats[(size_t) slot];
+}
+
+MidiRecorder::Event MidiRecorder::getEvent(int64_t index) const
+{
+    const ScopedReader reader(*this);
+    return readEvent(index);
+}
+
+MidiRecorder::Event MidiRecorder::readEvent(int64_t index) const
+{
+    Event event;
+
+    if (! juce::isPositiveAndBelow(index, getNumEvents()))
+        return event;
+
+    int slot = 0;
+    const auto& page = findPage(index, slot);
+    const auto word = page.messages[(size_t) slot];
+
+    event.samplePosition = page.baseSample + page.sampleOffsets[(size_t) slot];
+    event.beat = page.beats[(size_t) slot];
+    event.port = (int) ((word >> 24) & 0x3f);
+
+    if ((word & sysexFlag) != 0)
+    {
+        const auto* data = page.sysex.get() + (word & 0xffff);
+        event.message = juce::MidiMessage(data + 2, data[0] | (data[1] << 8));
+    }
+    else
+    {
+        const uint8_t bytes[] = { (uint8_t) word, (uint8_t) (word >> 8), (uint8_t) (word >> 16) };
+        const auto numBytes = juce::MidiMessage::getMessageLengthFromFirstByte(bytes[0]);
+        event.message = juce::MidiMessage(bytes, juce::jlimit(1, 3, numBytes));
+    }
+
+    event.message.setTimeStamp((double) event.samplePosition);
+    return event;
+}
+
+int64_t MidiRecorder::findFirstEventAtSample(int64_t samplePosition) const
+{
+    const ScopedReader reader(*this);
+
+    // Positions aren't in order if the play head was moved back, so skip whole pages
+    // that end before the position, then look through the first one that doesn't
+    const auto count = getNumEvents();
+    const auto numPages = numPagesUsed.load(std::memory_order_acquire);
+
+    for (int index = 0; index < numPages; ++index)
+    {
+        const auto& page = *pages[(size_t) index].load(std::memory_order_acquire);
+
+        if (page.firstIndex >= count)
+            break;
+
+        if (page.maxSample.load(std::memory_order_relaxed) < samplePosition)
+            continue;
+
+        const auto pageEnd = index + 1 < numPages ? pages[(size_t) index + 1].load(std::memory_order_acquire)->firstIndex : count;
+        const auto numOnPage = (int) (juce::jmin(pageEnd, count) - page.firstIndex);
+
+        for (int slot = 0; slot < numOnPage; ++slot)
+            if (page.baseSample + page.sampleOffsets[(size_t) slot] >= samplePosition)
+                return page.firstIndex + slot;
+    }
+
+    return count;
+}
+
+int64_t MidiRecorder::findFirstEventAtBeat(double beat) const
+{
+    const ScopedReader reader(*this);
+    int64_t low = 0, high = getNumEvents();
+
+    while (low < high)
+    {
+        const auto middle = low + (high - low) / 2;
+
+        if (getBeat(middle) < beat)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+size_t MidiRecorder::getMemoryUsage() const
+{
+    return (size_t) numPagesAllocated.load(std::memory_order_relaxed) * Page::getNumBytes(eventsPerPage);
+}
+
+//==============================================================================
+bool MidiRecorder::exportToMidiFile(const juce::File& file, const juce::StringArray& trackNames, juce::String& errorMessage) const
+{
+    // Clearing waits until the file is written
+    const ScopedReader reader(*this);
+    const auto count = getNumEvents();
+
+    if (count == 0)
+    {
+        errorMessage = "Nothing has been recorded";
+        return false;
+    }
+
+    // Tick 0 is the beat the first event falls in
+    const auto origin = std::floor(getBeat(0));
+    const auto toTicks = [origin](double beat) { return juce::jmax(0.0, std::round((beat - origin) * ticksPerBeat)); };
+
+    juce::MidiMessageSequence conductor;
+    const auto numTempi = numTempoChanges.load(std::memory_order_acquire);
+
+    if (numTempi == 0)
+        conductor.addEvent(juce::MidiMessage::tempoMetaEvent((int) std::lround(60.0e6 / (fallbackBeatsPerSecond * 60.0))), 0.0);
+
+    for (int i = 0; i < numTempi; ++i)
+    {
+        const auto& change = tempoChanges[(size_t) i];
+        conductor.addEvent(juce::MidiMessage::tempoMetaEvent((int) std::lround(60.0e6 / change.bpm)), toTicks(change.beat));
+    }
+
+    std::vector<juce::MidiMessageSequence> tracks((size_t) MidiInputPorts::maxPorts);
+
+    for (int64_t i = 0; i < count; ++i)
+    {
+        auto event = readEvent(i);
+        event.message.setTimeStamp(toTicks(event.beat));
+        tracks[(size_t) event.port].addEvent(event.message);
+    }
+
+    juce::MidiFile midiFile;
+    midiFile.setTicksPerQuarterNote(ticksPerBeat);
+    midiFile.addTrack(conductor);
+
+    for (size_t port = 0; port < tracks.size(); ++port)
+    {
+        auto& track = tracks[port];
+
+        if (track.getNumEvents() == 0)
+            continue;
+
+        // The name goes ahead of anything else at tick 0
+        juce::MidiMessageSequence named;
+
+        if (trackNames[(int) port].isNotEmpty())
+            named.addEvent(juce::MidiMessage::textMetaEvent(3, trackNames[(int) port]), 0.0);
+
+        named.addSequence(track, 0.0);
+        named.updateMatchedPairs();
+        midiFile.addTrack(named);
+    }
+
+    juce::TemporaryFile temporary(file);
+
+    {
+        juce::FileOutputStream stream(temporary.getFile());
+
+        if (! stream.openedOk() || ! midiFile.writeTo(stream, 1))
+        {
+            errorMessage = "Couldn't write " + file.getFullPathName();
+            return false;
+        }
+    }
+
+    if (! temporary.overwriteTargetFileWithTemporary())
+    {
+        errorMessage = "Couldn't replace " + file.getFullPathName();
+        return false;
+    }
+
+    return true;
+}
+
+bool MidiRecorder::exportInBackground(const juce::File& file,
+                                      const juce::StringArray& trackNames,
+                                      std::function<void(bool, const juce::String&)> onFinished)
+{
+    if (exportThread != nullptr && exportThread->isThreadRunning())
+        return false;
+
+    exportThread = std::make_unique<ExportThread>(*this, file, trackNames, std::move(onFinished));
+    exportThread->startThread(juce::Thread::Priority::low);
+    return true;
+}
+
+//==============================================================================
+void MidiRecorder::timerCallback()
+{
+    // Only running while stopped to retry a clear that found something reading
+    if (! recording.load())
+    {
+        if (! clearRequested.load(std::memory_order_acquire) || (! appending.load() && clearIfUnread()))
+            stopTimer();
+
+        return;
+    }
+
+    allocateSparePages();
+}
+
+void MidiRecorder::allocateSparePages()
+{
+    // One page being filled and one ready after it; a page lasts minutes of dense MIDI.
+    // Moving the play head back starts a page too, so when pages have been starting
+    // faster than that, keep twice as many ready as were started since the last call.
+    const auto used = numPagesUsed.load(std::memory_order_acquire);
+    const auto numStarted = juce::jmax(0, used - numPagesUsedBefore);
+    numPagesUsedBefore = used;
+
+    const auto wanted = juce::jmin(maxPages, used + 1 + juce::jmax(1, numStarted * 2));
+
+    while ((int) ownedPages.size() < wanted)
+    {
+        ownedPages.push_back(std::make_unique<Page>(eventsPerPage));
+        pages[ownedPages.size() - 1].store(ownedPages.back().get(), std::memory_order_release);
+        numPagesAllocated.store((int) ownedPages.size(), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_events/juce_events.h>
+#include "MidiInputPorts.h"
+#include "UmpTranslator.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class LinkManager;
+
+// Records everything arriving at the engine's MIDI input ports, each event stamped
+// with its sample position on the engine's timeline and its beat on the Link
+// timeline, for captures hours long.
+//
+// Events are stored column by column (sample offsets, beats, packed messages) in
+// fixed-size pages, 16 bytes an event. The audio thread appends without locking or
+// allocating: a timer keeps a spare page ready ahead of it. Events, once appended,
+// never move, so any thread can read, search and export what has been recorded while
+// recording carries on. Clearing waits until nothing is reading.
+class MidiRecorder : private juce::Timer
+{
+public:
+    struct Event
+    {
+        int64_t samplePosition = 0;
+        double beat = 0.0;
+        int port = 0;
+        juce::MidiMessage message;
+    };
+
+    explicit MidiRecorder(int eventsPerPage = 16384, int maxPages = 8192);
+    ~MidiRecorder() override;
+
+    // Where beats come from. Without a Link session, beats count at 120 BPM from the
+    // start of the engine's timeline. Set it while not recording; it has to outlive this.
+    void setLinkManager(LinkManager* linkManagerToUse) { linkManager = linkManagerToUse; }
+
+    void start();
+    void stop();
+    bool isRecording() const { return recording.load(std::memory_order_acquire); }
+
+    // Forget what was recorded, as soon as nothing is reading it, an export included:
+    // while recording, from the first block on which nothing is; anything recorded until
+    // then goes too. The memory is kept for the next take (message thread only).
+    void clear();
+
+    // Append a block of incoming MIDI that starts at a sample on the engine's timeline.
+    // The events arrived during the block before it, as MidiInputPorts places them,
+    // except those MidiInputQuantizer released, which are stamped with the beat it
+    // quantized them to (audio thread only).
+    void recordBlock(const MidiInputBlock& block, int64_t blockStartSample, double sampleRate, int numSamples) noexcept;
+
+    // What has been recorded so far (any thread)
+    int64_t getNumEvents() const { return numEvents.load(std::memory_order_acquire); }
+    Event getEvent(int64_t index) const;
+
+    // Index of the first event recorded at or after a position, or getNumEvents() if there
+    // is none. The play head may have been moved back while recording; searching by beat
+    // assumes the session's beat never jumped back.
+    int64_t findFirstEventAtSample(int64_t samplePosition) const;
+    int64_t findFirstEventAtBeat(double beat) const;
+
+    // Events lost because no page was ready, or the capture was full
+    uint64_t getNumDropped() const { return numDropped.load(std::memory_order_relaxed); }
+
+    // Bytes allocated for pages
+    size_t getMemoryUsage() const;
+
+    // Write what has been recorded to a Standard MIDI File, one track per port (named
+    // from trackNames where given) and the Link tempo changes on the first (any thread)
+    bool exportToMidiFile(const juce::File& file, const juce::StringArray& trackNames, juce::String& errorMessage) const;
+
+    // The same on a background thread, calling back on the message thread with the
+    // result. Returns false if an export is already running.
+    bool exportInBackground(const juce::File& file,
+                            const juce::StringArray& trackNames,
+                            std::function<void(bool, const juce::String&)> onFinished);
+
+private:
+    struct Page;
+    class ExportThread;
+    class ScopedReader;
+
+    struct TempoChange
+    {
+        double beat;
+        double bpm;
+    };
+
+    // Sample offsets from this far into a page no longer fit, so a new page starts
+    static constexpr int64_t maxPageSpan = 0xffffffffLL;
+
+    // Where an event's message lives: short messages are packed into its message
+    // word; longer ones go into the page's SysEx bytes, preceded by their length in
+    // two bytes, low byte first
+    static constexpr uint32_t sysexFlag = 0x80000000u;
+
+    bool append(int64_t samplePosition, double beat, int port, const uint8_t* data, int numBytes) noexcept;
+
+    // The page holding an event, and its slot there
+    const Page& findPage(int64_t index, int& slot) const noexcept;
+    double getBeat(int64_t index) const noexcept;
+
+    // getEvent() for a caller that is already reading
+    Event readEvent(int64_t index) const;
+
+    // Empty the recording unless something is reading it or the other thread is
+    // already at it; returns whether it was emptied
+    bool clearIfUnread() noexcept;
+
+    // Keep a page ready beyond the one being filled, or retry a clear while stopped
+    // (message thread)
+    void timerCallback() override;
+    void allocateSparePages();
+
+    const int eventsPerPage;
+    LinkManager* linkManager = nullptr;
+
+    // Pages in order; the audio thread only reads the pointers, the message thread adds pages
+    std::unique_ptr<std::atomic<Page*>[]> pages;
+    const int maxPages;
+    std::vector<std::unique_ptr<Page>> ownedPages;
+    std::atomic<int> numPagesAllocated { 0 };
+    std::atomic<int> numPagesUsed { 0 };
+
+    // Message thread only: numPagesUsed when spare pages were last allocated
+    int numPagesUsedBefore = 0;
+
+    std::atomic<int64_t> numEvents { 0 };
+    std::atomic<uint64_t> numDropped { 0 };
+    std::atomic<bool> recording { false };
+
+    // Set while a block may append, so that clear() knows when it can go ahead itself
+    std::atomic<bool> appending { false };
+
+    // Set by clear(), acted on by the audio thread once no ScopedReader is counted.
+    // clearing is set while it checks, and readers wait for it to go.
+    std::atomic<bool> clearRequested { false };
+    std::atomic<bool> clearing { false };
+    mutable std::atomic<int> numReaders { 0 };
+
+    // Tempo changes seen while recording, for the exported file
+    std::vector<TempoChange> tempoChanges;
+    std::atomic<int> numTempoChanges { 0 };
+    double lastTempo = 0.0;
+
+    // Packets back to MIDI 1.0 bytes, one per port so that split SysEx goes back together
+    std::array<UmpTranslator, MidiInputPorts::maxPorts> translators;
+
+    std::unique_ptr<ExportThread> exportThread;
+
+    JUCE_DECLARE_NON_COPYABLE(MidiRecorder)
+};
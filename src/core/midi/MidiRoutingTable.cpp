@@ -0,0 +1,46 @@
+#include "MidiRoutingTable.h"
+#include <algorithm>
+
+MidiRoutingTable::MidiRoutingTable(const std::vector<Route>& routesToCompile)
+{
+    for (const auto& route : routesToCompile)
+        if (route.port >= 0 && route.channel >= 0 && route.channel <= 16)
+            routes.push_back(route);
+
+    for (const auto& route : routes)
+    {
+        numPorts = juce::jmax(numPorts, route.port + 1);
+
+        if (std::find(destinations.begin(), destinations.end(), route.destination) == destinations.end())
+            destinations.push_back(route.destination);
+    }
+
+    // One list of destinations per (port, column) cell, without duplicates
+    const auto numCells = (size_t) (numPorts * numColumns);
+    std::vector<std::vector<uint16_t>> cells(numCells);
+
+    for (const auto& route : routes)
+    {
+        const auto destination = (uint16_t) (std::find(destinations.begin(), destinations.end(), route.destination)
+                                             - destinations.begin());
+        const auto firstColumn = route.channel == 0 ? 0 : route.channel - 1;
+        const auto lastColumn = route.channel == 0 ? numColumns - 1 : route.channel - 1;
+
+        for (auto column = firstColumn; column <= lastColumn; ++column)
+        {
+            auto& cell = cells[(size_t) (route.port * numColumns + column)];
+
+            if (std::find(cell.begin(), cell.end(), destination) == cell.end())
+                cell.push_back(destination);
+        }
+    }
+
+    offsets.reserve(numCells + 1);
+    offsets.push_back(0);
+
+    for (const auto& cell : cells)
+    {
+        targets.insert(targets.end(), cell.begin(), cell.end());
+        offsets.push_back((uint32_t) targets.size());
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "UmpBuffer.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// A MIDI routing matrix compiled for the audio thread: for every input port and MIDI
+// channel, the graph nodes its events go to, laid out as one flat array so that
+// routing an event is two loads and a loop, with no searching or allocation.
+//
+// Tables are immutable; a change to the routing compiles a new one, which goes to
+// the audio thread with the next render plan.
+class MidiRoutingTable
+{
+public:
+    using NodeID = juce::AudioProcessorGraph::NodeID;
+
+    // Channels 1-16 have a column each; messages without a channel share the last one
+    static constexpr int numColumns = 17;
+
+    struct Route
+    {
+        int port = 0;
+
+        // 1-16, or 0 for every channel and for messages without one
+        int channel = 0;
+
+        NodeID destination;
+    };
+
+    explicit MidiRoutingTable(const std::vector<Route>& routes);
+
+    // Every node something is routed to, in the order lookup() refers to them by
+    const std::vector<NodeID>& getDestinations() const { return destinations; }
+
+    int getNumPorts() const { return numPorts; }
+    int getNumRoutes() const { return (int) routes.size(); }
+    const std::vector<Route>& getRoutes() const { return routes; }
+
+    // Indices into getDestinations() for an event from a port (audio thread)
+    std::pair<const uint16_t*, const uint16_t*> lookup(int port, const UmpEvent& event) const noexcept
+    {
+        if (! juce::isPositiveAndBelow(port, numPorts))
+            return { nullptr, nullptr };
+
+        const auto cell = (size_t) (port * numColumns + getColumn(event));
+        return { targets.data() + offsets[cell], targets.data() + offsets[cell + 1] };
+    }
+
+    static int getColumn(const UmpEvent& event) noexcept
+    {
+        return event.isChannelVoice() ? (int) event.getChannel() : numColumns - 1;
+    }
+
+private:
+    std::vector<Route> routes;
+    std::vector<NodeID> destinations;
+    std::vector<uint32_t> offsets;
+    std::vector<uint16_t> targets;
+    int numPorts = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(MidiRoutingTable)
+};
@@ -0,0 +1,221 @@
+#include "MidiTransform.h"
+#include <cmath>
+
+namespace
+{
+    // MidiBuffer::addEvent searches for its place from the start of the buffer, which
+    // makes a block quadratic. The output here is already in order, so append in
+    // MidiBuffer's own layout instead: position, size, then the bytes.
+    inline void appendEvent(juce::MidiBuffer& output, const uint8_t* bytes, int numBytes, int position) noexcept
+    {
+        uint8_t header[sizeof(int32_t) + sizeof(uint16_t)];
+        juce::writeUnaligned<int32_t>(header, position);
+        juce::writeUnaligned<uint16_t>(header + sizeof(int32_t), (uint16_t) numBytes);
+
+        output.data.addArray(static_cast<const uint8_t*>(header), (int) sizeof(header));
+        output.data.addArray(bytes, numBytes);
+    }
+}
+
+void MidiTransform::ActiveNotes::clear() noexcept
+{
+    for (auto& channel : notes)
+        for (auto& note : channel)
+            note = notHeld;
+}
+
+MidiTransform::MidiTransform()
+    : MidiTransform(Rules())
+{
+}
+
+MidiTransform::MidiTransform(const Rules& rulesToUse)
+    : rules(rulesToUse)
+{
+    compile();
+}
+
+void MidiTransform::compile()
+{
+    bool mapsNotes = false, mapsVelocities = false, mapsOthers = false;
+
+    for (int channel = 0; channel < 16; ++channel)
+    {
+        const auto channelPasses = (rules.channelMask & (1 << channel)) != 0;
+
+        for (int note = 0; note < 128; ++note)
+        {
+            auto entry = droppedNote;
+
+            if (channelPasses && rules.passNotes && note >= rules.lowestNote && note <= rules.highestNote)
+            {
+                auto outputChannel = channel;
+                auto outputNote = note + rules.transpose;
+                auto inZone = rules.zones.empty();
+
+                for (const auto& zone : rules.zones)
+                {
+                    if (note < zone.lowestNote || note > zone.highestNote)
+                        continue;
+
+                    if (zone.channel > 0)
+                        outputChannel = juce::jmin(16, zone.channel) - 1;
+
+                    outputNote += zone.transpose;
+                    inZone = true;
+                    break;
+                }
+
+                if (inZone && outputNote >= 0 && outputNote < 128)
+                    entry = (uint16_t) ((outputChannel << 8) | outputNote);
+            }
+
+            noteMap[channel][note] = entry;
+            mapsNotes = mapsNotes || entry != (uint16_t) ((channel << 8) | note);
+        }
+
+        // Indexed by the status's high nibble less 8; notes go through the note map
+        const bool passes[8] = { true, true, rules.passAftertouch, rules.passControllers,
+                                 rules.passProgramChanges, rules.passAftertouch, rules.passPitchBend, true };
+
+        for (int kind = 0; kind < 8; ++kind)
+        {
+            otherMap[channel][kind] = channelPasses && passes[kind] ? (uint8_t) channel : (uint8_t) 0xff;
+            mapsOthers = mapsOthers || otherMap[channel][kind] != channel;
+        }
+    }
+
+    const auto lowestOutput = juce::jlimit(1, 127, rules.lowestOutputVelocity);
+    const auto highestOutput = juce::jlimit(lowestOutput, 127, rules.highestOutputVelocity);
+
+    velocityMap[0] = 0;
+
+    for (int velocity = 1; velocity < 128; ++velocity)
+    {
+        auto mapped = 0;
+
+        if (velocity >= rules.lowestVelocity && velocity <= rules.highestVelocity)
+        {
+            if (rules.fixedVelocity > 0)
+            {
+                mapped = juce::jmin(127, rules.fixedVelocity);
+            }
+            else
+            {
+                const auto shaped = std::pow((velocity - 1) / 126.0, juce::jmax(0.01, rules.velocityCurve));
+                mapped = juce::jlimit(1, 127, (int) std::lround(lowestOutput + (highestOutput - lowestOutput) * shaped));
+            }
+        }
+
+        velocityMap[velocity] = (uint8_t) mapped;
+        mapsVelocities = mapsVelocities || mapped != velocity;
+    }
+
+    // Dropping notes by velocity means following their note-offs too
+    mapsNotes = mapsNotes || rules.lowestVelocity > 1 || rules.highestVelocity < 127;
+
+    static constexpr ProcessFunction functions[2][2][2] = {
+        { { &processEvents<false, false, false>, &processEvents<false, false, true> },
+          { &processEvents<false, true, false>,  &processEvents<false, true, true> } },
+        { { &processEvents<true, false, false>,  &processEvents<true, false, true> },
+          { &processEvents<true, true, false>,   &processEvents<true, true, true> } }
+    };
+
+    process = functions[mapsNotes][mapsVelocities][mapsOthers];
+    identity = ! (mapsNotes || mapsVelocities || mapsOthers || ! rules.passSystem);
+}
+
+template <bool mapsNotes, bool mapsVelocities, bool mapsOthers>
+void MidiTransform::processEvents(const MidiTransform& transform,
+                                  const juce::MidiBuffer& input,
+                                  juce::MidiBuffer& output,
+                                  ActiveNotes& activeNotes) noexcept
+{
+    for (const auto metadata : input)
+    {
+        const auto* data = metadata.data;
+        const auto status = data[0];
+        const auto position = metadata.samplePosition;
+
+        // System messages, and anything too short to be a channel message
+        if (status >= 0xf0 || status < 0x80 || metadata.numBytes < 2)
+        {
+            if (status < 0xf0 || transform.rules.passSystem)
+                appendEvent(output, data, metadata.numBytes, position);
+
+            continue;
+        }
+
+        const auto kind = status >> 4;
+        const auto channel = status & 0x0f;
+
+        if (kind > 0xa || metadata.numBytes < 3)
+        {
+            if constexpr (mapsOthers)
+            {
+                const auto outputChannel = transform.otherMap[channel][kind - 8];
+
+                if (outputChannel == 0xff)
+                    continue;
+
+                uint8_t message[3] = { (uint8_t) ((kind << 4) | outputChannel), data[1], metadata.numBytes > 2 ? data[2] : (uint8_t) 0 };
+                appendEvent(output, message, metadata.numBytes, position);
+            }
+            else
+            {
+                appendEvent(output, data, metadata.numBytes, position);
+            }
+
+            continue;
+        }
+
+        // Note off, note on or poly aftertouch
+        if constexpr (mapsOthers)
+            if (kind == 0xa && transform.otherMap[channel][2] == 0xff)
+                continue;
+
+        const auto note = data[1] & 0x7f;
+        auto velocity = data[2];
+        const auto isNoteOn = kind == 0x9 && velocity > 0;
+        auto target = (uint16_t) ((channel << 8) | note);
+
+        // Held notes are followed whatever the rules, so that a change of rules can't
+        // leave a note hanging
+        auto& held = activeNotes.notes[channel][note];
+
+        if (isNoteOn)
+        {
+            if constexpr (mapsNotes)
+                target = transform.velocityMap[velocity] != 0 ? transform.noteMap[channel][note] : droppedNote;
+
+            held = target;
+        }
+        else
+        {
+            if (held != notHeld)
+                target = held;
+            else if constexpr (mapsNotes)
+                target = transform.noteMap[channel][note];
+
+            if (kind != 0xa)
+                held = notHeld;
+        }
+
+        if (target == droppedNote)
+            continue;
+
+        if constexpr (mapsVelocities)
+        {
+            if (isNoteOn)
+            {
+                velocity = transform.velocityMap[velocity];
+
+                if (velocity == 0)
+                    continue;
+            }
+        }
+
+        const uint8_t message[3] = { (uint8_t) ((kind << 4) | (target >> 8)), (uint8_t) (target & 0x7f), velocity };
+        appendEvent(output, message, 3, position);
+    }
+}
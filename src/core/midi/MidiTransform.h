@@ -0,0 +1,115 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <cstdint>
+#include <vector>
+
+// Filters, transposes, reshapes velocities and splits the keyboard, in one pass over a
+// block of MIDI. Rules are compiled into flat lookup tables, so each event costs a
+// load or two, and the pass is specialised by template for what the rules actually
+// change: rules that leave velocities alone never touch the velocity table, and so on.
+class MidiTransform
+{
+public:
+    struct Rules
+    {
+        // Input channels that pass, one bit per channel with channel 1 in bit 0
+        uint16_t channelMask = 0xffff;
+
+        // Kinds of message that pass
+        bool passNotes = true;
+        bool passControllers = true;
+        bool passProgramChanges = true;
+        bool passPitchBend = true;
+        bool passAftertouch = true;
+        bool passSystem = true;
+
+        // Notes outside this range are dropped, and note-ons outside the velocity range
+        int lowestNote = 0;
+        int highestNote = 127;
+        int lowestVelocity = 1;
+        int highestVelocity = 127;
+
+        // Semitones; notes pushed outside 0-127 are dropped
+        int transpose = 0;
+
+        // Velocity curve: above 1, soft playing gets softer; below 1, louder. The result is
+        // scaled into the output range, or replaced by fixedVelocity if that is set.
+        double velocityCurve = 1.0;
+        int lowestOutputVelocity = 1;
+        int highestOutputVelocity = 127;
+        int fixedVelocity = 0;
+
+        // Keyboard split: each zone sends a key range to a channel (1-16, or 0 to keep
+        // the input channel) with its own transpose. With zones, notes outside all of them
+        // are dropped; where zones overlap, the first one wins.
+        struct Zone
+        {
+            int lowestNote = 0;
+            int highestNote = 127;
+            int channel = 0;
+            int transpose = 0;
+        };
+
+        std::vector<Zone> zones;
+    };
+
+    // Where each held note went, so its note-off follows it even if the rules change
+    // (in the note map's format, or notHeld)
+    struct ActiveNotes
+    {
+        ActiveNotes() { clear(); }
+        void clear() noexcept;
+
+        uint16_t notes[16][128];
+    };
+
+    MidiTransform();
+    explicit MidiTransform(const Rules& rules);
+
+    const Rules& getRules() const { return rules; }
+
+    // Whether every event passes through unchanged
+    bool isIdentity() const { return identity; }
+
+    // Transform a block of events into an empty output buffer, which needs room for as
+    // many bytes as the input. Note-offs and poly aftertouch follow where their note-on
+    // went, even if the rules changed since. Never allocates if the output has room.
+    void processBlock(const juce::MidiBuffer& input, juce::MidiBuffer& output, ActiveNotes& activeNotes) const noexcept
+    {
+        process(*this, input, output, activeNotes);
+    }
+
+    // Entry in the note map for a note that is dropped
+    static constexpr uint16_t droppedNote = 0xffff;
+
+    // Entry in ActiveNotes for a note with no note-on seen; its note-off goes through the note map
+    static constexpr uint16_t notHeld = 0xfffe;
+
+private:
+    using ProcessFunction = void (*)(const MidiTransform&, const juce::MidiBuffer&, juce::MidiBuffer&, ActiveNotes&) noexcept;
+
+    template <bool mapsNotes, bool mapsVelocities, bool mapsOthers>
+    static void processEvents(const MidiTransform& transform,
+                              const juce::MidiBuffer& input,
+                              juce::MidiBuffer& output,
+                              ActiveNotes& activeNotes) noexcept;
+
+    void compile();
+
+    Rules rules;
+
+    // For notes: output channel (0-15) in the high byte and note in the low byte, by
+    // input channel and note, or droppedNote
+    uint16_t noteMap[16][128];
+
+    // New velocity for each note-on velocity, or 0 to drop the note
+    uint8_t velocityMap[128];
+
+    // For other channel messages: output channel (0-15), by input channel and the
+    // status's high nibble less 8, or 0xff to drop them
+    uint8_t otherMap[16][8];
+
+    ProcessFunction process = nullptr;
+    bool identity = true;
+};
@@ -0,0 +1,185 @@
+#include "MidiTransformProcessor.h"
+
+namespace
+{
+    // Room for a few hundred short events per block without MidiBuffer growing
+    constexpr int midiBufferBytes = 4096;
+}
+
+MidiTransformProcessor::MidiTransformProcessor(const MidiTransform::Rules& rules)
+    : juce::AudioPluginInstance(BusesProperties())
+{
+    scratch.ensureSize(midiBufferBytes);
+    setRules(rules);
+}
+
+MidiTransformProcessor::~MidiTransformProcessor() = default;
+
+void MidiTransformProcessor::setRules(const MidiTransform::Rules& rules)
+{
+    // Taking the callback lock would cost a block its MIDI, note-offs and all, since the
+    // render plan only ever tries for it
+    transforms.push_back(std::make_unique<MidiTransform>(rules));
+    latestTransform.store(transforms.back().get(), std::memory_order_release);
+    collectGarbage();
+}
+
+MidiTransform::Rules MidiTransformProcessor::getRules() const
+{
+    return transforms.back()->getRules();
+}
+
+void MidiTransformProcessor::collectGarbage()
+{
+    // Without blocks running, nothing moves transformInUse on, so retired rules would
+    // pile up with every change until the node was prepared again
+    if (! prepared)
+        transformInUse.store(latestTransform.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    // Everything before the rules in use is unreachable: the audio thread only ever moves on
+    const auto* inUse = transformInUse.load(std::memory_order_acquire);
+    auto used = std::find_if(transforms.begin(), transforms.end(),
+                             [inUse](const std::unique_ptr<MidiTransform>& transform) { return transform.get() == inUse; });
+
+    if (used != transforms.end())
+        transforms.erase(transforms.begin(), used);
+}
+
+void MidiTransformProcessor::fillInPluginDescription(juce::PluginDescription& description) const
+{
+    description.name = getName();
+    description.descriptiveName = "Filter, transpose, velocity curve and keyboard split";
+    description.pluginFormatName = "Internal";
+    description.category = "MIDI";
+    description.manufacturerName = "VSTLinkHost";
+    description.fileOrIdentifier = "MidiTransform";
+    description.uniqueId = description.fileOrIdentifier.hashCode();
+    description.numInputChannels = 0;
+    description.numOutputChannels = 0;
+    description.isInstrument = false;
+}
+
+void MidiTransformProcessor::prepareToPlay(double, int)
+{
+    scratch.ensureSize(midiBufferBytes);
+    activeNotes.clear();
+    prepared = true;
+}
+
+void MidiTransformProcessor::releaseResources()
+{
+    // Nodes may be released off the message thread, so what's retired waits for setRules()
+    prepared = false;
+}
+
+void MidiTransformProcessor::reset()
+{
+    activeNotes.clear();
+}
+
+void MidiTransformProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    buffer.clear();
+
+    // Published before it is used, so collectGarbage() never frees it from under this block
+    auto* transform = latestTransform.load(std::memory_order_acquire);
+    transformInUse.store(transform, std::memory_order_release);
+
+    if (midiMessages.isEmpty())
+        return;
+
+    scratch.clear();
+    transform->processBlock(midiMessages, scratch, activeNotes);
+    midiMessages.swapWith(scratch);
+}
+
+bool MidiTransformProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
+{
+    return layouts.getMainInputChannels() == 0 && layouts.getMainOutputChannels() == 0;
+}
+
+//==============================================================================
+void MidiTransformProcessor::getStateInformation(juce::MemoryBlock& destData)
+{
+    if (auto xml = rulesToValueTree(getRules()).createXml())
+        copyXmlToBinary(*xml, destData);
+}
+
+void MidiTransformProcessor::setStateInformation(const void* data, int sizeInBytes)
+{
+    if (auto xml = getXmlFromBinary(data, sizeInBytes))
+        setRules(rulesFromValueTree(juce::ValueTree::fromXml(*xml)));
+}
+
+juce::ValueTree MidiTransformProcessor::rulesToValueTree(const MidiTransform::Rules& rules)
+{
+    juce::ValueTree tree("MidiTransform");
+    tree.setProperty("channelMask", (int) rules.channelMask, nullptr);
+    tree.setProperty("passNotes", rules.passNotes, nullptr);
+    tree.setProperty("passControllers", rules.passControllers, nullptr);
+    tree.setProperty("passProgramChanges", rules.passProgramChanges, nullptr);
+    tree.setProperty("passPitchBend", rules.passPitchBend, nullptr);
+    tree.setProperty("passAftertouch", rules.passAftertouch, nullptr);
+    tree.setProperty("passSystem", rules.passSystem, nullptr);
+    tree.setProperty("lowestNote", rules.lowestNote, nullptr);
+    tree.setProperty("highestNote", rules.highestNote, nullptr);
+    tree.setProperty("lowestVelocity", rules.lowestVelocity, nullptr);
+    tree.setProperty("highestVelocity", rules.highestVelocity, nullptr);
+    tree.setProperty("transpose", rules.transpose, nullptr);
+    tree.setProperty("velocityCurve", rules.velocityCurve, nullptr);
+    tree.setProperty("lowestOutputVelocity", rules.lowestOutputVelocity, nullptr);
+    tree.setProperty("highestOutputVelocity", rules.highestOutputVelocity, nullptr);
+    tree.setProperty("fixedVelocity", rules.fixedVelocity, nullptr);
+
+    for (const auto& zone : rules.zones)
+    {
+        juce::ValueTree child("Zone");
+        child.setProperty("lowestNote", zone.lowestNote, nullptr);
+        child.setProperty("highestNote", zone.highestNote, nullptr);
+        child.setProperty("channel", zone.channel, nullptr);
+        child.setProperty("transpose", zone.transpose, nullptr);
+        tree.appendChild(child, nullptr);
+    }
+
+    return tree;
+}
+
+MidiTransform::Rules MidiTransformProcessor::rulesFromValueTree(const juce::ValueTree& tree)
+{
+    MidiTransform::Rules rules;
+
+    if (! tree.hasType("MidiTransform"))
+        return rules;
+
+    rules.channelMask = (uint16_t) (int) tree.getProperty("channelMask", (int) rules.channelMask);
+    rules.passNotes = tree.getProperty("passNotes", rules.passNotes);
+    rules.passControllers = tree.getProperty("passControllers", rules.passControllers);
+    rules.passProgramChanges = tree.getProperty("passProgramChanges", rules.passProgramChanges);
+    rules.passPitchBend = tree.getProperty("passPitchBend", rules.passPitchBend);
+    rules.passAftertouch = tree.getProperty("passAftertouch", rules.passAftertouch);
+    rules.passSystem = tree.getProperty("passSystem", rules.passSystem);
+    rules.lowestNote = tree.getProperty("lowestNote", rules.lowestNote);
+    rules.highestNote = tree.getProperty("highestNote", rules.highestNote);
+    rules.lowestVelocity = tree.getProperty("lowestVelocity", rules.lowestVelocity);
+    rules.highestVelocity = tree.getProperty("highestVelocity", rules.highestVelocity);
+    rules.transpose = tree.getProperty("transpose", rules.transpose);
+    rules.velocityCurve = tree.getProperty("velocityCurve", rules.velocityCurve);
+    rules.lowestOutputVelocity = tree.getProperty("lowestOutputVelocity", rules.lowestOutputVelocity);
+    rules.highestOutputVelocity = tree.getProperty("highestOutputVelocity", rules.highestOutputVelocity);
+    rules.fixedVelocity = tree.getProperty("fixedVelocity", rules.fixedVelocity);
+
+    for (const auto& child : tree)
+    {
+        if (! child.hasType("Zone"))
+            continue;
+
+        MidiTransform::Rules::Zone zone;
+        zone.lowestNote = child.getProperty("lowestNote", zone.lowestNote);
+        zone.highestNote = child.getProperty("highestNote", zone.highestNote);
+        zone.channel = child.getProperty("channel", zone.channel);
+        zone.transpose = child.getProperty("transpose", zone.transpose);
+        rules.zones.push_back(zone);
+    }
+
+    return rules;
+}
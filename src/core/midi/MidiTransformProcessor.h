@@ -0,0 +1,73 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "MidiTransform.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// A built-in MIDI effect node: filters, transposes, reshapes velocities and splits
+// the keyboard with a compiled MidiTransform, without the cost of hosting a MIDI
+// plugin for it. Put it between the MIDI input node (or a routed port) and a plugin.
+class MidiTransformProcessor : public juce::AudioPluginInstance
+{
+public:
+    explicit MidiTransformProcessor(const MidiTransform::Rules& rules = {});
+    ~MidiTransformProcessor() override;
+
+    // Compile new rules and swap them in from the next block, without locking (message thread)
+    void setRules(const MidiTransform::Rules& rules);
+    MidiTransform::Rules getRules() const;
+
+    //==============================================================================
+    const juce::String getName() const override { return "MIDI Transform"; }
+    void fillInPluginDescription(juce::PluginDescription& description) const override;
+
+    void prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) override;
+    void releaseResources() override;
+    void reset() override;
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override;
+    using juce::AudioPluginInstance::processBlock;
+
+    bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
+
+    double getTailLengthSeconds() const override { return 0.0; }
+    bool acceptsMidi() const override { return true; }
+    bool producesMidi() const override { return true; }
+    bool isMidiEffect() const override { return true; }
+
+    bool hasEditor() const override { return false; }
+    juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+
+    int getNumPrograms() override { return 1; }
+    int getCurrentProgram() override { return 0; }
+    void setCurrentProgram(int) override {}
+    const juce::String getProgramName(int) override { return {}; }
+    void changeProgramName(int, const juce::String&) override {}
+
+    // The rules, as XML
+    void getStateInformation(juce::MemoryBlock& destData) override;
+    void setStateInformation(const void* data, int sizeInBytes) override;
+
+    static juce::ValueTree rulesToValueTree(const MidiTransform::Rules& rules);
+    static MidiTransform::Rules rulesFromValueTree(const juce::ValueTree& tree);
+
+private:
+    // Free compiled rules the audio thread has moved past (message thread)
+    void collectGarbage();
+
+    // Compiled rules in the order they were set, the newest last. The audio thread picks
+    // up the newest at the start of a block and says which it is using; any before that
+    // one are freed on the message thread. While the node isn't prepared no blocks run,
+    // so all but the newest can go.
+    std::vector<std::unique_ptr<MidiTransform>> transforms;
+    std::atomic<MidiTransform*> latestTransform { nullptr };
+    std::atomic<MidiTransform*> transformInUse { nullptr };
+    std::atomic<bool> prepared { false };
+    MidiTransform::ActiveNotes activeNotes;
+
+    // Where a block is transformed into before being swapped with the node's buffer
+    juce::MidiBuffer scratch;
+
+    JUCE_DECLARE_NON_COPYABLE(MidiTransformProcessor)
+};
@@ -0,0 +1,130 @@
+#include "UmpBuffer.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+    // Widen a MIDI 1.0 value to 32 bits the MIDI 2.0 way: the centre stays the centre,
+    // and above it the lower bits repeat down the word so the top reaches 0xffffffff
+    uint32_t scaleTo32(uint32_t value, int bits) noexcept
+    {
+        const auto centre = 1u << (bits - 1);
+        auto result = value << (32 - bits);
+
+        if (value <= centre)
+            return result;
+
+        const auto repeat = value & (centre - 1);
+
+        for (auto shift = 32 - bits - (bits - 1); shift > -(bits - 1); shift -= bits - 1)
+            result |= shift >= 0 ? repeat << shift : repeat >> -shift;
+
+        return result;
+    }
+}
+
+uint32_t UmpEvent::getValue() const noexcept
+{
+    const auto word = words[0];
+
+    if (getMessageType() == 0x2)
+    {
+        switch (getStatus())
+        {
+            case 0x8:
+            case 0x9:
+            case 0xa:
+            case 0xb:   return scaleTo32(word & 0x7f, 7);
+            case 0xd:   return scaleTo32((word >> 8) & 0x7f, 7);
+            case 0xe:   return scaleTo32(((word & 0x7f) << 7) | ((word >> 8) & 0x7f), 14);
+            default:    return 0;
+        }
+    }
+
+    if (getMessageType() == 0x4)
+    {
+        switch (getStatus())
+        {
+            // 16-bit velocity in the top of the second word
+            case 0x8:
+            case 0x9:   return scaleTo32(words[1] >> 16, 16);
+
+            // Per-note controllers and pitch bend, RPN, NRPN, pressure, controllers and pitch bend
+            case 0x0:
+            case 0x1:
+            case 0x2:
+            case 0x3:
+            case 0x6:
+            case 0xa:
+            case 0xb:
+            case 0xd:
+            case 0xe:   return words[1];
+            default:    return 0;
+        }
+    }
+
+    return 0;
+}
+
+//==============================================================================
+UmpBuffer::UmpBuffer(int capacity)
+    : storage((size_t) juce::jmax(1, capacity))
+{
+}
+
+void UmpBuffer::setCapacity(int newCapacity)
+{
+    storage.resize((size_t) juce::jmax(1, newCapacity));
+    numEvents = juce::jmin(numEvents, (int) storage.size());
+}
+
+bool UmpBuffer::add(int samplePosition, const uint32_t* words) noexcept
+{
+    UmpEvent event;
+    event.samplePosition = samplePosition;
+    std::memcpy(event.words, words, sizeof(uint32_t) * (size_t) UmpEvent::getNumWords(words[0]));
+    return add(event);
+}
+
+bool UmpBuffer::add(const UmpEvent& event) noexcept
+{
+    if (numEvents >= (int) storage.size())
+    {
+        ++numDropped;
+        return false;
+    }
+
+    // Nearly always in order, so look for the place from the end
+    auto index = numEvents;
+
+    while (index > 0 && storage[(size_t) index - 1].samplePosition > event.samplePosition)
+        --index;
+
+    if (index < numEvents)
+        std::memmove(storage.data() + index + 1, storage.data() + index, sizeof(UmpEvent) * (size_t) (numEvents - index));
+
+    storage[(size_t) index] = event;
+    ++numEvents;
+    return true;
+}
+
+void UmpBuffer::addEvents(const UmpBuffer& other, int startSample, int numSamples, int sampleDelta) noexcept
+{
+    const auto endSample = numSamples < 0 ? std::numeric_limits<int>::max() : startSample + numSamples;
+
+    for (auto* event = other.findNextSamplePosition(startSample); event != other.end() && event->samplePosition < endSample; ++event)
+    {
+        auto moved = *event;
+        moved.samplePosition += sampleDelta;
+        add(moved);
+    }
+}
+
+const UmpEvent* UmpBuffer::findNextSamplePosition(int samplePosition) const noexcept
+{
+    return std::lower_bound(begin(), end(), samplePosition, [](const UmpEvent& event, int position)
+    {
+        return event.samplePosition < position;
+    });
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <cstdint>
+#include <vector>
+
+// One Universal MIDI Packet at a sample position. Every packet takes the same space,
+// so a block of them is a flat array that can be indexed and binary searched, and a
+// message's type, group, status and channel sit at fixed bits of its first word
+// instead of behind running status and a length that depends on the status byte.
+struct UmpEvent
+{
+    int32_t samplePosition = 0;
+
+    // Up to four words; getNumWords() says how many the message type uses
+    uint32_t words[4] = {};
+
+    uint32_t getMessageType() const noexcept { return words[0] >> 28; }
+    uint32_t getGroup() const noexcept { return (words[0] >> 24) & 0x0f; }
+    uint32_t getStatus() const noexcept { return (words[0] >> 20) & 0x0f; }
+    uint32_t getChannel() const noexcept { return (words[0] >> 16) & 0x0f; }
+
+    int getNumWords() const noexcept { return getNumWords(words[0]); }
+
+    static int getNumWords(uint32_t firstWord) noexcept
+    {
+        // By message type: utility, system and MIDI 1.0 voice are one word; SysEx and
+        // MIDI 2.0 voice two; data and stream messages up to four
+        static constexpr uint8_t sizes[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+        return sizes[firstWord >> 28];
+    }
+
+    // MIDI 1.0 (type 2) or MIDI 2.0 (type 4) channel voice
+    bool isChannelVoice() const noexcept
+    {
+        const auto type = getMessageType();
+        return type == 0x2 || type == 0x4;
+    }
+
+    bool isNoteOn() const noexcept
+    {
+        // MIDI 1.0 note-ons at velocity 0 are note-offs; MIDI 2.0 ones aren't
+        return isChannelVoice() && getStatus() == 0x9 && (getMessageType() == 0x4 || (words[0] & 0x7f) != 0);
+    }
+
+    bool isNoteOff() const noexcept
+    {
+        return isChannelVoice() && (getStatus() == 0x8 || (getStatus() == 0x9 && ! isNoteOn()));
+    }
+
+    // Note or controller number of a channel voice message
+    uint32_t getIndex() const noexcept { return (words[0] >> 8) & 0x7f; }
+
+    // Velocity, pressure, controller value or pitch bend scaled to 32 bits, the same
+    // whichever protocol the packet is in, or 0 for anything else
+    uint32_t getValue() const noexcept;
+};
+
+// A block of UMP events in time order, in storage allocated up front so that the audio
+// thread can fill and read it without allocating. Unlike MidiBuffer, finding the
+// events from a position is a binary search, and appending in order is a copy.
+class UmpBuffer
+{
+public:
+    explicit UmpBuffer(int capacity = 1024);
+
+    // Storage for this many events (not on the audio thread)
+    void setCapacity(int newCapacity);
+    int getCapacity() const noexcept { return (int) storage.size(); }
+
+    void clear() noexcept { numEvents = 0; }
+    bool isEmpty() const noexcept { return numEvents == 0; }
+    int getNumEvents() const noexcept { return numEvents; }
+
+    // Add a packet in time order, after any others at the same position. Returns false
+    // if the buffer is full, rather than allocating.
+    bool add(int samplePosition, const uint32_t* words) noexcept;
+    bool add(const UmpEvent& event) noexcept;
+
+    // Add another buffer's events in [startSample, startSample + numSamples), moved by
+    // sampleDelta; a negative numSamples means all of them from startSample on
+    void addEvents(const UmpBuffer& other, int startSample, int numSamples, int sampleDelta) noexcept;
+
+    const UmpEvent* begin() const noexcept { return storage.data(); }
+    const UmpEvent* end() const noexcept { return storage.data() + numEvents; }
+
+    // The first event at or after a position
+    const UmpEvent* findNextSamplePosition(int samplePosition) const noexcept;
+
+    // Events that were added while the buffer was full
+    uint64_t getNumDropped() const noexcept { return numDropped; }
+
+private:
+    std::vector<UmpEvent> storage;
+    int numEvents = 0;
+    uint64_t numDropped = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(UmpBuffer)
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+#include <cstdint>
+
+// Converts between MIDI 1.0 byte messages and Universal MIDI Packets at the edges of
+// the engine that only speak bytes: device input on the way in, and plugins and the
+// recorder on the way out.
+//
+// MIDI 1.0 messages become MIDI 1.0 protocol packets (message type 2), which keeps
+// every bit of them: upgrading them to MIDI 2.0 would add no resolution, and would
+// have to hold back bank select and data entry controllers until they pair up. MIDI
+// 2.0 packets from MIDI 2.0 sources stay MIDI 2.0 until they are narrowed here.
+class UmpTranslator
+{
+public:
+    // SysEx longer than this is dropped on its way back to bytes
+    static constexpr int maxSysExBytes = 512;
+
+    // Packets needed for a MIDI 1.0 message
+    static int getNumPackets(const uint8_t* data, int numBytes) noexcept
+    {
+        if (numBytes <= 0)
+            return 0;
+
+        if (data[0] != 0xf0)
+            return 1;
+
+        return juce::jmax(1, (getSysExDataSize(data, numBytes) + 5) / 6);
+    }
+
+    // Call back with the words of each packet for a MIDI 1.0 message: one for channel
+    // voice and system messages, or one for every six data bytes of a SysEx
+    template <typename Callback>
+    static void fromMidi1(const uint8_t* data, int numBytes, Callback&& callback)
+    {
+        if (numBytes <= 0)
+            return;
+
+        if (data[0] != 0xf0)
+        {
+            const auto type = data[0] >= 0xf0 ? 0x1u : 0x2u;
+            const uint32_t words[1] = { (type << 28) | ((uint32_t) data[0] << 16)
+                                        | (numBytes > 1 ? (uint32_t) (data[1] & 0x7f) << 8 : 0u)
+                                        | (numBytes > 2 ? (uint32_t) (data[2] & 0x7f) : 0u) };
+            callback(words);
+            return;
+        }
+
+        // Between the F0 and F7, six bytes a packet
+        const auto* sysEx = data + 1;
+        const auto size = getSysExDataSize(data, numBytes);
+        const auto numPackets = getNumPackets(data, numBytes);
+
+        for (int packet = 0; packet < numPackets; ++packet)
+        {
+            const auto status = numPackets == 1 ? 0x0u : packet == 0 ? 0x1u : packet == numPackets - 1 ? 0x3u : 0x2u;
+            const auto count = juce::jmin(6, size - packet * 6);
+            uint8_t bytes[6] = {};
+
+            for (int i = 0; i < count; ++i)
+                bytes[i] = sysEx[packet * 6 + i] & 0x7f;
+
+            const uint32_t words[2] = { (0x3u << 28) | (status << 20) | ((uint32_t) count << 16) | ((uint32_t) bytes[0] << 8) | bytes[1],
+                                        ((uint32_t) bytes[2] << 24) | ((uint32_t) bytes[3] << 16) | ((uint32_t) bytes[4] << 8) | bytes[5] };
+            callback(words);
+        }
+    }
+
+    // Call back with the bytes of each MIDI 1.0 message a packet makes, if any. SysEx
+    // packets are gathered until the last one; a MIDI 2.0 message may make several, as
+    // a registered parameter does, or none if MIDI 1.0 has nothing like it.
+    template <typename Callback>
+    void toMidi1(const uint32_t* words, Callback&& callback) noexcept
+    {
+        switch (words[0] >> 28)
+        {
+            case 0x1:
+            case 0x2:
+                emit(callback, (uint8_t) (words[0] >> 16), (uint8_t) ((words[0] >> 8) & 0x7f), (uint8_t) (words[0] & 0x7f));
+                break;
+
+            case 0x3:
+                addSysExPacket(words, callback);
+                break;
+
+            case 0x4:
+                narrowMidi2(words, callback);
+                break;
+
+            // Utility, data and stream messages have nothing to say to a MIDI 1.0 receiver
+            default:
+                break;
+        }
+    }
+
+    // Forget any SysEx half gathered
+    void reset() noexcept
+    {
+        sysExSize = 0;
+        inSysEx = false;
+    }
+
+private:
+    static int getSysExDataSize(const uint8_t* data, int numBytes) noexcept
+    {
+        return juce::jmax(0, numBytes - (data[numBytes - 1] == 0xf7 ? 2 : 1));
+    }
+
+    template <typename Callback>
+    static void emit(Callback& callback, uint8_t status, uint8_t data1, uint8_t data2)
+    {
+        if (status < 0x80)
+            return;
+
+        const uint8_t bytes[3] = { status, data1, data2 };
+        callback(bytes, juce::MidiMessage::getMessageLengthFromFirstByte(status));
+    }
+
+    // MIDI 2.0 channel voice to MIDI 1.0, as the MIDI 2.0 specification's default
+    // translation does it: values keep their top bits, bank select and registered
+    // parameters turn back into controllers
+    template <typename Callback>
+    static void narrowMidi2(const uint32_t* words, Callback& callback)
+    {
+        const auto kind = (words[0] >> 20) & 0x0f;
+        const auto channel = (uint8_t) ((words[0] >> 16) & 0x0f);
+        const auto index = (uint8_t) ((words[0] >> 8) & 0x7f);
+        const auto value7 = (uint8_t) (words[1] >> 25);
+        const auto value14 = words[1] >> 18;
+        const auto controller = [&](uint8_t number, uint8_t value) { emit(callback, (uint8_t) (0xb0 | channel), number, value); };
+
+        switch (kind)
+        {
+            case 0x8:
+                emit(callback, (uint8_t) (0x80 | channel), index, (uint8_t) (words[1] >> 25));
+                break;
+
+            case 0x9:
+                // A MIDI 1.0 note-on at velocity 0 would be a note-off
+                emit(callback, (uint8_t) (0x90 | channel), index, (uint8_t) juce::jmax(1u, words[1] >> 25));
+                break;
+
+            case 0xa:
+                emit(callback, (uint8_t) (0xa0 | channel), index, value7);
+                break;
+
+            case 0xb:
+                controller(index, value7);
+                break;
+
+            case 0xc:
+                if ((words[0] & 0x01) != 0)
+                {
+                    controller(0, (uint8_t) ((words[1] >> 8) & 0x7f));
+                    controller(32, (uint8_t) (words[1] & 0x7f));
+                }
+
+                emit(callback, (uint8_t) (0xc0 | channel), (uint8_t) ((words[1] >> 24) & 0x7f), 0);
+                break;
+
+            case 0xd:
+                emit(callback, (uint8_t) (0xd0 | channel), value7, 0);
+                break;
+
+            case 0xe:
+                emit(callback, (uint8_t) (0xe0 | channel), (uint8_t) (value14 & 0x7f), (uint8_t) (value14 >> 7));
+                break;
+
+            case 0x2:
+            case 0x3:
+                controller(kind == 0x2 ? 101 : 99, index);
+                controller(kind == 0x2 ? 100 : 98, (uint8_t) (words[0] & 0x7f));
+                controller(6, (uint8_t) (value14 >> 7));
+                controller(38, (uint8_t) (value14 & 0x7f));
+                break;
+
+            // Per-note and relative messages have no MIDI 1.0 form
+            default:
+                break;
+        }
+    }
+
+    template <typename Callback>
+    void addSysExPacket(const uint32_t* words, Callback& callback)
+    {
+        const auto status = (words[0] >> 20) & 0x0f;
+        const auto numBytes = (int) juce::jmin(6u, (words[0] >> 16) & 0x0f);
+        const uint8_t packetBytes[6] = { (uint8_t) (words[0] >> 8), (uint8_t) words[0],
+                                         (uint8_t) (words[1] >> 24), (uint8_t) (words[1] >> 16),
+                                         (uint8_t) (words[1] >> 8), (uint8_t) words[1] };
+
+        // Complete in one packet, or the start of a new one
+        if (status == 0x0 || status == 0x1)
+        {
+            sysEx[0] = 0xf0;
+            sysExSize = 1;
+            inSysEx = true;
+        }
+        else if (! inSysEx)
+        {
+            return;
+        }
+
+        if (sysExSize + numBytes + 1 > (int) sysEx.size())
+        {
+            reset();
+            return;
+        }
+
+        for (int i = 0; i < numBytes; ++i)
+            sysEx[(size_t) sysExSize++] = packetBytes[i] & 0x7f;
+
+        // Complete, or the end
+        if (status == 0x0 || status == 0x3)
+        {
+            sysEx[(size_t) sysExSize++] = 0xf7;
+            callback(sysEx.data(), sysExSize);
+            reset();
+        }
+    }
+
+    std::array<uint8_t, maxSysExBytes> sysEx {};
+    int sysExSize = 0;
+    bool inSysEx = false;
+};
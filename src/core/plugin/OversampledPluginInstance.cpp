@@ -0,0 +1,280 @@
+#include "OversampledPluginInstance.h"
+#include <cmath>
+
+//==============================================================================
+// Passes a parameter of the wrapped plugin straight through, changes and gestures
+// coming back from the plugin included
+class OversampledPluginInstance::Parameter : public juce::AudioPluginInstance::HostedParameter,
+                                             private juce::AudioProcessorParameter::Listener
+{
+public:
+    explicit Parameter(juce::AudioProcessorParameter& parameterToWrap)
+        : wrapped(&parameterToWrap)
+    {
+        wrapped->addListener(this);
+    }
+
+    ~Parameter() override
+    {
+        detach();
+    }
+
+    // Called before the wrapped plugin goes away
+    void detach()
+    {
+        if (wrapped != nullptr)
+            wrapped->removeListener(this);
+
+        wrapped = nullptr;
+    }
+
+    float getValue() const override { return wrapped != nullptr ? wrapped->getValue() : 0.0f; }
+
+    void setValue(float newValue) override
+    {
+        if (wrapped != nullptr)
+            wrapped->setValue(newValue);
+    }
+
+    float getDefaultValue() const override { return wrapped->getDefaultValue(); }
+    juce::String getName(int maximumStringLength) const override { return wrapped->getName(maximumStringLength); }
+    juce::String getLabel() const override { return wrapped->getLabel(); }
+    int getNumSteps() const override { return wrapped->getNumSteps(); }
+    bool isDiscrete() const override { return wrapped->isDiscrete(); }
+    bool isBoolean() const override { return wrapped->isBoolean(); }
+    bool isAutomatable() const override { return wrapped->isAutomatable(); }
+    bool isMetaParameter() const override { return wrapped->isMetaParameter(); }
+    bool isOrientationInverted() const override { return wrapped->isOrientationInverted(); }
+    Category getCategory() const override { return wrapped->getCategory(); }
+
+    juce::String getText(float value, int maximumStringLength) const override
+    {
+        return wrapped->getText(value, maximumStringLength);
+    }
+
+    float getValueForText(const juce::String& text) const override
+    {
+        return wrapped->getValueForText(text);
+    }
+
+    juce::String getParameterID() const override
+    {
+        if (auto* hosted = dynamic_cast<juce::AudioPluginInstance::HostedParameter*>(wrapped))
+            return hosted->getParameterID();
+
+        return juce::String(wrapped->getParameterIndex());
+    }
+
+private:
+    void parameterValueChanged(int, float newValue) override
+    {
+        sendValueChangedMessageToListeners(newValue);
+    }
+
+    void parameterGestureChanged(int, bool gestureIsStarting) override
+    {
+        if (gestureIsStarting)
+            beginChangeGesture();
+        else
+            endChangeGesture();
+    }
+
+    juce::AudioProcessorParameter* wrapped;
+};
+
+//==============================================================================
+OversampledPluginInstance::OversampledPluginInstance(std::unique_ptr<juce::AudioPluginInstance> pluginToWrap,
+                                                     int factorToUse,
+                                                     Oversampler::Phase phaseToUse)
+    : juce::AudioPluginInstance(createBuses(*pluginToWrap)),
+      plugin(std::move(pluginToWrap)),
+      factor(juce::nextPowerOfTwo(juce::jlimit(2, 8, factorToUse))),
+      phase(phaseToUse)
+{
+    for (auto* parameter : plugin->getParameters())
+        addHostedParameter(std::make_unique<Parameter>(*parameter));
+
+    plugin->setPlayHead(this);
+    plugin->addListener(this);
+
+    oversampler = std::make_unique<Oversampler>(juce::jmax(getTotalNumInputChannels(), getTotalNumOutputChannels()),
+                                                factor, phase);
+    updateLatency();
+}
+
+OversampledPluginInstance::~OversampledPluginInstance()
+{
+    // Our parameters outlive the plugin they point into
+    for (auto* parameter : getParameters())
+        if (auto* forwarding = dynamic_cast<Parameter*>(parameter))
+            forwarding->detach();
+
+    plugin->removeListener(this);
+    plugin->setPlayHead(nullptr);
+    cancelPendingUpdate();
+}
+
+juce::AudioProcessor::BusesProperties OversampledPluginInstance::createBuses(const juce::AudioPluginInstance& plugin)
+{
+    BusesProperties buses;
+
+    for (int i = 0; i < plugin.getBusCount(true); ++i)
+        if (auto* bus = plugin.getBus(true, i))
+            buses.addBus(true, bus->getName(), bus->getCurrentLayout(), bus->isEnabledByDefault());
+
+    for (int i = 0; i < plugin.getBusCount(false); ++i)
+        if (auto* bus = plugin.getBus(false, i))
+            buses.addBus(false, bus->getName(), bus->getCurrentLayout(), bus->isEnabledByDefault());
+
+    return buses;
+}
+
+void OversampledPluginInstance::fillInPluginDescription(juce::PluginDescription& description) const
+{
+    plugin->fillInPluginDescription(description);
+}
+
+void OversampledPluginInstance::prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock)
+{
+    const auto numChannels = juce::jmax(getTotalNumInputChannels(), getTotalNumOutputChannels());
+    const auto oversampledBlockSize = maximumExpectedSamplesPerBlock * factor;
+
+    plugin->setRateAndBufferSizeDetails(sampleRate * factor, oversampledBlockSize);
+    plugin->prepareToPlay(sampleRate * factor, oversampledBlockSize);
+
+    oversampler = std::make_unique<Oversampler>(numChannels, factor, phase);
+    oversampler->prepare(maximumExpectedSamplesPerBlock);
+    oversampledMidi.ensureSize(4096);
+
+    updateLatency();
+
+    // The padding is always less than one sample at the graph's rate, so room for
+    // that lets it follow the plugin's latency without allocating
+    padDelays.clear();
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        padDelays.push_back(std::make_unique<DelayLine>(padding.load(), oversampledBlockSize, factor - 1));
+}
+
+void OversampledPluginInstance::releaseResources()
+{
+    plugin->releaseResources();
+    padDelays.clear();
+}
+
+void OversampledPluginInstance::reset()
+{
+    plugin->reset();
+    oversampler->reset();
+
+    for (auto& delay : padDelays)
+        delay->clear();
+}
+
+void OversampledPluginInstance::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    const auto numSamples = buffer.getNumSamples();
+    const auto numOversampled = numSamples * factor;
+
+    auto& oversampled = oversampler->processUp(buffer, numSamples);
+    juce::AudioBuffer<float> block(oversampled.getArrayOfWritePointers(), oversampled.getNumChannels(), numOversampled);
+
+    oversampledMidi.clear();
+
+    for (const auto metadata : midiMessages)
+        oversampledMidi.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition * factor);
+
+    {
+        const juce::ScopedLock sl(plugin->getCallbackLock());
+
+        if (plugin->isSuspended())
+            block.clear();
+        else
+            plugin->processBlock(block, oversampledMidi);
+    }
+
+    // Follow the plugin if its latency changed, perhaps during the call above
+    const auto padSamples = padding.load(std::memory_order_relaxed);
+
+    if (! padDelays.empty() && padDelays.front()->getDelay() != padSamples)
+        for (auto& delay : padDelays)
+            delay->setDelay(padSamples);
+
+    if (padSamples > 0)
+        for (size_t ch = 0; ch < padDelays.size(); ++ch)
+            juce::FloatVectorOperations::copy(block.getWritePointer((int) ch),
+                                              padDelays[ch]->process(block.getReadPointer((int) ch), numOversampled),
+                                              numOversampled);
+
+    oversampler->processDown(buffer, numSamples);
+
+    midiMessages.clear();
+
+    for (const auto metadata : oversampledMidi)
+        midiMessages.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition / factor);
+}
+
+void OversampledPluginInstance::setNonRealtime(bool isNonRealtime) noexcept
+{
+    juce::AudioPluginInstance::setNonRealtime(isNonRealtime);
+    plugin->setNonRealtime(isNonRealtime);
+}
+
+bool OversampledPluginInstance::isBusesLayoutSupported(const BusesLayout& layouts) const
+{
+    return plugin->checkBusesLayoutSupported(layouts);
+}
+
+void OversampledPluginInstance::processorLayoutsChanged()
+{
+    plugin->setBusesLayout(getBusesLayout());
+}
+
+juce::Optional<juce::AudioPlayHead::PositionInfo> OversampledPluginInstance::getPosition() const
+{
+    auto* playHead = getPlayHead();
+
+    if (playHead == nullptr)
+        return {};
+
+    auto position = playHead->getPosition();
+
+    if (position.hasValue())
+        if (const auto timeInSamples = position->getTimeInSamples())
+            position->setTimeInSamples(*timeInSamples * factor);
+
+    return position;
+}
+
+void OversampledPluginInstance::audioProcessorChanged(juce::AudioProcessor*, const juce::AudioProcessorListener::ChangeDetails& details)
+{
+    // Can come from the audio thread, in the middle of the plugin's processBlock(), where
+    // the graph mustn't be told; the padding delays pick the change up at the end of a block
+    if (! details.latencyChanged)
+        return;
+
+    if (juce::MessageManager::existsAndIsCurrentThread())
+        updateLatency();
+    else
+        triggerAsyncUpdate();
+}
+
+void OversampledPluginInstance::handleAsyncUpdate()
+{
+    updateLatency();
+}
+
+int OversampledPluginInstance::getOversampledLatency() const
+{
+    return (int) std::lround(oversampler->getLatencyInOversampledSamples()) + plugin->getLatencySamples();
+}
+
+void OversampledPluginInstance::updateLatency()
+{
+    const auto oversampledLatency = getOversampledLatency();
+    const auto latency = (oversampledLatency + factor - 1) / factor;
+
+    // Top the latency up to whole samples at the graph's rate
+    padding.store(latency * factor - oversampledLatency, std::memory_order_relaxed);
+    setLatencySamples(latency);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "../audio/DelayLine.h"
+#include "../audio/Oversampler.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Runs a plugin at 2, 4 or 8 times the graph's sample rate, for saturators and
+// synths that alias at 44.1 or 48 kHz. It goes into the graph like any other
+// plugin, with its buses, parameters and state passed through.
+//
+// The reported latency covers the filters and the plugin's own latency, rounded up
+// to whole samples at the graph's rate with a short delay at the oversampled rate.
+// The delay follows the plugin when its latency changes while it plays; a change
+// reported from the audio thread is passed on from the message thread.
+class OversampledPluginInstance : public juce::AudioPluginInstance,
+                                  private juce::AudioPlayHead,
+                                  private juce::AudioProcessorListener,
+                                  private juce::AsyncUpdater
+{
+public:
+    OversampledPluginInstance(std::unique_ptr<juce::AudioPluginInstance> plugin, int factor, Oversampler::Phase phase);
+    ~OversampledPluginInstance() override;
+
+    // The plugin itself, e.g. to open its editor
+    juce::AudioPluginInstance& getWrappedPlugin() const { return *plugin; }
+
+    int getFactor() const { return factor; }
+    Oversampler::Phase getPhase() const { return phase; }
+
+    //==============================================================================
+    const juce::String getName() const override { return plugin->getName(); }
+    void fillInPluginDescription(juce::PluginDescription& description) const override;
+
+    void prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) override;
+    void releaseResources() override;
+    void reset() override;
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override;
+    using juce::AudioPluginInstance::processBlock;
+
+    void setNonRealtime(bool isNonRealtime) noexcept override;
+    bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
+    void processorLayoutsChanged() override;
+
+    double getTailLengthSeconds() const override { return plugin->getTailLengthSeconds(); }
+    bool acceptsMidi() const override { return plugin->acceptsMidi(); }
+    bool producesMidi() const override { return plugin->producesMidi(); }
+    bool isMidiEffect() const override { return plugin->isMidiEffect(); }
+
+    // The editor would belong to the wrapped plugin, so it is opened from there
+    bool hasEditor() const override { return false; }
+    juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+
+    int getNumPrograms() override { return plugin->getNumPrograms(); }
+    int getCurrentProgram() override { return plugin->getCurrentProgram(); }
+    void setCurrentProgram(int index) override { plugin->setCurrentProgram(index); }
+    const juce::String getProgramName(int index) override { return plugin->getProgramName(index); }
+    void changeProgramName(int index, const juce::String& newName) override { plugin->changeProgramName(index, newName); }
+
+    void getStateInformation(juce::MemoryBlock& destData) override { plugin->getStateInformation(destData); }
+    void setStateInformation(const void* data, int sizeInBytes) override { plugin->setStateInformation(data, sizeInBytes); }
+
+private:
+    class Parameter;
+
+    static BusesProperties createBuses(const juce::AudioPluginInstance& plugin);
+
+    // The plugin sees the transport in oversampled samples
+    juce::Optional<PositionInfo> getPosition() const override;
+
+    void audioProcessorParameterChanged(juce::AudioProcessor*, int, float) override {}
+    void audioProcessorChanged(juce::AudioProcessor* processor, const juce::AudioProcessorListener::ChangeDetails& details) override;
+
+    // Latency of filters plus plugin, in oversampled samples
+    int getOversampledLatency() const;
+    void updateLatency();
+    void handleAsyncUpdate() override;
+
+    std::unique_ptr<juce::AudioPluginInstance> plugin;
+    const int factor;
+    const Oversampler::Phase phase;
+
+    std::unique_ptr<Oversampler> oversampler;
+    std::vector<std::unique_ptr<DelayLine>> padDelays;
+
+    // Oversampled samples of padding the latency needs now
+    std::atomic<int> padding { 0 };
+    juce::MidiBuffer oversampledMidi;
+
+    JUCE_DECLARE_NON_COPYABLE(OversampledPluginInstance)
+};
@@ -1,4 +1,5 @@
 #include "PluginManager.h"
+#include "PluginSandbox.h"
 
 PluginManager::PluginManager()
 {
@@ -14,33 +15,14 @@ PluginManager::~PluginManager()
 
 bool PluginManager::loadPlugin(const juce::String& filePath)
 {
-    juce::File file(filePath);
-    if (!file.exists())
-        return false;
-    
-    // Find best matching format for this file
-    auto* format = formatManager.findFormatForFile(file);
-    if (format == nullptr)
-        return false;
-        
-    // Scan for plugin description
-    juce::PluginDescription description;
     juce::OwnedArray<juce::PluginDescription> descriptions;
     
-    juce::String errorMessage;
-    bool success = format->findAllTypesForFile(descriptions, file);
-    
-    if (!success || descriptions.isEmpty())
+    if (!findPluginTypes(filePath, descriptions))
         return false;
-        
-    description = *descriptions[0];
     
     // Create plugin instance
-    auto result = format->createPluginInstance(description, 44100.0, 512,
-                                              [](const juce::String& error)
-                                              {
-                                                  juce::Logger::writeToLog("Plugin error: " + error);
-                                              });
+    juce::String errorMessage;
+    auto result = formatManager.createPluginInstance(*descriptions[0], 44100.0, 512, errorMessage);
     
     if (result.get() != nullptr)
     {
@@ -48,16 +30,75 @@ bool PluginManager::loadPlugin(const juce::String& filePath)
         return true;
     }
     
+    juce::Logger::writeToLog("Plugin error: " + errorMessage);
     return false;
 }
 
+bool PluginManager::findPluginTypes(const juce::String& filePath, juce::OwnedArray<juce::PluginDescription>& descriptions)
+{
+    juce::File file(filePath);
+    if (!file.exists())
+        return false;
+    
+    // Every format that might load this file gets to say what's in it
+    for (auto* format : formatManager.getFormats())
+        if (format->fileMightContainThisPluginType(file.getFullPathName()))
+            format->findAllTypesForFile(descriptions, file.getFullPathName());
+    
+    return !descriptions.isEmpty();
+}
+
 std::unique_ptr<juce::AudioPluginInstance> PluginManager::createPluginInstance(
     const juce::PluginDescription& desc, 
     double sampleRate, 
     int blockSize,
-    juce::String& errorMessage)
+    juce::String& errorMessage,
+    const juce::String& sandboxGroup)
+{
+    if (sandboxMode == SandboxMode::off)
+        return formatManager.createPluginInstance(desc, sampleRate, blockSize, errorMessage);
+
+    auto sandbox = getSandbox(sandboxMode == SandboxMode::grouped ? sandboxGroup : juce::String(), errorMessage);
+
+    if (sandbox == nullptr)
+        return nullptr;
+
+    return sandbox->createPluginInstance(desc, sampleRate, blockSize, errorMessage);
+}
+
+void PluginManager::setSandboxMode(SandboxMode mode)
 {
-    return formatManager.createPluginInstance(desc, sampleRate, blockSize, errorMessage);
+    // Only affects plugins created from now on
+    sandboxMode = mode;
+}
+
+void PluginManager::setSandboxCrashCallback(SandboxCrashCallback callback)
+{
+    sandboxCrashCallback = std::move(callback);
+}
+
+std::shared_ptr<PluginSandbox> PluginManager::getSandbox(const juce::String& group, juce::String& errorMessage)
+{
+    if (group.isNotEmpty())
+        if (auto existing = sandboxGroups[group].lock())
+            if (existing->isRunning())
+                return existing;
+
+    auto sandbox = std::make_shared<PluginSandbox>();
+
+    if (! sandbox->launch(errorMessage))
+        return nullptr;
+
+    sandbox->setCrashCallback([this](const juce::StringArray& pluginNames)
+    {
+        if (sandboxCrashCallback)
+            sandboxCrashCallback(pluginNames);
+    });
+
+    if (group.isNotEmpty())
+        sandboxGroups[group] = sandbox;
+
+    return sandbox;
 }
 
 void PluginManager::scanForPlugins(const juce::String& directoryPath)
@@ -69,16 +110,21 @@ void PluginManager::scanForPlugins(const juce::String& directoryPath)
     // Clear existing plugin list
     knownPluginList.clear();
     
-    // Scan for VSTs
-    for (auto* format : formatManager.getFormats())
+    // Scan with each format in turn; a plugin that crashes the scan is skipped next time
+    const auto deadMansPedal = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("VSTLinkHostScan.tmp");
+    const auto numFormats = formatManager.getNumFormats();
+    
+    for (int i = 0; i < numFormats; ++i)
     {
-        knownPluginList.scanAndAddFile(directory.getFullPathName(),
-                                       true, // search recursively 
-                                       knownPluginList.getBlacklistedFiles(),
-                                       [this](const juce::String& name, float progress)
-                                       {
-                                           handlePluginScanProgress(name, progress);
-                                       });
+        juce::PluginDirectoryScanner scanner(knownPluginList,
+                                             *formatManager.getFormat(i),
+                                             juce::FileSearchPath(directory.getFullPathName()),
+                                             true, // search recursively
+                                             deadMansPedal);
+        juce::String pluginBeingScanned;
+        
+        while (scanner.scanNextFile(true, pluginBeingScanned))
+            handlePluginScanProgress(((float) i + scanner.getProgress()) / (float) numFormats);
     }
 }
 
@@ -99,12 +145,10 @@ const std::vector<std::unique_ptr<juce::AudioPluginInstance>>& PluginManager::ge
 
 bool PluginManager::savePluginList(const juce::File& file)
 {
-    juce::XmlElement xml("PLUGIN_LIST");
+    if (auto xml = knownPluginList.createXml())
+        return xml->writeTo(file);
     
-    knownPluginList.createXml()->copyAttributesTo(xml);
-    
-    // Save to file
-    return xml.writeTo(file);
+    return false;
 }
 
 bool PluginManager::loadPluginList(const juce::File& file)
@@ -114,7 +158,7 @@ bool PluginManager::loadPluginList(const juce::File& file)
         
     std::unique_ptr<juce::XmlElement> xml = juce::XmlDocument::parse(file);
     
-    if (xml == nullptr || xml->getTagName() != "PLUGIN_LIST")
+    if (xml == nullptr || !xml->hasTagName("KNOWNPLUGINS"))
         return false;
         
     knownPluginList.recreateFromXml(*xml);
@@ -126,7 +170,7 @@ void PluginManager::setScanProgressCallback(ScanProgressCallback callback)
     scanProgressCallback = std::move(callback);
 }
 
-void PluginManager::handlePluginScanProgress(const juce::String& pluginBeingScanned, float progress)
+void PluginManager::handlePluginScanProgress(float progress)
 {
     if (scanProgressCallback)
         scanProgressCallback(progress);
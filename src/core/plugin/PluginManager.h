@@ -5,6 +5,9 @@
 #include <memory>
 #include <functional>
 #include <unordered_map>
+#include <map>
+
+class PluginSandbox;
 
 class PluginManager
 {
@@ -15,11 +18,32 @@ public:
     // Load a plugin from a file
     bool loadPlugin(const juce::String& filePath);
     
-    // Load a plugin from a description
+    // Describe the plugins in a file, whichever format it is in
+    bool findPluginTypes(const juce::String& filePath, juce::OwnedArray<juce::PluginDescription>& descriptions);
+    
+    // Where plugins created from descriptions run: in this process, each in a sandbox
+    // process of its own, or in one sandbox process per group
+    enum class SandboxMode
+    {
+        off,
+        perPlugin,
+        grouped
+    };
+
+    void setSandboxMode(SandboxMode mode);
+    SandboxMode getSandboxMode() const { return sandboxMode; }
+
+    // Load a plugin from a description. In grouped mode, plugins with the same
+    // sandbox group share a process; an empty group gets a process of its own.
     std::unique_ptr<juce::AudioPluginInstance> createPluginInstance(const juce::PluginDescription& desc, 
                                                                   double sampleRate, 
                                                                   int blockSize,
-                                                                  juce::String& errorMessage);
+                                                                  juce::String& errorMessage,
+                                                                  const juce::String& sandboxGroup = {});
+
+    // Called on the message thread when a sandbox process dies, with the plugins it took down
+    using SandboxCrashCallback = std::function<void(const juce::StringArray& pluginNames)>;
+    void setSandboxCrashCallback(SandboxCrashCallback callback);
 
     // Scan for plugins in a directory
     void scanForPlugins(const juce::String& directoryPath);
@@ -46,7 +70,15 @@ private:
     juce::KnownPluginList knownPluginList;
     std::vector<std::unique_ptr<juce::AudioPluginInstance>> loadedPlugins;
     ScanProgressCallback scanProgressCallback;
+
+    SandboxMode sandboxMode = SandboxMode::off;
+    SandboxCrashCallback sandboxCrashCallback;
+
+    // Sandboxes stay alive for as long as the plugins in them do
+    std::map<juce::String, std::weak_ptr<PluginSandbox>> sandboxGroups;
+
+    std::shared_ptr<PluginSandbox> getSandbox(const juce::String& group, juce::String& errorMessage);
     
     // Plugin scan progress callback
-    void handlePluginScanProgress(const juce::String& pluginBeingScanned, float progress);
+    void handlePluginScanProgress(float progress);
 };
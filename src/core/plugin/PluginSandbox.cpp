@@ -0,0 +1,162 @@
+#include "PluginSandbox.h"
+#include "SandboxProtocol.h"
+#include "SandboxedPluginInstance.h"
+
+PluginSandbox::PluginSandbox() = default;
+
+PluginSandbox::~PluginSandbox()
+{
+    // Shutting down on purpose is not a crash
+    running = false;
+    killWorkerProcess();
+}
+
+bool PluginSandbox::launch(juce::String& errorMessage)
+{
+    // The worker is this same executable, started with the sandbox command line
+    const auto executable = juce::File::getSpecialLocation(juce::File::currentExecutableFile);
+    running = launchWorkerProcess(executable, SandboxProtocol::commandLineUID, 10000);
+
+    if (! running)
+        errorMessage = "Couldn't start the plugin sandbox";
+
+    return running;
+}
+
+std::unique_ptr<juce::AudioPluginInstance> PluginSandbox::createPluginInstance(const juce::PluginDescription& description,
+                                                                               double sampleRate,
+                                                                               int blockSize,
+                                                                               juce::String& errorMessage)
+{
+    if (! isRunning())
+    {
+        errorMessage = "The plugin sandbox isn't running";
+        return nullptr;
+    }
+
+    const auto instanceID = nextInstanceID++;
+
+    juce::ValueTree request(SandboxProtocol::load);
+    request.setProperty(SandboxProtocol::instance, instanceID, nullptr);
+    request.setProperty(SandboxProtocol::description, description.createXml()->toString(), nullptr);
+    request.setProperty(SandboxProtocol::sampleRate, sampleRate, nullptr);
+    request.setProperty(SandboxProtocol::blockSize, blockSize, nullptr);
+
+    // Some plugins take a long time to load
+    const auto reply = call(request, 60000);
+
+    if (! reply.isValid())
+    {
+        errorMessage = "The plugin sandbox didn't answer while loading " + description.name;
+        return nullptr;
+    }
+
+    if (reply.hasProperty(SandboxProtocol::error))
+    {
+        errorMessage = reply[SandboxProtocol::error].toString();
+        return nullptr;
+    }
+
+    return std::make_unique<SandboxedPluginInstance>(shared_from_this(), instanceID, description, reply);
+}
+
+juce::ValueTree PluginSandbox::call(juce::ValueTree request, int timeoutMs)
+{
+    const auto requestID = nextRequestID++;
+    request.setProperty(SandboxProtocol::id, requestID, nullptr);
+
+    auto pending = std::make_shared<PendingCall>();
+
+    {
+        const juce::ScopedLock sl(lock);
+        pendingCalls[requestID] = pending;
+    }
+
+    const auto replied = isRunning()
+                      && sendMessageToWorker(SandboxProtocol::toMemoryBlock(request))
+                      && pending->replied.wait(timeoutMs);
+
+    const juce::ScopedLock sl(lock);
+    pendingCalls.erase(requestID);
+    return replied ? pending->reply : juce::ValueTree();
+}
+
+void PluginSandbox::post(const juce::ValueTree& message)
+{
+    if (isRunning())
+        sendMessageToWorker(SandboxProtocol::toMemoryBlock(message));
+}
+
+void PluginSandbox::handleMessageFromWorker(const juce::MemoryBlock& message)
+{
+    const auto tree = SandboxProtocol::fromMemoryBlock(message);
+    const juce::ScopedLock sl(lock);
+
+    if (tree.hasType(SandboxProtocol::reply))
+    {
+        const auto pending = pendingCalls.find((int) tree[SandboxProtocol::id]);
+
+        if (pending != pendingCalls.end())
+        {
+            pending->second->reply = tree;
+            pending->second->replied.signal();
+        }
+
+        return;
+    }
+
+    const auto instance = instances.find((int) tree[SandboxProtocol::instance]);
+
+    if (instance == instances.end())
+        return;
+
+    if (tree.hasType(SandboxProtocol::parameterChanged))
+        instance->second->handleParameterChanged(tree[SandboxProtocol::index], tree[SandboxProtocol::value], tree[SandboxProtocol::text]);
+    else if (tree.hasType(SandboxProtocol::parameterText))
+        instance->second->handleParameterText(tree[SandboxProtocol::index], tree[SandboxProtocol::value], tree[SandboxProtocol::text]);
+    else if (tree.hasType(SandboxProtocol::latencyChanged))
+        instance->second->handleLatencyChanged(tree[SandboxProtocol::latency]);
+}
+
+void PluginSandbox::handleConnectionLost()
+{
+    if (! running.exchange(false))
+        return;
+
+    juce::StringArray pluginNames;
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        // Anyone still waiting for a reply gets an invalid one
+        for (auto& pending : pendingCalls)
+            pending.second->replied.signal();
+
+        for (auto& instance : instances)
+        {
+            pluginNames.add(instance.second->getName());
+            instance.second->handleCrash();
+        }
+    }
+
+    juce::Logger::writeToLog("Plugin sandbox stopped unexpectedly, silencing: " + pluginNames.joinIntoString(", "));
+
+    juce::MessageManager::callAsync([weakThis = weak_from_this(), pluginNames]
+    {
+        if (auto sandbox = weakThis.lock())
+            if (sandbox->crashCallback != nullptr)
+                sandbox->crashCallback(pluginNames);
+    });
+}
+
+void PluginSandbox::addInstance(int instanceID, SandboxedPluginInstance* instance)
+{
+    const juce::ScopedLock sl(lock);
+    instances[instanceID] = instance;
+}
+
+void PluginSandbox::removeInstance(int instanceID)
+{
+    const juce::ScopedLock sl(lock);
+    instances.erase(instanceID);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+
+class SandboxedPluginInstance;
+
+// A worker process that hosts plugins on the host's behalf, so that a crashing
+// plugin only takes the worker down with it. One sandbox can hold several plugins.
+//
+// Control messages (loading, preparing, state, parameter changes) go over JUCE's
+// child process pipe; each plugin's audio goes through its own SandboxChannel.
+class PluginSandbox : public std::enable_shared_from_this<PluginSandbox>,
+                      private juce::ChildProcessCoordinator
+{
+public:
+    PluginSandbox();
+    ~PluginSandbox() override;
+
+    // Start the worker process
+    bool launch(juce::String& errorMessage);
+
+    // False once the worker has died or been shut down
+    bool isRunning() const { return running.load(std::memory_order_acquire); }
+
+    // Load a plugin into the worker. The instance keeps the sandbox alive.
+    std::unique_ptr<juce::AudioPluginInstance> createPluginInstance(const juce::PluginDescription& description,
+                                                                    double sampleRate,
+                                                                    int blockSize,
+                                                                    juce::String& errorMessage);
+
+    // Send a request and wait for its reply. Returns an invalid tree if the worker
+    // doesn't answer in time or has died. Not for the audio thread.
+    juce::ValueTree call(juce::ValueTree request, int timeoutMs = 5000);
+
+    // Send a message that needs no reply
+    void post(const juce::ValueTree& message);
+
+    // Called on the message thread when the worker dies, with the names of the plugins it held
+    using CrashCallback = std::function<void(const juce::StringArray& pluginNames)>;
+    void setCrashCallback(CrashCallback callback) { crashCallback = std::move(callback); }
+
+private:
+    friend class SandboxedPluginInstance;
+
+    struct PendingCall
+    {
+        juce::WaitableEvent replied;
+        juce::ValueTree reply;
+    };
+
+    void handleMessageFromWorker(const juce::MemoryBlock& message) override;
+    void handleConnectionLost() override;
+
+    void addInstance(int instanceID, SandboxedPluginInstance* instance);
+    void removeInstance(int instanceID);
+
+    std::atomic<bool> running { false };
+    std::atomic<int> nextRequestID { 1 };
+    std::atomic<int> nextInstanceID { 1 };
+
+    juce::CriticalSection lock;
+    std::map<int, std::shared_ptr<PendingCall>> pendingCalls;
+    std::map<int, SandboxedPluginInstance*> instances;
+
+    CrashCallback crashCallback;
+
+    JUCE_DECLARE_NON_COPYABLE(PluginSandbox)
+};
@@ -0,0 +1,437 @@
+#include "PluginSandboxWorker.h"
+#include "SandboxChannel.h"
+#include "SandboxProtocol.h"
+#include <vector>
+
+//==============================================================================
+// One plugin loaded into the worker, with the thread that processes its blocks
+class PluginSandboxWorker::HostedPlugin : private juce::Thread,
+                                          private juce::AudioProcessorListener,
+                                          private juce::AudioPlayHead
+{
+public:
+    explicit HostedPlugin(std::unique_ptr<juce::AudioPluginInstance> pluginToHost)
+        : juce::Thread("Sandboxed " + pluginToHost->getName()),
+          plugin(std::move(pluginToHost)),
+          changedParameters(std::make_unique<std::atomic<bool>[]>((size_t) plugin->getParameters().size()))
+    {
+        plugin->addListener(this);
+    }
+
+    ~HostedPlugin() override
+    {
+        editorWindow.reset();
+        release();
+        plugin->removeListener(this);
+    }
+
+    juce::AudioPluginInstance& getPlugin() { return *plugin; }
+
+    // What the host needs to know to stand in for the plugin
+    void describe(juce::ValueTree& reply) const
+    {
+        reply.setProperty(SandboxProtocol::name, plugin->getName(), nullptr);
+        reply.setProperty(SandboxProtocol::numInputChannels, plugin->getTotalNumInputChannels(), nullptr);
+        reply.setProperty(SandboxProtocol::numOutputChannels, plugin->getTotalNumOutputChannels(), nullptr);
+        reply.setProperty(SandboxProtocol::acceptsMidi, plugin->acceptsMidi(), nullptr);
+        reply.setProperty(SandboxProtocol::producesMidi, plugin->producesMidi(), nullptr);
+        reply.setProperty(SandboxProtocol::latency, plugin->getLatencySamples(), nullptr);
+        reply.setProperty(SandboxProtocol::tailSeconds, plugin->getTailLengthSeconds(), nullptr);
+
+        for (auto* parameter : plugin->getParameters())
+        {
+            juce::ValueTree info(SandboxProtocol::parameter);
+            info.setProperty(SandboxProtocol::parameterID, getParameterID(*parameter), nullptr);
+            info.setProperty(SandboxProtocol::name, parameter->getName(1024), nullptr);
+            info.setProperty(SandboxProtocol::label, parameter->getLabel(), nullptr);
+            info.setProperty(SandboxProtocol::defaultValue, parameter->getDefaultValue(), nullptr);
+            info.setProperty(SandboxProtocol::value, parameter->getValue(), nullptr);
+            info.setProperty(SandboxProtocol::text, parameter->getCurrentValueAsText(), nullptr);
+            info.setProperty(SandboxProtocol::numSteps, parameter->getNumSteps(), nullptr);
+            info.setProperty(SandboxProtocol::isDiscrete, parameter->isDiscrete(), nullptr);
+            info.setProperty(SandboxProtocol::isBoolean, parameter->isBoolean(), nullptr);
+            reply.appendChild(info, nullptr);
+        }
+    }
+
+    // Every parameter's current value, e.g. after loading a state
+    void describeParameterValues(juce::ValueTree& reply) const
+    {
+        const auto& parameters = plugin->getParameters();
+
+        for (int i = 0; i < parameters.size(); ++i)
+        {
+            juce::ValueTree change(SandboxProtocol::parameter);
+            change.setProperty(SandboxProtocol::index, i, nullptr);
+            change.setProperty(SandboxProtocol::value, parameters.getUnchecked(i)->getValue(), nullptr);
+            change.setProperty(SandboxProtocol::text, parameters.getUnchecked(i)->getCurrentValueAsText(), nullptr);
+            reply.appendChild(change, nullptr);
+        }
+
+        reply.setProperty(SandboxProtocol::latency, plugin->getLatencySamples(), nullptr);
+    }
+
+    bool prepare(double sampleRate, int blockSize, const juce::File& channelFile)
+    {
+        release();
+
+        channel = SandboxChannel::open(channelFile);
+
+        if (channel == nullptr)
+            return false;
+
+        plugin->setPlayHead(this);
+        plugin->setRateAndBufferSizeDetails(sampleRate, blockSize);
+        plugin->prepareToPlay(sampleRate, blockSize);
+        isPrepared = true;
+
+        startRealtimeThread(juce::Thread::RealtimeOptions().withPriority(10));
+        return true;
+    }
+
+    void release()
+    {
+        stopThread(2000);
+
+        if (isPrepared)
+            plugin->releaseResources();
+
+        isPrepared = false;
+        channel.reset();
+    }
+
+    void openEditor()
+    {
+        if (editorWindow == nullptr)
+            if (auto* editor = plugin->createEditorIfNeeded())
+                editorWindow = std::make_unique<EditorWindow>(plugin->getName(), editor);
+
+        if (editorWindow != nullptr)
+        {
+            editorWindow->setVisible(true);
+            editorWindow->toFront(true);
+        }
+    }
+
+    // Messages for the host about what the plugin has changed since last time
+    void collectChanges(int instanceID, juce::Array<juce::ValueTree>& messages)
+    {
+        if (latencyChanged.exchange(false))
+        {
+            juce::ValueTree message(SandboxProtocol::latencyChanged);
+            message.setProperty(SandboxProtocol::instance, instanceID, nullptr);
+            message.setProperty(SandboxProtocol::latency, plugin->getLatencySamples(), nullptr);
+            messages.add(message);
+        }
+
+        if (! anyParameterChanged.exchange(false))
+            return;
+
+        const auto& parameters = plugin->getParameters();
+
+        for (int i = 0; i < parameters.size(); ++i)
+        {
+            if (! changedParameters[(size_t) i].exchange(false))
+                continue;
+
+            juce::ValueTree message(SandboxProtocol::parameterChanged);
+            message.setProperty(SandboxProtocol::instance, instanceID, nullptr);
+            message.setProperty(SandboxProtocol::index, i, nullptr);
+            message.setProperty(SandboxProtocol::value, parameters.getUnchecked(i)->getValue(), nullptr);
+            message.setProperty(SandboxProtocol::text, parameters.getUnchecked(i)->getCurrentValueAsText(), nullptr);
+            messages.add(message);
+        }
+    }
+
+private:
+    class EditorWindow : public juce::DocumentWindow
+    {
+    public:
+        EditorWindow(const juce::String& name, juce::AudioProcessorEditor* editor)
+            : DocumentWindow(name, juce::Colours::darkgrey, DocumentWindow::closeButton)
+        {
+            setUsingNativeTitleBar(true);
+            setContentOwned(editor, true);
+            setResizable(editor->isResizable(), false);
+            centreWithSize(getWidth(), getHeight());
+        }
+
+        void closeButtonPressed() override
+        {
+            setVisible(false);
+        }
+    };
+
+    static juce::String getParameterID(juce::AudioProcessorParameter& parameter)
+    {
+        if (auto* hosted = dynamic_cast<juce::AudioPluginInstance::HostedParameter*>(&parameter))
+            return hosted->getParameterID();
+
+        return juce::String(parameter.getParameterIndex());
+    }
+
+    void run() override
+    {
+        auto& header = channel->getHeader();
+        const auto& parameters = plugin->getParameters();
+        auto lastRequest = header.request.load(std::memory_order_acquire);
+
+        std::vector<float*> channels;
+
+        for (int ch = 0; ch < header.numChannels; ++ch)
+            channels.push_back(channel->getChannel(ch));
+
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+        midi.ensureSize((size_t) SandboxChannel::maxMidiBytes);
+
+        while (! threadShouldExit())
+        {
+            if (! channel->waitForRequest(lastRequest, std::chrono::milliseconds(100)))
+                continue;
+
+            lastRequest = header.request.load(std::memory_order_acquire);
+
+            // Host-side changes are applied without notifying, so they don't echo back
+            const auto* changes = channel->getParameterChanges();
+
+            for (int i = 0; i < juce::jmin((int) header.numParameterChanges, SandboxChannel::maxParameterChanges); ++i)
+                if (auto* parameter = parameters[changes[i].index])
+                    parameter->setValue(changes[i].value);
+
+            readPosition(header);
+
+            const auto numSamples = juce::jlimit(0, (int) header.maxBlockSize, (int) header.numSamples);
+
+            if (channels.empty())
+                buffer.setSize(0, numSamples, false, false, true);
+            else
+                buffer.setDataToReferTo(channels.data(), (int) channels.size(), numSamples);
+
+            channel->readMidiIn(midi);
+
+            {
+                const juce::ScopedLock sl(plugin->getCallbackLock());
+
+                if (plugin->isSuspended())
+                    buffer.clear();
+                else
+                    plugin->processBlock(buffer, midi);
+            }
+
+            channel->writeMidiOut(midi);
+            channel->sendResponse(lastRequest);
+        }
+    }
+
+    void readPosition(const SandboxChannel::Header& header)
+    {
+        if (header.hasPosition == 0)
+        {
+            position.reset();
+            return;
+        }
+
+        PositionInfo info;
+        info.setIsPlaying(header.isPlaying != 0);
+        info.setBpm(header.bpm);
+        info.setTimeInSamples(header.timeInSamples);
+        info.setPpqPosition(header.ppqPosition);
+        info.setPpqPositionOfLastBarStart(header.ppqPositionOfLastBarStart);
+        info.setTimeSignature(TimeSignature { header.timeSigNumerator, header.timeSigDenominator });
+        position = info;
+    }
+
+    // Only asked for from inside processBlock, on the thread that sets it
+    juce::Optional<PositionInfo> getPosition() const override
+    {
+        return position;
+    }
+
+    void audioProcessorParameterChanged(juce::AudioProcessor*, int parameterIndex, float) override
+    {
+        if (! juce::isPositiveAndBelow(parameterIndex, plugin->getParameters().size()))
+            return;
+
+        changedParameters[(size_t) parameterIndex].store(true);
+        anyParameterChanged.store(true);
+    }
+
+    void audioProcessorChanged(juce::AudioProcessor*, const ChangeDetails& details) override
+    {
+        if (details.latencyChanged)
+            latencyChanged.store(true);
+    }
+
+    std::unique_ptr<juce::AudioPluginInstance> plugin;
+    std::unique_ptr<SandboxChannel> channel;
+    std::unique_ptr<EditorWindow> editorWindow;
+    bool isPrepared = false;
+    juce::Optional<PositionInfo> position;
+
+    // Set from whichever thread the plugin changes them on, read by the worker's timer
+    std::unique_ptr<std::atomic<bool>[]> changedParameters;
+    std::atomic<bool> anyParameterChanged { false };
+    std::atomic<bool> latencyChanged { false };
+
+    JUCE_DECLARE_NON_COPYABLE(HostedPlugin)
+};
+
+//==============================================================================
+PluginSandboxWorker::PluginSandboxWorker()
+{
+    formatManager.addDefaultFormats();
+    startTimerHz(30);
+}
+
+PluginSandboxWorker::~PluginSandboxWorker()
+{
+    stopTimer();
+    plugins.clear();
+}
+
+void PluginSandboxWorker::handleMessageFromCoordinator(const juce::MemoryBlock& message)
+{
+    // Plugins expect to be loaded and managed on the message thread
+    const auto tree = SandboxProtocol::fromMemoryBlock(message);
+
+    juce::MessageManager::callAsync([this, tree]
+    {
+        handleMessage(tree);
+    });
+}
+
+void PluginSandboxWorker::handleConnectionLost()
+{
+    // The host has gone, so there's nobody left to play to
+    juce::MessageManager::callAsync([]
+    {
+        juce::JUCEApplicationBase::quit();
+    });
+}
+
+void PluginSandboxWorker::handleMessage(const juce::ValueTree& message)
+{
+    juce::ValueTree reply(SandboxProtocol::reply);
+    reply.setProperty(SandboxProtocol::id, message[SandboxProtocol::id], nullptr);
+
+    const int instanceID = message[SandboxProtocol::instance];
+    const auto found = plugins.find(instanceID);
+    auto* hosted = found != plugins.end() ? found->second.get() : nullptr;
+
+    if (message.hasType(SandboxProtocol::load))
+    {
+        reply = load(message);
+    }
+    else if (hosted == nullptr)
+    {
+        reply.setProperty(SandboxProtocol::error, "No plugin loaded as instance " + juce::String(instanceID), nullptr);
+    }
+    else if (message.hasType(SandboxProtocol::prepare))
+    {
+        const juce::File channelFile(message[SandboxProtocol::channelFile].toString());
+
+        if (hosted->prepare(message[SandboxProtocol::sampleRate], message[SandboxProtocol::blockSize], channelFile))
+            reply.setProperty(SandboxProtocol::latency, hosted->getPlugin().getLatencySamples(), nullptr);
+        else
+            reply.setProperty(SandboxProtocol::error, "Couldn't open " + channelFile.getFullPathName(), nullptr);
+    }
+    else if (message.hasType(SandboxProtocol::release))
+    {
+        hosted->release();
+    }
+    else if (message.hasType(SandboxProtocol::unload))
+    {
+        plugins.erase(found);
+    }
+    else if (message.hasType(SandboxProtocol::getState))
+    {
+        juce::MemoryBlock state;
+        hosted->getPlugin().getStateInformation(state);
+        reply.setProperty(SandboxProtocol::state, state, nullptr);
+    }
+    else if (message.hasType(SandboxProtocol::setState))
+    {
+        if (const auto* state = message[SandboxProtocol::state].getBinaryData())
+            hosted->getPlugin().setStateInformation(state->getData(), (int) state->getSize());
+
+        hosted->describeParameterValues(reply);
+    }
+    else if (message.hasType(SandboxProtocol::setParameters))
+    {
+        const auto& parameters = hosted->getPlugin().getParameters();
+
+        for (const auto& change : message)
+            if (auto* parameter = parameters[(int) change[SandboxProtocol::index]])
+                parameter->setValue(change[SandboxProtocol::value]);
+    }
+    else if (message.hasType(SandboxProtocol::getParameterText))
+    {
+        // Answered as a message of its own, so that the host doesn't wait for it
+        if (auto* parameter = hosted->getPlugin().getParameters()[(int) message[SandboxProtocol::index]])
+        {
+            juce::ValueTree text(SandboxProtocol::parameterText);
+            text.setProperty(SandboxProtocol::instance, instanceID, nullptr);
+            text.setProperty(SandboxProtocol::index, message[SandboxProtocol::index], nullptr);
+            text.setProperty(SandboxProtocol::value, message[SandboxProtocol::value], nullptr);
+            text.setProperty(SandboxProtocol::text, parameter->getText(message[SandboxProtocol::value], 1024), nullptr);
+            sendMessageToCoordinator(SandboxProtocol::toMemoryBlock(text));
+        }
+    }
+    else if (message.hasType(SandboxProtocol::getParameterValue))
+    {
+        if (auto* parameter = hosted->getPlugin().getParameters()[(int) message[SandboxProtocol::index]])
+            reply.setProperty(SandboxProtocol::value, parameter->getValueForText(message[SandboxProtocol::text]), nullptr);
+    }
+    else if (message.hasType(SandboxProtocol::openEditor))
+    {
+        hosted->openEditor();
+    }
+
+    // Only requests that carry an id are waiting for an answer
+    if (message.hasProperty(SandboxProtocol::id))
+        sendMessageToCoordinator(SandboxProtocol::toMemoryBlock(reply));
+}
+
+juce::ValueTree PluginSandboxWorker::load(const juce::ValueTree& request)
+{
+    juce::ValueTree reply(SandboxProtocol::reply);
+    reply.setProperty(SandboxProtocol::id, request[SandboxProtocol::id], nullptr);
+
+    juce::PluginDescription description;
+    const auto xml = juce::parseXML(request[SandboxProtocol::description].toString());
+
+    if (xml == nullptr || ! description.loadFromXml(*xml))
+    {
+        reply.setProperty(SandboxProtocol::error, "Invalid plugin description", nullptr);
+        return reply;
+    }
+
+    juce::String errorMessage;
+    auto instance = formatManager.createPluginInstance(description,
+                                                       request[SandboxProtocol::sampleRate],
+                                                       request[SandboxProtocol::blockSize],
+                                                       errorMessage);
+
+    if (instance == nullptr)
+    {
+        reply.setProperty(SandboxProtocol::error, errorMessage, nullptr);
+        return reply;
+    }
+
+    auto hosted = std::make_unique<HostedPlugin>(std::move(instance));
+    hosted->describe(reply);
+    plugins[(int) request[SandboxProtocol::instance]] = std::move(hosted);
+    return reply;
+}
+
+void PluginSandboxWorker::timerCallback()
+{
+    juce::Array<juce::ValueTree> messages;
+
+    for (auto& plugin : plugins)
+        plugin.second->collectChanges(plugin.first, messages);
+
+    for (const auto& message : messages)
+        sendMessageToCoordinator(SandboxProtocol::toMemoryBlock(message));
+}
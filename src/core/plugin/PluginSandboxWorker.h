@@ -0,0 +1,35 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <map>
+#include <memory>
+
+// The other end of a PluginSandbox: runs in the worker process and hosts the
+// plugins the host asks for. Control messages are handled on the message thread;
+// each plugin processes its blocks on a realtime thread of its own, reading from
+// and writing to its SandboxChannel.
+class PluginSandboxWorker : public juce::ChildProcessWorker,
+                            private juce::Timer
+{
+public:
+    PluginSandboxWorker();
+    ~PluginSandboxWorker() override;
+
+private:
+    class HostedPlugin;
+
+    void handleMessageFromCoordinator(const juce::MemoryBlock& message) override;
+    void handleConnectionLost() override;
+
+    // Message thread only
+    void handleMessage(const juce::ValueTree& message);
+    juce::ValueTree load(const juce::ValueTree& request);
+
+    // Sends the parameter and latency changes the plugins have made to the host
+    void timerCallback() override;
+
+    juce::AudioPluginFormatManager formatManager;
+    std::map<int, std::unique_ptr<HostedPlugin>> plugins;
+
+    JUCE_DECLARE_NON_COPYABLE(PluginSandboxWorker)
+};
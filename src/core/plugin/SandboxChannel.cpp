@@ -0,0 +1,280 @@
+#include "SandboxChannel.h"
+#include <climits>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#if JUCE_LINUX
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+  #include <ctime>
+#endif
+
+namespace
+{
+    constexpr size_t alignment = 64;
+
+    size_t alignUp(size_t numBytes)
+    {
+        return (numBytes + alignment - 1) & ~(alignment - 1);
+    }
+
+    size_t getAudioOffset()                              { return alignUp(sizeof(SandboxChannel::Header)); }
+    size_t getMidiInOffset(int numChannels, int maxBlock) { return getAudioOffset() + alignUp((size_t) numChannels * (size_t) maxBlock * sizeof(float)); }
+    size_t getMidiOutOffset(int numChannels, int maxBlock) { return getMidiInOffset(numChannels, maxBlock) + alignUp(SandboxChannel::maxMidiBytes); }
+    size_t getParameterOffset(int numChannels, int maxBlock) { return getMidiOutOffset(numChannels, maxBlock) + alignUp(SandboxChannel::maxMidiBytes); }
+
+    size_t getTotalSize(int numChannels, int maxBlock)
+    {
+        return getParameterOffset(numChannels, maxBlock)
+             + alignUp(SandboxChannel::maxParameterChanges * sizeof(SandboxChannel::ParameterChange));
+    }
+
+    // How long to poll before going to sleep: a fast plugin answers well within the
+    // time it takes to sleep on a futex and be woken again
+    constexpr auto spinTime = std::chrono::microseconds(20);
+
+   #if ! JUCE_LINUX
+    // Without a futex, how long to keep yielding before sleeping for real, and the
+    // longest sleep once the wait has dragged on
+    constexpr auto yieldTime = std::chrono::microseconds(200);
+    constexpr auto maxSleepTime = std::chrono::milliseconds(2);
+   #endif
+
+    void sleepWhileEqual(std::atomic<uint32_t>& word, uint32_t value,
+                         std::chrono::nanoseconds waited, std::chrono::nanoseconds timeout) noexcept
+    {
+       #if JUCE_LINUX
+        // Not FUTEX_PRIVATE: the word is shared between processes
+        juce::ignoreUnused(waited);
+        const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        timespec relative { (time_t) seconds.count(), (long) (timeout - seconds).count() };
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value, &relative, nullptr, 0);
+       #else
+        // No portable cross-process wait: yield for a little while, then back off to real
+        // sleeps that grow with the wait, so an idle side doesn't keep a core busy
+        juce::ignoreUnused(word, value);
+
+        if (waited < yieldTime)
+        {
+            std::this_thread::yield();
+            return;
+        }
+
+        const auto sleepTime = juce::jmin(std::chrono::duration_cast<std::chrono::nanoseconds>(maxSleepTime),
+                                          waited / 8,
+                                          timeout);
+        std::this_thread::sleep_for(sleepTime);
+       #endif
+    }
+
+    void wake(std::atomic<uint32_t>& word) noexcept
+    {
+       #if JUCE_LINUX
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+       #else
+        juce::ignoreUnused(word);
+       #endif
+    }
+
+    // Wait until the word moves on from `value`, or until the timeout
+    bool waitWhileEqual(std::atomic<uint32_t>& word, uint32_t value, std::chrono::nanoseconds timeout) noexcept
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const auto deadline = start + timeout;
+
+        while (word.load(std::memory_order_acquire) == value)
+        {
+            const auto now = std::chrono::steady_clock::now();
+
+            if (now >= deadline)
+                return false;
+
+            if (now - start < spinTime)
+                continue;
+
+            sleepWhileEqual(word, value,
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(now - start),
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now));
+        }
+
+        return true;
+    }
+
+    int32_t writeMidi(const juce::MidiBuffer& midi, uint8_t* area) noexcept
+    {
+        int32_t numBytes = 0;
+
+        for (const auto metadata : midi)
+        {
+            const auto eventSize = (int32_t) (sizeof(int32_t) + sizeof(uint16_t)) + metadata.numBytes;
+
+            if (numBytes + eventSize > SandboxChannel::maxMidiBytes)
+                break;
+
+            const auto position = (int32_t) metadata.samplePosition;
+            const auto size = (uint16_t) metadata.numBytes;
+            std::memcpy(area + numBytes, &position, sizeof(position));
+            std::memcpy(area + numBytes + sizeof(position), &size, sizeof(size));
+            std::memcpy(area + numBytes + sizeof(position) + sizeof(size), metadata.data, (size_t) metadata.numBytes);
+            numBytes += eventSize;
+        }
+
+        return numBytes;
+    }
+
+    void readMidi(const uint8_t* area, int32_t numBytes, juce::MidiBuffer& midi) noexcept
+    {
+        midi.clear();
+        numBytes = juce::jlimit(0, SandboxChannel::maxMidiBytes, (int) numBytes);
+
+        for (int32_t offset = 0; offset + (int32_t) (sizeof(int32_t) + sizeof(uint16_t)) <= numBytes;)
+        {
+            int32_t position;
+            uint16_t size;
+            std::memcpy(&position, area + offset, sizeof(position));
+            std::memcpy(&size, area + offset + sizeof(position), sizeof(size));
+            offset += (int32_t) (sizeof(position) + sizeof(size));
+
+            if (offset + size > numBytes)
+                break;
+
+            midi.addEvent(area + offset, size, position);
+            offset += size;
+        }
+    }
+}
+
+SandboxChannel::~SandboxChannel()
+{
+    mapping.reset();
+
+    if (ownsFile)
+        file.deleteFile();
+}
+
+juce::File SandboxChannel::createChannelFile()
+{
+    const juce::File sharedMemory("/dev/shm");
+    const auto directory = sharedMemory.isDirectory() ? sharedMemory
+                                                      : juce::File::getSpecialLocation(juce::File::tempDirectory);
+
+    return directory.getNonexistentChildFile("VSTLinkHost-sandbox", ".shm", false);
+}
+
+std::unique_ptr<SandboxChannel> SandboxChannel::create(const juce::File& file, int numChannels, int maxBlockSize)
+{
+    const auto size = getTotalSize(numChannels, maxBlockSize);
+
+    {
+        juce::FileOutputStream stream(file);
+
+        if (! stream.openedOk() || ! stream.writeRepeatedByte(0, size))
+            return nullptr;
+    }
+
+    std::unique_ptr<SandboxChannel> channel(new SandboxChannel());
+    channel->file = file;
+    channel->ownsFile = true;
+
+    channel->mapping.reset(new juce::MemoryMappedFile(file, juce::MemoryMappedFile::readWrite, false));
+
+    if (channel->mapping->getData() == nullptr || channel->mapping->getSize() < size)
+        return nullptr;
+
+    auto* header = new (channel->mapping->getData()) Header();
+    header->request = 0;
+    header->response = 0;
+    header->numChannels = numChannels;
+    header->maxBlockSize = maxBlockSize;
+
+    if (! channel->map(file))
+        return nullptr;
+
+    return channel;
+}
+
+std::unique_ptr<SandboxChannel> SandboxChannel::open(const juce::File& file)
+{
+    std::unique_ptr<SandboxChannel> channel(new SandboxChannel());
+    channel->mapping.reset(new juce::MemoryMappedFile(file, juce::MemoryMappedFile::readWrite, false));
+
+    if (channel->mapping->getData() == nullptr || ! channel->map(file))
+        return nullptr;
+
+    return channel;
+}
+
+bool SandboxChannel::map(const juce::File& fileToMap)
+{
+    file = fileToMap;
+
+    auto* base = static_cast<uint8_t*>(mapping->getData());
+    header = reinterpret_cast<Header*>(base);
+
+    const auto numChannels = header->numChannels;
+    const auto maxBlockSize = header->maxBlockSize;
+
+    if (numChannels < 0 || maxBlockSize <= 0 || mapping->getSize() < getTotalSize(numChannels, maxBlockSize))
+        return false;
+
+    audio = reinterpret_cast<float*>(base + getAudioOffset());
+    midiIn = base + getMidiInOffset(numChannels, maxBlockSize);
+    midiOut = base + getMidiOutOffset(numChannels, maxBlockSize);
+    parameterChanges = reinterpret_cast<ParameterChange*>(base + getParameterOffset(numChannels, maxBlockSize));
+    return true;
+}
+
+float* SandboxChannel::getChannel(int channel) const noexcept
+{
+    jassert(juce::isPositiveAndBelow(channel, header->numChannels));
+    return audio + (size_t) channel * (size_t) header->maxBlockSize;
+}
+
+void SandboxChannel::writeMidiIn(const juce::MidiBuffer& midi) noexcept
+{
+    header->numMidiInBytes = writeMidi(midi, midiIn);
+}
+
+void SandboxChannel::readMidiIn(juce::MidiBuffer& midi) const noexcept
+{
+    readMidi(midiIn, header->numMidiInBytes, midi);
+}
+
+void SandboxChannel::writeMidiOut(const juce::MidiBuffer& midi) noexcept
+{
+    header->numMidiOutBytes = writeMidi(midi, midiOut);
+}
+
+void SandboxChannel::readMidiOut(juce::MidiBuffer& midi) const noexcept
+{
+    readMidi(midiOut, header->numMidiOutBytes, midi);
+}
+
+uint32_t SandboxChannel::sendRequest() noexcept
+{
+    const auto request = header->request.load(std::memory_order_relaxed) + 1;
+    header->request.store(request, std::memory_order_release);
+    wake(header->request);
+    return request;
+}
+
+bool SandboxChannel::waitForResponse(uint32_t request, std::chrono::nanoseconds timeout) noexcept
+{
+    // Responses only ever catch up with the latest request, one at a time
+    return header->response.load(std::memory_order_acquire) == request
+        || (waitWhileEqual(header->response, request - 1, timeout)
+            && header->response.load(std::memory_order_acquire) == request);
+}
+
+bool SandboxChannel::waitForRequest(uint32_t lastRequest, std::chrono::nanoseconds timeout) noexcept
+{
+    return waitWhileEqual(header->request, lastRequest, timeout);
+}
+
+void SandboxChannel::sendResponse(uint32_t request) noexcept
+{
+    header->response.store(request, std::memory_order_release);
+    wake(header->response);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+// Shared memory carrying one block at a time between the host and a plugin running
+// in a sandbox process: the audio, the MIDI in both directions, parameter changes
+// and the play head position. The file is mapped by both processes; on Linux it
+// lives in /dev/shm, so it never touches the disk.
+//
+// The host fills in a block and bumps the request number; the worker processes it
+// and sets the response number to match. Either side sleeps on a futex while it
+// waits, after a short spin.
+class SandboxChannel
+{
+public:
+    static constexpr int maxMidiBytes = 16384;
+    static constexpr int maxParameterChanges = 512;
+
+    struct ParameterChange
+    {
+        int32_t index;
+        float value;
+    };
+
+    struct Header
+    {
+        std::atomic<uint32_t> request;
+        std::atomic<uint32_t> response;
+
+        // Fixed when the channel is created
+        int32_t numChannels;
+        int32_t maxBlockSize;
+
+        // The current block
+        int32_t numSamples;
+        int32_t numMidiInBytes;
+        int32_t numMidiOutBytes;
+        int32_t numParameterChanges;
+        int32_t bypassed;
+
+        // Play head position for the block, if hasPosition is set
+        int32_t hasPosition;
+        int32_t isPlaying;
+        int32_t timeSigNumerator;
+        int32_t timeSigDenominator;
+        int64_t timeInSamples;
+        double bpm;
+        double ppqPosition;
+        double ppqPositionOfLastBarStart;
+    };
+
+    ~SandboxChannel();
+
+    // Create a new channel file (host side), or map one the host created (worker side)
+    static std::unique_ptr<SandboxChannel> create(const juce::File& file, int numChannels, int maxBlockSize);
+    static std::unique_ptr<SandboxChannel> open(const juce::File& file);
+
+    // Somewhere for a new channel file to go
+    static juce::File createChannelFile();
+
+    const juce::File& getFile() const noexcept { return file; }
+    Header& getHeader() const noexcept { return *header; }
+    float* getChannel(int channel) const noexcept;
+    ParameterChange* getParameterChanges() const noexcept { return parameterChanges; }
+
+    // Pack a block's MIDI into the channel, or unpack it. Events that don't fit are dropped.
+    void writeMidiIn(const juce::MidiBuffer& midi) noexcept;
+    void readMidiIn(juce::MidiBuffer& midi) const noexcept;
+    void writeMidiOut(const juce::MidiBuffer& midi) noexcept;
+    void readMidiOut(juce::MidiBuffer& midi) const noexcept;
+
+    // Host side: hand the block over, then wait for the worker to finish it
+    uint32_t sendRequest() noexcept;
+    bool waitForResponse(uint32_t request, std::chrono::nanoseconds timeout) noexcept;
+
+    // Worker side: wait for a block after `lastRequest`, then hand it back
+    bool waitForRequest(uint32_t lastRequest, std::chrono::nanoseconds timeout) noexcept;
+    void sendResponse(uint32_t request) noexcept;
+
+private:
+    SandboxChannel() = default;
+
+    bool map(const juce::File& fileToMap);
+
+    juce::File file;
+    bool ownsFile = false;
+    std::unique_ptr<juce::MemoryMappedFile> mapping;
+
+    Header* header = nullptr;
+    float* audio = nullptr;
+    uint8_t* midiIn = nullptr;
+    uint8_t* midiOut = nullptr;
+    ParameterChange* parameterChanges = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(SandboxChannel)
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <juce_data_structures/juce_data_structures.h>
+
+// Control messages between the host and its plugin sandbox processes. Each message
+// is a ValueTree; requests that expect an answer carry an id that the reply repeats.
+// Audio never goes through here: it goes through each instance's SandboxChannel.
+namespace SandboxProtocol
+{
+    // Passed on the worker's command line so that the app knows to run as a sandbox
+    static constexpr const char* commandLineUID = "vstlinkhost-sandbox";
+
+    // Host to worker
+    static const juce::Identifier load { "load" };
+    static const juce::Identifier prepare { "prepare" };
+    static const juce::Identifier release { "release" };
+    static const juce::Identifier unload { "unload" };
+    static const juce::Identifier getState { "getState" };
+    static const juce::Identifier setState { "setState" };
+    static const juce::Identifier setParameters { "setParameters" };
+    static const juce::Identifier getParameterText { "getParameterText" };
+    static const juce::Identifier getParameterValue { "getParameterValue" };
+    static const juce::Identifier openEditor { "openEditor" };
+
+    // Worker to host
+    static const juce::Identifier reply { "reply" };
+    static const juce::Identifier parameterChanged { "parameterChanged" };
+    static const juce::Identifier latencyChanged { "latencyChanged" };
+    static const juce::Identifier parameterText { "parameterText" };
+
+    // Properties and children
+    static const juce::Identifier id { "id" };
+    static const juce::Identifier instance { "instance" };
+    static const juce::Identifier error { "error" };
+    static const juce::Identifier description { "description" };
+    static const juce::Identifier name { "name" };
+    static const juce::Identifier numInputChannels { "numInputChannels" };
+    static const juce::Identifier numOutputChannels { "numOutputChannels" };
+    static const juce::Identifier acceptsMidi { "acceptsMidi" };
+    static const juce::Identifier producesMidi { "producesMidi" };
+    static const juce::Identifier latency { "latency" };
+    static const juce::Identifier tailSeconds { "tailSeconds" };
+    static const juce::Identifier sampleRate { "sampleRate" };
+    static const juce::Identifier blockSize { "blockSize" };
+    static const juce::Identifier channelFile { "channelFile" };
+    static const juce::Identifier state { "state" };
+    static const juce::Identifier parameter { "parameter" };
+    static const juce::Identifier index { "index" };
+    static const juce::Identifier value { "value" };
+    static const juce::Identifier text { "text" };
+    static const juce::Identifier parameterID { "parameterID" };
+    static const juce::Identifier label { "label" };
+    static const juce::Identifier defaultValue { "defaultValue" };
+    static const juce::Identifier numSteps { "numSteps" };
+    static const juce::Identifier isDiscrete { "isDiscrete" };
+    static const juce::Identifier isBoolean { "isBoolean" };
+
+    inline juce::MemoryBlock toMemoryBlock(const juce::ValueTree& message)
+    {
+        juce::MemoryOutputStream stream;
+        message.writeToStream(stream);
+        return stream.getMemoryBlock();
+    }
+
+    inline juce::ValueTree fromMemoryBlock(const juce::MemoryBlock& block)
+    {
+        return juce::ValueTree::readFromData(block.getData(), block.getSize());
+    }
+}
@@ -0,0 +1,520 @@
+#include "SandboxedPluginInstance.h"
+#include "SandboxProtocol.h"
+#include <map>
+#include <set>
+
+namespace
+{
+    juce::AudioChannelSet getChannelSet(int numChannels)
+    {
+        const auto canonical = juce::AudioChannelSet::canonicalChannelSet(numChannels);
+        return canonical.size() == numChannels ? canonical : juce::AudioChannelSet::discreteChannels(numChannels);
+    }
+
+    void writePosition(juce::AudioPlayHead* playHead, SandboxChannel::Header& header) noexcept
+    {
+        header.hasPosition = 0;
+
+        if (playHead == nullptr)
+            return;
+
+        const auto position = playHead->getPosition();
+
+        if (! position.hasValue())
+            return;
+
+        const auto timeSignature = position->getTimeSignature().orFallback(juce::AudioPlayHead::TimeSignature());
+
+        header.hasPosition = 1;
+        header.isPlaying = position->getIsPlaying() ? 1 : 0;
+        header.timeSigNumerator = timeSignature.numerator;
+        header.timeSigDenominator = timeSignature.denominator;
+        header.timeInSamples = position->getTimeInSamples().orFallback(0);
+        header.bpm = position->getBpm().orFallback(120.0);
+        header.ppqPosition = position->getPpqPosition().orFallback(0.0);
+        header.ppqPositionOfLastBarStart = position->getPpqPositionOfLastBarStart().orFallback(0.0);
+    }
+}
+
+//==============================================================================
+// A parameter whose value lives in the worker. Changes made here are sent with the
+// next block; changes made by the plugin come back through the sandbox.
+//
+// Its texts come from the plugin too. The text of the current value arrives with
+// each change; others are asked for the first time they're shown and kept, and are
+// shown as a number until the answer arrives.
+class SandboxedPluginInstance::Parameter : public juce::AudioPluginInstance::HostedParameter
+{
+public:
+    Parameter(SandboxedPluginInstance& ownerToUse, int indexToUse, const juce::ValueTree& info)
+        : owner(ownerToUse),
+          index(indexToUse),
+          parameterID(info[SandboxProtocol::parameterID].toString()),
+          name(info[SandboxProtocol::name].toString()),
+          label(info[SandboxProtocol::label].toString()),
+          defaultValue(info[SandboxProtocol::defaultValue]),
+          numSteps(info[SandboxProtocol::numSteps]),
+          discrete(info[SandboxProtocol::isDiscrete]),
+          boolean(info[SandboxProtocol::isBoolean]),
+          value((float) info[SandboxProtocol::value])
+    {
+        cacheText(value, info[SandboxProtocol::text]);
+    }
+
+    float getValue() const override { return value.load(std::memory_order_relaxed); }
+
+    void setValue(float newValue) override
+    {
+        value.store(newValue, std::memory_order_relaxed);
+        owner.markParameterDirty(index);
+    }
+
+    void setValueFromSandbox(float newValue, const juce::String& text)
+    {
+        cacheText(newValue, text);
+        value.store(newValue, std::memory_order_relaxed);
+        sendValueChangedMessageToListeners(newValue);
+    }
+
+    float getDefaultValue() const override { return defaultValue; }
+    juce::String getName(int maximumStringLength) const override { return name.substring(0, maximumStringLength); }
+    juce::String getLabel() const override { return label; }
+    int getNumSteps() const override { return numSteps > 0 ? numSteps : juce::AudioProcessor::getDefaultNumParameterSteps(); }
+    bool isDiscrete() const override { return discrete; }
+    bool isBoolean() const override { return boolean; }
+    juce::String getParameterID() const override { return parameterID; }
+
+    juce::String getText(float valueToShow, int maximumStringLength) const override
+    {
+        bool shouldRequest = false;
+
+        {
+            const juce::ScopedLock sl(textLock);
+            const auto found = texts.find(valueToShow);
+
+            if (found != texts.end())
+                return found->second.substring(0, maximumStringLength);
+
+            // A worker that has stopped answering would have these pile up, so past a
+            // limit, values show as numbers until some answers come back
+            if (requestedTexts.size() < maxRequestedTexts && ! owner.hasCrashed())
+                shouldRequest = requestedTexts.insert(valueToShow).second;
+        }
+
+        if (shouldRequest)
+            owner.requestParameterText(index, valueToShow);
+
+        return juce::String(valueToShow, 2).substring(0, maximumStringLength);
+    }
+
+    float getValueForText(const juce::String& text) const override
+    {
+        return owner.getParameterValue(index, text);
+    }
+
+    void cacheText(float valueShown, const juce::String& text)
+    {
+        const juce::ScopedLock sl(textLock);
+
+        // Dragging a slider asks for a text at every step, so don't keep them all
+        if (texts.size() >= maxCachedTexts)
+            texts.clear();
+
+        texts[valueShown] = text;
+        requestedTexts.erase(valueShown);
+    }
+
+    // A new state might change what the values mean, and a worker that's gone won't
+    // answer what was asked of it
+    void clearTexts()
+    {
+        const juce::ScopedLock sl(textLock);
+        texts.clear();
+        requestedTexts.clear();
+    }
+
+private:
+    SandboxedPluginInstance& owner;
+    const int index;
+    const juce::String parameterID, name, label;
+    const float defaultValue;
+    const int numSteps;
+    const bool discrete, boolean;
+    std::atomic<float> value;
+
+    static constexpr size_t maxCachedTexts = 256;
+    static constexpr size_t maxRequestedTexts = 64;
+    juce::CriticalSection textLock;
+    mutable std::map<float, juce::String> texts;
+    mutable std::set<float> requestedTexts;
+};
+
+//==============================================================================
+SandboxedPluginInstance::SandboxedPluginInstance(std::shared_ptr<PluginSandbox> sandboxToUse,
+                                                 int instanceIDToUse,
+                                                 const juce::PluginDescription& descriptionToUse,
+                                                 const juce::ValueTree& loadReply)
+    : juce::AudioPluginInstance(createBuses(loadReply)),
+      sandbox(std::move(sandboxToUse)),
+      instanceID(instanceIDToUse),
+      description(descriptionToUse),
+      tailSeconds(loadReply[SandboxProtocol::tailSeconds]),
+      acceptsMidiInput(loadReply[SandboxProtocol::acceptsMidi]),
+      producesMidiOutput(loadReply[SandboxProtocol::producesMidi])
+{
+    setLatencySamples(loadReply[SandboxProtocol::latency]);
+
+    int numParameters = 0;
+
+    for (const auto& info : loadReply)
+        if (info.hasType(SandboxProtocol::parameter))
+            addHostedParameter(std::make_unique<Parameter>(*this, numParameters++, info));
+
+    dirtyParameters = std::make_unique<std::atomic<bool>[]>((size_t) numParameters);
+
+    sandbox->addInstance(instanceID, this);
+}
+
+SandboxedPluginInstance::~SandboxedPluginInstance()
+{
+    sandbox->removeInstance(instanceID);
+    sandbox->post(createRequest(SandboxProtocol::unload));
+}
+
+// The stand-in gets the same buses as the plugin reports in the worker
+juce::AudioProcessor::BusesProperties SandboxedPluginInstance::createBuses(const juce::ValueTree& loadReply)
+{
+    const int numInputs = loadReply[SandboxProtocol::numInputChannels];
+    const int numOutputs = loadReply[SandboxProtocol::numOutputChannels];
+
+    BusesProperties buses;
+
+    if (numInputs > 0)
+        buses = buses.withInput("Input", getChannelSet(numInputs), true);
+
+    if (numOutputs > 0)
+        buses = buses.withOutput("Output", getChannelSet(numOutputs), true);
+
+    return buses;
+}
+
+void SandboxedPluginInstance::setResponseBudget(double fractionOfBlock)
+{
+    responseBudget = juce::jlimit(0.05, 1.0, fractionOfBlock);
+}
+
+SandboxedPluginInstance::RoundTripStats SandboxedPluginInstance::getRoundTripStats() const
+{
+    RoundTripStats stats;
+    stats.lastMicros = lastMicros.load(std::memory_order_relaxed);
+    stats.maxMicros = maxMicros.load(std::memory_order_relaxed);
+    stats.numBlocks = numBlocks.load(std::memory_order_relaxed);
+    stats.numMissedBlocks = numMissedBlocks.load(std::memory_order_relaxed);
+
+    if (const auto count = numRoundTrips.load(std::memory_order_relaxed))
+        stats.meanMicros = totalMicros.load(std::memory_order_relaxed) / (double) count;
+
+    return stats;
+}
+
+void SandboxedPluginInstance::resetRoundTripStats()
+{
+    lastMicros = 0.0;
+    totalMicros = 0.0;
+    maxMicros = 0.0;
+    numRoundTrips = 0;
+    numBlocks = 0;
+    numMissedBlocks = 0;
+}
+
+void SandboxedPluginInstance::openEditorWindow()
+{
+    sandbox->post(createRequest(SandboxProtocol::openEditor));
+}
+
+const juce::String SandboxedPluginInstance::getName() const
+{
+    return description.name;
+}
+
+void SandboxedPluginInstance::fillInPluginDescription(juce::PluginDescription& descriptionToFill) const
+{
+    descriptionToFill = description;
+}
+
+void SandboxedPluginInstance::prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock)
+{
+    // The worker switches over to the new channel before this one is dropped
+    auto newChannel = SandboxChannel::create(SandboxChannel::createChannelFile(),
+                                             juce::jmax(getTotalNumInputChannels(), getTotalNumOutputChannels()),
+                                             maximumExpectedSamplesPerBlock);
+
+    if (newChannel == nullptr)
+    {
+        juce::Logger::writeToLog("Couldn't create the sandbox channel for " + getName());
+        channel.reset();
+        return;
+    }
+
+    auto request = createRequest(SandboxProtocol::prepare);
+    request.setProperty(SandboxProtocol::sampleRate, sampleRate, nullptr);
+    request.setProperty(SandboxProtocol::blockSize, maximumExpectedSamplesPerBlock, nullptr);
+    request.setProperty(SandboxProtocol::channelFile, newChannel->getFile().getFullPathName(), nullptr);
+
+    const auto reply = sandbox->call(request);
+
+    if (! reply.isValid() || reply.hasProperty(SandboxProtocol::error))
+    {
+        juce::Logger::writeToLog("Couldn't prepare sandboxed plugin " + getName() + ": "
+                                 + reply[SandboxProtocol::error].toString());
+        channel.reset();
+        return;
+    }
+
+    channel = std::move(newChannel);
+    unansweredRequest = 0;
+    setLatencySamples(reply[SandboxProtocol::latency]);
+}
+
+void SandboxedPluginInstance::releaseResources()
+{
+    if (channel != nullptr)
+        sandbox->call(createRequest(SandboxProtocol::release));
+
+    channel.reset();
+
+    const auto stats = getRoundTripStats();
+
+    if (stats.numBlocks > 0)
+        juce::Logger::writeToLog("Sandboxed " + getName() + ": round trip mean "
+                                 + juce::String(stats.meanMicros, 1) + " us, max "
+                                 + juce::String(stats.maxMicros, 1) + " us, "
+                                 + juce::String(stats.numMissedBlocks) + " of "
+                                 + juce::String(stats.numBlocks) + " blocks missed");
+}
+
+void SandboxedPluginInstance::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    const auto numSamples = buffer.getNumSamples();
+
+    auto missBlock = [&]
+    {
+        numBlocks.fetch_add(1, std::memory_order_relaxed);
+        numMissedBlocks.fetch_add(1, std::memory_order_relaxed);
+        buffer.clear();
+        midiMessages.clear();
+    };
+
+    if (channel == nullptr || hasCrashed() || numSamples > channel->getHeader().maxBlockSize)
+    {
+        missBlock();
+        return;
+    }
+
+    auto& header = channel->getHeader();
+
+    // The worker is still busy with a block that missed its deadline
+    if (unansweredRequest != 0)
+    {
+        if (header.response.load(std::memory_order_acquire) != unansweredRequest)
+        {
+            missBlock();
+            return;
+        }
+
+        unansweredRequest = 0;
+    }
+
+    const auto numChannels = juce::jmin(buffer.getNumChannels(), (int) header.numChannels);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        juce::FloatVectorOperations::copy(channel->getChannel(ch), buffer.getReadPointer(ch), numSamples);
+
+    header.numSamples = numSamples;
+    header.bypassed = 0;
+    channel->writeMidiIn(midiMessages);
+    writeParameterChanges();
+    writePosition(getPlayHead(), header);
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto request = channel->sendRequest();
+    const auto budget = std::chrono::nanoseconds((int64_t) (responseBudget.load(std::memory_order_relaxed)
+                                                            * numSamples * 1.0e9 / getSampleRate()));
+
+    if (! channel->waitForResponse(request, budget))
+    {
+        unansweredRequest = request;
+        missBlock();
+        return;
+    }
+
+    recordRoundTrip(std::chrono::steady_clock::now() - start);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        juce::FloatVectorOperations::copy(buffer.getWritePointer(ch), channel->getChannel(ch), numSamples);
+
+    for (int ch = numChannels; ch < buffer.getNumChannels(); ++ch)
+        buffer.clear(ch, 0, numSamples);
+
+    channel->readMidiOut(midiMessages);
+}
+
+void SandboxedPluginInstance::getStateInformation(juce::MemoryBlock& destData)
+{
+    flushParameterChanges();
+
+    const auto reply = sandbox->call(createRequest(SandboxProtocol::getState));
+
+    if (const auto* state = reply[SandboxProtocol::state].getBinaryData())
+        destData = *state;
+}
+
+void SandboxedPluginInstance::setStateInformation(const void* data, int sizeInBytes)
+{
+    auto request = createRequest(SandboxProtocol::setState);
+    request.setProperty(SandboxProtocol::state, juce::MemoryBlock(data, (size_t) sizeInBytes), nullptr);
+
+    const auto reply = sandbox->call(request);
+
+    for (auto* parameter : getParameters())
+        if (auto* sandboxed = dynamic_cast<Parameter*>(parameter))
+            sandboxed->clearTexts();
+
+    // The reply carries every parameter's value after the state was loaded
+    for (const auto& change : reply)
+        handleParameterChanged(change[SandboxProtocol::index], change[SandboxProtocol::value], change[SandboxProtocol::text]);
+
+    if (reply.hasProperty(SandboxProtocol::latency))
+        setLatencySamples(reply[SandboxProtocol::latency]);
+}
+
+void SandboxedPluginInstance::handleParameterChanged(int index, float value, const juce::String& text)
+{
+    if (auto* parameter = dynamic_cast<Parameter*>(getParameters()[index]))
+        parameter->setValueFromSandbox(value, text);
+}
+
+void SandboxedPluginInstance::handleParameterText(int index, float value, const juce::String& text)
+{
+    if (auto* parameter = dynamic_cast<Parameter*>(getParameters()[index]))
+        parameter->cacheText(value, text);
+}
+
+void SandboxedPluginInstance::handleLatencyChanged(int samples)
+{
+    setLatencySamples(samples);
+}
+
+void SandboxedPluginInstance::handleCrash()
+{
+    crashed = true;
+
+    for (auto* parameter : getParameters())
+        if (auto* sandboxed = dynamic_cast<Parameter*>(parameter))
+            sandboxed->clearTexts();
+}
+
+void SandboxedPluginInstance::markParameterDirty(int index) noexcept
+{
+    dirtyParameters[(size_t) index].store(true, std::memory_order_relaxed);
+    anyParameterDirty.store(true, std::memory_order_release);
+}
+
+void SandboxedPluginInstance::writeParameterChanges() noexcept
+{
+    auto& header = channel->getHeader();
+    header.numParameterChanges = 0;
+
+    if (! anyParameterDirty.exchange(false, std::memory_order_acq_rel))
+        return;
+
+    const auto& parameters = getParameters();
+    auto* changes = channel->getParameterChanges();
+    int numChanges = 0;
+
+    for (int i = 0; i < parameters.size(); ++i)
+    {
+        if (! dirtyParameters[(size_t) i].load(std::memory_order_relaxed))
+            continue;
+
+        // Whatever doesn't fit goes with the next block
+        if (numChanges == SandboxChannel::maxParameterChanges)
+        {
+            anyParameterDirty = true;
+            break;
+        }
+
+        dirtyParameters[(size_t) i].store(false, std::memory_order_relaxed);
+        changes[numChanges++] = { (int32_t) i, parameters.getUnchecked(i)->getValue() };
+    }
+
+    header.numParameterChanges = numChanges;
+}
+
+void SandboxedPluginInstance::flushParameterChanges()
+{
+    // Changes made while no blocks are running still have to reach the worker
+    if (! anyParameterDirty.exchange(false, std::memory_order_acq_rel))
+        return;
+
+    auto message = createRequest(SandboxProtocol::setParameters);
+    const auto& parameters = getParameters();
+
+    for (int i = 0; i < parameters.size(); ++i)
+    {
+        if (! dirtyParameters[(size_t) i].exchange(false, std::memory_order_relaxed))
+            continue;
+
+        juce::ValueTree change(SandboxProtocol::parameter);
+        change.setProperty(SandboxProtocol::index, i, nullptr);
+        change.setProperty(SandboxProtocol::value, parameters.getUnchecked(i)->getValue(), nullptr);
+        message.appendChild(change, nullptr);
+    }
+
+    sandbox->post(message);
+}
+
+void SandboxedPluginInstance::requestParameterText(int index, float value)
+{
+    // The answer comes back as a message of its own, through handleParameterText()
+    auto request = createRequest(SandboxProtocol::getParameterText);
+    request.setProperty(SandboxProtocol::index, index, nullptr);
+    request.setProperty(SandboxProtocol::value, value, nullptr);
+
+    sandbox->post(request);
+}
+
+float SandboxedPluginInstance::getParameterValue(int index, const juce::String& text)
+{
+    // Someone typed a value in, so it's worth a short wait for the plugin to read it
+    auto request = createRequest(SandboxProtocol::getParameterValue);
+    request.setProperty(SandboxProtocol::index, index, nullptr);
+    request.setProperty(SandboxProtocol::text, text, nullptr);
+
+    const auto reply = sandbox->call(request, 200);
+
+    if (reply.hasProperty(SandboxProtocol::value))
+        return reply[SandboxProtocol::value];
+
+    return juce::jlimit(0.0f, 1.0f, text.getFloatValue());
+}
+
+juce::ValueTree SandboxedPluginInstance::createRequest(const juce::Identifier& type) const
+{
+    juce::ValueTree request(type);
+    request.setProperty(SandboxProtocol::instance, instanceID, nullptr);
+    return request;
+}
+
+void SandboxedPluginInstance::recordRoundTrip(std::chrono::steady_clock::duration duration) noexcept
+{
+    const auto micros = std::chrono::duration<double, std::micro>(duration).count();
+
+    numBlocks.fetch_add(1, std::memory_order_relaxed);
+    numRoundTrips.fetch_add(1, std::memory_order_relaxed);
+    lastMicros.store(micros, std::memory_order_relaxed);
+    totalMicros.store(totalMicros.load(std::memory_order_relaxed) + micros, std::memory_order_relaxed);
+
+    if (micros > maxMicros.load(std::memory_order_relaxed))
+        maxMicros.store(micros, std::memory_order_relaxed);
+}
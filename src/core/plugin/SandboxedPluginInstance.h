@@ -0,0 +1,117 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "PluginSandbox.h"
+#include "SandboxChannel.h"
+#include <atomic>
+#include <memory>
+
+// Stands in for a plugin that runs inside a PluginSandbox. To the graph it looks
+// like any other plugin; each block is copied into shared memory, processed by the
+// worker and copied back.
+//
+// The audio thread only waits for the worker for part of the block. If the answer
+// doesn't come in time, or the worker has died, the block comes out silent and is
+// counted as missed instead of holding up the rest of the graph.
+class SandboxedPluginInstance : public juce::AudioPluginInstance
+{
+public:
+    struct RoundTripStats
+    {
+        double lastMicros = 0.0;
+        double meanMicros = 0.0;
+        double maxMicros = 0.0;
+        uint64_t numBlocks = 0;
+        uint64_t numMissedBlocks = 0;
+    };
+
+    SandboxedPluginInstance(std::shared_ptr<PluginSandbox> sandbox,
+                            int instanceID,
+                            const juce::PluginDescription& description,
+                            const juce::ValueTree& loadReply);
+    ~SandboxedPluginInstance() override;
+
+    // How much of a block the audio thread will wait for the worker
+    void setResponseBudget(double fractionOfBlock);
+
+    RoundTripStats getRoundTripStats() const;
+    void resetRoundTripStats();
+
+    // True once the worker hosting this plugin has died
+    bool hasCrashed() const { return crashed.load(std::memory_order_acquire); }
+
+    // Ask the worker to show the plugin's own editor in a window of its own
+    void openEditorWindow();
+
+    //==============================================================================
+    const juce::String getName() const override;
+    void fillInPluginDescription(juce::PluginDescription& description) const override;
+
+    void prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) override;
+    void releaseResources() override;
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override;
+    using juce::AudioPluginInstance::processBlock;
+
+    double getTailLengthSeconds() const override { return tailSeconds; }
+    bool acceptsMidi() const override { return acceptsMidiInput; }
+    bool producesMidi() const override { return producesMidiOutput; }
+
+    bool hasEditor() const override { return false; }
+    juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+
+    int getNumPrograms() override { return 1; }
+    int getCurrentProgram() override { return 0; }
+    void setCurrentProgram(int) override {}
+    const juce::String getProgramName(int) override { return {}; }
+    void changeProgramName(int, const juce::String&) override {}
+
+    void getStateInformation(juce::MemoryBlock& destData) override;
+    void setStateInformation(const void* data, int sizeInBytes) override;
+
+private:
+    friend class PluginSandbox;
+    class Parameter;
+
+    static BusesProperties createBuses(const juce::ValueTree& loadReply);
+
+    // From the sandbox's connection thread
+    void handleParameterChanged(int index, float value, const juce::String& text);
+    void handleParameterText(int index, float value, const juce::String& text);
+    void handleLatencyChanged(int samples);
+    void handleCrash();
+
+    void markParameterDirty(int index) noexcept;
+    void writeParameterChanges() noexcept;
+    void flushParameterChanges();
+    void requestParameterText(int index, float value);
+    float getParameterValue(int index, const juce::String& text);
+
+    juce::ValueTree createRequest(const juce::Identifier& type) const;
+    void recordRoundTrip(std::chrono::steady_clock::duration duration) noexcept;
+
+    std::shared_ptr<PluginSandbox> sandbox;
+    const int instanceID;
+    juce::PluginDescription description;
+    double tailSeconds = 0.0;
+    bool acceptsMidiInput = false;
+    bool producesMidiOutput = false;
+
+    std::unique_ptr<SandboxChannel> channel;
+    uint32_t unansweredRequest = 0;
+    std::atomic<bool> crashed { false };
+    std::atomic<double> responseBudget { 0.5 };
+
+    // Parameter changes made on the host side, waiting to be sent to the worker
+    std::unique_ptr<std::atomic<bool>[]> dirtyParameters;
+    std::atomic<bool> anyParameterDirty { false };
+
+    // Written by the audio thread only
+    std::atomic<double> lastMicros { 0.0 };
+    std::atomic<double> totalMicros { 0.0 };
+    std::atomic<double> maxMicros { 0.0 };
+    std::atomic<uint64_t> numRoundTrips { 0 };
+    std::atomic<uint64_t> numBlocks { 0 };
+    std::atomic<uint64_t> numMissedBlocks { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(SandboxedPluginInstance)
+};
@@ -1,5 +1,6 @@
 #include "LinkManager.h"
 #include <chrono>
+#include <cmath>
 #include <iostream>
 
 LinkManager::LinkManager()
@@ -62,7 +63,7 @@ double LinkManager::getTempo() const
     if (!link)
         return 120.0;
     
-    auto timeline = link->captureAudioTimeline();
+    auto timeline = link->captureAppSessionState();
     return timeline.tempo();
 }
 
@@ -71,9 +72,9 @@ void LinkManager::setTempo(double bpm)
     if (!link)
         return;
     
-    auto timeline = link->captureAudioTimeline();
+    auto timeline = link->captureAppSessionState();
     timeline.setTempo(bpm, link->clock().micros());
-    link->commitAudioTimeline(timeline);
+    link->commitAppSessionState(timeline);
     
     // Notify tempo callback
     if (tempoCallback)
@@ -85,7 +86,7 @@ double LinkManager::getBeatTime() const
     if (!link)
         return 0.0;
     
-    auto timeline = link->captureAudioTimeline();
+    auto timeline = link->captureAppSessionState();
     return timeline.beatAtTime(link->clock().micros(), quantum);
 }
 
@@ -94,29 +95,53 @@ double LinkManager::getBeatTimeAtTimestamp(std::chrono::microseconds timestamp)
     if (!link)
         return 0.0;
     
-    auto timeline = link->captureAudioTimeline();
+    auto timeline = link->captureAppSessionState();
     return timeline.beatAtTime(timestamp, quantum);
 }
 
+std::chrono::microseconds LinkManager::getClockMicros() const
+{
+    if (!link)
+        return std::chrono::microseconds(0);
+    
+    return link->clock().micros();
+}
+
 double LinkManager::getPhaseAtTimestamp(std::chrono::microseconds timestamp, double quantumValue) const
 {
     if (!link)
         return 0.0;
     
-    auto timeline = link->captureAudioTimeline();
+    auto timeline = link->captureAppSessionState();
     auto beat = timeline.beatAtTime(timestamp, quantumValue);
     return beat - std::floor(beat / quantumValue) * quantumValue;
 }
 
+std::optional<LinkManager::Timeline> LinkManager::captureTimeline() const
+{
+    if (!link)
+        return std::nullopt;
+    
+    return Timeline(link->captureAppSessionState(), quantum);
+}
+
+std::optional<LinkManager::Timeline> LinkManager::captureAudioTimeline() const
+{
+    if (!link)
+        return std::nullopt;
+    
+    return Timeline(link->captureAudioSessionState(), quantum);
+}
+
 void LinkManager::setBeatPosition(double position)
 {
     if (!link)
         return;
     
-    auto timeline = link->captureAudioTimeline();
+    auto timeline = link->captureAppSessionState();
     auto time = link->clock().micros();
     timeline.requestBeatAtTime(position, time, quantum);
-    link->commitAudioTimeline(timeline);
+    link->commitAppSessionState(timeline);
 }
 
 void LinkManager::setIsPlaying(bool shouldPlay)
@@ -128,7 +153,7 @@ void LinkManager::setIsPlaying(bool shouldPlay)
     {
         isLinkPlaying = shouldPlay;
         
-        auto timeline = link->captureAudioTimeline();
+        auto timeline = link->captureAppSessionState();
         auto time = link->clock().micros();
         
         if (shouldPlay)
@@ -144,7 +169,7 @@ void LinkManager::setIsPlaying(bool shouldPlay)
             timeline.setIsPlaying(false, time);
         }
         
-        link->commitAudioTimeline(timeline);
+        link->commitAppSessionState(timeline);
         
         // Notify callback
         if (startStopCallback)
@@ -157,7 +182,7 @@ bool LinkManager::isPlaying() const
     if (!link)
         return false;
     
-    auto timeline = link->captureAudioTimeline();
+    auto timeline = link->captureAppSessionState();
     return timeline.isPlaying();
 }
 
@@ -7,6 +7,7 @@
 #include <mutex>
 #include <thread>
 #include <condition_variable>
+#include <optional>
 
 class LinkManager
 {
@@ -38,9 +39,49 @@ public:
     // Get beat time at specific audio timestamp
     double getBeatTimeAtTimestamp(std::chrono::microseconds timestamp) const;
     
+    // Get the current time on Link's host clock
+    std::chrono::microseconds getClockMicros() const;
+    
     // Get phase at specific audio timestamp (0-1 representing position in the current bar)
     double getPhaseAtTimestamp(std::chrono::microseconds timestamp, double quantum = 4.0) const;
     
+    // One consistent view of the session timeline, for threads that schedule events
+    // against Link's host clock (not for the audio thread)
+    class Timeline
+    {
+    public:
+        double getTempo() const { return state.tempo(); }
+        bool isPlaying() const { return state.isPlaying(); }
+        double getQuantum() const { return quantum; }
+        
+        double getBeatAtTime(std::chrono::microseconds time) const { return state.beatAtTime(time, quantum); }
+        std::chrono::microseconds getTimeAtBeat(double beat) const { return state.timeAtBeat(beat, quantum); }
+        
+        // The same against another quantum, such as a quantization grid, so that its
+        // boundaries line up with the other peers' (beat minus phase is one of them)
+        double getBeatAtTime(std::chrono::microseconds time, double quantumToUse) const { return state.beatAtTime(time, quantumToUse); }
+        double getPhaseAtTime(std::chrono::microseconds time, double quantumToUse) const { return state.phaseAtTime(time, quantumToUse); }
+        std::chrono::microseconds getTimeAtBeat(double beat, double quantumToUse) const { return state.timeAtBeat(beat, quantumToUse); }
+        
+        // When the transport last started or stopped
+        std::chrono::microseconds getTimeForIsPlaying() const { return state.timeForIsPlaying(); }
+        
+    private:
+        friend class LinkManager;
+        
+        Timeline(const ableton::Link::SessionState& stateToUse, double quantumToUse)
+            : state(stateToUse), quantum(quantumToUse) {}
+        
+        ableton::Link::SessionState state;
+        double quantum;
+    };
+    
+    // Empty until initialize() has been called
+    std::optional<Timeline> captureTimeline() const;
+    
+    // The same, but safe to call from the audio thread, which mustn't use captureTimeline()
+    std::optional<Timeline> captureAudioTimeline() const;
+    
     // Explicitly set the beat position
     void setBeatPosition(double position);
     
@@ -289,16 +289,10 @@ bool PluginListComponent::loadPlugin(int index)
         // Add the plugin to the audio engine's processor graph
         auto nodeID = audioEngine.addPluginProcessor(std::move(pluginInstance));
         
-        // Connect to input and output nodes if successful
+        // Connect the plugin's main buses to the device inputs and outputs if successful
         if (nodeID.isValid())
         {
-            // Connect to input (assuming stereo)
-            audioEngine.connectNodes(audioEngine.getInputNode(), 0, nodeID, 0);
-            audioEngine.connectNodes(audioEngine.getInputNode(), 1, nodeID, 1);
-            
-            // Connect to output (assuming stereo)
-            audioEngine.connectNodes(nodeID, 0, audioEngine.getOutputNode(), 0);
-            audioEngine.connectNodes(nodeID, 1, audioEngine.getOutputNode(), 1);
+            audioEngine.connectToAudioIO(nodeID);
             
             juce::MouseCursor::hideWaitCursor();
             return true;
@@ -15,6 +15,9 @@
 // Core includes
 #include "core/audio/AudioEngine.h"
 #include "core/midi/MidiManager.h"
+#include "core/plugin/PluginManager.h"
+#include "core/plugin/PluginSandboxWorker.h"
+#include "core/plugin/SandboxProtocol.h"
 
 // Simplified basic application for initial testing
 class SimpleAudioApp : public juce::JUCEApplication
@@ -24,10 +27,26 @@ public:
 
     const juce::String getApplicationName() override { return "VSTLinkHost"; }
     const juce::String getApplicationVersion() override { return "0.1.0"; }
-    bool moreThanOneInstanceAllowed() override { return false; }
+
+    // Plugin sandboxes are more copies of this app, running alongside the main one
+    bool moreThanOneInstanceAllowed() override
+    {
+        return getCommandLineParameters().contains(SandboxProtocol::commandLineUID);
+    }
 
     void initialise(const juce::String& commandLine) override
     {
+        // Launched by a PluginSandbox: host plugins for it instead of opening the app
+        if (commandLine.contains(SandboxProtocol::commandLineUID))
+        {
+            sandboxWorker = std::make_unique<PluginSandboxWorker>();
+
+            if (! sandboxWorker->initialiseFromCommandLine(commandLine, SandboxProtocol::commandLineUID))
+                quit();
+
+            return;
+        }
+
         std::cout << "Initializing VSTLinkHost (Basic Version)..." << std::endl;
         
         // Initialize components
@@ -35,9 +54,28 @@ public:
         midiManager = std::make_unique<MidiManager>();
         
         // Start components
+        midiManager->setInputPorts(&audioEngine->getMidiInputPorts());
+        midiManager->setOutputQueue(&audioEngine->getMidiOutputQueue());
+        midiManager->setRoutingCallback([engine = audioEngine.get()](std::shared_ptr<const MidiRoutingTable> table)
+        {
+            engine->setMidiRouting(std::move(table));
+        });
         midiManager->initialize();
         audioEngine->start();
         
+        // Plugins named on the command line run in sandboxes unless told otherwise
+        pluginManager = std::make_unique<PluginManager>();
+        pluginManager->setSandboxMode(commandLine.contains("--no-sandbox") ? PluginManager::SandboxMode::off
+                                                                            : PluginManager::SandboxMode::perPlugin);
+        pluginManager->setSandboxCrashCallback([](const juce::StringArray& pluginNames)
+        {
+            juce::Logger::writeToLog("Plugin sandbox crashed, taking down: " + pluginNames.joinIntoString(", "));
+        });
+        
+        for (const auto& argument : getCommandLineParameterArray())
+            if (argument.startsWith("--plugin="))
+                loadPlugin(argument.fromFirstOccurrenceOf("=", false, false).unquoted());
+        
         // Create a simple window
         mainWindow = std::make_unique<MainWindow>(getApplicationName());
     }
@@ -45,7 +83,15 @@ public:
     void shutdown() override
     {
         mainWindow = nullptr;
-        audioEngine->stop();
+        sandboxWorker = nullptr;
+
+        if (audioEngine != nullptr)
+            audioEngine->stop();
+
+        // The engine's graph holds the plugins, which hold their sandboxes
+        midiManager = nullptr;
+        audioEngine = nullptr;
+        pluginManager = nullptr;
     }
 
     void systemRequestedQuit() override
@@ -110,9 +156,37 @@ public:
     };
 
 private:
+    // Add the first plugin in a file to the graph, between the device's input and output
+    void loadPlugin(const juce::String& filePath)
+    {
+        juce::OwnedArray<juce::PluginDescription> descriptions;
+
+        if (! pluginManager->findPluginTypes(filePath, descriptions))
+        {
+            std::cout << "No plugin found in " << filePath << std::endl;
+            return;
+        }
+
+        juce::String errorMessage;
+        auto instance = pluginManager->createPluginInstance(*descriptions[0],
+                                                            audioEngine->getSampleRate(),
+                                                            audioEngine->getBufferSize(),
+                                                            errorMessage);
+
+        if (instance == nullptr)
+        {
+            std::cout << "Couldn't load " << filePath << ": " << errorMessage << std::endl;
+            return;
+        }
+
+        audioEngine->connectToAudioIO(audioEngine->addPluginProcessor(std::move(instance)));
+    }
+
     std::unique_ptr<MainWindow> mainWindow;
     std::unique_ptr<AudioEngine> audioEngine;
     std::unique_ptr<MidiManager> midiManager;
+    std::unique_ptr<PluginManager> pluginManager;
+    std::unique_ptr<PluginSandboxWorker> sandboxWorker;
 };
 
 // This macro will start the application
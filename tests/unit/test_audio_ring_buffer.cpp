@@ -0,0 +1,122 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/audio/AudioRingBuffer.h"
+#include <vector>
+
+// AudioRingBuffer carries samples by their position on the play head's timeline, so a
+// read finds what was written for that position however the two sides line up
+class AudioRingBufferTests : public juce::UnitTest
+{
+public:
+    AudioRingBufferTests() : juce::UnitTest("AudioRingBuffer", "Audio") {}
+
+    void runTest() override
+    {
+        beginTest("Reads what was written at the same position");
+        {
+            AudioRingBuffer ring(64, 16);
+            write(ring, 100, 32);
+
+            expect(matches(ring.read(100, 16), 100, 16));
+            expect(matches(ring.read(116, 16), 116, 16));
+            expectEquals((int) ring.getNumUnderruns(), 0);
+        }
+
+        beginTest("A read that starts before the audio gets silence up to it");
+        {
+            AudioRingBuffer ring(64, 16);
+            write(ring, 1000, 16);
+
+            const auto* samples = ring.read(992, 16);
+            expect(isSilent(samples, 8));
+            expect(matches(samples + 8, 1000, 8));
+            expectEquals((int) ring.getNumUnderruns(), 1);
+        }
+
+        beginTest("A read past the audio gets silence and counts an underrun");
+        {
+            AudioRingBuffer ring(64, 16);
+            write(ring, 0, 8);
+
+            const auto* samples = ring.read(0, 16);
+            expect(matches(samples, 0, 8));
+            expect(isSilent(samples + 8, 8));
+            expectEquals((int) ring.getNumUnderruns(), 1);
+
+            // The reader has moved on regardless
+            expect(ring.canWrite(16, 64, 0));
+            expect(! ring.canWrite(17, 64, 0));
+        }
+
+        beginTest("Audio before a gap is never read as leading up to what follows it");
+        {
+            AudioRingBuffer ring(64, 16);
+            write(ring, 0, 16);
+            write(ring, 24, 16);
+
+            const auto* samples = ring.read(16, 16);
+            expect(isSilent(samples, 8));
+            expect(matches(samples + 8, 24, 8));
+        }
+
+        beginTest("Writes wrap around the end of the ring");
+        {
+            AudioRingBuffer ring(48, 16);
+
+            for (juce::int64 position = 0; position < 480; position += 16)
+            {
+                expect(ring.canWrite(position, 16, position));
+                write(ring, position, 16);
+                expect(matches(ring.read(position, 16), position, 16));
+            }
+
+            expectEquals((int) ring.getNumUnderruns(), 0);
+        }
+
+        beginTest("The writer waits for the reader to make room");
+        {
+            AudioRingBuffer ring(32, 16);
+
+            // Until the first read, the caller says where the reader is
+            expect(ring.canWrite(500, 32, 500));
+            expect(! ring.canWrite(500, 33, 500));
+
+            write(ring, 500, 32);
+            ring.read(500, 16);
+
+            expect(ring.canWrite(532, 16, 0));
+            expect(! ring.canWrite(532, 17, 0));
+        }
+    }
+
+private:
+    // A ramp whose values are their timeline positions, so any misplaced sample shows
+    static void write(AudioRingBuffer& ring, juce::int64 position, int numSamples)
+    {
+        std::vector<float> samples((size_t) numSamples);
+
+        for (int i = 0; i < numSamples; ++i)
+            samples[(size_t) i] = (float) (position + i);
+
+        ring.write(samples.data(), numSamples, position);
+    }
+
+    static bool matches(const float* samples, juce::int64 position, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            if (samples[i] != (float) (position + i))
+                return false;
+
+        return true;
+    }
+
+    static bool isSilent(const float* samples, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            if (samples[i] != 0.0f)
+                return false;
+
+        return true;
+    }
+};
+
+static AudioRingBufferTests audioRingBufferTests;
@@ -1,9 +1,63 @@
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
 
-int main(int argc, char** argv) {
+namespace
+{
+    // Prints the runner's output, and counts JUCE assertions, which JUCE_LOG_ASSERTIONS
+    // sends here, as failures. Leaks are only reported once main has returned, so an
+    // assertion then ends the run with a failure there and then.
+    class TestLogger : public juce::Logger
+    {
+    public:
+        void logMessage(const juce::String& message) override
+        {
+            std::cout << message << std::endl;
+
+            if (! message.startsWith("JUCE Assertion failure"))
+                return;
+
+            ++numAssertions;
+
+            if (mainHasReturned)
+                std::_Exit(1);
+        }
+
+        std::atomic<int> numAssertions { 0 };
+        std::atomic<bool> mainHasReturned { false };
+    };
+
+    // Never deleted, as leaks are reported while statics are being destroyed
+    TestLogger& logger = *new TestLogger();
+}
+
+// Runs every juce::UnitTest linked into the executable; each test file registers its
+// own with a static instance
+int main(int argc, char** argv)
+{
+    juce::ignoreUnused(argc, argv);
+    juce::Logger::setCurrentLogger(&logger);
     std::cout << "Running unit tests..." << std::endl;
-    
-    // Add your test framework initialization here
-    
-    return 0; // Return non-zero if tests fail
+
+    int numFailures = 0;
+
+    {
+        // A message manager for the timers and async calls under test, as the app has
+        const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+        juce::UnitTestRunner runner;
+        runner.setAssertOnFailure(false);
+        runner.runAllTests();
+
+        for (int i = 0; i < runner.getNumResults(); ++i)
+            numFailures += runner.getResult(i)->failures;
+    }
+
+    if (logger.numAssertions > 0)
+        std::cout << logger.numAssertions << " JUCE assertion(s) failed" << std::endl;
+
+    logger.mainHasReturned = true;
+    return numFailures > 0 || logger.numAssertions > 0 ? 1 : 0;
 }
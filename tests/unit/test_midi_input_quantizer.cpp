@@ -0,0 +1,241 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/midi/MidiInputQuantizer.h"
+#include "core/midi/MidiRecorder.h"
+#include "core/sync/LinkManager.h"
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 480;
+    const auto blockDuration = std::chrono::microseconds((int) (1.0e6 * blockSize / sampleRate));
+
+    struct Released
+    {
+        juce::MidiMessage message;
+        int samplePosition = 0;
+        double beat = 0.0;
+    };
+
+    void addMessage(MidiInputBlock& block, int samplePosition, const juce::MidiMessage& message)
+    {
+        block.numPorts = 1;
+
+        UmpTranslator::fromMidi1(message.getRawData(), message.getRawDataSize(),
+                                 [&](const uint32_t* words) { block.ports[0].add(samplePosition, words); });
+    }
+
+    // What came out of port 0, with the beat the quantizer noted for each, or NaN
+    std::vector<Released> collect(const MidiInputBlock& block)
+    {
+        std::vector<Released> released;
+        UmpTranslator translator;
+
+        for (const auto& event : block.ports[0])
+        {
+            const auto index = (size_t) (&event - block.ports[0].begin());
+            const auto beat = block.hasReleaseBeats[0] ? block.releaseBeats[0][index] : std::nan("");
+
+            translator.toMidi1(event.words, [&](const uint8_t* data, int numBytes)
+            {
+                released.push_back({ juce::MidiMessage(data, numBytes), event.samplePosition, beat });
+            });
+        }
+
+        return released;
+    }
+}
+
+// MidiInputQuantizer against a Link timeline captured once, with each block's time on
+// Link's clock given rather than read, so where the grid falls is fixed: held notes go
+// on the grid, their note-offs keep the notes' lengths, and nothing is left held once
+// the grid is off
+class MidiInputQuantizerTests : public juce::UnitTest
+{
+public:
+    MidiInputQuantizerTests() : juce::UnitTest("MidiInputQuantizer", "MIDI") {}
+
+    void runTest() override
+    {
+        using Message = juce::MidiMessage;
+
+        LinkManager linkManager;
+        linkManager.initialize(120.0);
+
+        const auto timeline = *linkManager.captureTimeline();
+
+        beginTest("Without a Link session nothing is held");
+        {
+            MidiInputQuantizer quantizer;
+            quantizer.setSettings(0, { 1.0, false });
+
+            MidiInputBlock block;
+            block.clear();
+            addMessage(block, 100, Message::noteOn(1, 60, (juce::uint8) 100));
+            quantizer.processBlock(block, sampleRate, blockSize, 0);
+
+            const auto released = collect(block);
+            expectEquals((int) released.size(), 1);
+            expect(released.size() == 1 && released[0].samplePosition == 100);
+        }
+
+        beginTest("Notes go on the grid and keep their length, and the recorder stamps them with the grid beat");
+        {
+            constexpr double grid = 0.25;
+
+            MidiInputQuantizer quantizer;
+            quantizer.setLinkManager(&linkManager);
+            quantizer.setSettings(0, { grid, false });
+
+            MidiRecorder recorder(256, 4);
+            recorder.setLinkManager(&linkManager);
+            recorder.start();
+
+            // A note 240 samples long, which at 120 BPM is a hundredth of a beat. The block
+            // starts at beat 8.1, so the note arrived at 8.08, 0.17 before the next sixteenth.
+            MidiInputBlock block;
+            block.clear();
+            addMessage(block, 0, Message::noteOn(1, 60, (juce::uint8) 100));
+            addMessage(block, 240, Message::noteOff(1, 60, (juce::uint8) 0));
+
+            std::vector<Released> released;
+            std::vector<int> releaseBlocks;
+            auto now = timeline.getTimeAtBeat(8.1, grid);
+            int64_t blockStart = 0;
+
+            // Each block is a fiftieth of a beat; a beat is plenty for both to come out
+            for (int i = 0; i < 50; ++i)
+            {
+                quantizer.processBlock(block, sampleRate, blockSize, 0, timeline, now);
+                recorder.recordBlock(block, blockStart, sampleRate, blockSize);
+
+                for (const auto& event : collect(block))
+                {
+                    released.push_back(event);
+                    releaseBlocks.push_back(i);
+                }
+
+                now += blockDuration;
+                blockStart += blockSize;
+                block.clear();
+                block.numPorts = 1;
+            }
+
+            expectEquals((int) released.size(), 2);
+
+            // 8.25 is heard 0.15 beats, or 7.5 blocks, after the first block starts
+            expect(releaseBlocks == std::vector<int> { 7, 8 });
+
+            if (released.size() == 2)
+            {
+                const auto& noteOn = released[0];
+                const auto& noteOff = released[1];
+
+                expect(noteOn.message.isNoteOn() && noteOff.message.isNoteOff());
+                expect(! std::isnan(noteOn.beat) && ! std::isnan(noteOff.beat));
+
+                expectWithinAbsoluteError(noteOn.beat, 8.25, 1.0e-4);
+                expectWithinAbsoluteError(noteOff.beat, 8.26, 1.0e-4);
+                expectEquals(noteOn.samplePosition, blockSize / 2);
+
+                expectEquals((int) recorder.getNumEvents(), 2);
+                expectWithinAbsoluteError(recorder.getEvent(0).beat, noteOn.beat, 1.0e-9);
+                expectWithinAbsoluteError(recorder.getEvent(1).beat, noteOff.beat, 1.0e-9);
+            }
+        }
+
+        beginTest("A note-off with no room to wait takes its held note-on with it");
+        {
+            MidiInputQuantizer quantizer(2);
+            quantizer.setSettings(0, { 1.0, false });
+
+            // Both note-ons wait for beat 11 and fill the queue, so the note-off can't
+            MidiInputBlock block;
+            block.clear();
+            addMessage(block, 0, Message::noteOn(1, 60, (juce::uint8) 100));
+            addMessage(block, 10, Message::noteOn(1, 61, (juce::uint8) 100));
+            addMessage(block, 240, Message::noteOff(1, 60, (juce::uint8) 0));
+
+            auto now = timeline.getTimeAtBeat(10.5, 1.0);
+            quantizer.processBlock(block, sampleRate, blockSize, 0, timeline, now);
+
+            auto released = collect(block);
+            expectEquals((int) released.size(), 2);
+            expectEquals((int) quantizer.getNumOverflowed(), 1);
+
+            if (released.size() == 2)
+            {
+                expect(released[0].message.isNoteOn() && released[0].message.getNoteNumber() == 60);
+                expect(released[1].message.isNoteOff() && released[1].message.getNoteNumber() == 60);
+                expectEquals(released[0].samplePosition, 240);
+                expectEquals(released[1].samplePosition, 240);
+            }
+
+            // The other note still goes on the grid
+            released.clear();
+
+            for (int i = 0; i < 50; ++i)
+            {
+                block.clear();
+                block.numPorts = 1;
+                now += blockDuration;
+                quantizer.processBlock(block, sampleRate, blockSize, 0, timeline, now);
+
+                for (const auto& event : collect(block))
+                    released.push_back(event);
+            }
+
+            expectEquals((int) released.size(), 1);
+
+            if (released.size() == 1)
+            {
+                expect(released[0].message.isNoteOn() && released[0].message.getNoteNumber() == 61);
+                expectWithinAbsoluteError(released[0].beat, 11.0, 1.0e-4);
+            }
+        }
+
+        beginTest("Turning the grid off lets held notes go, and their note-offs straight after");
+        {
+            MidiInputQuantizer quantizer;
+            quantizer.setLinkManager(&linkManager);
+            quantizer.setSettings(0, { 16.0, false });
+
+            auto now = timeline.getTimeAtBeat(1.0, 16.0);
+
+            MidiInputBlock block;
+            block.clear();
+            addMessage(block, 0, Message::noteOn(1, 60, (juce::uint8) 100));
+            quantizer.processBlock(block, sampleRate, blockSize, 0, timeline, now);
+
+            // It waits until beat 16
+            expect(collect(block).empty());
+
+            quantizer.setSettings(0, { 0.0, false });
+
+            block.clear();
+            addMessage(block, 100, Message::noteOff(1, 60, (juce::uint8) 0));
+            now += blockDuration;
+            quantizer.processBlock(block, sampleRate, blockSize, 0, timeline, now);
+
+            const auto released = collect(block);
+            expectEquals((int) released.size(), 2);
+
+            if (released.size() == 2)
+            {
+                expect(released[0].message.isNoteOn() && released[0].samplePosition == 0);
+                expect(released[1].message.isNoteOff() && released[1].samplePosition == 100);
+            }
+
+            // Nothing is left waiting
+            block.clear();
+            block.numPorts = 1;
+            now += blockDuration;
+            quantizer.processBlock(block, sampleRate, blockSize, 0, timeline, now);
+            expect(collect(block).empty());
+        }
+    }
+};
+
+static MidiInputQuantizerTests midiInputQuantizerTests;
@@ -0,0 +1,114 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/midi/MidiInputQueue.h"
+#include "core/midi/UmpTranslator.h"
+#include <vector>
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 480;
+
+    // A block is a hundredth of a second, and the one being popped ends at 10 s
+    constexpr double blockEndTime = 10.0;
+    constexpr double blockStartTime = blockEndTime - blockSize / sampleRate;
+
+    juce::MidiMessage at(juce::MidiMessage message, double timestamp)
+    {
+        message.setTimeStamp(timestamp);
+        return message;
+    }
+
+    // Where each packet in a block was placed
+    std::vector<int> positionsIn(const UmpBuffer& buffer)
+    {
+        std::vector<int> positions;
+
+        for (const auto& event : buffer)
+            positions.push_back(event.samplePosition);
+
+        return positions;
+    }
+}
+
+// MidiInputQueue placing events in the block after the one they arrived in, at the
+// sample their timestamp gives
+class MidiInputQueueTests : public juce::UnitTest
+{
+public:
+    MidiInputQueueTests() : juce::UnitTest("MidiInputQueue", "MIDI") {}
+
+    void runTest() override
+    {
+        using Message = juce::MidiMessage;
+
+        beginTest("Events go at the sample their timestamp falls on in the block's window");
+        {
+            MidiInputQueue queue;
+            UmpBuffer block;
+
+            // A quarter and three quarters of the way through, and just over half a sample before the end
+            expect(queue.push(at(Message::noteOn(1, 60, (juce::uint8) 100), blockStartTime + 0.0025)));
+            expect(queue.push(at(Message::noteOff(1, 60, (juce::uint8) 0), blockStartTime + 0.0075)));
+            expect(queue.push(at(Message::controllerEvent(1, 7, 64), blockEndTime - 0.6 / sampleRate)));
+
+            queue.popBlock(block, blockEndTime, sampleRate, blockSize);
+            expect(positionsIn(block) == std::vector<int> { 120, 360, blockSize - 1 });
+
+            const auto stats = queue.getTimingStats();
+            expectEquals((int) stats.numEvents, 3);
+            expectEquals((int) stats.numDisplaced, 0);
+            expect(stats.maxErrorSamples <= 0.5);
+        }
+
+        beginTest("Events stamped at or after the block's end wait for the next one");
+        {
+            MidiInputQueue queue;
+            UmpBuffer block;
+
+            expect(queue.push(at(Message::noteOn(1, 60, (juce::uint8) 100), blockEndTime)));
+            expect(queue.push(at(Message::noteOn(1, 62, (juce::uint8) 100), blockEndTime + 0.005)));
+
+            queue.popBlock(block, blockEndTime, sampleRate, blockSize);
+            expect(block.isEmpty());
+
+            queue.popBlock(block, blockEndTime + blockSize / sampleRate, sampleRate, blockSize);
+            expect(positionsIn(block) == std::vector<int> { 0, 240 });
+        }
+
+        beginTest("Events from before the window, after a late callback, go at its start and are counted");
+        {
+            MidiInputQueue queue;
+            UmpBuffer block;
+
+            expect(queue.push(at(Message::noteOn(1, 60, (juce::uint8) 100), blockStartTime - 0.003)));
+            queue.popBlock(block, blockEndTime, sampleRate, blockSize);
+
+            expect(positionsIn(block) == std::vector<int> { 0 });
+            expectEquals((int) queue.getTimingStats().numDisplaced, 1);
+            expectWithinAbsoluteError(queue.getTimingStats().maxErrorSamples, 0.003 * sampleRate, 1.0e-6);
+        }
+
+        beginTest("A SysEx goes in whole or not at all");
+        {
+            // Thirteen bytes of SysEx data take three packets of six, and only two fit
+            MidiInputQueue queue(2);
+            const uint8_t data[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13 };
+            const auto sysex = at(Message::createSysExMessage(data, (int) sizeof(data)), blockStartTime);
+
+            expect(! queue.push(sysex));
+            expectEquals((int) queue.getTimingStats().numDropped, 1);
+
+            UmpBuffer block;
+            queue.popBlock(block, blockEndTime, sampleRate, blockSize);
+            expect(block.isEmpty());
+
+            // With room for it, every packet lands at the same sample
+            MidiInputQueue roomier(4);
+            expect(roomier.push(sysex));
+            roomier.popBlock(block, blockEndTime, sampleRate, blockSize);
+            expect(positionsIn(block) == std::vector<int> { 0, 0, 0 });
+        }
+    }
+};
+
+static MidiInputQueueTests midiInputQueueTests;
@@ -0,0 +1,119 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/midi/MidiOutputQueue.h"
+#include <vector>
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+
+    // The scheduler counts positions in milliseconds
+    constexpr double positionsPerSecond = 1000.0;
+
+    juce::MidiBuffer bufferOf(const std::vector<std::pair<juce::MidiMessage, int>>& events)
+    {
+        juce::MidiBuffer buffer;
+
+        for (const auto& [message, samplePosition] : events)
+            buffer.addEvent(message, samplePosition);
+
+        return buffer;
+    }
+
+    // Where each event taken from the queue was put
+    std::vector<int> positionsIn(const juce::MidiBuffer& buffer)
+    {
+        std::vector<int> positions;
+
+        for (const auto metadata : buffer)
+            positions.push_back(metadata.samplePosition);
+
+        return positions;
+    }
+}
+
+// MidiOutputQueue stamping each block's events with when they should be heard, and the
+// scheduler placing them from those times
+class MidiOutputQueueTests : public juce::UnitTest
+{
+public:
+    MidiOutputQueueTests() : juce::UnitTest("MidiOutputQueue", "MIDI") {}
+
+    void runTest() override
+    {
+        using Message = juce::MidiMessage;
+        const auto noteOn = Message::noteOn(1, 60, (juce::uint8) 100);
+        const auto noteOff = Message::noteOff(1, 60, (juce::uint8) 0);
+
+        beginTest("Events go at their sample's time, counted from when the scheduler takes them");
+        {
+            MidiOutputQueue queue;
+
+            // A block heard from 10 s, with events at its start, 5 ms and 10 ms in
+            queue.pushBlock(bufferOf({ { noteOn, 0 }, { noteOff, 240 }, { noteOn, 480 } }), 10.0, sampleRate);
+
+            juce::MidiBuffer pending;
+            expectEquals(queue.popAll(pending, 9.998, positionsPerSecond), 3);
+            expect(positionsIn(pending) == std::vector<int> { 2, 7, 12 });
+
+            const auto stats = queue.getStats();
+            expectEquals((int) stats.numEvents, 3);
+            expectEquals((int) stats.numLate, 0);
+            expectEquals((int) stats.numDropped, 0);
+
+            // Nothing is left to take
+            pending.clear();
+            expectEquals(queue.popAll(pending, 10.0, positionsPerSecond), 0);
+            expect(pending.isEmpty());
+        }
+
+        beginTest("Events taken after their time go straight away, and are counted as late");
+        {
+            MidiOutputQueue queue;
+            queue.pushBlock(bufferOf({ { noteOn, 0 }, { noteOff, 480 } }), 10.0, sampleRate);
+
+            juce::MidiBuffer pending;
+            expectEquals(queue.popAll(pending, 10.004, positionsPerSecond), 2);
+            expect(positionsIn(pending) == std::vector<int> { 0, 6 });
+            expectEquals((int) queue.getStats().numLate, 1);
+        }
+
+        beginTest("SysEx longer than an event's space is dropped, and what follows still goes");
+        {
+            MidiOutputQueue queue;
+            std::vector<uint8_t> data(MidiOutputQueue::maxEventBytes, 0x10);
+
+            // The F0 and F7 make two bytes more than the data
+            const auto fits = Message::createSysExMessage(data.data(), MidiOutputQueue::maxEventBytes - 2);
+            const auto tooLong = Message::createSysExMessage(data.data(), MidiOutputQueue::maxEventBytes - 1);
+            queue.pushBlock(bufferOf({ { tooLong, 0 }, { fits, 0 }, { noteOn, 48 } }), 10.0, sampleRate);
+
+            juce::MidiBuffer pending;
+            expectEquals(queue.popAll(pending, 10.0, positionsPerSecond), 2);
+            expect(positionsIn(pending) == std::vector<int> { 0, 1 });
+            expectEquals((int) queue.getStats().numDropped, 1);
+
+            const auto first = *pending.begin();
+            expectEquals(first.numBytes, MidiOutputQueue::maxEventBytes);
+            expect(first.getMessage().isSysEx());
+        }
+
+        beginTest("A full queue drops what doesn't fit until the scheduler catches up");
+        {
+            MidiOutputQueue queue(2);
+            queue.pushBlock(bufferOf({ { noteOn, 0 }, { noteOff, 48 }, { noteOn, 96 } }), 10.0, sampleRate);
+            expectEquals((int) queue.getStats().numDropped, 1);
+
+            juce::MidiBuffer pending;
+            expectEquals(queue.popAll(pending, 10.0, positionsPerSecond), 2);
+            expect(positionsIn(pending) == std::vector<int> { 0, 1 });
+
+            queue.pushBlock(bufferOf({ { noteOff, 0 } }), 10.01, sampleRate);
+            pending.clear();
+            expectEquals(queue.popAll(pending, 10.0, positionsPerSecond), 1);
+            expect(positionsIn(pending) == std::vector<int> { 10 });
+            expectEquals((int) queue.getStats().numDropped, 1);
+        }
+    }
+};
+
+static MidiOutputQueueTests midiOutputQueueTests;
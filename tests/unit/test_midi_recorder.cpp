@@ -0,0 +1,181 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/midi/MidiRecorder.h"
+#include <vector>
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 480;
+
+    void addMessage(MidiInputBlock& block, int port, int samplePosition, const juce::MidiMessage& message)
+    {
+        block.numPorts = juce::jmax(block.numPorts, port + 1);
+
+        UmpTranslator::fromMidi1(message.getRawData(), message.getRawDataSize(),
+                                 [&](const uint32_t* words) { block.ports[(size_t) port].add(samplePosition, words); });
+    }
+
+    // Without a Link session, beats count at 120 BPM from sample 0
+    double beatAtSample(int64_t samplePosition)
+    {
+        return (double) samplePosition / sampleRate * 2.0;
+    }
+}
+
+// What MidiRecorder keeps of each event, and finding events again after the play head
+// was moved back or the recording cleared
+class MidiRecorderTests : public juce::UnitTest
+{
+public:
+    MidiRecorderTests() : juce::UnitTest("MidiRecorder", "MIDI") {}
+
+    void runTest() override
+    {
+        using Message = juce::MidiMessage;
+
+        beginTest("Nothing is recorded until started");
+        {
+            MidiRecorder recorder(64, 4);
+            MidiInputBlock block;
+            addMessage(block, 0, 0, Message::noteOn(1, 60, (juce::uint8) 100));
+
+            recorder.recordBlock(block, 0, sampleRate, blockSize);
+            expectEquals((int) recorder.getNumEvents(), 0);
+        }
+
+        beginTest("Events keep their position, beat, port and bytes, in time order across ports");
+        {
+            MidiRecorder recorder(64, 4);
+            recorder.start();
+
+            MidiInputBlock block;
+            addMessage(block, 0, 10, Message::noteOn(1, 60, (juce::uint8) 100));
+            addMessage(block, 1, 5, Message::controllerEvent(2, 7, 90));
+            recorder.recordBlock(block, 48000, sampleRate, blockSize);
+
+            expectEquals((int) recorder.getNumEvents(), 2);
+
+            const auto first = recorder.getEvent(0);
+            expectEquals((juce::int64) first.samplePosition, (juce::int64) 48005);
+            expectWithinAbsoluteError(first.beat, beatAtSample(48005), 1.0e-9);
+            expectEquals(first.port, 1);
+            expect(first.message.isControllerOfType(7) && first.message.getControllerValue() == 90);
+
+            const auto second = recorder.getEvent(1);
+            expectEquals((juce::int64) second.samplePosition, (juce::int64) 48010);
+            expectEquals(second.port, 0);
+            expect(second.message.isNoteOn() && second.message.getNoteNumber() == 60);
+        }
+
+        beginTest("SysEx longer than a byte can count comes back whole");
+        {
+            MidiRecorder recorder(64, 4);
+            recorder.start();
+
+            std::vector<uint8_t> data(300);
+
+            for (size_t i = 0; i < data.size(); ++i)
+                data[i] = (uint8_t) (i & 0x7f);
+
+            const auto sysEx = Message::createSysExMessage(data.data(), (int) data.size());
+
+            MidiInputBlock block;
+            addMessage(block, 0, 0, sysEx);
+            recorder.recordBlock(block, 0, sampleRate, blockSize);
+
+            expectEquals((int) recorder.getNumEvents(), 1);
+            const auto event = recorder.getEvent(0);
+            expect(event.message.isSysEx());
+            expectEquals(event.message.getSysExDataSize(), (int) data.size());
+            expect(std::equal(data.begin(), data.end(), event.message.getSysExData()));
+        }
+
+        beginTest("Searching by sample finds events recorded after the play head moved back");
+        {
+            MidiRecorder recorder(64, 4);
+            recorder.start();
+
+            MidiInputBlock block;
+            addMessage(block, 0, 0, Message::noteOn(1, 60, (juce::uint8) 100));
+            addMessage(block, 0, 10, Message::noteOff(1, 60, (juce::uint8) 0));
+            recorder.recordBlock(block, 1000, sampleRate, blockSize);
+
+            block.clear();
+            addMessage(block, 0, 0, Message::noteOn(1, 62, (juce::uint8) 100));
+            addMessage(block, 0, 20, Message::noteOff(1, 62, (juce::uint8) 0));
+            recorder.recordBlock(block, 0, sampleRate, blockSize);
+
+            expectEquals((int) recorder.getNumEvents(), 4);
+            expectEquals((int) recorder.findFirstEventAtSample(5), 0);
+            expectEquals((int) recorder.findFirstEventAtSample(1005), 1);
+            expectEquals((int) recorder.findFirstEventAtSample(1011), 4);
+
+            // Beats only ever go forwards in a session, and are searched as such
+            block.clear();
+            addMessage(block, 0, 0, Message::noteOn(1, 64, (juce::uint8) 100));
+            recorder.recordBlock(block, 96000, sampleRate, blockSize);
+            expectEquals((int) recorder.findFirstEventAtBeat(beatAtSample(96000)), 4);
+        }
+
+        beginTest("Clearing takes effect on the next block, and recording carries on");
+        {
+            MidiRecorder recorder(64, 4);
+            recorder.start();
+
+            MidiInputBlock block;
+            addMessage(block, 0, 0, Message::noteOn(1, 60, (juce::uint8) 100));
+            recorder.recordBlock(block, 0, sampleRate, blockSize);
+
+            recorder.clear();
+            expectEquals((int) recorder.getNumEvents(), 1);
+
+            block.clear();
+            addMessage(block, 0, 0, Message::noteOn(1, 67, (juce::uint8) 100));
+            recorder.recordBlock(block, 480, sampleRate, blockSize);
+
+            expectEquals((int) recorder.getNumEvents(), 1);
+            expectEquals(recorder.getEvent(0).message.getNoteNumber(), 67);
+            expectEquals((juce::int64) recorder.getEvent(0).samplePosition, (juce::int64) 480);
+        }
+
+        beginTest("Clearing while stopped doesn't wait for a block");
+        {
+            MidiRecorder recorder(64, 4);
+            recorder.start();
+
+            MidiInputBlock block;
+            addMessage(block, 0, 0, Message::noteOn(1, 60, (juce::uint8) 100));
+            recorder.recordBlock(block, 0, sampleRate, blockSize);
+            recorder.stop();
+
+            recorder.clear();
+            expectEquals((int) recorder.getNumEvents(), 0);
+            expectEquals(recorder.findFirstEventAtSample(0), (int64_t) 0);
+        }
+
+        beginTest("Pages started by moving the play head back get more spares ready");
+        {
+            MidiRecorder recorder(64, 16);
+            recorder.start();
+
+            const auto bytesPerPage = recorder.getMemoryUsage() / 2;
+
+            // The first block takes the first page and each jump back another, until none is ready
+            for (int i = 0; i < 3; ++i)
+            {
+                MidiInputBlock block;
+                addMessage(block, 0, 0, Message::noteOn(1, 60 + i, (juce::uint8) 100));
+                recorder.recordBlock(block, 48000 - i * blockSize, sampleRate, blockSize);
+            }
+
+            expectEquals((int) recorder.getNumEvents(), 2);
+            expectEquals((int) recorder.getNumDropped(), 1);
+
+            // Two were started, so four are kept ready beyond the one being filled
+            recorder.start();
+            expectEquals((int) (recorder.getMemoryUsage() / bytesPerPage), 7);
+        }
+    }
+};
+
+static MidiRecorderTests midiRecorderTests;
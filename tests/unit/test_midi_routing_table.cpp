@@ -0,0 +1,103 @@
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "core/midi/MidiRoutingTable.h"
+#include "core/midi/UmpTranslator.h"
+#include <vector>
+
+namespace
+{
+    using NodeID = MidiRoutingTable::NodeID;
+
+    const NodeID synth { 10 }, drums { 20 }, arpeggiator { 30 };
+
+    // Channel voice and system messages are one word
+    UmpEvent toUmp(const juce::MidiMessage& message)
+    {
+        UmpEvent event;
+        UmpTranslator::fromMidi1(message.getRawData(), message.getRawDataSize(),
+                                 [&](const uint32_t* words) { event.words[0] = words[0]; });
+        return event;
+    }
+
+    // The nodes an event from a port goes to, in the order lookup() gives them
+    std::vector<NodeID> destinationsOf(const MidiRoutingTable& table, int port, const juce::MidiMessage& message)
+    {
+        std::vector<NodeID> result;
+        const auto [first, last] = table.lookup(port, toUmp(message));
+
+        for (auto* index = first; index != last; ++index)
+            result.push_back(table.getDestinations()[*index]);
+
+        return result;
+    }
+}
+
+// MidiRoutingTable sending each event to the nodes routed from its port and channel
+class MidiRoutingTableTests : public juce::UnitTest
+{
+public:
+    MidiRoutingTableTests() : juce::UnitTest("MidiRoutingTable", "MIDI") {}
+
+    void runTest() override
+    {
+        using Message = juce::MidiMessage;
+        const auto noteOn = [](int channel) { return Message::noteOn(channel, 60, (juce::uint8) 100); };
+
+        beginTest("A channel's route only takes that channel, and channel 0 takes everything");
+        {
+            const MidiRoutingTable table({ { 0, 10, drums }, { 0, 0, synth } });
+
+            expect(destinationsOf(table, 0, noteOn(10)) == std::vector<NodeID> { drums, synth });
+            expect(destinationsOf(table, 0, noteOn(1)) == std::vector<NodeID> { synth });
+            expect(destinationsOf(table, 0, noteOn(16)) == std::vector<NodeID> { synth });
+
+            // Messages without a channel only go where every channel does
+            expect(destinationsOf(table, 0, Message::midiClock()) == std::vector<NodeID> { synth });
+            expect(destinationsOf(table, 0, Message::songPositionPointer(4)) == std::vector<NodeID> { synth });
+        }
+
+        beginTest("Routes from one port leave the others alone");
+        {
+            const MidiRoutingTable table({ { 1, 0, synth }, { 2, 3, arpeggiator } });
+            expectEquals(table.getNumPorts(), 3);
+
+            expect(destinationsOf(table, 0, noteOn(1)).empty());
+            expect(destinationsOf(table, 1, noteOn(3)) == std::vector<NodeID> { synth });
+            expect(destinationsOf(table, 2, noteOn(3)) == std::vector<NodeID> { arpeggiator });
+            expect(destinationsOf(table, 2, noteOn(4)).empty());
+
+            // Ports the table has never heard of go nowhere
+            expect(destinationsOf(table, 3, noteOn(1)).empty());
+            expect(destinationsOf(table, -1, noteOn(1)).empty());
+        }
+
+        beginTest("A node reached by more than one route gets each event once");
+        {
+            const MidiRoutingTable table({ { 0, 0, synth }, { 0, 5, synth }, { 0, 5, synth }, { 0, 5, drums } });
+
+            expect(destinationsOf(table, 0, noteOn(5)) == std::vector<NodeID> { synth, drums });
+            expect(destinationsOf(table, 0, noteOn(6)) == std::vector<NodeID> { synth });
+            expect(table.getDestinations() == std::vector<NodeID> { synth, drums });
+        }
+
+        beginTest("Routes from an invalid port or channel are dropped");
+        {
+            const MidiRoutingTable table({ { -1, 0, synth }, { 0, 17, drums }, { 0, -1, drums }, { 0, 2, arpeggiator } });
+
+            expectEquals(table.getNumRoutes(), 1);
+            expect(table.getDestinations() == std::vector<NodeID> { arpeggiator });
+            expect(destinationsOf(table, 0, noteOn(2)) == std::vector<NodeID> { arpeggiator });
+            expect(destinationsOf(table, 0, Message::midiClock()).empty());
+        }
+
+        beginTest("An empty table routes nothing");
+        {
+            const MidiRoutingTable table({});
+
+            expectEquals(table.getNumPorts(), 0);
+            expect(table.getDestinations().empty());
+            expect(destinationsOf(table, 0, noteOn(1)).empty());
+        }
+    }
+};
+
+static MidiRoutingTableTests midiRoutingTableTests;
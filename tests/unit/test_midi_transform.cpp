@@ -0,0 +1,169 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/midi/MidiTransform.h"
+#include <vector>
+
+// What each of MidiTransform's rules does to a block, and that note-offs follow their
+// note-ons through a change of rules
+class MidiTransformTests : public juce::UnitTest
+{
+public:
+    MidiTransformTests() : juce::UnitTest("MidiTransform", "MIDI") {}
+
+    void runTest() override
+    {
+        using Message = juce::MidiMessage;
+        using Rules = MidiTransform::Rules;
+
+        beginTest("Default rules pass everything unchanged");
+        {
+            MidiTransform transform;
+            expect(transform.isIdentity());
+
+            const std::vector<Message> input { Message::noteOn(1, 60, (juce::uint8) 100),
+                                               Message::controllerEvent(3, 7, 90),
+                                               Message::pitchWheel(16, 9000),
+                                               Message::midiClock(),
+                                               Message::noteOff(1, 60, (juce::uint8) 0) };
+
+            expectSame(run(transform, input), input);
+        }
+
+        beginTest("Transpose, dropping notes pushed out of range");
+        {
+            Rules rules;
+            rules.transpose = 12;
+            MidiTransform transform(rules);
+            expect(! transform.isIdentity());
+
+            expectSame(run(transform, { Message::noteOn(1, 60, (juce::uint8) 100),
+                                        Message::noteOn(1, 120, (juce::uint8) 100),
+                                        Message::noteOff(1, 60, (juce::uint8) 0),
+                                        Message::noteOff(1, 120, (juce::uint8) 0) }),
+                       { Message::noteOn(1, 72, (juce::uint8) 100),
+                         Message::noteOff(1, 72, (juce::uint8) 0) });
+        }
+
+        beginTest("Channel mask and message kinds");
+        {
+            Rules rules;
+            rules.channelMask = 0x0001;
+            rules.passControllers = false;
+            rules.passSystem = false;
+            MidiTransform transform(rules);
+
+            expectSame(run(transform, { Message::noteOn(1, 60, (juce::uint8) 100),
+                                        Message::noteOn(2, 62, (juce::uint8) 100),
+                                        Message::controllerEvent(1, 1, 64),
+                                        Message::programChange(1, 5),
+                                        Message::midiClock() }),
+                       { Message::noteOn(1, 60, (juce::uint8) 100),
+                         Message::programChange(1, 5) });
+        }
+
+        beginTest("Notes outside the velocity range are dropped with their note-offs");
+        {
+            Rules rules;
+            rules.lowestVelocity = 64;
+            MidiTransform transform(rules);
+
+            expectSame(run(transform, { Message::noteOn(1, 60, (juce::uint8) 30),
+                                        Message::noteOn(1, 62, (juce::uint8) 90),
+                                        Message::noteOff(1, 60, (juce::uint8) 0),
+                                        Message::noteOff(1, 62, (juce::uint8) 0) }),
+                       { Message::noteOn(1, 62, (juce::uint8) 90),
+                         Message::noteOff(1, 62, (juce::uint8) 0) });
+        }
+
+        beginTest("Velocity curve and fixed velocity");
+        {
+            Rules scaled;
+            scaled.lowestOutputVelocity = 20;
+            scaled.highestOutputVelocity = 100;
+            MidiTransform scaling(scaled);
+
+            expectSame(run(scaling, { Message::noteOn(1, 60, (juce::uint8) 1),
+                                      Message::noteOn(1, 61, (juce::uint8) 127) }),
+                       { Message::noteOn(1, 60, (juce::uint8) 20),
+                         Message::noteOn(1, 61, (juce::uint8) 100) });
+
+            Rules fixed;
+            fixed.fixedVelocity = 100;
+            MidiTransform fixing(fixed);
+
+            expectSame(run(fixing, { Message::noteOn(1, 60, (juce::uint8) 5),
+                                     Message::noteOn(1, 61, (juce::uint8) 127) }),
+                       { Message::noteOn(1, 60, (juce::uint8) 100),
+                         Message::noteOn(1, 61, (juce::uint8) 100) });
+        }
+
+        beginTest("Keyboard split sends each zone to its channel and transpose");
+        {
+            Rules rules;
+            rules.zones = { { 0, 59, 2, -12 }, { 60, 127, 3, 0 }, { 60, 127, 4, 0 } };
+            MidiTransform transform(rules);
+
+            expectSame(run(transform, { Message::noteOn(1, 48, (juce::uint8) 100),
+                                        Message::noteOn(1, 64, (juce::uint8) 100) }),
+                       { Message::noteOn(2, 36, (juce::uint8) 100),
+                         Message::noteOn(3, 64, (juce::uint8) 100) });
+        }
+
+        beginTest("Note-offs follow their note-ons through a change of rules");
+        {
+            Rules up;
+            up.transpose = 5;
+            Rules split;
+            split.zones = { { 0, 127, 9, 0 } };
+
+            MidiTransform before(up);
+            MidiTransform after(split);
+            MidiTransform::ActiveNotes activeNotes;
+
+            expectSame(run(before, { Message::noteOn(1, 60, (juce::uint8) 100) }, activeNotes),
+                       { Message::noteOn(1, 65, (juce::uint8) 100) });
+
+            expectSame(run(after, { Message::noteOff(1, 60, (juce::uint8) 0),
+                                    Message::noteOff(1, 62, (juce::uint8) 0) }, activeNotes),
+                       { Message::noteOff(1, 65, (juce::uint8) 0),
+                         Message::noteOff(9, 62, (juce::uint8) 0) });
+        }
+    }
+
+private:
+    static std::vector<juce::MidiMessage> run(const MidiTransform& transform,
+                                              const std::vector<juce::MidiMessage>& events,
+                                              MidiTransform::ActiveNotes& activeNotes)
+    {
+        juce::MidiBuffer input, output;
+
+        for (size_t i = 0; i < events.size(); ++i)
+            input.addEvent(events[i], (int) i);
+
+        output.ensureSize((size_t) input.data.size());
+        transform.processBlock(input, output, activeNotes);
+
+        std::vector<juce::MidiMessage> result;
+
+        for (const auto metadata : output)
+            result.push_back(metadata.getMessage());
+
+        return result;
+    }
+
+    static std::vector<juce::MidiMessage> run(const MidiTransform& transform, const std::vector<juce::MidiMessage>& events)
+    {
+        MidiTransform::ActiveNotes activeNotes;
+        return run(transform, events, activeNotes);
+    }
+
+    void expectSame(const std::vector<juce::MidiMessage>& actual, const std::vector<juce::MidiMessage>& expected)
+    {
+        expectEquals((int) actual.size(), (int) expected.size());
+
+        for (size_t i = 0; i < juce::jmin(actual.size(), expected.size()); ++i)
+            expect(actual[i].getDescription() == expected[i].getDescription(),
+                   actual[i].getDescription() + " instead of " + expected[i].getDescription());
+    }
+};
+
+static MidiTransformTests midiTransformTests;
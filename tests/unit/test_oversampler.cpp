@@ -0,0 +1,97 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/audio/Oversampler.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    constexpr int blockSize = 256;
+
+    // Take a signal up and straight back down again, a block at a time
+    std::vector<float> roundTrip(Oversampler& oversampler, const std::vector<float>& signal)
+    {
+        std::vector<float> result;
+        juce::AudioBuffer<float> buffer(1, blockSize);
+
+        for (size_t start = 0; start < signal.size(); start += blockSize)
+        {
+            buffer.clear();
+            std::copy(signal.begin() + (std::ptrdiff_t) start, signal.begin() + (std::ptrdiff_t) start + blockSize, buffer.getWritePointer(0));
+
+            oversampler.processUp(buffer, blockSize);
+            oversampler.processDown(buffer, blockSize);
+            result.insert(result.end(), buffer.getReadPointer(0), buffer.getReadPointer(0) + blockSize);
+        }
+
+        return result;
+    }
+
+    juce::String describe(int factor, Oversampler::Phase phase)
+    {
+        return juce::String(factor) + "x " + (phase == Oversampler::Phase::linear ? "linear" : "minimum") + " phase";
+    }
+}
+
+// Oversampler's reported latency against the delay of an impulse taken up and back
+// down, and its gain at DC, at every factor and phase
+class OversamplerTests : public juce::UnitTest
+{
+public:
+    OversamplerTests() : juce::UnitTest("Oversampler", "Audio") {}
+
+    void runTest() override
+    {
+        for (const auto phase : { Oversampler::Phase::linear, Oversampler::Phase::minimum })
+        {
+            for (const auto factor : { 2, 4, 8 })
+            {
+                beginTest("Latency matches an impulse's delay, " + describe(factor, phase));
+                {
+                    Oversampler oversampler(1, factor, phase);
+                    oversampler.prepare(blockSize);
+
+                    constexpr int impulseAt = 32;
+                    std::vector<float> impulse(4 * blockSize, 0.0f);
+                    impulse[impulseAt] = 1.0f;
+
+                    const auto response = roundTrip(oversampler, impulse);
+                    const auto latency = oversampler.getLatencyInOversampledSamples() / factor;
+
+                    // The delay at low frequencies is the response's centre of mass
+                    double sum = 0.0, moment = 0.0;
+
+                    for (size_t i = 0; i < response.size(); ++i)
+                    {
+                        sum += response[i];
+                        moment += response[i] * (double) i;
+                    }
+
+                    expectWithinAbsoluteError(moment / sum - impulseAt, latency, 0.05);
+
+                    // A linear phase response is symmetric, so it peaks there too
+                    if (phase == Oversampler::Phase::linear)
+                    {
+                        const auto peak = std::max_element(response.begin(), response.end()) - response.begin();
+                        expectWithinAbsoluteError((double) (peak - impulseAt), latency, 0.5);
+                    }
+                }
+
+                beginTest("DC comes back at unity gain, " + describe(factor, phase));
+                {
+                    Oversampler oversampler(1, factor, phase);
+                    oversampler.prepare(blockSize);
+
+                    const auto response = roundTrip(oversampler, std::vector<float>(8 * blockSize, 1.0f));
+
+                    // Once the filters have filled up
+                    const auto [lowest, highest] = std::minmax_element(response.end() - blockSize, response.end());
+                    expectWithinAbsoluteError(*lowest, 1.0f, 1.0e-4f);
+                    expectWithinAbsoluteError(*highest, 1.0f, 1.0e-4f);
+                }
+            }
+        }
+    }
+};
+
+static OversamplerTests oversamplerTests;
@@ -0,0 +1,212 @@
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "core/audio/RenderPlan.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 64;
+
+    using Graph = juce::AudioProcessorGraph;
+    using IOProcessor = Graph::AudioGraphIOProcessor;
+
+    // A mono plugin that delays its input by as many samples as it reports, and notes
+    // when it was processed
+    class DelayingProcessor : public juce::AudioProcessor
+    {
+    public:
+        DelayingProcessor(const juce::String& nameToUse, int latency, juce::StringArray& logToUse)
+            : juce::AudioProcessor(BusesProperties().withInput("Input", juce::AudioChannelSet::mono())
+                                                    .withOutput("Output", juce::AudioChannelSet::mono())),
+              name(nameToUse),
+              history((size_t) latency + 1, 0.0f),
+              log(logToUse)
+        {
+            setLatencySamples(latency);
+        }
+
+        const juce::String getName() const override { return name; }
+
+        void prepareToPlay(double, int) override {}
+        void releaseResources() override {}
+
+        void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&) override
+        {
+            log.add(name);
+            auto* samples = buffer.getWritePointer(0);
+
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+            {
+                history[position] = samples[i];
+                position = (position + 1) % history.size();
+                samples[i] = history[position];
+            }
+        }
+
+        double getTailLengthSeconds() const override { return 0.0; }
+        bool acceptsMidi() const override { return false; }
+        bool producesMidi() const override { return false; }
+        juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+        bool hasEditor() const override { return false; }
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram(int) override {}
+        const juce::String getProgramName(int) override { return {}; }
+        void changeProgramName(int, const juce::String&) override {}
+        void getStateInformation(juce::MemoryBlock&) override {}
+        void setStateInformation(const void*, int) override {}
+
+    private:
+        const juce::String name;
+        std::vector<float> history;
+        size_t position = 0;
+        juce::StringArray& log;
+    };
+
+    Graph::NodeID addProcessor(Graph& graph, const juce::String& name, int latency, juce::StringArray& log)
+    {
+        auto processor = std::make_unique<DelayingProcessor>(name, latency, log);
+        processor->setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor->prepareToPlay(sampleRate, blockSize);
+        return graph.addNode(std::move(processor), std::nullopt, Graph::UpdateKind::none)->nodeID;
+    }
+
+    void connect(Graph& graph, Graph::NodeID source, Graph::NodeID destination)
+    {
+        graph.addConnection({ { source, 0 }, { destination, 0 } }, Graph::UpdateKind::none);
+    }
+}
+
+// RenderPlan::compile putting nodes in processing order, and lining up parallel paths
+// with different latencies
+class RenderPlanTests : public juce::UnitTest
+{
+public:
+    RenderPlanTests() : juce::UnitTest("RenderPlan", "Audio") {}
+
+    void initialise() override
+    {
+        arena.prepare(1 << 16);
+        midiInput.clear();
+    }
+
+    void runTest() override
+    {
+        beginTest("Nodes run after what feeds them, whatever order they were added in");
+        {
+            Graph graph;
+            juce::StringArray log;
+            createGraph(graph, log);
+            const auto plan = compile(graph);
+            expectEquals(plan->getNumSteps(), 5);
+
+            for (int block = 0; block < 4; ++block)
+            {
+                std::vector<float> samples((size_t) blockSize, 0.0f);
+                render(*plan, samples);
+
+                // "late" before "after" in every block; "dry" may go anywhere
+                expectEquals(log.size(), 3);
+                expect(log.indexOf("late") >= 0 && log.indexOf("late") < log.indexOf("after"));
+                expect(log.contains("dry"));
+                log.clear();
+            }
+        }
+
+        beginTest("The dry branch is delayed by the latent branch's latency, and comes out sample-aligned with it");
+        {
+            Graph graph;
+            juce::StringArray log;
+            const auto nodes = createGraph(graph, log);
+            const auto plan = compile(graph);
+
+            expectEquals(plan->getNodeLatencySamples(nodes.input), 0);
+            expectEquals(plan->getNodeLatencySamples(nodes.late), 100);
+            expectEquals(plan->getNodeLatencySamples(nodes.after), 100);
+            expectEquals(plan->getNodeLatencySamples(nodes.dry), 0);
+            expectEquals(plan->getLatencySamples(), 100);
+
+            // Only the dry path into the output needs a delay line
+            expectEquals(plan->getNumDelayLines(), 1);
+
+            // An impulse comes out once, 100 samples on, at the height of both paths together
+            constexpr int impulseAt = 10;
+            std::vector<float> rendered;
+
+            for (int block = 0; block < 4; ++block)
+            {
+                std::vector<float> samples((size_t) blockSize, 0.0f);
+
+                if (block == 0)
+                    samples[(size_t) impulseAt] = 1.0f;
+
+                render(*plan, samples);
+                rendered.insert(rendered.end(), samples.begin(), samples.end());
+            }
+
+            const auto numNonZero = std::count_if(rendered.begin(), rendered.end(), [](float sample) { return sample != 0.0f; });
+            expectEquals((int) numNonZero, 1);
+            expectEquals(rendered[(size_t) impulseAt + 100], 2.0f);
+        }
+    }
+
+private:
+    struct Nodes
+    {
+        Graph::NodeID input, late, after, dry, output;
+    };
+
+    // Input goes through "late" (100 samples of latency) and then "after", and through
+    // "dry" alongside, to one output. Added back to front, so that the order nodes were
+    // added in is no help.
+    static Nodes createGraph(Graph& graph, juce::StringArray& log)
+    {
+        graph.setPlayConfigDetails(1, 1, sampleRate, blockSize);
+
+        Nodes nodes;
+        nodes.output = graph.addNode(std::make_unique<IOProcessor>(IOProcessor::audioOutputNode),
+                                     std::nullopt, Graph::UpdateKind::none)->nodeID;
+        nodes.after = addProcessor(graph, "after", 0, log);
+        nodes.late = addProcessor(graph, "late", 100, log);
+        nodes.dry = addProcessor(graph, "dry", 0, log);
+        nodes.input = graph.addNode(std::make_unique<IOProcessor>(IOProcessor::audioInputNode),
+                                    std::nullopt, Graph::UpdateKind::none)->nodeID;
+
+        connect(graph, nodes.input, nodes.late);
+        connect(graph, nodes.late, nodes.after);
+        connect(graph, nodes.after, nodes.output);
+        connect(graph, nodes.input, nodes.dry);
+        connect(graph, nodes.dry, nodes.output);
+        return nodes;
+    }
+
+    static std::unique_ptr<RenderPlan> compile(const Graph& graph)
+    {
+        RenderPlan::Settings settings;
+        settings.sampleRate = sampleRate;
+        settings.blockSize = blockSize;
+        return RenderPlan::compile(graph, settings);
+    }
+
+    // Render a block of mono audio in place
+    void render(RenderPlan& plan, std::vector<float>& samples)
+    {
+        std::vector<float> out(samples.size(), 0.0f);
+        const float* inputs[] = { samples.data() };
+        float* outputs[] = { out.data() };
+
+        arena.reset();
+        plan.process(inputs, 1, outputs, 1, (int) samples.size(), midiInput, midiOutput, position, arena);
+        position += (juce::int64) samples.size();
+        samples = out;
+    }
+
+    BlockArena arena;
+    MidiInputBlock midiInput;
+    juce::MidiBuffer midiOutput;
+    juce::int64 position = 0;
+};
+
+static RenderPlanTests renderPlanTests;
@@ -0,0 +1,171 @@
+#include <juce_core/juce_core.h>
+#include "core/audio/RenderThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    // Tasks that each depend on a few earlier ones, noting whether they ran once each
+    // and only after everything they depend on
+    class DependencyJob : public RenderThreadPool::Job
+    {
+    public:
+        DependencyJob(int numTasks, juce::Random& random)
+            : dependencies((size_t) numTasks),
+              dependents((size_t) numTasks),
+              waitingFor(new std::atomic<int>[(size_t) numTasks]),
+              runCounts(new std::atomic<int>[(size_t) numTasks]),
+              finished(new std::atomic<bool>[(size_t) numTasks])
+        {
+            for (int task = 1; task < numTasks; ++task)
+            {
+                const auto numDependencies = random.nextInt(juce::jmin(task, 4) + 1);
+
+                for (int i = 0; i < numDependencies; ++i)
+                {
+                    const auto dependency = random.nextInt(task);
+
+                    if (std::find(dependencies[(size_t) task].begin(), dependencies[(size_t) task].end(), dependency)
+                        == dependencies[(size_t) task].end())
+                    {
+                        dependencies[(size_t) task].push_back(dependency);
+                        dependents[(size_t) dependency].push_back(task);
+                    }
+                }
+            }
+
+            for (int task = 0; task < numTasks; ++task)
+                if (dependencies[(size_t) task].empty())
+                    initialTasks.push_back(task);
+        }
+
+        void reset()
+        {
+            for (size_t task = 0; task < dependencies.size(); ++task)
+            {
+                waitingFor[task].store((int) dependencies[task].size());
+                runCounts[task].store(0);
+                finished[task].store(false);
+            }
+
+            numRunEarly.store(0);
+        }
+
+        void runTask(int taskIndex, RenderThreadPool::TaskQueue& queue) noexcept override
+        {
+            const auto task = (size_t) taskIndex;
+
+            for (const auto dependency : dependencies[task])
+                if (! finished[(size_t) dependency].load(std::memory_order_acquire))
+                    ++numRunEarly;
+
+            ++runCounts[task];
+            finished[task].store(true, std::memory_order_release);
+
+            for (const auto dependent : dependents[task])
+                if (waitingFor[(size_t) dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    queue.push(dependent);
+        }
+
+        int getNumTasks() const { return (int) dependencies.size(); }
+        int getRunCount(int task) const { return runCounts[(size_t) task].load(); }
+
+        std::vector<int> initialTasks;
+        std::atomic<int> numRunEarly { 0 };
+
+    private:
+        std::vector<std::vector<int>> dependencies, dependents;
+        std::unique_ptr<std::atomic<int>[]> waitingFor;
+        std::unique_ptr<std::atomic<int>[]> runCounts;
+        std::unique_ptr<std::atomic<bool>[]> finished;
+    };
+
+    // Tasks that each take a while, so that a round runs on past its deadline
+    class SlowJob : public RenderThreadPool::Job
+    {
+    public:
+        void runTask(int, RenderThreadPool::TaskQueue&) noexcept override
+        {
+            const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(200);
+
+            while (std::chrono::steady_clock::now() < until) {}
+
+            ++numRun;
+        }
+
+        std::atomic<int> numRun { 0 };
+    };
+}
+
+// RenderThreadPool running dependent tasks across the audio thread and its workers,
+// and what happens when a round is late
+class RenderThreadPoolTests : public juce::UnitTest
+{
+public:
+    RenderThreadPoolTests() : juce::UnitTest("RenderThreadPool", "Audio") {}
+
+    void runTest() override
+    {
+        const auto farOff = [] { return std::chrono::steady_clock::now() + std::chrono::seconds(10); };
+
+        for (const auto numWorkers : { 0, 1, 3, 7 })
+        {
+            beginTest("Every task runs once, after its dependencies, with " + juce::String(numWorkers) + " worker(s)");
+
+            juce::Random random(numWorkers + 1);
+            RenderThreadPool pool(numWorkers);
+            expectEquals(pool.getNumWorkers(), numWorkers);
+
+            int numRunWrongly = 0, numEarly = 0, numLate = 0;
+
+            for (int round = 0; round < 200; ++round)
+            {
+                // A new graph every round, now and then with as many tasks as a round can hold
+                const auto numTasks = round % 50 == 49 ? RenderThreadPool::maxTasksPerRound : 1 + random.nextInt(200);
+                DependencyJob job(numTasks, random);
+                job.reset();
+
+                if (! pool.run(job, job.initialTasks.data(), (int) job.initialTasks.size(), job.getNumTasks(), farOff()))
+                    ++numLate;
+
+                for (int task = 0; task < job.getNumTasks(); ++task)
+                    if (job.getRunCount(task) != 1)
+                        ++numRunWrongly;
+
+                numEarly += job.numRunEarly.load();
+            }
+
+            expectEquals(numRunWrongly, 0);
+            expectEquals(numEarly, 0);
+            expectEquals(numLate, 0);
+            expectEquals((int) pool.getNumDeadlineMisses(), 0);
+        }
+
+        beginTest("A round already past its deadline is still finished by the audio thread");
+        {
+            RenderThreadPool pool(3);
+            SlowJob job;
+
+            std::vector<int> tasks(64);
+
+            for (int i = 0; i < (int) tasks.size(); ++i)
+                tasks[(size_t) i] = i;
+
+            const auto deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(1);
+            expect(! pool.run(job, tasks.data(), (int) tasks.size(), (int) tasks.size(), deadline));
+            expectEquals(job.numRun.load(), (int) tasks.size());
+            expectEquals((int) pool.getNumDeadlineMisses(), 1);
+
+            // The workers that gave up on it are back for the next round
+            job.numRun = 0;
+            expect(pool.run(job, tasks.data(), (int) tasks.size(), (int) tasks.size(), farOff()));
+            expectEquals(job.numRun.load(), (int) tasks.size());
+            expectEquals((int) pool.getNumDeadlineMisses(), 1);
+        }
+    }
+};
+
+static RenderThreadPoolTests renderThreadPoolTests;
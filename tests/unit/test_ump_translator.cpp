@@ -0,0 +1,155 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "core/midi/UmpBuffer.h"
+#include "core/midi/UmpTranslator.h"
+#include <vector>
+
+namespace
+{
+    std::vector<uint8_t> bytesOf(const juce::MidiMessage& message)
+    {
+        return { message.getRawData(), message.getRawData() + message.getRawDataSize() };
+    }
+
+    juce::MidiMessage makeSysEx(int size)
+    {
+        std::vector<uint8_t> data((size_t) size);
+
+        for (int i = 0; i < size; ++i)
+            data[(size_t) i] = (uint8_t) (i & 0x7f);
+
+        return juce::MidiMessage::createSysExMessage(data.data(), size);
+    }
+
+    auto collect(std::vector<std::vector<uint8_t>>& result)
+    {
+        return [&result](const uint8_t* bytes, int numBytes) { result.emplace_back(bytes, bytes + numBytes); };
+    }
+
+    std::vector<std::vector<uint8_t>> roundTrip(const juce::MidiMessage& message, UmpTranslator& translator)
+    {
+        std::vector<std::vector<uint8_t>> result;
+
+        UmpTranslator::fromMidi1(message.getRawData(), message.getRawDataSize(),
+                                 [&](const uint32_t* words) { translator.toMidi1(words, collect(result)); });
+
+        return result;
+    }
+
+    std::vector<std::vector<uint8_t>> roundTrip(const juce::MidiMessage& message)
+    {
+        UmpTranslator translator;
+        return roundTrip(message, translator);
+    }
+}
+
+// MIDI 1.0 messages must come back from Universal MIDI Packets byte for byte, and MIDI
+// 2.0 packets must narrow to what a MIDI 1.0 receiver expects
+class UmpTranslatorTests : public juce::UnitTest
+{
+public:
+    UmpTranslatorTests() : juce::UnitTest("UmpTranslator", "MIDI") {}
+
+    void runTest() override
+    {
+        using Message = juce::MidiMessage;
+
+        beginTest("Channel voice and system messages round trip in one packet");
+        {
+            for (const auto& message : { Message::noteOn(1, 60, (juce::uint8) 100),
+                                         Message::noteOff(16, 127, (juce::uint8) 64),
+                                         Message::aftertouchChange(3, 60, 20),
+                                         Message::controllerEvent(5, 74, 127),
+                                         Message::programChange(10, 42),
+                                         Message::channelPressureChange(2, 90),
+                                         Message::pitchWheel(1, 16383),
+                                         Message::midiClock(),
+                                         Message::songPositionPointer(300) })
+            {
+                expectEquals(UmpTranslator::getNumPackets(message.getRawData(), message.getRawDataSize()), 1);
+                expect(roundTrip(message) == std::vector<std::vector<uint8_t>> { bytesOf(message) },
+                       message.getDescription());
+            }
+        }
+
+        beginTest("SysEx round trips over as many packets as it needs");
+        {
+            for (int size : { 0, 1, 6, 7, 12, 300, UmpTranslator::maxSysExBytes - 2 })
+            {
+                const auto message = makeSysEx(size);
+                expectEquals(UmpTranslator::getNumPackets(message.getRawData(), message.getRawDataSize()),
+                             juce::jmax(1, (size + 5) / 6));
+                expect(roundTrip(message) == std::vector<std::vector<uint8_t>> { bytesOf(message) },
+                       juce::String(size) + " bytes of SysEx");
+            }
+        }
+
+        beginTest("SysEx too long to gather is dropped, and the next one still comes through");
+        {
+            UmpTranslator translator;
+            auto result = roundTrip(makeSysEx(UmpTranslator::maxSysExBytes), translator);
+            expect(result.empty());
+
+            const auto next = makeSysEx(10);
+            result = roundTrip(next, translator);
+            expect(result == std::vector<std::vector<uint8_t>> { bytesOf(next) });
+        }
+
+        beginTest("SysEx continuations without a start are ignored");
+        {
+            UmpTranslator translator;
+            std::vector<std::vector<uint8_t>> result;
+            const uint32_t continuation[2] = { 0x30230102, 0 };
+            translator.toMidi1(continuation, collect(result));
+            expect(result.empty());
+        }
+
+        beginTest("MIDI 2.0 channel voice narrows to MIDI 1.0");
+        {
+            UmpTranslator translator;
+            std::vector<std::vector<uint8_t>> result;
+
+            // Note-on with a 16-bit velocity keeps its top seven bits, and never narrows to 0
+            const uint32_t noteOn[2] = { 0x40913c00, 0xc8000000 };
+            const uint32_t quietNoteOn[2] = { 0x40913c00, 0x00010000 };
+            translator.toMidi1(noteOn, collect(result));
+            translator.toMidi1(quietNoteOn, collect(result));
+
+            // 32-bit controller and pitch bend keep their top 7 and 14 bits
+            const uint32_t controller[2] = { 0x40b24a00, 0x80000000 };
+            const uint32_t pitchBend[2] = { 0x40e00000, 0xffffffff };
+            translator.toMidi1(controller, collect(result));
+            translator.toMidi1(pitchBend, collect(result));
+
+            // Program change with bank select turns into the two bank controllers first
+            const uint32_t programChange[2] = { 0x40c30001, 0x05000203 };
+            translator.toMidi1(programChange, collect(result));
+
+            const std::vector<std::vector<uint8_t>> expected { { 0x91, 0x3c, 0x64 },
+                                                               { 0x91, 0x3c, 0x01 },
+                                                               { 0xb2, 0x4a, 0x40 },
+                                                               { 0xe0, 0x7f, 0x7f },
+                                                               { 0xb3, 0x00, 0x02 },
+                                                               { 0xb3, 0x20, 0x03 },
+                                                               { 0xc3, 0x05 } };
+            expect(result == expected);
+        }
+
+        beginTest("Packets keep their place in a UmpBuffer");
+        {
+            UmpBuffer buffer(8);
+
+            for (int position : { 0, 10, 10, 40 })
+                UmpTranslator::fromMidi1(Message::noteOn(1, 60 + position, (juce::uint8) 100).getRawData(), 3,
+                                         [&](const uint32_t* words) { buffer.add(position, words); });
+
+            expectEquals(buffer.getNumEvents(), 4);
+            expectEquals((int) (buffer.findNextSamplePosition(5) - buffer.begin()), 1);
+            expectEquals((int) (buffer.findNextSamplePosition(11) - buffer.begin()), 3);
+            expect(buffer.findNextSamplePosition(41) == buffer.end());
+            expect(buffer.begin()[3].isNoteOn());
+            expectEquals((int) buffer.begin()[3].getIndex(), 100);
+        }
+    }
+};
+
+static UmpTranslatorTests umpTranslatorTests;